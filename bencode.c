@@ -15,11 +15,374 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <ctype.h>
 #include <math.h>
+#include <limits.h>
 
 #include "bencode.h"
 
+/* selector component types */
+enum {
+    SEL_KEY,
+    SEL_ANYKEY,
+    SEL_IDX,
+    SEL_ANYIDX
+};
+
+typedef struct {
+    int type;
+    const char* key;
+    unsigned int klen;
+    unsigned int idx;
+} selector_comp_t;
+
+struct bencode_selector_s {
+    unsigned int npaths;
+
+    /* components of selector i are comps[off[i]] to comps[off[i + 1] - 1] */
+    selector_comp_t* comps;
+    unsigned int off[33];
+
+    /* copy of the selectors that keys point into */
+    char* keys;
+    unsigned int keys_len;
+};
+
+/* the stack and path buffer a parser needs while it's mid-document */
+struct bencode_workspace_s {
+    bencode_frame_t* stk;
+    unsigned int nframes;
+
+    char* path;
+    unsigned int path_size;
+
+    struct bencode_workspace_s* next;
+};
+
+struct bencode_pool_s {
+    /* workspaces not currently lent to a parser */
+    struct bencode_workspace_s* free;
+    unsigned int nfree;
+};
+
+/* the parts of a frame that outlive a token */
+typedef struct {
+    unsigned long int start;
+    unsigned long int kstart;
+    unsigned int path_off;
+    int key_off;
+    unsigned int idx;
+    unsigned int nitems;
+    unsigned int sel;
+    int sel_mode;
+    int sel_match;
+
+    /* length of a dict's previous key; -1 if there isn't one */
+    int len;
+
+    void* udata;
+} __resume_frame_t;
+
+#define RESUME_BITS (8 * sizeof(unsigned int))
+
+/* where a pooled parser is within a document while its workspace is back
+ * in the pool. It's only taken between tokens, when the frames below the
+ * top are all lists or dicts. Laid out in one block: the frames, a bit per
+ * frame below the top that's set for dicts, the path, then the previous
+ * key of each dict that has one */
+struct bencode_resume_s {
+    /* type of the top frame */
+    int top;
+    unsigned int path_len;
+    unsigned int size;
+    __resume_frame_t frames[];
+};
+
+/**
+ * Get the root frame ready for a new document */
+static void __reset_root(bencode_t* me)
+{
+    bencode_frame_t* f = &me->stk[0];
+    bencode_selector_t* sel = me->selector;
+    unsigned int i;
+
+    f->type = BENCODE_TOK_NONE;
+    f->pos = 0;
+    f->len = 0;
+    f->intval = 0;
+    f->nitems = 0;
+    f->path_off = 0;
+    f->key_off = -1;
+    f->sel_match = -1;
+
+    if (!sel)
+    {
+        f->sel = 0;
+        f->sel_mode = BENCODE_SEL_DELIVER;
+        return;
+    }
+
+    f->sel = 32 == sel->npaths ? ~0u : (1u << sel->npaths) - 1;
+    for (i = 0; i < sel->npaths; i++)
+        if (sel->off[i] == sel->off[i + 1])
+        {
+            f->sel_match = i;
+            break;
+        }
+    f->sel_mode = -1 == f->sel_match ? BENCODE_SEL_TRANSIT : BENCODE_SEL_DELIVER;
+    if (0 == sel->npaths)
+        f->sel_mode = BENCODE_SEL_SKIP;
+}
+
+/**
+ * @return bytes held by the batch and its strings, which the parser keeps
+ *         while its workspace goes back to the pool */
+static unsigned int __batch_mem(bencode_t* me)
+{
+    return me->batch_size * sizeof(bencode_item_t) + me->bs_size;
+}
+
+/**
+ * @return 1 if the parser is between tokens, with nothing part way read */
+static int __between_tokens(bencode_t* me)
+{
+    bencode_frame_t* f = &me->stk[me->d];
+
+    switch (f->type)
+    {
+    case BENCODE_TOK_NONE:
+        return 0 == me->d;
+    case BENCODE_TOK_LIST:
+    case BENCODE_TOK_DICT:
+    case BENCODE_TOK_DICT_VAL:
+        return 1;
+    case BENCODE_TOK_DICT_KEYLEN:
+        return 0 == f->pos;
+    }
+    return 0;
+}
+
+/**
+ * Put the frames back the way they were when we handed our workspace back
+ * @return 0 if we're out of memory; otherwise 1 */
+static int __resume(bencode_t* me, struct bencode_resume_s* r)
+{
+    unsigned int* dicts = (unsigned int*)(r->frames + me->d + 1);
+    const char* path = (const char*)(dicts + me->d / RESUME_BITS + 1);
+    const char* keys = path + r->path_len;
+    unsigned int i;
+
+    if (me->path_size <= r->path_len)
+    {
+        char* p = realloc(me->path, r->path_len + 1);
+
+        if (!p)
+            return 0;
+        me->path = p;
+        me->path_size = r->path_len + 1;
+    }
+    memcpy(me->path, path, r->path_len);
+    me->path_len = r->path_len;
+    me->path[me->path_len] = '\0';
+
+    for (i = 0; i <= me->d; i++)
+    {
+        bencode_frame_t* f = &me->stk[i];
+        __resume_frame_t* rf = &r->frames[i];
+
+        if (i == me->d)
+            f->type = r->top;
+        else
+            f->type = dicts[i / RESUME_BITS] & (1u << i % RESUME_BITS) ?
+                BENCODE_TOK_DICT : BENCODE_TOK_LIST;
+        f->start = rf->start;
+        f->kstart = rf->kstart;
+        f->path_off = rf->path_off;
+        f->key_off = rf->key_off;
+        f->idx = rf->idx;
+        f->nitems = rf->nitems;
+        f->sel = rf->sel;
+        f->sel_mode = rf->sel_mode;
+        f->sel_match = rf->sel_match;
+        f->udata = rf->udata;
+        f->len = rf->len;
+        f->pos = 0;
+        f->intval = 0;
+        f->neg = 0;
+        f->big = 0;
+        f->kcmp = 0;
+        f->sink = NULL;
+
+        if (0 < f->len)
+        {
+            if (f->sv_size < f->len)
+            {
+                char* sv = realloc(f->strval, f->len);
+
+                if (!sv)
+                    return 0;
+                f->strval = sv;
+                f->sv_size = f->len;
+            }
+            memcpy(f->strval, keys, f->len);
+            keys += f->len;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Borrow a stack and path buffer from the pool, and pick up where we left
+ * off with them
+ * @return 0 if we're out of memory; otherwise 1 */
+static int __acquire(bencode_t* me)
+{
+    struct bencode_workspace_s** p, *ws = NULL;
+    unsigned int i;
+
+    for (p = &me->pool->free; *p; p = &(*p)->next)
+        if (me->nframes <= (*p)->nframes)
+        {
+            ws = *p;
+            *p = ws->next;
+            me->pool->nfree--;
+            break;
+        }
+
+    if (!ws)
+    {
+        if (!(ws = calloc(1, sizeof(struct bencode_workspace_s))))
+            return 0;
+        ws->nframes = me->nframes;
+        ws->stk = calloc(10 + ws->nframes, sizeof(bencode_frame_t));
+        ws->path_size = 32;
+        ws->path = malloc(ws->path_size);
+        if (!ws->stk || !ws->path)
+        {
+            free(ws->stk);
+            free(ws->path);
+            free(ws);
+            return 0;
+        }
+    }
+
+    me->ws = ws;
+    me->stk = ws->stk;
+    me->path = ws->path;
+    me->path_size = ws->path_size;
+
+    if (me->resume)
+    {
+        /* even if this fails, the workspace goes back to the pool with
+         * the parser */
+        if (!__resume(me, me->resume))
+            return 0;
+        free(me->resume);
+        me->resume = NULL;
+    }
+    else
+    {
+        me->path_len = 0;
+        me->path[0] = '\0';
+        me->d = 0;
+        __reset_root(me);
+    }
+
+    me->mem = sizeof(bencode_t) + me->path_size + __batch_mem(me) +
+        (10 + ws->nframes) * sizeof(bencode_frame_t);
+    for (i = 0; i < 10 + ws->nframes; i++)
+        me->mem += ws->stk[i].sv_size;
+    return 1;
+}
+
+/**
+ * Keep what we need of the frames to carry on from between tokens
+ * @return NULL if we're out of memory */
+static struct bencode_resume_s* __suspend(bencode_t* me)
+{
+    struct bencode_resume_s* r;
+    unsigned int* dicts;
+    unsigned int i, nwords = me->d / RESUME_BITS + 1, klen = 0;
+    unsigned long int size;
+    char* p;
+
+    for (i = 0; i <= me->d; i++)
+        if (BENCODE_TOK_DICT == me->stk[i].type && 0 < me->stk[i].len)
+            klen += me->stk[i].len;
+
+    size = sizeof(struct bencode_resume_s) +
+        (me->d + 1) * sizeof(__resume_frame_t) +
+        nwords * sizeof(unsigned int) + me->path_len + klen;
+    if (!(r = malloc(size)))
+        return NULL;
+    r->top = me->stk[me->d].type;
+    r->path_len = me->path_len;
+    r->size = size;
+
+    dicts = (unsigned int*)(r->frames + me->d + 1);
+    memset(dicts, 0, nwords * sizeof(unsigned int));
+    p = (char*)(dicts + nwords);
+    memcpy(p, me->path, me->path_len);
+    p += me->path_len;
+
+    for (i = 0; i <= me->d; i++)
+    {
+        bencode_frame_t* f = &me->stk[i];
+        __resume_frame_t* rf = &r->frames[i];
+
+        rf->start = f->start;
+        rf->kstart = f->kstart;
+        rf->path_off = f->path_off;
+        rf->key_off = f->key_off;
+        rf->idx = f->idx;
+        rf->nitems = f->nitems;
+        rf->sel = f->sel;
+        rf->sel_mode = f->sel_mode;
+        rf->sel_match = f->sel_match;
+        rf->udata = f->udata;
+
+        /* only a dict's len means anything between tokens */
+        rf->len = BENCODE_TOK_DICT == f->type ? f->len : 0;
+        if (BENCODE_TOK_DICT != f->type)
+            continue;
+
+        if (i < me->d)
+            dicts[i / RESUME_BITS] |= 1u << i % RESUME_BITS;
+        if (0 < f->len)
+        {
+            memcpy(p, f->strval, f->len);
+            p += f->len;
+        }
+    }
+    return r;
+}
+
+/**
+ * Hand our stack and path buffer back to the pool. If we're mid-document
+ * we keep a note of where we are, or hang on to them if we can't */
+static void __release(bencode_t* me)
+{
+    struct bencode_workspace_s* ws = me->ws;
+
+    if (!(0 == me->d && BENCODE_TOK_NONE == me->stk[0].type) &&
+        !(me->resume = __suspend(me)))
+        return;
+
+    /* the path buffer might have grown while we had it */
+    ws->path = me->path;
+    ws->path_size = me->path_size;
+    ws->next = me->pool->free;
+    me->pool->free = ws;
+    me->pool->nfree++;
+
+    me->ws = NULL;
+    me->stk = NULL;
+    me->path = NULL;
+    me->path_size = 0;
+    me->path_len = 0;
+    me->mem = sizeof(bencode_t) + __batch_mem(me) +
+        (me->resume ? me->resume->size : 0);
+}
+
 bencode_t* bencode_new(
         int expected_depth,
         bencode_callbacks_t* cb,
@@ -27,349 +390,1932 @@ bencode_t* bencode_new(
 {
     bencode_t* me;
 
-    me = calloc(1, sizeof(bencode_t));
-    bencode_set_callbacks(me, cb);
-    me->udata = udata;
-    me->nframes = expected_depth;
-    me->stk = calloc(10 + expected_depth, sizeof(bencode_frame_t));
-    return me;
-}
+    if (!(me = calloc(1, sizeof(bencode_t))))
+        return NULL;
+    bencode_set_callbacks(me, cb);
+    me->udata = udata;
+    me->nframes = expected_depth;
+    me->stk = calloc(10 + expected_depth, sizeof(bencode_frame_t));
+    me->path_size = 32;
+    me->path = malloc(me->path_size);
+    if (!me->stk || !me->path)
+    {
+        free(me->stk);
+        free(me->path);
+        free(me);
+        return NULL;
+    }
+    me->path[0] = '\0';
+    me->mem = sizeof(bencode_t) + me->path_size +
+        (10 + expected_depth) * sizeof(bencode_frame_t);
+    __reset_root(me);
+    return me;
+}
+
+bencode_t* bencode_new_pooled(
+        int expected_depth,
+        bencode_callbacks_t* cb,
+        void* udata,
+        bencode_pool_t* pool)
+{
+    bencode_t* me;
+
+    if (!(me = calloc(1, sizeof(bencode_t))))
+        return NULL;
+    bencode_set_callbacks(me, cb);
+    me->udata = udata;
+    me->nframes = expected_depth;
+    me->pool = pool;
+    me->mem = sizeof(bencode_t);
+    return me;
+}
+
+void bencode_free(bencode_t* me)
+{
+    unsigned int i;
+
+    free(me->batch);
+    free(me->batch_str);
+
+    if (me->pool)
+    {
+        /* there's no document to come back to */
+        if (me->ws)
+        {
+            me->d = 0;
+            __reset_root(me);
+            __release(me);
+        }
+        free(me->resume);
+        free(me);
+        return;
+    }
+
+    for (i = 0; i < 10 + me->nframes; i++)
+        free(me->stk[i].strval);
+    free(me->stk);
+    free(me->path);
+    free(me);
+}
+
+bencode_pool_t* bencode_pool_new(void)
+{
+    return calloc(1, sizeof(bencode_pool_t));
+}
+
+void bencode_pool_free(bencode_pool_t* me)
+{
+    while (me->free)
+    {
+        struct bencode_workspace_s* ws = me->free;
+        unsigned int i;
+
+        me->free = ws->next;
+        for (i = 0; i < 10 + ws->nframes; i++)
+            free(ws->stk[i].strval);
+        free(ws->stk);
+        free(ws->path);
+        free(ws);
+    }
+    free(me);
+}
+
+unsigned int bencode_pool_count(bencode_pool_t* me)
+{
+    return me->nfree;
+}
+
+void bencode_init(bencode_t* me)
+{
+    memset(me,0,sizeof(bencode_t));
+}
+
+void bencode_reset(bencode_t* me)
+{
+    me->err = BENCODE_ERR_NONE;
+    me->err_off = 0;
+    me->err_depth = 0;
+    me->off = 0;
+    me->doc_start = 0;
+    me->doc_items = 0;
+    me->batch_len = 0;
+    me->bs_len = 0;
+    me->batched = 0;
+    me->d = 0;
+
+    /* forget where we were when we handed our stack back */
+    if (me->resume)
+    {
+        free(me->resume);
+        me->resume = NULL;
+        if (!me->stk)
+            me->mem = sizeof(bencode_t) + __batch_mem(me);
+    }
+    if (!me->stk)
+        return;
+
+    me->path_len = 0;
+    me->path[0] = '\0';
+    __reset_root(me);
+}
+
+static int __fail(bencode_t* me, int err)
+{
+    /* keep the first error; it's the one that explains the rest */
+    if (BENCODE_ERR_NONE == me->err)
+    {
+        me->err = err;
+        me->err_off = me->off;
+        me->err_depth = me->d;
+    }
+    return 0;
+}
+
+/**
+ * Account for a buffer growing from old_size to new_size
+ * @return 0 if this would take us over our memory budget; otherwise 1 */
+static int __charge(
+        bencode_t* me,
+        unsigned int old_size,
+        unsigned int new_size)
+{
+    if (me->limits.max_mem && me->limits.max_mem < me->mem + new_size - old_size)
+        return __fail(me, BENCODE_ERR_MEMORY);
+    me->mem += new_size - old_size;
+    return 1;
+}
+
+static int __path_append(bencode_t* me, const char* s, unsigned int len)
+{
+    /* +1 for '\0' terminator */
+    if (me->path_size <= me->path_len + len + 1)
+    {
+        unsigned int size = (me->path_len + len + 1) * 2;
+
+        if (!__charge(me, me->path_size, size))
+            return 0;
+        me->path_size = size;
+        me->path = realloc(me->path, me->path_size);
+    }
+    memcpy(me->path + me->path_len, s, len);
+    me->path_len += len;
+    me->path[me->path_len] = '\0';
+    return 1;
+}
+
+static int __path_append_index(bencode_t* me, unsigned int idx)
+{
+    char tmp[16];
+    int i = sizeof(tmp);
+
+    tmp[--i] = ']';
+    do
+    {
+        tmp[--i] = '0' + idx % 10;
+        idx /= 10;
+    }
+    while (idx);
+    tmp[--i] = '[';
+    return __path_append(me, tmp + i, sizeof(tmp) - i);
+}
+
+static void __path_truncate(bencode_t* me, unsigned int len)
+{
+    me->path_len = len;
+    me->path[len] = '\0';
+}
+
+static const char* __frame_key(bencode_t* me, bencode_frame_t* f)
+{
+    if (-1 == f->key_off)
+        return NULL;
+    return me->path + f->key_off;
+}
+
+static int __delivering(bencode_frame_t* f)
+{
+    return BENCODE_SEL_DELIVER == f->sel_mode;
+}
+
+/**
+ * Work out which selectors are still alive now that we know the key or
+ * index of the item at the top of the stack */
+static void __selector_step(
+        bencode_t* me,
+        const char* key,
+        unsigned int klen,
+        unsigned int idx)
+{
+    bencode_selector_t* sel = me->selector;
+    bencode_frame_t* f = &me->stk[me->d];
+    unsigned int live = 0, i;
+
+    f->sel_match = -1;
+
+    for (i = 0; i < sel->npaths; i++)
+    {
+        selector_comp_t* c;
+
+        if (!(me->stk[me->d - 1].sel & (1u << i)))
+            continue;
+
+        /* a transit frame's selectors always have components left */
+        c = &sel->comps[sel->off[i] + me->d - 1];
+
+        switch (c->type)
+        {
+        case SEL_KEY:
+            if (!key || c->klen != klen || 0 != memcmp(c->key, key, klen))
+                continue;
+            break;
+        case SEL_ANYKEY:
+            if (!key)
+                continue;
+            break;
+        case SEL_IDX:
+            if (key || c->idx != idx)
+                continue;
+            break;
+        case SEL_ANYIDX:
+            if (key)
+                continue;
+            break;
+        }
+
+        live |= 1u << i;
+        if (-1 == f->sel_match && sel->off[i] + me->d == sel->off[i + 1])
+            f->sel_match = i;
+    }
+
+    f->sel = live;
+    if (-1 != f->sel_match)
+        f->sel_mode = BENCODE_SEL_DELIVER;
+    else if (live)
+        f->sel_mode = BENCODE_SEL_TRANSIT;
+    else
+        f->sel_mode = BENCODE_SEL_SKIP;
+}
+
+/**
+ * Get ready to compare the key we're about to read with the previous key of
+ * its dict. The dict frame's strval holds the previous key, and its len the
+ * previous key's length. */
+static int __key_order_begin(bencode_t* me, bencode_frame_t* f)
+{
+    bencode_frame_t* dict = &me->stk[me->d - 1];
+
+    if (dict->sv_size < f->len)
+    {
+        if (!__charge(me, dict->sv_size, f->len))
+            return 0;
+        dict->strval = realloc(dict->strval, f->len);
+        dict->sv_size = f->len;
+    }
+    f->kcmp = -1 == dict->len;
+    return 1;
+}
+
+/**
+ * Compare the next n bytes of the key, overwriting the previous key as we
+ * go so it's ready for the next comparison */
+static int __key_order(
+        bencode_t* me,
+        bencode_frame_t* f,
+        const char* buf,
+        unsigned int n)
+{
+    bencode_frame_t* dict = &me->stk[me->d - 1];
+    unsigned char* prev = (unsigned char*)dict->strval + f->pos;
+    unsigned int i;
+
+    for (i = 0; i < n; i++)
+    {
+        unsigned char c = buf[i];
+
+        if (0 == f->kcmp)
+        {
+            /* the previous key is a prefix of this one */
+            if (dict->len <= f->pos + (int)i || prev[i] < c)
+                f->kcmp = 1;
+            else if (c < prev[i])
+                return __fail(me, BENCODE_ERR_KEY_ORDER);
+        }
+        prev[i] = c;
+    }
+    return 1;
+}
+
+static int __key_order_end(bencode_t* me, bencode_frame_t* f)
+{
+    /* same as the previous key, or a prefix of it */
+    if (0 == f->kcmp)
+        return __fail(me, BENCODE_ERR_KEY_ORDER);
+    me->stk[me->d - 1].len = f->len;
+    return 1;
+}
+
+static void __key_done(bencode_t* me, bencode_frame_t* f)
+{
+    f->type = BENCODE_TOK_DICT_VAL;
+    f->pos = 0;
+    f->len = 0;
+
+    if (BENCODE_SEL_TRANSIT == f->sel_mode)
+        __selector_step(me, me->path + f->key_off,
+                me->path_len - f->key_off, 0);
+}
+
+static bencode_frame_t* __push_stack(bencode_t* me)
+{
+    if (me->nframes <= me->d)
+    {
+        __fail(me, BENCODE_ERR_TOO_DEEP);
+        return NULL;
+    }
+
+    me->d++;
+    //memset(&me->stk[me->d], 0, sizeof(bencode_frame_t));
+
+    bencode_frame_t* s = &me->stk[me->d];
+    bencode_frame_t* parent = &me->stk[me->d - 1];
+
+    s->pos = 0;
+    s->intval = 0;
+    s->len = 0;
+    s->type = 0;
+    s->nitems = 0;
+    s->key_off = -1;
+    s->path_off = me->path_len;
+    s->start = s->kstart = me->off;
+    s->sel = parent->sel;
+    s->sel_mode = parent->sel_mode;
+    s->sel_match = parent->sel_match;
+
+    /* list items are known by their index; dict items get their key
+     * appended once we've read it */
+    if (BENCODE_TOK_LIST == parent->type)
+    {
+        s->idx = parent->nitems++;
+        if (BENCODE_SEL_SKIP != s->sel_mode &&
+            !__path_append_index(me, s->idx))
+            return NULL;
+        if (BENCODE_SEL_TRANSIT == s->sel_mode)
+            __selector_step(me, NULL, 0, s->idx);
+    }
+
+    return &me->stk[me->d];
+}
+
+/**
+ * @return 1 if the element we've just finished should go into the batch */
+static int __batching(bencode_t* me)
+{
+    return me->batch_size && me->cb.hit_batch && !me->cb.hit_slice &&
+        0 < me->d && BENCODE_TOK_LIST == me->stk[me->d - 1].type;
+}
+
+/**
+ * Hand the batch to the list it belongs to */
+static void __batch_flush(bencode_t* me, bencode_frame_t* list)
+{
+    unsigned int i, off = 0;
+
+    if (0 == me->batch_len)
+        return;
+
+    /* the strings' bytes could have moved as they were added */
+    for (i = 0; i < me->batch_len; i++)
+    {
+        bencode_item_t* it = &me->batch[i];
+
+        if (BENCODE_TOK_STR != it->type)
+            continue;
+        it->strval = me->batch_str + off;
+        off += it->len + 1;
+    }
+
+    /* we're usually within an element; hide its part of the path so the
+     * list's key is all that's left */
+    if (list < &me->stk[me->d])
+    {
+        unsigned int end = (list + 1)->path_off;
+        char c = me->path[end];
+
+        me->path[end] = '\0';
+        if (!me->cb.hit_batch(me, __frame_key(me, list), me->batch,
+                    me->batch_len))
+            __fail(me, BENCODE_ERR_CALLBACK);
+        me->path[end] = c;
+    }
+    else if (!me->cb.hit_batch(me, __frame_key(me, list), me->batch,
+                me->batch_len))
+        __fail(me, BENCODE_ERR_CALLBACK);
+    me->batch_len = 0;
+    me->bs_len = 0;
+}
+
+/**
+ * Flush the batch ahead of an element of the list that isn't batched, so
+ * that the elements arrive in order */
+static void __batch_flush_before(bencode_t* me)
+{
+    if (__batching(me))
+        __batch_flush(me, &me->stk[me->d - 1]);
+}
+
+static void __batch_add_int(bencode_t* me, long long int val)
+{
+    bencode_item_t* it = &me->batch[me->batch_len++];
+
+    it->type = BENCODE_TOK_INT;
+    it->intval = val;
+    it->strval = NULL;
+    it->len = 0;
+    me->batched = 1;
+    if (me->batch_len == me->batch_size)
+        __batch_flush(me, &me->stk[me->d - 1]);
+}
+
+static int __batch_add_str(bencode_t* me, const char* val, unsigned int len)
+{
+    bencode_item_t* it;
+
+    if (me->bs_size < me->bs_len + len + 1)
+    {
+        unsigned int size = (me->bs_len + len + 1) * 2;
+
+        char* str;
+
+        if (!__charge(me, me->bs_size, size))
+            return 0;
+        if (!(str = realloc(me->batch_str, size)))
+        {
+            me->mem -= size - me->bs_size;
+            return __fail(me, BENCODE_ERR_MEMORY);
+        }
+        me->batch_str = str;
+        me->bs_size = size;
+    }
+    memcpy(me->batch_str + me->bs_len, val, len);
+    me->batch_str[me->bs_len + len] = '\0';
+    me->bs_len += len + 1;
+
+    it = &me->batch[me->batch_len++];
+    it->type = BENCODE_TOK_STR;
+    it->intval = 0;
+    it->len = len;
+    me->batched = 1;
+    if (me->batch_len == me->batch_size)
+        __batch_flush(me, &me->stk[me->d - 1]);
+    return 1;
+}
+
+static bencode_frame_t* __pop_stack(bencode_t* me)
+{
+    bencode_frame_t* f;
+
+    f = &me->stk[me->d];
+
+    switch(f->type)
+    {
+        case BENCODE_TOK_LIST:
+            __batch_flush(me, f);
+            if (me->cb.list_leave && __delivering(f) &&
+                !me->cb.list_leave(me, __frame_key(me, f)))
+                __fail(me, BENCODE_ERR_CALLBACK);
+            break;
+        case BENCODE_TOK_DICT:
+            if (me->cb.dict_leave && __delivering(f) &&
+                !me->cb.dict_leave(me, __frame_key(me, f)))
+                __fail(me, BENCODE_ERR_CALLBACK);
+            break;
+    }
+
+    /* we've finished the document; be ready for another */
+    if (me->d == 0)
+    {
+        __reset_root(me);
+        return NULL;
+    }
+
+    __path_truncate(me, f->path_off);
+    f = &me->stk[--me->d];
+
+    switch(f->type)
+    {
+        case BENCODE_TOK_LIST:
+            /* hit_batch stands in for list_next */
+            if (me->batched)
+                me->batched = 0;
+            else if (me->cb.list_next && __delivering(f) &&
+                     !me->cb.list_next(me))
+                __fail(me, BENCODE_ERR_CALLBACK);
+            break;
+        case BENCODE_TOK_DICT:
+            if (me->cb.dict_next && __delivering(f) && !me->cb.dict_next(me))
+                __fail(me, BENCODE_ERR_CALLBACK);
+            break;
+    }
+
+    return f;
+}
+
+/* classes of byte the state machine tells apart */
+enum {
+    CLS_OTHER,
+    CLS_DIGIT,
+    CLS_COLON,
+    CLS_MINUS,
+    CLS_I,
+    CLS_L,
+    CLS_D,
+    CLS_E,
+    CLS_N
+};
+
+static const unsigned char __cls[256] = {
+    ['0'] = CLS_DIGIT, ['1'] = CLS_DIGIT, ['2'] = CLS_DIGIT,
+    ['3'] = CLS_DIGIT, ['4'] = CLS_DIGIT, ['5'] = CLS_DIGIT,
+    ['6'] = CLS_DIGIT, ['7'] = CLS_DIGIT, ['8'] = CLS_DIGIT,
+    ['9'] = CLS_DIGIT,
+    [':'] = CLS_COLON,
+    ['-'] = CLS_MINUS,
+    ['i'] = CLS_I,
+    ['l'] = CLS_L,
+    ['d'] = CLS_D,
+    ['e'] = CLS_E
+};
+
+/**
+ * Like isdigit(), without the locale lookup */
+static int __is_digit(const char c)
+{
+    return CLS_DIGIT == __cls[(unsigned char)c];
+}
+
+static int __parse_digit(const int current_value, const char c)
+{
+    return (c - '0') + current_value * 10;
+}
+
+/**
+ * Add another digit to the length of a string or key
+ * @param max The longest length we'll accept; 0 for no limit
+ * @return 0 if the length is too long; otherwise 1 */
+static int __parse_len(
+        bencode_t* me,
+        bencode_frame_t* f,
+        const char c,
+        unsigned int max)
+{
+    if ((INT_MAX - (c - '0')) / 10 < f->len)
+        return __fail(me, BENCODE_ERR_TOO_LONG);
+    f->len = __parse_digit(f->len, c);
+
+    if (max && max < (unsigned int)f->len)
+        return __fail(me, BENCODE_ERR_TOO_LONG);
+
+    /* the string would run past the end of the document */
+    if (me->limits.max_bytes &&
+        me->limits.max_bytes < me->off + 1 - me->doc_start + f->len)
+        return __fail(me, BENCODE_ERR_TOO_MANY_BYTES);
+
+    return 1;
+}
+
+/**
+ * Count another item towards the document's limit
+ * @return 0 if there are too many items; otherwise 1 */
+static int __count_item(bencode_t* me)
+{
+    if (me->limits.max_items && me->limits.max_items < ++me->doc_items)
+        return __fail(me, BENCODE_ERR_TOO_MANY_ITEMS);
+    return 1;
+}
+
+/**
+ * @return 1 if we've gone past the document's byte limit */
+static int __too_many_bytes(bencode_t* me)
+{
+    return me->limits.max_bytes &&
+        me->limits.max_bytes <= me->off - me->doc_start &&
+        !(0 == me->d && BENCODE_TOK_NONE == me->stk[0].type);
+}
+
+/**
+ * Tell value_start about the value that's starting at this byte */
+static void __value_start(bencode_t* me, bencode_frame_t* f, int type)
+{
+    if (me->cb.value_start && __delivering(f) &&
+        !me->cb.value_start(me, __frame_key(me, f), type))
+        __fail(me, BENCODE_ERR_CALLBACK);
+}
+
+static void __start_int(bencode_t* me, bencode_frame_t* f)
+{
+    f->type = BENCODE_TOK_INT;
+    f->pos = 0;
+    f->intval = 0;
+    f->neg = 0;
+    f->big = 0;
+    f->start = me->off;
+    __value_start(me, f, BENCODE_TOK_INT);
+}
+
+/**
+ * Consume the run of digits at the start of buf, without going past len.
+ * Negative values are accumulated downwards so that INT64_MIN fits.
+ * @return number of bytes consumed */
+static unsigned int __parse_int_run(
+        bencode_frame_t* f,
+        const char* buf,
+        unsigned int len)
+{
+    long long int v = f->intval;
+    unsigned int i;
+
+    for (i = 0; i < len && __is_digit(buf[i]); i++)
+    {
+        int d = buf[i] - '0';
+
+        if (f->big)
+            continue;
+
+        if (f->neg)
+        {
+            if (v < (LLONG_MIN + d) / 10)
+                f->big = 1;
+            else
+                v = v * 10 - d;
+        }
+        else
+        {
+            if ((LLONG_MAX - d) / 10 < v)
+                f->big = 1;
+            else
+                v = v * 10 + d;
+        }
+    }
+
+    f->intval = v;
+    return i;
+}
+
+/**
+ * Check an integer we have all of, without converting it
+ * @param n Number of bytes between the 'i' and the 'e'
+ * @return 0 if it's malformed; otherwise 1 */
+static int __int_check(bencode_t* me, const char* s, unsigned int n)
+{
+    unsigned int i, neg = 0 < n && '-' == *s;
+
+    /* "ie" and "i-e" */
+    if (n == neg)
+        return __fail(me, BENCODE_ERR_BAD_INT);
+
+    for (i = neg; i < n; i++)
+        if (!__is_digit(s[i]))
+        {
+            me->off += i;
+            return __fail(me, BENCODE_ERR_BAD_INT);
+        }
+
+    if (me->canonical && '0' == s[neg] && (neg || 1 < n))
+        return __fail(me, BENCODE_ERR_NOT_CANONICAL);
+    return 1;
+}
+
+/**
+ * Keep the integer's bytes for hit_int_raw */
+static int __int_raw_append(
+        bencode_t* me,
+        bencode_frame_t* f,
+        const char* buf,
+        unsigned int n)
+{
+    if (f->sv_size < f->pos + (int)n)
+    {
+        int size = (f->pos + n) * 2;
+
+        if (!__charge(me, f->sv_size, size))
+            return 0;
+        f->strval = realloc(f->strval, size);
+        f->sv_size = size;
+    }
+    memcpy(f->strval + f->pos, buf, n);
+    return 1;
+}
+
+static bencode_frame_t* __start_dict(bencode_t* me, bencode_frame_t* f)
+{
+    /* batched elements come before this one */
+    if (0 < me->d)
+        __batch_flush(me, &me->stk[me->d - 1]);
+
+    f->type = BENCODE_TOK_DICT;
+    f->pos = 0;
+    /* no previous key yet */
+    f->len = -1;
+    f->start = me->off;
+    __value_start(me, f, BENCODE_TOK_DICT);
+    if (me->cb.dict_enter && __delivering(f) &&
+        !me->cb.dict_enter(me, __frame_key(me, f)))
+        __fail(me, BENCODE_ERR_CALLBACK);
+
+    /* key/value */
+    f = __push_stack(me);
+    if (f)
+        f->type = BENCODE_TOK_DICT_KEYLEN;
+    return f;
+}
+
+static void __start_list(bencode_t* me, bencode_frame_t* f)
+{
+    /* batched elements come before this one */
+    if (0 < me->d)
+        __batch_flush(me, &me->stk[me->d - 1]);
+
+    f->type = BENCODE_TOK_LIST;
+    f->pos = 0;
+    f->start = me->off;
+    __value_start(me, f, BENCODE_TOK_LIST);
+    if (me->cb.list_enter && __delivering(f) &&
+        !me->cb.list_enter(me, __frame_key(me, f)))
+        __fail(me, BENCODE_ERR_CALLBACK);
+}
+
+static void __start_str(bencode_t* me, bencode_frame_t* f)
+{
+    f->type = BENCODE_TOK_STR_LEN;
+    f->pos = 0;
+    f->start = me->off;
+    __value_start(me, f, BENCODE_TOK_STR);
+}
+
+/**
+ * Hand over an integer we have all of, as it is
+ * @param n Number of bytes between here and the 'e'
+ * @return 0 on error; otherwise 1 */
+static int __int_slice(
+        bencode_t* me,
+        bencode_frame_t* f,
+        const char** buf,
+        unsigned int *len,
+        unsigned int n)
+{
+    if (!__int_check(me, *buf, n))
+        return 0;
+    *buf += n;
+    *len -= n;
+    me->off += n;
+    if (__delivering(f) && !me->cb.hit_slice(me,
+                __frame_key(me, f), BENCODE_TOK_INT, *buf - n, n))
+        return __fail(me, BENCODE_ERR_CALLBACK);
+    __pop_stack(me);
+    return 1;
+}
+
+static int __int_end(bencode_t* me, bencode_frame_t* f)
+{
+    /* "ie" and "i-e" */
+    if (f->pos == f->neg)
+        return __fail(me, BENCODE_ERR_BAD_INT);
+
+    if (__delivering(f) && me->cb.hit_slice)
+    {
+        if (!me->cb.hit_slice(me, __frame_key(me, f),
+                    BENCODE_TOK_INT, f->strval, f->pos))
+            return __fail(me, BENCODE_ERR_CALLBACK);
+    }
+    else if (__delivering(f))
+    {
+        /* integers aren't batched when hit_int_raw is set */
+        if (me->cb.hit_int_raw)
+            __batch_flush_before(me);
+        if (me->cb.hit_int_raw &&
+            !me->cb.hit_int_raw(me, __frame_key(me, f), f->strval, f->pos))
+            return __fail(me, BENCODE_ERR_CALLBACK);
+
+        if (f->big)
+        {
+            if (!me->cb.hit_int_raw)
+                return __fail(me, BENCODE_ERR_INT_OVERFLOW);
+        }
+        else if (!me->cb.hit_int_raw && __batching(me))
+            __batch_add_int(me, f->intval);
+        else if (!me->cb.hit_int(me, __frame_key(me, f), f->intval))
+            return __fail(me, BENCODE_ERR_CALLBACK);
+    }
+    __pop_stack(me);
+    return 1;
+}
+
+static int __int_neg(bencode_t* me, bencode_frame_t* f, const char* buf)
+{
+    f->neg = 1;
+    if ((me->cb.hit_int_raw || me->cb.hit_slice) && __delivering(f) &&
+        !__int_raw_append(me, f, buf, 1))
+        return 0;
+    f->pos = 1;
+    return 1;
+}
+
+/**
+ * Take the whole run of digits we have in one go */
+static int __int_digits(
+        bencode_t* me,
+        bencode_frame_t* f,
+        const char** buf,
+        unsigned int *len)
+{
+    unsigned int n;
+
+    /* a digit after a leading zero */
+    if (me->canonical && f->neg < f->pos && 0 == f->intval)
+        return __fail(me, BENCODE_ERR_NOT_CANONICAL);
+
+    n = __parse_int_run(f, *buf, *len);
+
+    /* lazy integers split across buffers are gathered up too */
+    if ((me->cb.hit_int_raw || me->cb.hit_slice) && __delivering(f) &&
+        !__int_raw_append(me, f, *buf, n))
+        return 0;
+
+    if (me->canonical && f->pos == f->neg && '0' == **buf &&
+        (f->neg || 1 < n))
+        return __fail(me, BENCODE_ERR_NOT_CANONICAL);
+
+    f->pos += n;
+    *buf += n - 1;
+    *len -= n - 1;
+    me->off += n - 1;
+    return 1;
+}
+
+/**
+ * We have the string's length; get ready for its bytes */
+static int __str_len_end(
+        bencode_t* me,
+        bencode_frame_t* f,
+        const char* buf,
+        unsigned int len)
+{
+    if (0 == f->len)
+    {
+        if (__delivering(f) && __batching(me))
+        {
+            if (!__batch_add_str(me, "", 0))
+                return 0;
+        }
+        else if (__delivering(f) && (me->cb.hit_slice ?
+                !me->cb.hit_slice(me, __frame_key(me, f),
+                    BENCODE_TOK_STR, buf, 0) :
+                !me->cb.hit_str(me, __frame_key(me, f), 0, NULL, 0)))
+            return __fail(me, BENCODE_ERR_CALLBACK);
+        __pop_stack(me);
+        return 1;
+    }
+
+    f->type = BENCODE_TOK_STR;
+    f->pos = 0;
+    f->sink = NULL;
+
+    /* strings have nothing below them to match */
+    if (BENCODE_SEL_TRANSIT == f->sel_mode)
+        f->sel_mode = BENCODE_SEL_SKIP;
+
+    if (!__delivering(f))
+        return 1;
+
+    if (me->cb.str_sink)
+        f->sink = me->cb.str_sink(me, __frame_key(me, f), f->len);
+
+    /* lazy, and the whole string is in front of us; we'll hand
+     * it over without copying */
+    if (!f->sink && me->cb.hit_slice && (unsigned int)f->len < len)
+        return 1;
+
+    /* grow once up front rather than as the bytes arrive
+     * +1 incase we also need to count for '\0' terminator */
+    if (!f->sink && f->sv_size <= f->len)
+    {
+        if (!__charge(me, f->sv_size, f->len + 1))
+            return 0;
+        f->sv_size = f->len + 1;
+        f->strval = realloc(f->strval, f->sv_size);
+    }
+    return 1;
+}
+
+static int __str_len_digit(bencode_t* me, bencode_frame_t* f, const char c)
+{
+    /* a digit after a leading zero */
+    if (me->canonical && 0 == f->len)
+        return __fail(me, BENCODE_ERR_NOT_CANONICAL);
+    return __parse_len(me, f, c, me->limits.max_str_len);
+}
+
+/**
+ * Take as much of the string as we have in one go */
+static int __str(
+        bencode_t* me,
+        bencode_frame_t* f,
+        const char** buf,
+        unsigned int *len)
+{
+    unsigned int n = f->len - f->pos;
+
+    if (!f->sink && me->cb.hit_slice && 0 == f->pos && n <= *len)
+    {
+        *buf += n - 1;
+        *len -= n - 1;
+        me->off += n - 1;
+        if (__delivering(f) && !me->cb.hit_slice(me, __frame_key(me, f),
+                    BENCODE_TOK_STR, *buf - (n - 1), n))
+            return __fail(me, BENCODE_ERR_CALLBACK);
+        __pop_stack(me);
+        return 1;
+    }
+
+    if (*len < n)
+        n = *len;
+
+    /* nobody wants this string, so we don't keep it */
+    if (BENCODE_SEL_SKIP != f->sel_mode)
+        memcpy((f->sink ? (char*)f->sink : f->strval) + f->pos, *buf, n);
+
+    f->pos += n;
+    *buf += n - 1;
+    *len -= n - 1;
+    me->off += n - 1;
+
+    if (f->len == f->pos)
+    {
+        if (f->sink)
+        {
+            __batch_flush_before(me);
+            if (!me->cb.hit_str(me, __frame_key(me, f), f->len,
+                        f->sink, f->len))
+                return __fail(me, BENCODE_ERR_CALLBACK);
+        }
+        else if (__delivering(f) && me->cb.hit_slice)
+        {
+            if (!me->cb.hit_slice(me, __frame_key(me, f), BENCODE_TOK_STR,
+                        f->strval, f->len))
+                return __fail(me, BENCODE_ERR_CALLBACK);
+        }
+        else if (__delivering(f) && __batching(me))
+        {
+            if (!__batch_add_str(me, f->strval, f->len))
+                return 0;
+        }
+        else if (__delivering(f))
+        {
+            f->strval[f->pos] = 0;
+            if (!me->cb.hit_str(me, __frame_key(me, f), f->len,
+                    (const unsigned char*)f->strval, f->len))
+                return __fail(me, BENCODE_ERR_CALLBACK);
+        }
+        __pop_stack(me);
+    }
+    return 1;
+}
+
+/**
+ * Push a frame for the dict's next key */
+static bencode_frame_t* __start_key(bencode_t* me)
+{
+    bencode_frame_t* f = __push_stack(me);
+
+    if (f)
+    {
+        f->type = BENCODE_TOK_DICT_KEYLEN;
+        f->pos = 0;
+    }
+    return f;
+}
+
+/**
+ * We have the key's length; get ready for its bytes */
+static int __key_len_end(bencode_t* me, bencode_frame_t* f)
+{
+    /* a ':' with no length before it */
+    if (0 == f->pos)
+        return __fail(me, BENCODE_ERR_BAD_KEY);
+
+    if (0 < me->path_len && BENCODE_SEL_SKIP != f->sel_mode &&
+        !__path_append(me, ".", 1))
+        return 0;
+    f->key_off = me->path_len;
+    f->type = BENCODE_TOK_DICT_KEY;
+    f->pos = 0;
+    if (me->canonical && !__key_order_begin(me, f))
+        return 0;
+    if (0 == f->len)
+    {
+        if (me->canonical && !__key_order_end(me, f))
+            return 0;
+        __key_done(me, f);
+    }
+    return 1;
+}
+
+static int __key_len_digit(bencode_t* me, bencode_frame_t* f, const char c)
+{
+    if (0 == f->pos++)
+        f->kstart = me->off;
+    /* a digit after a leading zero */
+    else if (me->canonical && 0 == f->len)
+        return __fail(me, BENCODE_ERR_NOT_CANONICAL);
+    return __parse_len(me, f, c, me->limits.max_key_len);
+}
+
+/**
+ * End of an empty dictionary; drop the key frame quietly as there was no
+ * item for it */
+static void __dict_end_empty(bencode_t* me, bencode_frame_t* f)
+{
+    __path_truncate(me, f->path_off);
+    me->d--;
+    __pop_stack(me);
+}
+
+static int __key(
+        bencode_t* me,
+        bencode_frame_t* f,
+        const char** buf,
+        unsigned int *len)
+{
+    /* nobody wants this key; don't bother recording it */
+    if (BENCODE_SEL_SKIP == f->sel_mode)
+    {
+        unsigned int n = f->len - f->pos;
+
+        if (*len < n)
+            n = *len;
+        if (me->canonical && !__key_order(me, f, *buf, n))
+            return 0;
+        f->pos += n;
+        *buf += n - 1;
+        *len -= n - 1;
+        me->off += n - 1;
+    }
+    else
+    {
+        if (me->canonical && !__key_order(me, f, *buf, 1))
+            return 0;
+        if (!__path_append(me, *buf, 1))
+            return 0;
+        f->pos++;
+    }
+
+    if (f->pos == f->len)
+    {
+        if (me->canonical && !__key_order_end(me, f))
+            return 0;
+        __key_done(me, f);
+    }
+    return 1;
+}
+
+/**
+ * Get the counters ready if this byte starts a new document */
+static void __doc_begin(bencode_t* me)
+{
+    if (0 == me->d)
+    {
+        me->doc_start = me->off;
+        me->doc_items = 0;
+    }
+}
+
+#ifdef BENCODE_SWITCH_ENGINE
+
+/**
+ * Start the value whose first byte is c
+ * @return 0 if c can't start a value; otherwise 1 */
+static int __start_value(bencode_t* me, bencode_frame_t* f, const char c)
+{
+    switch (c)
+    {
+    case 'i':
+        __start_int(me, f);
+        break;
+    case 'd':
+        if (!__start_dict(me, f))
+            return 0;
+        break;
+    case 'l':
+        __start_list(me, f);
+        break;
+    /* calculating length of string */
+    default:
+        if (!__is_digit(c))
+            return __fail(me, BENCODE_ERR_BAD_VALUE);
+        __start_str(me, f);
+        return __parse_len(me, f, c, me->limits.max_str_len);
+    }
+    return 1;
+}
+
+static int __process_tok(
+        bencode_t* me,
+        const char** buf,
+        unsigned int *len)
+{
+    bencode_frame_t* f = &me->stk[me->d];
+    const char* e;
+
+    switch (f->type)
+    {
+    case BENCODE_TOK_LIST:
+        /* end of list/dict */
+        if ('e' == **buf)
+        {
+            __pop_stack(me);
+            break;
+        }
+
+        if (!__count_item(me) || !(f = __push_stack(me)) ||
+            !__start_value(me, f, **buf))
+            return 0;
+        break;
+
+    case BENCODE_TOK_NONE:
+        __doc_begin(me);
+        /* fall through */
+    case BENCODE_TOK_DICT_VAL:
+        if (!__count_item(me) || !__start_value(me, f, **buf))
+            return 0;
+        break;
+
+    case BENCODE_TOK_INT:
+        /* lazy, and the whole integer is in front of us; hand it over as
+         * it is */
+        if (me->cb.hit_slice && 0 == f->pos &&
+            (e = memchr(*buf, 'e', *len)))
+        {
+            if (!__int_slice(me, f, buf, len, e - *buf))
+                return 0;
+        }
+        else if ('e' == **buf)
+        {
+            if (!__int_end(me, f))
+                return 0;
+        }
+        else if ('-' == **buf && 0 == f->pos)
+        {
+            if (!__int_neg(me, f, *buf))
+                return 0;
+        }
+        else if (__is_digit(**buf))
+        {
+            if (!__int_digits(me, f, buf, len))
+                return 0;
+        }
+        else
+        {
+            return __fail(me, BENCODE_ERR_BAD_INT);
+        }
+        break;
+
+    case BENCODE_TOK_STR_LEN:
+        if (':' == **buf)
+        {
+            if (!__str_len_end(me, f, *buf, *len))
+                return 0;
+        }
+        else if (__is_digit(**buf))
+        {
+            if (!__str_len_digit(me, f, **buf))
+                return 0;
+        }
+        else
+        {
+            return __fail(me, BENCODE_ERR_BAD_STR_LEN);
+        }
+        break;
+
+    case BENCODE_TOK_STR:
+        if (!__str(me, f, buf, len))
+            return 0;
+        break;
+
+    case BENCODE_TOK_DICT:
+        if ('e' == **buf)
+        {
+            __pop_stack(me);
+            break;
+        }
+
+        if (!(f = __start_key(me)))
+            return 0;
+        /* fall through */
+    case BENCODE_TOK_DICT_KEYLEN:
+        if (':' == **buf)
+        {
+            if (!__key_len_end(me, f))
+                return 0;
+        }
+        else if (__is_digit(**buf))
+        {
+            if (!__key_len_digit(me, f, **buf))
+                return 0;
+        }
+        else if ('e' == **buf && 0 == f->pos)
+        {
+            __dict_end_empty(me, f);
+        }
+        else
+        {
+            return __fail(me, BENCODE_ERR_BAD_KEY);
+        }
+        break;
+
+    case BENCODE_TOK_DICT_KEY:
+        if (!__key(me, f, buf, len))
+            return 0;
+        break;
+
+    default:
+        return __fail(me, BENCODE_ERR_BAD_STATE);
+    }
+
+    (*buf)++;
+    *len -= 1;
+    me->off++;
+    return 1;
+}
+
+static int __process(
+        bencode_t* me,
+        const char* buf,
+        unsigned int len)
+{
+    while (0 < len)
+    {
+        if (__too_many_bytes(me))
+            return __fail(me, BENCODE_ERR_TOO_MANY_BYTES);
+
+        /* callbacks deep inside the state machine can fail us too */
+        if (!__process_tok(me, &buf, &len) || me->err)
+            return 0;
+    }
+    return 1;
+}
+
+#else /* table engine */
+
+/* what the table engine does with a byte; which one depends on the type of
+ * the top frame and the byte's class */
+enum {
+    A_BAD_STATE,
+    /* a value inside a list, or the list's end */
+    A_ITEM_INT,
+    A_ITEM_DICT,
+    A_ITEM_LIST,
+    A_ITEM_STR,
+    A_ITEM_BAD,
+    A_LIST_END,
+    /* the root value, or a dict's value */
+    A_VAL_INT,
+    A_VAL_DICT,
+    A_VAL_LIST,
+    A_VAL_STR,
+    A_VAL_BAD,
+    A_INT_DIGITS,
+    A_INT_NEG,
+    A_INT_END,
+    A_INT_BAD,
+    A_LEN_DIGIT,
+    A_LEN_END,
+    A_LEN_BAD,
+    A_STR,
+    /* a dict's next key, or the dict's end */
+    A_DICT_DIGIT,
+    A_DICT_COLON,
+    A_DICT_BAD,
+    A_DICT_END,
+    A_KLEN_DIGIT,
+    A_KLEN_END,
+    A_KLEN_E,
+    A_KLEN_BAD,
+    A_KEY,
+    A_N
+};
+
+/* columns are: other, digit, ':', '-', 'i', 'l', 'd', 'e' */
+static const unsigned char __next[BENCODE_TOK_DICT + 1][CLS_N] = {
+    [BENCODE_TOK_NONE] = {
+        A_VAL_BAD, A_VAL_STR, A_VAL_BAD, A_VAL_BAD,
+        A_VAL_INT, A_VAL_LIST, A_VAL_DICT, A_VAL_BAD },
+    [BENCODE_TOK_LIST] = {
+        A_ITEM_BAD, A_ITEM_STR, A_ITEM_BAD, A_ITEM_BAD,
+        A_ITEM_INT, A_ITEM_LIST, A_ITEM_DICT, A_LIST_END },
+    [BENCODE_TOK_DICT_KEYLEN] = {
+        A_KLEN_BAD, A_KLEN_DIGIT, A_KLEN_END, A_KLEN_BAD,
+        A_KLEN_BAD, A_KLEN_BAD, A_KLEN_BAD, A_KLEN_E },
+    [BENCODE_TOK_DICT_KEY] = {
+        A_KEY, A_KEY, A_KEY, A_KEY,
+        A_KEY, A_KEY, A_KEY, A_KEY },
+    [BENCODE_TOK_DICT_VAL] = {
+        A_VAL_BAD, A_VAL_STR, A_VAL_BAD, A_VAL_BAD,
+        A_VAL_INT, A_VAL_LIST, A_VAL_DICT, A_VAL_BAD },
+    [BENCODE_TOK_INT] = {
+        A_INT_BAD, A_INT_DIGITS, A_INT_BAD, A_INT_NEG,
+        A_INT_BAD, A_INT_BAD, A_INT_BAD, A_INT_END },
+    [BENCODE_TOK_STR_LEN] = {
+        A_LEN_BAD, A_LEN_DIGIT, A_LEN_END, A_LEN_BAD,
+        A_LEN_BAD, A_LEN_BAD, A_LEN_BAD, A_LEN_BAD },
+    [BENCODE_TOK_STR] = {
+        A_STR, A_STR, A_STR, A_STR,
+        A_STR, A_STR, A_STR, A_STR },
+    [BENCODE_TOK_DICT] = {
+        A_DICT_BAD, A_DICT_DIGIT, A_DICT_COLON, A_DICT_BAD,
+        A_DICT_BAD, A_DICT_BAD, A_DICT_BAD, A_DICT_END },
+};
+
+/* with computed goto every action jumps straight to the next one, so each
+ * has its own indirect branch for the CPU to learn; otherwise we fall back
+ * to a switch */
+#if defined(__GNUC__) && !defined(BENCODE_NO_COMPUTED_GOTO)
+#define THREADED 1
+#define ACTION(a) L_##a
+#define DISPATCH() goto *labels[a]
+#else
+#define ACTION(a) case a
+#define DISPATCH() goto dispatch
+#endif
+
+/* work out what to do with the byte in front of us, and do it */
+#define FETCH() \
+    do { \
+        if (__too_many_bytes(me)) \
+            return __fail(me, BENCODE_ERR_TOO_MANY_BYTES); \
+        f = &me->stk[me->d]; \
+        a = BENCODE_TOK_DICT < (unsigned int)f->type ? A_BAD_STATE : \
+            __next[f->type][__cls[(unsigned char)*buf]]; \
+        DISPATCH(); \
+    } while (0)
+
+/* on to the next byte; callbacks deep inside the state machine can fail us
+ * too */
+#define NEXT() \
+    do { \
+        buf++; \
+        len--; \
+        me->off++; \
+        if (0 == len || me->err) \
+            goto out; \
+        FETCH(); \
+    } while (0)
+
+/**
+ * Count a list's next item and push a frame for it */
+static bencode_frame_t* __item(bencode_t* me)
+{
+    if (!__count_item(me))
+        return NULL;
+    return __push_stack(me);
+}
+
+static int __process(
+        bencode_t* me,
+        const char* buf,
+        unsigned int len)
+{
+#ifdef THREADED
+    static const void* const labels[A_N] = {
+        [A_BAD_STATE] = &&L_A_BAD_STATE,
+        [A_ITEM_INT] = &&L_A_ITEM_INT,
+        [A_ITEM_DICT] = &&L_A_ITEM_DICT,
+        [A_ITEM_LIST] = &&L_A_ITEM_LIST,
+        [A_ITEM_STR] = &&L_A_ITEM_STR,
+        [A_ITEM_BAD] = &&L_A_ITEM_BAD,
+        [A_LIST_END] = &&L_A_LIST_END,
+        [A_VAL_INT] = &&L_A_VAL_INT,
+        [A_VAL_DICT] = &&L_A_VAL_DICT,
+        [A_VAL_LIST] = &&L_A_VAL_LIST,
+        [A_VAL_STR] = &&L_A_VAL_STR,
+        [A_VAL_BAD] = &&L_A_VAL_BAD,
+        [A_INT_DIGITS] = &&L_A_INT_DIGITS,
+        [A_INT_NEG] = &&L_A_INT_NEG,
+        [A_INT_END] = &&L_A_INT_END,
+        [A_INT_BAD] = &&L_A_INT_BAD,
+        [A_LEN_DIGIT] = &&L_A_LEN_DIGIT,
+        [A_LEN_END] = &&L_A_LEN_END,
+        [A_LEN_BAD] = &&L_A_LEN_BAD,
+        [A_STR] = &&L_A_STR,
+        [A_DICT_DIGIT] = &&L_A_DICT_DIGIT,
+        [A_DICT_COLON] = &&L_A_DICT_COLON,
+        [A_DICT_BAD] = &&L_A_DICT_BAD,
+        [A_DICT_END] = &&L_A_DICT_END,
+        [A_KLEN_DIGIT] = &&L_A_KLEN_DIGIT,
+        [A_KLEN_END] = &&L_A_KLEN_END,
+        [A_KLEN_E] = &&L_A_KLEN_E,
+        [A_KLEN_BAD] = &&L_A_KLEN_BAD,
+        [A_KEY] = &&L_A_KEY,
+    };
+#endif
+    bencode_frame_t* f;
+    const char* e;
+    unsigned int a;
+
+    if (0 == len)
+        return 1;
+    FETCH();
+
+#ifndef THREADED
+dispatch:
+    switch (a)
+#endif
+    {
+    ACTION(A_ITEM_INT):
+        if (!(f = __item(me)))
+            return 0;
+        __start_int(me, f);
+        NEXT();
+
+    ACTION(A_ITEM_DICT):
+        if (!(f = __item(me)) || !__start_dict(me, f))
+            return 0;
+        NEXT();
+
+    ACTION(A_ITEM_LIST):
+        if (!(f = __item(me)))
+            return 0;
+        __start_list(me, f);
+        NEXT();
+
+    ACTION(A_ITEM_STR):
+        if (!(f = __item(me)))
+            return 0;
+        __start_str(me, f);
+        if (!__parse_len(me, f, *buf, me->limits.max_str_len))
+            return 0;
+        NEXT();
+
+    ACTION(A_ITEM_BAD):
+        if (!__item(me))
+            return 0;
+        return __fail(me, BENCODE_ERR_BAD_VALUE);
+
+    ACTION(A_LIST_END):
+    ACTION(A_DICT_END):
+        __pop_stack(me);
+        NEXT();
+
+    ACTION(A_VAL_INT):
+        __doc_begin(me);
+        if (!__count_item(me))
+            return 0;
+        __start_int(me, f);
+        NEXT();
+
+    ACTION(A_VAL_DICT):
+        __doc_begin(me);
+        if (!__count_item(me) || !__start_dict(me, f))
+            return 0;
+        NEXT();
+
+    ACTION(A_VAL_LIST):
+        __doc_begin(me);
+        if (!__count_item(me))
+            return 0;
+        __start_list(me, f);
+        NEXT();
+
+    ACTION(A_VAL_STR):
+        __doc_begin(me);
+        if (!__count_item(me))
+            return 0;
+        __start_str(me, f);
+        if (!__parse_len(me, f, *buf, me->limits.max_str_len))
+            return 0;
+        NEXT();
+
+    ACTION(A_VAL_BAD):
+        __doc_begin(me);
+        if (!__count_item(me))
+            return 0;
+        return __fail(me, BENCODE_ERR_BAD_VALUE);
+
+    /* lazy, and the whole integer is in front of us; hand it over as it
+     * is */
+    int_slice:
+        if (!__int_slice(me, f, &buf, &len, e - buf))
+            return 0;
+        NEXT();
+
+    ACTION(A_INT_DIGITS):
+        if (me->cb.hit_slice && 0 == f->pos && (e = memchr(buf, 'e', len)))
+            goto int_slice;
+        if (!__int_digits(me, f, &buf, &len))
+            return 0;
+        NEXT();
+
+    ACTION(A_INT_NEG):
+        if (me->cb.hit_slice && 0 == f->pos && (e = memchr(buf, 'e', len)))
+            goto int_slice;
+        if (0 != f->pos)
+            return __fail(me, BENCODE_ERR_BAD_INT);
+        if (!__int_neg(me, f, buf))
+            return 0;
+        NEXT();
+
+    ACTION(A_INT_END):
+        if (me->cb.hit_slice && 0 == f->pos && (e = memchr(buf, 'e', len)))
+            goto int_slice;
+        if (!__int_end(me, f))
+            return 0;
+        NEXT();
+
+    ACTION(A_INT_BAD):
+        if (me->cb.hit_slice && 0 == f->pos && (e = memchr(buf, 'e', len)))
+            goto int_slice;
+        return __fail(me, BENCODE_ERR_BAD_INT);
+
+    ACTION(A_LEN_DIGIT):
+        if (!__str_len_digit(me, f, *buf))
+            return 0;
+        NEXT();
+
+    ACTION(A_LEN_END):
+        if (!__str_len_end(me, f, buf, len))
+            return 0;
+        NEXT();
 
-void bencode_init(bencode_t* me)
-{
-    memset(me,0,sizeof(bencode_t));
-}
+    ACTION(A_LEN_BAD):
+        return __fail(me, BENCODE_ERR_BAD_STR_LEN);
 
-static bencode_frame_t* __push_stack(bencode_t* me)
-{
-    if (me->nframes <= me->d)
-    {
-        assert(0);
-        return NULL;
-    }
+    ACTION(A_STR):
+        if (!__str(me, f, &buf, &len))
+            return 0;
+        NEXT();
 
-    me->d++;
-    //memset(&me->stk[me->d], 0, sizeof(bencode_frame_t));
+    ACTION(A_DICT_DIGIT):
+        if (!(f = __start_key(me)) || !__key_len_digit(me, f, *buf))
+            return 0;
+        NEXT();
 
-    bencode_frame_t* s = &me->stk[me->d];
+    ACTION(A_KLEN_DIGIT):
+        if (!__key_len_digit(me, f, *buf))
+            return 0;
+        NEXT();
 
-    s->pos = 0;
-    s->intval = 0;
-    s->len = 0;
-    s->type = 0;
+    ACTION(A_DICT_COLON):
+        if (!(f = __start_key(me)) || !__key_len_end(me, f))
+            return 0;
+        NEXT();
 
-    if (0 == s->sv_size)
-    {
-        s->sv_size = 20;
-        s->strval = malloc(s->sv_size);
-    }
+    ACTION(A_KLEN_END):
+        if (!__key_len_end(me, f))
+            return 0;
+        NEXT();
 
-    if (0 == s->k_size)
-    {
-        s->k_size = 20;
-        s->key = malloc(s->k_size);
+    ACTION(A_KLEN_E):
+        if (0 != f->pos)
+            return __fail(me, BENCODE_ERR_BAD_KEY);
+        __dict_end_empty(me, f);
+        NEXT();
+
+    ACTION(A_DICT_BAD):
+        if (!__start_key(me))
+            return 0;
+        return __fail(me, BENCODE_ERR_BAD_KEY);
+
+    ACTION(A_KLEN_BAD):
+        return __fail(me, BENCODE_ERR_BAD_KEY);
+
+    ACTION(A_KEY):
+        if (!__key(me, f, &buf, &len))
+            return 0;
+        NEXT();
+
+    ACTION(A_BAD_STATE):
+        return __fail(me, BENCODE_ERR_BAD_STATE);
     }
-    
-    return &me->stk[me->d];
+
+out:
+    return !me->err;
 }
 
-static bencode_frame_t* __pop_stack(bencode_t* me)
-{
-    bencode_frame_t* f;
+#endif /* BENCODE_SWITCH_ENGINE */
 
-    f = &me->stk[me->d];
+int bencode_dispatch_from_buffer(
+        bencode_t* me,
+        const char* buf,
+        unsigned int len)
+{
+    /* once we've failed, we stay failed */
+    if (me->err)
+        return 0;
 
-    switch(f->type)
-    {
-        case BENCODE_TOK_LIST:
-            if (me->cb.list_leave)
-                me->cb.list_leave(me, f->key);
-            break;
-        case BENCODE_TOK_DICT:
-            if (me->cb.dict_leave)
-                me->cb.dict_leave(me, f->key);
-            break;
-    }
+    if (!me->stk && !__acquire(me))
+        return __fail(me, BENCODE_ERR_MEMORY);
 
-    if (me->d == 0)
-        return NULL;
+    if (me->nframes <= me->d)
+        return __fail(me, BENCODE_ERR_TOO_DEEP);
 
-    f = &me->stk[--me->d];
+    if (!__process(me, buf, len))
+        return __fail(me, BENCODE_ERR_BAD_STATE);
 
-    switch(f->type)
-    {
-        case BENCODE_TOK_LIST:
-            if (me->cb.list_next)
-                me->cb.list_next(me);
-            break;
-        case BENCODE_TOK_DICT:
-            if (me->cb.dict_next)
-                me->cb.dict_next(me);
-            break;
-    }
+    /* we don't need our stack until there's more input, unless we're part
+     * way through a token */
+    if (me->pool && __between_tokens(me))
+        __release(me);
 
-    return f;
+    return 1;
 }
 
-static int __parse_digit(const int current_value, const char c)
+void bencode_set_callbacks(
+        bencode_t* me,
+        bencode_callbacks_t* cb)
 {
-    return (c - '0') + current_value * 10;
+     memcpy(&me->cb,cb,sizeof(bencode_callbacks_t));
 }
 
-static void __start_int(bencode_frame_t* f)
+const char* bencode_path(bencode_t* me)
 {
-    f->type = BENCODE_TOK_INT;
-    f->pos = 0;
+    return me->path ? me->path : "";
 }
 
-static bencode_frame_t* __start_dict(bencode_t* me, bencode_frame_t* f)
+unsigned int bencode_path_depth(bencode_t* me)
 {
-    f->type = BENCODE_TOK_DICT;
-    f->pos = 0;
-    if (me->cb.dict_enter)
-        me->cb.dict_enter(me, f->key);
-
-    /* key/value */
-    f = __push_stack(me);
-    f->type = BENCODE_TOK_DICT_KEYLEN;
-    return f;
+    return me->d;
 }
 
-static void __start_list(bencode_t* me, bencode_frame_t* f)
+const char* bencode_path_key(
+        bencode_t* me,
+        unsigned int depth,
+        unsigned int* len)
 {
-    f->type = BENCODE_TOK_LIST;
-    f->pos = 0;
-    if (me->cb.list_enter)
-        me->cb.list_enter(me, f->key);
+    bencode_frame_t* f;
+
+    if (!me->stk || me->d <= depth)
+        return NULL;
+
+    f = &me->stk[depth + 1];
+    if (-1 == f->key_off)
+        return NULL;
+
+    if (len)
+        *len = (depth + 1 < me->d ? me->stk[depth + 2].path_off : me->path_len)
+            - f->key_off;
+    return me->path + f->key_off;
 }
 
-static void __start_str(bencode_frame_t* f)
+int bencode_path_index(
+        bencode_t* me,
+        unsigned int depth)
 {
-    f->type = BENCODE_TOK_STR_LEN;
-    f->pos = 0;
+    bencode_frame_t* f;
+
+    if (!me->stk || me->d <= depth)
+        return -1;
+
+    f = &me->stk[depth + 1];
+    if (BENCODE_TOK_LIST != me->stk[depth].type)
+        return -1;
+    return f->idx;
 }
 
-static int __process_tok(
-        bencode_t* me,
-        const char** buf,
-        unsigned int *len)
+bencode_selector_t* bencode_selector_new(
+        const char** paths,
+        unsigned int npaths)
 {
-    bencode_frame_t* f = &me->stk[me->d];
+    bencode_selector_t* me;
+    unsigned int i, size = 0, n = 0;
+    char* p;
 
-    switch (f->type)
+    if (32 < npaths)
+        return NULL;
+
+    for (i = 0; i < npaths; i++)
+        size += strlen(paths[i]) + 1;
+
+    me = calloc(1, sizeof(bencode_selector_t));
+    me->npaths = npaths;
+    me->keys_len = size;
+    me->keys = p = malloc(size + 1);
+    /* every component is at least one character long */
+    me->comps = malloc((size + 1) * sizeof(selector_comp_t));
+
+    for (i = 0; i < npaths; i++)
     {
-    case BENCODE_TOK_LIST:
-        switch (**buf)
+        strcpy(p, paths[i]);
+        me->off[i] = n;
+
+        while (*p)
         {
-        /* end of list/dict */
-        case 'e':
-            f = __pop_stack(me);
-            break;
-        case 'i':
-            f = __push_stack(me);
-            __start_int(f);
-            break;
-        case 'd':
-            f = __push_stack(me);
-            f = __start_dict(me,f);
-            break;
-        case 'l':
-            f = __push_stack(me);
-            __start_list(me,f);
-            break;
-        /* calculating length of string */
-        default:
-            if (isdigit(**buf))
+            selector_comp_t* c = &me->comps[n++];
+
+            if ('[' == *p)
             {
-                f = __push_stack(me);
-                __start_str(f);
-                f->len = __parse_digit(f->len, **buf);
+                p++;
+                if ('*' == *p)
+                {
+                    c->type = SEL_ANYIDX;
+                    p++;
+                }
+                else if (__is_digit(*p))
+                {
+                    c->type = SEL_IDX;
+                    c->idx = strtoul(p, &p, 10);
+                }
+                else
+                    goto fail;
+
+                if (']' != *p++)
+                    goto fail;
             }
             else
             {
-                return 0;
+                c->key = p;
+                while (*p && '.' != *p && '[' != *p)
+                    p++;
+                c->klen = p - c->key;
+                if (0 == c->klen)
+                    goto fail;
+                c->type = 1 == c->klen && '*' == *c->key ? SEL_ANYKEY : SEL_KEY;
             }
-            break;
-        }
-        break;
 
-    case BENCODE_TOK_DICT_VAL:
-        /* drop through */
-    case BENCODE_TOK_NONE:
-        switch (**buf)
-        {
-        case 'i':
-            __start_int(f);
-            break;
-        case 'd':
-            f = __start_dict(me,f);
-            break;
-        case 'l':
-            __start_list(me,f);
-            break;
-        /* calculating length of string */
-        default:
-            if (isdigit(**buf))
-            {
-                __start_str(f);
-                f->len = __parse_digit(f->len, **buf);
-            }
-            else
+            /* a separator must be followed by a key */
+            if ('.' == *p)
             {
-                return 0;
+                p++;
+                if ('\0' == *p || '[' == *p || '.' == *p)
+                    goto fail;
             }
-            break;
-
         }
-        break;
 
-    case BENCODE_TOK_INT:
-        if ('e' == **buf)
-        {
-            me->cb.hit_int(me, f->key, f->intval);
-            f = __pop_stack(me);
-        }
-        else if (isdigit(**buf))
-        {
-            f->intval = __parse_digit(f->intval, **buf);
-        }
-        else
-        {
-            assert(0);
-        }
-        break;
+        p++;
+    }
 
-    case BENCODE_TOK_STR_LEN:
-        if (':' == **buf)
-        {
-            if (0 == f->len)
-            {
-                me->cb.hit_str(me, f->key, 0, NULL, 0);
-                f = __pop_stack(me);
-            }
-            else
-            {
-                f->type = BENCODE_TOK_STR;
-                f->pos = 0;
-            }
-        }
-        else if (isdigit(**buf))
-        {
-            f->len = __parse_digit(f->len, **buf);
-        }
-        else
-        {
-            assert(0);
-        }
+    me->off[npaths] = n;
+    return me;
 
-        break;
-    case BENCODE_TOK_STR:
+fail:
+    bencode_selector_free(me);
+    return NULL;
+}
 
-        /* resize string
-         * +1 incase we also need to count for '\0' terminator */
-        if (f->sv_size <= f->pos + 1)
-        {
-            f->sv_size = 4 + f->sv_size * 2;
-            f->strval = realloc(f->strval,f->sv_size);
-        }
-        f->strval[f->pos++] = **buf;
+void bencode_selector_free(bencode_selector_t* me)
+{
+    free(me->keys);
+    free(me->comps);
+    free(me);
+}
 
-        if (f->len == f->pos)
-        {
-            f->strval[f->pos] = 0;
-            me->cb.hit_str(me, f->key, f->len,
-                    (const unsigned char*)f->strval, f->len);
-            f = __pop_stack(me);
-        }
+const char* bencode_selector_paths(
+        const bencode_selector_t* me,
+        unsigned int* len)
+{
+    *len = me->keys_len;
+    return me->keys;
+}
 
-        break;
-    case BENCODE_TOK_DICT:
-        if ('e' == **buf)
-        {
-            f = __pop_stack(me);
-            goto done;
-        }
+void bencode_set_selector(
+        bencode_t* me,
+        bencode_selector_t* sel)
+{
+    me->selector = sel;
 
-        f = __push_stack(me);
-        f->type = BENCODE_TOK_DICT_KEYLEN;
-        f->pos = 0;
-        /* drop through */
-    case BENCODE_TOK_DICT_KEYLEN:
-        if (':' == **buf)
-        {
-            f->type = BENCODE_TOK_DICT_KEY;
-            f->pos = 0;
-        }
-        else if (isdigit(**buf))
-        {
-            f->len = __parse_digit(f->len, **buf);
-        }
-        /* end of dictionary */
-        else if ('e' == **buf)
-        {
-            //return 0;
-            f = __pop_stack(me);
-        }
-        else
-        {
-            return 0;
-        }
+    /* pooled parsers pick this up when they next borrow a stack */
+    if (me->stk)
+        __reset_root(me);
+}
 
-        break;
-    case BENCODE_TOK_DICT_KEY:
-        if (f->k_size <= f->pos + 1)
-        {
-            f->k_size = f->k_size * 2 + 4;
-            f->key = realloc(f->key, f->k_size);
-        }
+int bencode_selector_match(bencode_t* me)
+{
+    if (!me->stk)
+        return -1;
+    return me->stk[me->d].sel_match;
+}
 
-        f->key[f->pos++] = **buf; 
+unsigned long int bencode_offset(bencode_t* me)
+{
+    return me->off;
+}
 
-        if (f->pos == f->len)
-        {
-            f->key[f->pos] = '\0';
-            //f = __push_stack(me);
-            f->type = BENCODE_TOK_DICT_VAL;
-            f->pos = 0;
-            f->len = 0;
-        }
-        break;
+unsigned long int bencode_value_offset(bencode_t* me)
+{
+    if (!me->stk)
+        return me->off;
+    return me->stk[me->d].start;
+}
 
-    default:
-        assert(0); break;
-    }
+unsigned long int bencode_key_offset(bencode_t* me)
+{
+    if (!me->stk)
+        return me->off;
+    return me->stk[me->d].kstart;
+}
 
-done:
-    (*buf)++;
-    *len -= 1;
+void bencode_set_limits(
+        bencode_t* me,
+        const bencode_limits_t* limits)
+{
+    memcpy(&me->limits, limits, sizeof(bencode_limits_t));
+}
+
+int bencode_slice_int(
+        const char* digits,
+        unsigned int len,
+        long long int* val)
+{
+    bencode_frame_t f;
+
+    memset(&f, 0, sizeof(f));
+    f.neg = 0 < len && '-' == *digits;
+    if (len == (unsigned int)f.neg ||
+        len - f.neg != __parse_int_run(&f, digits + f.neg, len - f.neg) ||
+        f.big)
+        return 0;
+    *val = f.intval;
     return 1;
 }
 
-int bencode_dispatch_from_buffer(
-        bencode_t* me,
-        const char* buf,
-        unsigned int len)
+int bencode_slice_str(
+        const char* val,
+        unsigned int len,
+        char* dst,
+        unsigned int dst_size)
 {
-    if (me->nframes <= me->d)
+    if (dst_size <= len)
         return 0;
+    memcpy(dst, val, len);
+    dst[len] = '\0';
+    return 1;
+}
 
-    while (0 < len)
+int bencode_set_batch(bencode_t* me, unsigned int n)
+{
+    unsigned int old_size = me->batch_size * sizeof(bencode_item_t);
+    unsigned int size = n * sizeof(bencode_item_t);
+    bencode_item_t* batch;
+
+    if (0 == n)
+    {
+        free(me->batch);
+        me->batch = NULL;
+        me->mem -= old_size;
+    }
+    else
     {
-        switch(__process_tok(me, &buf, &len))
+        if (!__charge(me, old_size, size))
+            return 0;
+        if (!(batch = realloc(me->batch, size)))
         {
-            case 0:
-                return 0;
-                break;
+            me->mem -= size - old_size;
+            return __fail(me, BENCODE_ERR_MEMORY);
         }
+        me->batch = batch;
     }
-
+    me->batch_size = n;
+    me->batch_len = 0;
     return 1;
 }
 
-void bencode_set_callbacks(
-        bencode_t* me,
-        bencode_callbacks_t* cb)
+void bencode_set_canonical(bencode_t* me, int on)
 {
-     memcpy(&me->cb,cb,sizeof(bencode_callbacks_t));
+    me->canonical = on;
+}
+
+int bencode_error(bencode_t* me)
+{
+    return me->err;
+}
+
+unsigned long int bencode_error_offset(bencode_t* me)
+{
+    return me->err_off;
+}
+
+unsigned int bencode_error_depth(bencode_t* me)
+{
+    return me->err_depth;
 }
 
+const char* bencode_strerror(int err)
+{
+    switch (err)
+    {
+    case BENCODE_ERR_NONE: return "no error";
+    case BENCODE_ERR_BAD_VALUE: return "byte can't start a value";
+    case BENCODE_ERR_KEY_ORDER: return "dict keys not in order";
+    case BENCODE_ERR_NOT_CANONICAL: return "leading zero or -0";
+    case BENCODE_ERR_BAD_INT: return "malformed integer";
+    case BENCODE_ERR_INT_OVERFLOW: return "integer too big";
+    case BENCODE_ERR_BAD_STR_LEN: return "malformed string length";
+    case BENCODE_ERR_BAD_KEY: return "malformed dict key";
+    case BENCODE_ERR_BAD_STATE: return "parser in unknown state";
+    case BENCODE_ERR_TOO_DEEP: return "nested too deeply";
+    case BENCODE_ERR_TOO_LONG: return "string or key too long";
+    case BENCODE_ERR_TOO_MANY_BYTES: return "document too large";
+    case BENCODE_ERR_TOO_MANY_ITEMS: return "too many items";
+    case BENCODE_ERR_MEMORY: return "memory budget exceeded";
+    case BENCODE_ERR_CALLBACK: return "callback failed";
+    }
+    return "unknown error";
+}
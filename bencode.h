@@ -21,8 +21,82 @@ enum {
     BENCODE_TOK_DICT
 }; 
 
+/* why bencode_dispatch_from_buffer() failed */
+enum {
+    BENCODE_ERR_NONE,
+    /* a byte that can't start a value */
+    BENCODE_ERR_BAD_VALUE,
+    /* a dict key that doesn't sort after the previous key; canonical only */
+    BENCODE_ERR_KEY_ORDER,
+    /* an integer or length with a leading zero, or -0; canonical only */
+    BENCODE_ERR_NOT_CANONICAL,
+    /* a non-digit within an integer, or an integer without digits */
+    BENCODE_ERR_BAD_INT,
+    /* an integer that doesn't fit in 64 bits */
+    BENCODE_ERR_INT_OVERFLOW,
+    /* a non-digit within a string's length */
+    BENCODE_ERR_BAD_STR_LEN,
+    /* a dict key that isn't a string */
+    BENCODE_ERR_BAD_KEY,
+    BENCODE_ERR_BAD_STATE,
+    /* more nesting than the parser has frames for */
+    BENCODE_ERR_TOO_DEEP,
+    /* a string or key longer than the limit, or too long to represent */
+    BENCODE_ERR_TOO_LONG,
+    BENCODE_ERR_TOO_MANY_BYTES,
+    BENCODE_ERR_TOO_MANY_ITEMS,
+    /* the parser would go over its memory budget */
+    BENCODE_ERR_MEMORY,
+    /* a callback returned 0 */
+    BENCODE_ERR_CALLBACK
+};
+
+/* how a frame is treated when a selector is set */
+enum {
+    /* the item matches a selector; callbacks fire */
+    BENCODE_SEL_DELIVER,
+    /* a selector might match an item below this one; no callbacks */
+    BENCODE_SEL_TRANSIT,
+    /* nothing below matches; bytes are skipped without buffering */
+    BENCODE_SEL_SKIP
+};
+
 typedef struct bencode_s bencode_t;
 
+/* limits on what a parser will accept; 0 means no limit */
+typedef struct {
+    /* longest string value */
+    unsigned int max_str_len;
+
+    /* longest dict key */
+    unsigned int max_key_len;
+
+    /* most bytes in a single document */
+    unsigned long int max_bytes;
+
+    /* most items (values of any type) in a single document */
+    unsigned long int max_items;
+
+    /* most heap the parser may hold, including its stack and buffers */
+    unsigned long int max_mem;
+} bencode_limits_t;
+
+typedef struct bencode_selector_s bencode_selector_t;
+
+typedef struct bencode_pool_s bencode_pool_t;
+
+/* a list element handed over by hit_batch */
+typedef struct {
+    /* BENCODE_TOK_INT or BENCODE_TOK_STR */
+    int type;
+
+    long long int intval;
+
+    /* '\0' terminated */
+    const char* strval;
+    unsigned int len;
+} bencode_item_t;
+
 typedef struct {
 
     /**
@@ -33,7 +107,7 @@ typedef struct {
      */
     int (*hit_int)(bencode_t *s,
             const char *dict_key,
-            const long int val);
+            const long long int val);
 
     /**
      * Call when there is some string for us to read.
@@ -97,25 +171,145 @@ typedef struct {
      */
     int (*dict_next)(bencode_t *s);
 
+    /**
+     * Optional. Called when a string's length has been read, before any of
+     * its bytes. Returning a buffer has the string's bytes copied straight
+     * into it as they arrive, instead of being buffered by the parser.
+     * hit_str is then called once with val pointing at this buffer.
+     *
+     * @param dict_key The dictionary key for this item.
+     *        This is set to null for list entries
+     * @param v_total_len The total length of the string
+     * @return buffer of at least v_total_len bytes; NULL to let the parser
+     *         buffer the string
+     */
+    unsigned char* (*str_sink)(bencode_t *s,
+        const char *dict_key,
+        unsigned int v_total_len);
+
+    /**
+     * Optional. Called with an integer's digits, including any leading
+     * '-', before hit_int. Integers too big for 64 bits only come through
+     * here; without this callback they fail with BENCODE_ERR_INT_OVERFLOW.
+     *
+     * @param dict_key The dictionary key for this item.
+     *        This is set to null for list entries
+     * @param digits The integer as it appears in the document
+     * @param len Number of bytes in digits
+     * @return 0 on error; otherwise 1
+     */
+    int (*hit_int_raw)(bencode_t *s,
+        const char *dict_key,
+        const char *digits,
+        unsigned int len);
+
+    /**
+     * Optional. Setting this turns on lazy mode: integers and strings are
+     * reported here as they appear in the input instead of through
+     * hit_int and hit_str, and aren't converted or copied. Values that
+     * are split across buffers are gathered up first. Use
+     * bencode_slice_int() and bencode_slice_str() to convert the ones
+     * you're interested in.
+     *
+     * @param dict_key The dictionary key for this item.
+     *        This is set to null for list entries
+     * @param type BENCODE_TOK_INT or BENCODE_TOK_STR
+     * @param val The digits of an integer, without the 'i' and 'e', or
+     *        the body of a string. Only valid during the callback
+     * @param len Number of bytes in val
+     * @return 0 on error; otherwise 1
+     */
+    int (*hit_slice)(bencode_t *s,
+        const char *dict_key,
+        int type,
+        const char *val,
+        unsigned int len);
+
+    /**
+     * Optional, see bencode_set_batch(). Called with integers and strings
+     * that are elements of a list, instead of hit_int, hit_str and
+     * list_next. Fires when the batch is full, before the list gets a
+     * list or dict element, and before list_leave.
+     *
+     * @param dict_key The list's dictionary key.
+     *        This is set to null if the list is within a list
+     * @param items The elements, in order. Only valid during the callback
+     * @param n Number of elements
+     * @return 0 on error; otherwise 1
+     */
+    int (*hit_batch)(bencode_t *s,
+        const char *dict_key,
+        const bencode_item_t* items,
+        unsigned int n);
+
+    /**
+     * Optional. Called at the first byte of every value, before anything
+     * else is reported about it; eg. before dict_enter, or before any of
+     * a string's bytes are read. bencode_value_offset() and
+     * bencode_key_offset() say where the value and its key start.
+     *
+     * @param dict_key The dictionary key for this item.
+     *        This is set to null for list entries
+     * @param type BENCODE_TOK_INT, _STR, _LIST or _DICT
+     * @return 0 on error; otherwise 1
+     */
+    int (*value_start)(bencode_t *s,
+        const char *dict_key,
+        int type);
+
 } bencode_callbacks_t;
 
 typedef struct {
 
-    /* dict key */
-    char* key;
-    int k_size;
-
     char* strval;
     int sv_size;
-    /* length of key buffer */
-//    int keylen;
 
-    long int intval;
+    /* caller supplied destination for the string we're reading */
+    unsigned char* sink;
+
+    long long int intval;
+
+    /* the integer we're reading has a '-' */
+    char neg;
+
+    /* the integer we're reading doesn't fit in intval */
+    char big;
+
+    /* 0 while the key we're reading matches the previous key so far; 1
+     * once it sorts after it */
+    char kcmp;
 
     int len;
 
     int pos;
 
+    /* offset within the path buffer where this frame's component starts */
+    unsigned int path_off;
+
+    /* offset of the dict key within the path buffer; -1 if there's no key */
+    int key_off;
+
+    /* this item's index within its parent list */
+    unsigned int idx;
+
+    /* number of items this list has seen so far */
+    unsigned int nitems;
+
+    /* bitmap of selectors that have matched the path up to this frame */
+    unsigned int sel;
+
+    /* BENCODE_SEL_* */
+    int sel_mode;
+
+    /* the selector this item matched; -1 if none */
+    int sel_match;
+
+    /* offset of the first byte of this item's value */
+    unsigned long int start;
+
+    /* offset of the first byte of this item's dict key */
+    unsigned long int kstart;
+
     /* token type */
     int type;
 
@@ -134,6 +328,67 @@ struct bencode_s {
     /* current depth within stack */
     unsigned int d;
 
+    /* offset of the byte we're processing, counted from the first byte we
+     * were given */
+    unsigned long int off;
+
+    /* path of the current item, eg. "info.files[3].length"
+     * Each frame appends its own component when it is pushed and truncates
+     * the path back to where it started when it is popped. */
+    char* path;
+    unsigned int path_size;
+    unsigned int path_len;
+
+    /* only deliver items matching this selector; NULL delivers everything */
+    bencode_selector_t* selector;
+
+    /* if set, stk and path are borrowed from this pool while we're
+     * parsing, and handed back at the end of each dispatch that leaves us
+     * between tokens */
+    bencode_pool_t* pool;
+    struct bencode_workspace_s* ws;
+
+    /* what we kept of stk and path when we handed them back mid-document */
+    struct bencode_resume_s* resume;
+
+    bencode_limits_t limits;
+
+    /* check the input is in canonical form as we parse */
+    int canonical;
+
+    /* list elements waiting for hit_batch */
+    bencode_item_t* batch;
+    unsigned int batch_len;
+
+    /* most elements in a batch; 0 if we aren't batching */
+    unsigned int batch_size;
+
+    /* bytes of the batched strings */
+    char* batch_str;
+    unsigned int bs_len;
+    unsigned int bs_size;
+
+    /* the element we've just finished went into the batch */
+    int batched;
+
+    /* offset of the first byte of the current document */
+    unsigned long int doc_start;
+
+    /* number of items in the current document */
+    unsigned long int doc_items;
+
+    /* heap we're holding */
+    unsigned long int mem;
+
+    /* first error we hit, BENCODE_ERR_* */
+    int err;
+
+    /* offset of the byte that caused the error */
+    unsigned long int err_off;
+
+    /* depth we were at when we hit the error */
+    unsigned int err_depth;
+
     /* user data for context */
     void* udata;
 
@@ -144,19 +399,75 @@ struct bencode_s {
 /**
  * @param expected_depth The expected depth of the bencode
  * @param cb The callbacks we need to parse the bencode
- * @return new memory for a bencode sax parser
+ * @return new memory for a bencode sax parser; NULL if we're out of memory
  */
 bencode_t* bencode_new(
         int expected_depth,
         bencode_callbacks_t* cb,
         void* udata);
 
+/**
+ * Create a parser that holds no stack or buffers while it's idle. They're
+ * borrowed from the pool when input arrives, and returned once a dispatch
+ * leaves the parser between tokens, even in the middle of a document. Handy
+ * for holding many mostly idle connections.
+ *
+ * Mid-document the parser keeps only a compact record of its open
+ * containers, its path, and the previous key of each dict for the
+ * canonical check. A peer that stalls partway through an integer, a
+ * string or a key keeps its whole stack until it sends the rest of it.
+ * While the stack is in the pool, bencode_path() is empty and
+ * bencode_path_key() and bencode_path_index() don't know the containers.
+ *
+ * Pools aren't thread safe; give each thread its own.
+ *
+ * @param expected_depth The expected depth of the bencode
+ * @param cb The callbacks we need to parse the bencode
+ * @param pool The pool to borrow from
+ * @return new memory for a bencode sax parser; NULL if we're out of memory
+ */
+bencode_t* bencode_new_pooled(
+        int expected_depth,
+        bencode_callbacks_t* cb,
+        void* udata,
+        bencode_pool_t* pool);
+
+/**
+ * Free the parser and all of its buffers
+ */
+void bencode_free(bencode_t*);
+
+/**
+ * @return new pool of parser stacks and buffers
+ */
+bencode_pool_t* bencode_pool_new(void);
+
+/**
+ * Free the pool. Parsers using the pool must have been freed first
+ */
+void bencode_pool_free(bencode_pool_t*);
+
+/**
+ * @return number of stacks sitting idle in the pool
+ */
+unsigned int bencode_pool_count(bencode_pool_t*);
+
 /**
  * Initialise reader
  */
 void bencode_init(bencode_t*);
 
 /**
+ * Forget the document in progress, and any error, so the parser can be
+ * reused for another document. Buffers are kept, so this is cheaper than
+ * a new parser. Offsets count from 0 again.
+ */
+void bencode_reset(bencode_t*);
+
+/**
+ * Stops at the first byte that's invalid. Once this has failed it will
+ * keep failing; bencode_error() says why.
+ *
  * @param buf The buffer to read new input from
  * @param len The size of the buffer
  * @return 0 on error; otherwise 1
@@ -172,5 +483,173 @@ void bencode_set_callbacks(
         bencode_t*,
         bencode_callbacks_t* cb);
 
+/**
+ * The path is made up of dict keys separated by '.' and list indices within
+ * square brackets, eg. "info.files[3].length". Keys may contain '.' or '['
+ * themselves; use bencode_path_key() when an unambiguous key is required.
+ *
+ * @return the path of the item we're currently processing; never NULL
+ */
+const char* bencode_path(bencode_t*);
+
+/**
+ * @return the number of components in the current path
+ */
+unsigned int bencode_path_depth(bencode_t*);
+
+/**
+ * @param depth The component we want, 0 being the outermost
+ * @param len Set to the length of the key
+ * @return the dict key at this depth; NULL if the component is a list index
+ */
+const char* bencode_path_key(
+        bencode_t*,
+        unsigned int depth,
+        unsigned int* len);
+
+/**
+ * @param depth The component we want, 0 being the outermost
+ * @return the list index at this depth; -1 if the component is a dict key
+ */
+int bencode_path_index(
+        bencode_t*,
+        unsigned int depth);
+
+/**
+ * Compile path selectors into a filter that the parser runs while parsing.
+ *
+ * A selector is written like a path, eg. "info.files[*].length". Dict keys
+ * are separated by '.', "*" matches any key, "[n]" matches list index n
+ * and "[*]" matches any index. An empty selector matches the whole
+ * document. At most 32 selectors can be compiled together.
+ *
+ * @param paths The selectors
+ * @param npaths Number of selectors
+ * @return new compiled selector; NULL if a selector is invalid
+ */
+bencode_selector_t* bencode_selector_new(
+        const char** paths,
+        unsigned int npaths);
+
+void bencode_selector_free(bencode_selector_t*);
+
+/**
+ * @param len Set to the number of bytes returned
+ * @return the paths the selector was compiled from, each followed by a
+ *         '\0'; selectors compiled from the same paths give the same bytes
+ */
+const char* bencode_selector_paths(
+        const bencode_selector_t*,
+        unsigned int* len);
+
+/**
+ * Only items matching the selector (and everything inside them) will
+ * reach the callbacks. Everything else is skipped without buffering.
+ * Must be set before the first byte is dispatched.
+ *
+ * @param sel The compiled selector; NULL to deliver everything
+ */
+void bencode_set_selector(
+        bencode_t*,
+        bencode_selector_t* sel);
+
+/**
+ * @return index of the selector the current item matched; -1 if none
+ */
+int bencode_selector_match(bencode_t*);
+
+/**
+ * @return offset of the byte currently being processed
+ */
+unsigned long int bencode_offset(bencode_t*);
+
+/**
+ * @return offset of the first byte of the current item's value
+ */
+unsigned long int bencode_value_offset(bencode_t*);
+
+/**
+ * @return offset of the first byte of the current item's dict key, ie. its
+ *         length prefix. Only meaningful for dict items
+ */
+unsigned long int bencode_key_offset(bencode_t*);
+
+/**
+ * Input breaking a limit makes bencode_dispatch_from_buffer() fail. String
+ * and key lengths are checked as soon as their length prefix is read,
+ * before any of their bytes are buffered.
+ *
+ * @param limits The limits to apply
+ */
+void bencode_set_limits(
+        bencode_t*,
+        const bencode_limits_t* limits);
+
+/**
+ * Make input that isn't canonical fail: dict keys out of order or
+ * repeated, and integers or lengths with leading zeros or -0. Each key
+ * is compared with the previous key of its dict as it streams in; no
+ * tree is built.
+ *
+ * @param on 1 to check; 0 to accept non-canonical input (the default)
+ */
+void bencode_set_canonical(bencode_t*, int on);
+
+/**
+ * Hand list elements to hit_batch in groups of up to n, so that long
+ * lists of integers and strings cost one callback per batch rather than
+ * two per element. Strings given to str_sink, integers too big for
+ * hit_int, and lazy mode aren't batched. The batch counts towards
+ * max_mem.
+ *
+ * @param n Most elements in a batch; 0 to stop batching
+ * @return 0 if the batch would go over max_mem or we're out of memory,
+ *         and the previous batch size is kept; otherwise 1
+ */
+int bencode_set_batch(bencode_t*, unsigned int n);
+
+/**
+ * Convert an integer reported by hit_slice
+ * @param digits The integer's digits, with any leading '-'
+ * @param len Number of bytes in digits
+ * @param val Where the value is written
+ * @return 0 if the integer doesn't fit in 64 bits; otherwise 1
+ */
+int bencode_slice_int(
+        const char* digits,
+        unsigned int len,
+        long long int* val);
+
+/**
+ * Copy a string reported by hit_slice and terminate it with '\0'
+ * @param dst Where the string is written
+ * @param dst_size Size of dst
+ * @return 0 if dst is too small; otherwise 1
+ */
+int bencode_slice_str(
+        const char* val,
+        unsigned int len,
+        char* dst,
+        unsigned int dst_size);
+
+/**
+ * @return the error that made dispatching fail, BENCODE_ERR_*
+ */
+int bencode_error(bencode_t*);
+
+/**
+ * @return offset of the byte that caused the error
+ */
+unsigned long int bencode_error_offset(bencode_t*);
+
+/**
+ * @return depth the parser was at when it hit the error
+ */
+unsigned int bencode_error_depth(bencode_t*);
+
+/**
+ * @return a description of the error
+ */
+const char* bencode_strerror(int err);
 
 #endif /* BENCODE_H */
@@ -0,0 +1,825 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Parse many documents across a pool of threads
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#include "bencode.h"
+#include "bencode_batch.h"
+
+typedef struct __worker_s __worker_t;
+
+/* what all the workers share */
+typedef struct {
+    bencode_batch_item_t* items;
+    bencode_callbacks_t* cb;
+    int expected_depth;
+
+    /* io_uring only: reads in flight per worker, and the size of each
+     * one's buffer */
+    unsigned int queue_depth;
+    unsigned int buf_size;
+
+    __worker_t* workers;
+    unsigned int nworkers;
+} __run_t;
+
+struct __worker_s {
+    __run_t* run;
+    pthread_t thread;
+    int started;
+
+    /* the items we've still to do, as lo in the bottom half and hi in the
+     * top half. We take from lo, thieves take from hi */
+    uint64_t range;
+
+    bencode_t* ben;
+
+    /* file contents */
+    char* buf;
+    unsigned long int buf_size;
+
+    unsigned int nok;
+};
+
+#define RANGE(lo, hi) ((uint64_t)(hi) << 32 | (uint32_t)(lo))
+#define LO(r) ((uint32_t)(r))
+#define HI(r) ((uint32_t)((r) >> 32))
+
+#define ROL(x, n) ((x) << (n) | (x) >> (32 - (n)))
+
+static void __sha1_block(uint32_t h[5], const unsigned char* p)
+{
+    uint32_t w[80], a, b, c, d, e, t;
+    int i;
+
+    for (i = 0; i < 16; i++)
+        w[i] = (uint32_t)p[i * 4] << 24 | (uint32_t)p[i * 4 + 1] << 16 |
+            (uint32_t)p[i * 4 + 2] << 8 | p[i * 4 + 3];
+    for (; i < 80; i++)
+        w[i] = ROL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    a = h[0]; b = h[1]; c = h[2]; d = h[3]; e = h[4];
+    for (i = 0; i < 80; i++)
+    {
+        if (i < 20)
+            t = ((b & c) | (~b & d)) + 0x5a827999;
+        else if (i < 40)
+            t = (b ^ c ^ d) + 0x6ed9eba1;
+        else if (i < 60)
+            t = ((b & c) | (b & d) | (c & d)) + 0x8f1bbcdc;
+        else
+            t = (b ^ c ^ d) + 0xca62c1d6;
+        t += ROL(a, 5) + e + w[i];
+        e = d; d = c; c = ROL(b, 30); b = a; a = t;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+}
+
+void bencode_sha1(
+        const void* buf,
+        unsigned long int len,
+        unsigned char out[20])
+{
+    uint32_t h[5] = {
+        0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+    const unsigned char* p = buf;
+    unsigned char last[128];
+    unsigned long int i, rest = len % 64;
+    uint64_t bits = (uint64_t)len * 8;
+    unsigned int nlast;
+
+    for (i = 0; i + 64 <= len; i += 64)
+        __sha1_block(h, p + i);
+
+    /* the remainder, a 1 bit, padding, and the length in bits */
+    memset(last, 0, sizeof(last));
+    memcpy(last, p + i, rest);
+    last[rest] = 0x80;
+    nlast = rest < 56 ? 64 : 128;
+    for (i = 0; i < 8; i++)
+        last[nlast - 1 - i] = (unsigned char)(bits >> (i * 8));
+    for (i = 0; i < nlast; i += 64)
+        __sha1_block(h, last + i);
+
+    for (i = 0; i < 20; i++)
+        out[i] = (unsigned char)(h[i / 4] >> (24 - (i % 4) * 8));
+}
+
+/**
+ * Step over the value at p, which the parser has already checked
+ * @return the byte after the value */
+static const char* __skip(const char* p)
+{
+    unsigned int d = 0;
+
+    do
+    {
+        if ('i' == *p)
+            p = strchr(p, 'e') + 1;
+        else if ('l' == *p || 'd' == *p)
+        {
+            p++;
+            d++;
+            continue;
+        }
+        else if ('e' == *p)
+        {
+            p++;
+            d--;
+        }
+        else
+        {
+            char* colon;
+            unsigned long int len = strtoul(p, &colon, 10);
+
+            p = colon + 1 + len;
+        }
+    }
+    while (0 < d);
+
+    return p;
+}
+
+/**
+ * Find the root dict's "info" value. buf has to start with a valid
+ * document
+ * @return 0 if there isn't one; otherwise 1 */
+static int __info(const char* buf, const char** info, unsigned long int* len)
+{
+    const char* p = buf + 1;
+
+    if ('d' != *buf)
+        return 0;
+
+    while ('e' != *p)
+    {
+        char* colon;
+        unsigned long int klen = strtoul(p, &colon, 10);
+        const char* key = colon + 1;
+
+        p = __skip(key + klen);
+        if (4 == klen && 0 == memcmp(key, "info", 4) && 'd' == key[4])
+        {
+            *info = key + 4;
+            *len = p - *info;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Make room in our buffer for a file of this size */
+static void __reserve(__worker_t* w, unsigned long int size)
+{
+    if (w->buf_size < size)
+    {
+        w->buf_size = size;
+        w->buf = realloc(w->buf, w->buf_size);
+    }
+}
+
+/**
+ * Read the file from offset n on into our buffer, which holds the first n
+ * bytes already
+ * @param len Set to the size of the file
+ * @return errno on error; otherwise 0 */
+static int __pread(__worker_t* w, int fd, unsigned long int n,
+        unsigned long int* len)
+{
+    struct stat st;
+
+    if (-1 == fstat(fd, &st))
+        return errno;
+
+    __reserve(w, st.st_size);
+    while (n < (unsigned long int)st.st_size)
+    {
+        ssize_t r = pread(fd, w->buf + n, st.st_size - n, n);
+
+        if (r < 0)
+            return errno;
+        /* it's shrunk underneath us */
+        if (0 == r)
+            break;
+        n += r;
+    }
+
+    *len = n;
+    return 0;
+}
+
+/**
+ * Parse a document that's been read, and fill in the item's results */
+static void __parse_buf(
+        __worker_t* w,
+        bencode_batch_item_t* it,
+        const char* buf,
+        unsigned long int len)
+{
+    bencode_t* s = w->ben;
+    const char* info;
+    unsigned long int info_len;
+
+    bencode_reset(s);
+    s->udata = it;
+    if (!bencode_dispatch_from_buffer(s, buf, len))
+    {
+        it->err = bencode_error(s);
+        return;
+    }
+
+    /* empty, or cut short */
+    if (0 == len || 0 != s->d || BENCODE_TOK_NONE != s->stk[0].type)
+    {
+        it->err = BENCODE_ERR_BAD_STATE;
+        return;
+    }
+
+    if (__info(buf, &info, &info_len))
+    {
+        bencode_sha1(info, info_len, it->info_hash);
+        it->has_info_hash = 1;
+    }
+    w->nok++;
+}
+
+static void __clear(bencode_batch_item_t* it)
+{
+    it->io_err = 0;
+    it->err = BENCODE_ERR_NONE;
+    it->has_info_hash = 0;
+}
+
+static void __parse(__worker_t* w, bencode_batch_item_t* it)
+{
+    unsigned long int len;
+    int fd;
+
+    __clear(it);
+    if (!it->path)
+    {
+        __parse_buf(w, it, it->buf, it->len);
+        return;
+    }
+
+    if (-1 == (fd = open(it->path, O_RDONLY)))
+    {
+        it->io_err = errno;
+        return;
+    }
+    it->io_err = __pread(w, fd, 0, &len);
+    close(fd);
+    if (0 == it->io_err)
+        __parse_buf(w, it, w->buf, len);
+}
+
+/**
+ * Take our next item, or steal some from another worker
+ * @return index of the item; -1 if there's nothing left anywhere */
+static long int __next(__worker_t* w)
+{
+    __run_t* run = w->run;
+    unsigned int i;
+
+    while (1)
+    {
+        uint64_t r = __atomic_load_n(&w->range, __ATOMIC_ACQUIRE);
+
+        if (LO(r) == HI(r))
+            break;
+        if (__atomic_compare_exchange_n(&w->range, &r,
+                    RANGE(LO(r) + 1, HI(r)), 0,
+                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return LO(r);
+    }
+
+    /* steal half of what the next busy worker has left */
+    for (i = 1; i < run->nworkers; i++)
+    {
+        __worker_t* v = &run->workers[(w - run->workers + i) % run->nworkers];
+        uint64_t r = __atomic_load_n(&v->range, __ATOMIC_ACQUIRE);
+
+        while (LO(r) != HI(r))
+        {
+            uint32_t n = (HI(r) - LO(r) + 1) / 2;
+
+            if (__atomic_compare_exchange_n(&v->range, &r,
+                        RANGE(LO(r), HI(r) - n), 0,
+                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            {
+                /* nobody steals from an empty range, so this is safe */
+                __atomic_store_n(&w->range,
+                        RANGE(HI(r) - n + 1, HI(r)), __ATOMIC_RELEASE);
+                return HI(r) - n;
+            }
+        }
+    }
+
+    return -1;
+}
+
+static void* __work(void* arg)
+{
+    __worker_t* w = arg;
+    long int i;
+
+    while (-1 != (i = __next(w)))
+        __parse(w, &w->run->items[i]);
+    return NULL;
+}
+
+#ifdef HAVE_IO_URING
+
+/* user_data of the closes we don't wait on */
+#define CLOSE_TAG (~0ULL)
+
+enum {
+    SLOT_IDLE,
+    SLOT_OPEN,
+    SLOT_READ
+};
+
+/* a file we're reading */
+typedef struct {
+    int state;
+    long int item;
+    int fd;
+    char* buf;
+} __slot_t;
+
+typedef struct {
+    int fd;
+
+    unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe* sqes;
+    unsigned int sq_entries;
+
+    unsigned int *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe* cqes;
+
+    void* sq_ptr;
+    size_t sq_len;
+    void* cq_ptr;
+    size_t cq_len;
+    size_t sqes_len;
+
+    /* submitted but not completed */
+    unsigned int inflight;
+    unsigned int to_submit;
+
+    /* the slot buffers are registered, so we can use READ_FIXED */
+    int fixed;
+} __ring_t;
+
+static int __ring_supports(int fd)
+{
+    struct io_uring_probe* p;
+    size_t len = sizeof(*p) + 256 * sizeof(struct io_uring_probe_op);
+    int ok;
+
+    p = calloc(1, len);
+    ok = 0 <= syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE,
+                p, 256) &&
+        IORING_OP_CLOSE < p->ops_len &&
+        (p->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED) &&
+        (p->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) &&
+        (p->ops[IORING_OP_READ_FIXED].flags & IO_URING_OP_SUPPORTED) &&
+        (p->ops[IORING_OP_CLOSE].flags & IO_URING_OP_SUPPORTED);
+    free(p);
+    return ok;
+}
+
+static void __ring_free(__ring_t* r)
+{
+    if (r->sqes)
+        munmap(r->sqes, r->sqes_len);
+    if (r->cq_ptr && r->cq_ptr != r->sq_ptr)
+        munmap(r->cq_ptr, r->cq_len);
+    if (r->sq_ptr)
+        munmap(r->sq_ptr, r->sq_len);
+    close(r->fd);
+}
+
+/**
+ * @return 0 if io_uring isn't available, or can't do what we need;
+ *         otherwise 1 */
+static int __ring_new(__ring_t* r, unsigned int entries,
+        const struct iovec* iov, unsigned int niov)
+{
+    struct io_uring_params p;
+    char* sq, *cq;
+
+    memset(r, 0, sizeof(__ring_t));
+    memset(&p, 0, sizeof(p));
+    r->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0)
+        return 0;
+
+    if (!__ring_supports(r->fd))
+    {
+        close(r->fd);
+        return 0;
+    }
+
+    r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP && r->sq_len < r->cq_len)
+        r->sq_len = r->cq_len;
+
+    r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == r->sq_ptr)
+    {
+        r->sq_ptr = NULL;
+        __ring_free(r);
+        return 0;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        r->cq_ptr = r->sq_ptr;
+    else
+    {
+        r->cq_ptr = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (MAP_FAILED == r->cq_ptr)
+        {
+            r->cq_ptr = NULL;
+            __ring_free(r);
+            return 0;
+        }
+    }
+
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (MAP_FAILED == r->sqes)
+    {
+        r->sqes = NULL;
+        __ring_free(r);
+        return 0;
+    }
+
+    sq = r->sq_ptr;
+    r->sq_head = (unsigned int*)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned int*)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned int*)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned int*)(sq + p.sq_off.array);
+    r->sq_entries = p.sq_entries;
+    cq = r->cq_ptr;
+    r->cq_head = (unsigned int*)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned int*)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned int*)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+    /* locked memory limits can stop this; plain reads will do */
+    r->fixed = 0 == syscall(__NR_io_uring_register, r->fd,
+            IORING_REGISTER_BUFFERS, iov, niov);
+    return 1;
+}
+
+static struct io_uring_sqe* __ring_sqe(__ring_t* r, unsigned long long tag)
+{
+    unsigned int tail = *r->sq_tail;
+    unsigned int i = tail & *r->sq_mask;
+    struct io_uring_sqe* sqe = &r->sqes[i];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = tag;
+    r->sq_array[i] = i;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    r->to_submit++;
+    r->inflight++;
+    return sqe;
+}
+
+static void __ring_close(__ring_t* r, int fd)
+{
+    struct io_uring_sqe* sqe = __ring_sqe(r, CLOSE_TAG);
+
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+}
+
+static void __ring_read(__ring_t* r, __slot_t* sl, unsigned int idx,
+        unsigned int size)
+{
+    struct io_uring_sqe* sqe = __ring_sqe(r, idx);
+
+    sqe->opcode = r->fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = sl->fd;
+    sqe->addr = (unsigned long)sl->buf;
+    sqe->len = size;
+    sqe->off = 0;
+    sqe->buf_index = idx;
+    sl->state = SLOT_READ;
+}
+
+/**
+ * Start on the next item that has a file to read
+ * @return 0 if there are no more; otherwise 1 */
+static int __ring_open(__worker_t* w, __ring_t* r, __slot_t* sl,
+        unsigned int idx)
+{
+    bencode_batch_item_t* items = w->run->items;
+    struct io_uring_sqe* sqe;
+    long int i;
+
+    while (1)
+    {
+        if (-1 == (i = __next(w)))
+            return 0;
+        if (items[i].path)
+            break;
+        /* nothing to read */
+        __parse(w, &items[i]);
+    }
+
+    __clear(&items[i]);
+    sl->item = i;
+    sqe = __ring_sqe(r, idx);
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (unsigned long)items[i].path;
+    sqe->open_flags = O_RDONLY;
+    sl->state = SLOT_OPEN;
+    return 1;
+}
+
+/**
+ * A read's finished; parse what we got, reading the rest of the file
+ * first if it didn't fit */
+static void __ring_parse(__worker_t* w, __ring_t* r, __slot_t* sl, int res)
+{
+    bencode_batch_item_t* it = &w->run->items[sl->item];
+    unsigned long int len;
+
+    if (res < 0)
+        it->io_err = -res;
+    else if ((unsigned int)res < w->run->buf_size)
+        __parse_buf(w, it, sl->buf, res);
+    else
+    {
+        __reserve(w, res);
+        memcpy(w->buf, sl->buf, res);
+        if (0 == (it->io_err = __pread(w, sl->fd, res, &len)))
+            __parse_buf(w, it, w->buf, len);
+    }
+
+    __ring_close(r, sl->fd);
+    sl->state = SLOT_IDLE;
+}
+
+/**
+ * We can't wait on the ring any more; take what's already completed, so we
+ * know which opens left us an fd to close */
+static void __ring_drain(__ring_t* r, __slot_t* slots)
+{
+    unsigned int head = *r->cq_head;
+    unsigned int tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; head++)
+    {
+        struct io_uring_cqe* cqe = &r->cqes[head & *r->cq_mask];
+        __slot_t* sl;
+
+        if (CLOSE_TAG == cqe->user_data)
+            continue;
+
+        sl = &slots[cqe->user_data];
+        if (SLOT_OPEN == sl->state && 0 <= cqe->res)
+        {
+            sl->fd = cqe->res;
+            sl->state = SLOT_READ;
+        }
+    }
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/**
+ * Keep queue_depth files opening or being read, and parse each as soon as
+ * it's in */
+static void __ring_work(__worker_t* w, __ring_t* r, __slot_t* slots)
+{
+    unsigned int i, n = w->run->queue_depth;
+    int more = 1;
+
+    while (1)
+    {
+        unsigned int head, tail;
+
+        /* closes we haven't reaped yet take up room in the ring too */
+        for (i = 0; more && i < n && r->inflight < r->sq_entries; i++)
+            if (SLOT_IDLE == slots[i].state)
+                more = __ring_open(w, r, &slots[i], i);
+
+        if (0 == r->inflight)
+            break;
+
+        if (syscall(__NR_io_uring_enter, r->fd, r->to_submit, 1,
+                    IORING_ENTER_GETEVENTS, NULL, 0) < 0)
+        {
+            if (EINTR == errno)
+                continue;
+            /* __ingest finishes the busy slots without the ring */
+            __ring_drain(r, slots);
+            break;
+        }
+        r->to_submit = 0;
+
+        head = *r->cq_head;
+        tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++)
+        {
+            struct io_uring_cqe* cqe = &r->cqes[head & *r->cq_mask];
+            __slot_t* sl;
+
+            r->inflight--;
+            if (CLOSE_TAG == cqe->user_data)
+                continue;
+
+            sl = &slots[cqe->user_data];
+            if (SLOT_OPEN == sl->state)
+            {
+                if (cqe->res < 0)
+                {
+                    w->run->items[sl->item].io_err = -cqe->res;
+                    sl->state = SLOT_IDLE;
+                }
+                else
+                {
+                    sl->fd = cqe->res;
+                    __ring_read(r, sl, cqe->user_data, w->run->buf_size);
+                }
+            }
+            else
+                __ring_parse(w, r, sl, cqe->res);
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+static void* __ingest(void* arg)
+{
+    __worker_t* w = arg;
+    unsigned int i, n = w->run->queue_depth;
+    struct iovec* iov = calloc(n, sizeof(struct iovec));
+    __slot_t* slots = calloc(n, sizeof(__slot_t));
+    char* bufs = malloc((unsigned long int)n * w->run->buf_size);
+    __ring_t r;
+
+    for (i = 0; i < n; i++)
+    {
+        slots[i].buf = bufs + (unsigned long int)i * w->run->buf_size;
+        iov[i].iov_base = slots[i].buf;
+        iov[i].iov_len = w->run->buf_size;
+    }
+
+    /* room for a read or open per slot, and a close per slot */
+    if (__ring_new(&r, n * 2, iov, n))
+    {
+        __ring_work(w, &r, slots);
+        /* before the buffers go, as reads may still be in flight */
+        __ring_free(&r);
+    }
+
+    /* the ring failed us partway through; these items were taken, so
+     * nobody else will parse them */
+    for (i = 0; i < n; i++)
+    {
+        if (SLOT_IDLE == slots[i].state)
+            continue;
+        if (SLOT_READ == slots[i].state)
+            close(slots[i].fd);
+        __parse(w, &w->run->items[slots[i].item]);
+    }
+
+    /* anything left over, eg. if there's no io_uring */
+    __work(w);
+
+    free(bufs);
+    free(slots);
+    free(iov);
+    return NULL;
+}
+
+#endif /* HAVE_IO_URING */
+
+static unsigned int __run(
+        __run_t* run,
+        unsigned int nitems,
+        unsigned int nthreads,
+        void* (*work)(void*))
+{
+    unsigned int i, nok = 0;
+
+    if (0 == nthreads)
+    {
+        long int n = sysconf(_SC_NPROCESSORS_ONLN);
+
+        nthreads = 0 < n ? n : 1;
+    }
+    if (nitems < nthreads)
+        nthreads = 0 < nitems ? nitems : 1;
+
+    run->nworkers = nthreads;
+    run->workers = calloc(nthreads, sizeof(__worker_t));
+
+    for (i = 0; i < nthreads; i++)
+    {
+        __worker_t* w = &run->workers[i];
+
+        w->run = run;
+        w->range = RANGE((uint64_t)nitems * i / nthreads,
+                (uint64_t)nitems * (i + 1) / nthreads);
+        w->ben = bencode_new(run->expected_depth, run->cb, NULL);
+    }
+
+    /* we're the first worker ourselves. If a thread can't be started,
+     * its items will be stolen */
+    for (i = 1; i < nthreads; i++)
+        run->workers[i].started = 0 == pthread_create(
+                &run->workers[i].thread, NULL, work, &run->workers[i]);
+    work(&run->workers[0]);
+
+    for (i = 0; i < nthreads; i++)
+    {
+        __worker_t* w = &run->workers[i];
+
+        if (w->started)
+            pthread_join(w->thread, NULL);
+        nok += w->nok;
+        bencode_free(w->ben);
+        free(w->buf);
+    }
+
+    free(run->workers);
+    return nok;
+}
+
+unsigned int bencode_batch_run(
+        bencode_batch_item_t* items,
+        unsigned int nitems,
+        bencode_callbacks_t* cb,
+        int expected_depth,
+        unsigned int nthreads)
+{
+    __run_t run;
+
+    memset(&run, 0, sizeof(run));
+    run.items = items;
+    run.cb = cb;
+    run.expected_depth = expected_depth;
+    return __run(&run, nitems, nthreads, __work);
+}
+
+unsigned int bencode_batch_ingest(
+        bencode_batch_item_t* items,
+        unsigned int nitems,
+        bencode_callbacks_t* cb,
+        int expected_depth,
+        unsigned int nthreads,
+        unsigned int queue_depth,
+        unsigned int buf_size)
+{
+    __run_t run;
+
+    memset(&run, 0, sizeof(run));
+    run.items = items;
+    run.cb = cb;
+    run.expected_depth = expected_depth;
+    run.queue_depth = 0 < queue_depth ? queue_depth : 32;
+    run.buf_size = 0 < buf_size ? buf_size : 1 << 16;
+#ifdef HAVE_IO_URING
+    return __run(&run, nitems, nthreads, __ingest);
+#else
+    return __run(&run, nitems, nthreads, __work);
+#endif
+}
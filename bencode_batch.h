@@ -0,0 +1,80 @@
+#ifndef BENCODE_BATCH_H
+#define BENCODE_BATCH_H
+
+/* a document to parse, and how it went */
+typedef struct {
+    /* file to read; NULL to parse buf instead */
+    const char* path;
+    const char* buf;
+    unsigned int len;
+
+    /* for the callbacks, eg. a struct for the fields they pick out */
+    void* udata;
+
+    /* errno if the file couldn't be read; otherwise 0 */
+    int io_err;
+
+    /* BENCODE_ERR_*; BENCODE_ERR_BAD_STATE if the document was cut short */
+    int err;
+
+    /* SHA-1 of the root dict's "info" value, as it appears in the document */
+    unsigned char info_hash[20];
+    int has_info_hash;
+} bencode_batch_item_t;
+
+/**
+ * Parse many documents across a pool of threads. Each thread keeps a
+ * parser and read buffer that it reuses for every document it takes on.
+ * Documents are shared out evenly up front; a thread that runs out
+ * steals half of what's left from another.
+ *
+ * The callbacks run on the worker threads, so must be thread safe. They
+ * get s->udata set to the item being parsed.
+ *
+ * @param items The documents; results are written into each
+ * @param nitems Number of items
+ * @param cb The callbacks to parse each document with
+ * @param expected_depth The expected depth of the bencode
+ * @param nthreads Number of threads; 0 for one per CPU
+ * @return number of items that were read and parsed without error
+ */
+unsigned int bencode_batch_run(
+        bencode_batch_item_t* items,
+        unsigned int nitems,
+        bencode_callbacks_t* cb,
+        int expected_depth,
+        unsigned int nthreads);
+
+/**
+ * As bencode_batch_run(), for when there are so many small files that
+ * waiting on the filesystem takes longer than parsing. Each thread keeps
+ * queue_depth files opening and being read through io_uring, into
+ * buffers registered with the kernel, and parses each one as soon as it
+ * arrives. Without io_uring, files are read with pread() as
+ * bencode_batch_run() does.
+ *
+ * @param queue_depth Files each thread has in flight; 0 for 32
+ * @param buf_size Size of each read buffer; 0 for 64KB. Files bigger than
+ *        this take a second read
+ * @return number of items that were read and parsed without error
+ */
+unsigned int bencode_batch_ingest(
+        bencode_batch_item_t* items,
+        unsigned int nitems,
+        bencode_callbacks_t* cb,
+        int expected_depth,
+        unsigned int nthreads,
+        unsigned int queue_depth,
+        unsigned int buf_size);
+
+/**
+ * @param buf The bytes to hash
+ * @param len Number of bytes
+ * @param out Where the 20 byte digest is written
+ */
+void bencode_sha1(
+        const void* buf,
+        unsigned long int len,
+        unsigned char out[20]);
+
+#endif /* BENCODE_BATCH_H */
@@ -0,0 +1,458 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Re-encode bencode into canonical form as it streams in
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bencode.h"
+#include "bencode_canon.h"
+
+/* a dict item we're holding until its dict ends */
+typedef struct {
+    /* offset of the item's encoding within the hold buffer, key first */
+    unsigned int off;
+
+    /* length of the item's encoding, key and value */
+    unsigned int len;
+
+    /* where the key's bytes are, and how many there are */
+    unsigned int koff;
+    unsigned int klen;
+
+    /* only set while sorting */
+    const char* key;
+} __item_t;
+
+/* what we know about the container at each depth */
+typedef struct {
+    /* index of the dict's first item; -1 if this is a list */
+    int first;
+
+    /* offset within the hold buffer where the dict's items start */
+    unsigned int start;
+
+    /* the dict's keys have all arrived in order, so it needs no sorting */
+    int sorted;
+} __open_t;
+
+struct bencode_canon_s {
+    bencode_t* ben;
+
+    /* caller's output buffer */
+    char* out;
+    unsigned int out_size;
+    unsigned int out_len;
+
+    bencode_canon_flush_f flush;
+    void* udata;
+
+    /* encodings of the dicts we're inside of */
+    char* hold;
+    unsigned int hold_len;
+    unsigned int hold_size;
+
+    /* items of the dicts we're inside of */
+    __item_t* items;
+    unsigned int nitems;
+    unsigned int items_size;
+
+    /* where a nested dict's items are put in order */
+    char* tmp;
+    unsigned int tmp_size;
+
+    __open_t* open;
+
+    /* number of dicts we're inside of */
+    unsigned int ndicts;
+
+    unsigned long int mem;
+    unsigned long int max_mem;
+
+    /* bytes of the current string we've written so far, in case it
+     * arrives in pieces */
+    unsigned int str_pos;
+
+    /* the flush callback failed, or we went over max_mem */
+    int failed;
+};
+
+static void __flush(bencode_canon_t* me)
+{
+    if (0 == me->out_len)
+        return;
+    if (!me->flush(me->udata, me->out, me->out_len))
+        me->failed = 1;
+    me->out_len = 0;
+}
+
+/**
+ * Grow one of our buffers, keeping within max_mem
+ * @return 0 if we'd go over max_mem; otherwise 1 */
+static int __grow(
+        bencode_canon_t* me,
+        void** ptr,
+        unsigned int* size,
+        unsigned int need,
+        unsigned int elem_size)
+{
+    unsigned int new_size;
+
+    if (need <= *size)
+        return 1;
+
+    new_size = need * 2;
+    if (me->max_mem &&
+        me->max_mem < me->mem + (new_size - *size) * elem_size)
+    {
+        new_size = need;
+        if (me->max_mem < me->mem + (new_size - *size) * elem_size)
+        {
+            me->failed = 1;
+            return 0;
+        }
+    }
+
+    me->mem += (new_size - *size) * elem_size;
+    *ptr = realloc(*ptr, new_size * elem_size);
+    *size = new_size;
+    return 1;
+}
+
+/**
+ * Write straight out, or hold the bytes if we're inside a dict */
+static void __put(bencode_canon_t* me, const char* s, unsigned int len)
+{
+    if (0 < me->ndicts)
+    {
+        if (!__grow(me, (void**)&me->hold, &me->hold_size,
+                    me->hold_len + len, 1))
+            return;
+        memcpy(me->hold + me->hold_len, s, len);
+        me->hold_len += len;
+        return;
+    }
+
+    while (0 < len)
+    {
+        unsigned int n = me->out_size - me->out_len;
+
+        if (0 == n)
+        {
+            __flush(me);
+            n = me->out_size;
+        }
+        if (len < n)
+            n = len;
+        memcpy(me->out + me->out_len, s, n);
+        me->out_len += n;
+        s += n;
+        len -= n;
+    }
+}
+
+static void __put_len(bencode_canon_t* me, unsigned int len)
+{
+    char tmp[16];
+    int i = sizeof(tmp);
+
+    tmp[--i] = ':';
+    do
+    {
+        tmp[--i] = '0' + len % 10;
+        len /= 10;
+    }
+    while (len);
+    __put(me, tmp + i, sizeof(tmp) - i);
+}
+
+static int __item_cmp(const void* a, const void* b)
+{
+    const __item_t* x = a;
+    const __item_t* y = b;
+    int r;
+
+    r = memcmp(x->key, y->key, x->klen < y->klen ? x->klen : y->klen);
+    if (0 != r)
+        return r;
+    return (x->klen > y->klen) - (x->klen < y->klen);
+}
+
+/**
+ * Start a dict item with its key, if the value is within a dict */
+static void __begin_value(bencode_canon_t* me, bencode_t* s)
+{
+    __open_t* o;
+    __item_t* it;
+    const char* key;
+    unsigned int klen;
+
+    if (0 == s->d || -1 == me->open[s->d - 1].first)
+        return;
+
+    if (!__grow(me, (void**)&me->items, &me->items_size,
+                me->nitems + 1, sizeof(__item_t)))
+        return;
+
+    key = bencode_path_key(s, s->d - 1, &klen);
+
+    /* keep track of whether the keys are arriving in order */
+    o = &me->open[s->d - 1];
+    if (o->sorted && (unsigned int)o->first < me->nitems)
+    {
+        __item_t* prev = &me->items[me->nitems - 1];
+        __item_t k = { .key = key, .klen = klen };
+        int r;
+
+        prev->key = me->hold + prev->koff;
+        r = __item_cmp(prev, &k);
+
+        /* there's no canonical order for a repeated key */
+        if (0 == r)
+        {
+            me->failed = 1;
+            return;
+        }
+        o->sorted = r < 0;
+    }
+
+    it = &me->items[me->nitems++];
+    it->off = me->hold_len;
+    __put_len(me, klen);
+    it->koff = me->hold_len;
+    it->klen = klen;
+    __put(me, key, klen);
+}
+
+static int __int(bencode_t *s __attribute__((__unused__)),
+        const char *dict_key __attribute__((__unused__)),
+        const long long int val __attribute__((__unused__)))
+{
+    /* written by __int_raw, which handles any size of integer */
+    return 1;
+}
+
+static int __int_raw(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)),
+        const char *digits,
+        unsigned int len)
+{
+    bencode_canon_t* me = s->udata;
+    int neg = '-' == *digits;
+
+    digits += neg;
+    len -= neg;
+    while (1 < len && '0' == *digits)
+    {
+        digits++;
+        len--;
+    }
+
+    __begin_value(me, s);
+    __put(me, "i", 1);
+    /* -0 is just 0 */
+    if (neg && '0' != *digits)
+        __put(me, "-", 1);
+    __put(me, digits, len);
+    __put(me, "e", 1);
+    return !me->failed;
+}
+
+static int __str(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)),
+        unsigned int v_total_len,
+        const unsigned char* val,
+        unsigned int v_len)
+{
+    bencode_canon_t* me = s->udata;
+
+    if (0 == me->str_pos)
+    {
+        __begin_value(me, s);
+        __put_len(me, v_total_len);
+    }
+
+    __put(me, (const char*)val, v_len);
+
+    me->str_pos += v_len;
+    if (v_total_len <= me->str_pos)
+        me->str_pos = 0;
+    return !me->failed;
+}
+
+static int __dict_enter(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)))
+{
+    bencode_canon_t* me = s->udata;
+
+    __begin_value(me, s);
+    __put(me, "d", 1);
+    me->ndicts++;
+    me->open[s->d].first = me->nitems;
+    me->open[s->d].start = me->hold_len;
+    me->open[s->d].sorted = 1;
+    return !me->failed;
+}
+
+/**
+ * Put a nested dict's items in order where they are in the hold buffer.
+ * Items that are already where they belong aren't moved
+ * @return 0 if we'd go over max_mem; otherwise 1 */
+static int __reorder(bencode_canon_t* me, __item_t* items, unsigned int n,
+        unsigned int pos)
+{
+    unsigned int i, tlen = 0;
+
+    for (i = 0; i < n && items[i].off == pos; i++)
+        pos += items[i].len;
+    if (i == n)
+        return 1;
+
+    if (!__grow(me, (void**)&me->tmp, &me->tmp_size, me->hold_len - pos, 1))
+        return 0;
+
+    for (; i < n; i++)
+    {
+        memcpy(me->tmp + tlen, me->hold + items[i].off, items[i].len);
+        tlen += items[i].len;
+    }
+    memcpy(me->hold + pos, me->tmp, tlen);
+    return 1;
+}
+
+static int __dict_leave(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)))
+{
+    bencode_canon_t* me = s->udata;
+    __open_t* o = &me->open[s->d];
+    __item_t* items = me->items + o->first;
+    unsigned int i, n = me->nitems - o->first;
+
+    if (me->failed)
+        return 0;
+
+    for (i = 0; i < n; i++)
+    {
+        items[i].len = (i + 1 < n ? items[i + 1].off : me->hold_len) -
+            items[i].off;
+        items[i].key = me->hold + items[i].koff;
+    }
+
+    if (!o->sorted)
+    {
+        qsort(items, n, sizeof(__item_t), __item_cmp);
+
+        /* there's no canonical order for a repeated key */
+        for (i = 1; i < n; i++)
+            if (0 == __item_cmp(&items[i - 1], &items[i]))
+            {
+                me->failed = 1;
+                return 0;
+            }
+    }
+
+    me->nitems = o->first;
+    me->ndicts--;
+
+    if (0 == me->ndicts)
+    {
+        /* the outermost dict's items go straight out, in order */
+        for (i = 0; i < n; i++)
+            __put(me, me->hold + items[i].off, items[i].len);
+        me->hold_len = o->start;
+    }
+    /* the dict we're within holds onto them */
+    else if (!o->sorted && !__reorder(me, items, n, o->start))
+        return 0;
+
+    __put(me, "e", 1);
+    return !me->failed;
+}
+
+static int __list_enter(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)))
+{
+    bencode_canon_t* me = s->udata;
+
+    __begin_value(me, s);
+    __put(me, "l", 1);
+    me->open[s->d].first = -1;
+    return !me->failed;
+}
+
+static int __list_leave(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)))
+{
+    bencode_canon_t* me = s->udata;
+
+    __put(me, "e", 1);
+    return !me->failed;
+}
+
+static bencode_callbacks_t __cb = {
+    .hit_int = __int,
+    .hit_str = __str,
+    .dict_enter = __dict_enter,
+    .dict_leave = __dict_leave,
+    .list_enter = __list_enter,
+    .list_leave = __list_leave,
+    .hit_int_raw = __int_raw,
+};
+
+bencode_canon_t* bencode_canon_new(
+        int expected_depth,
+        char* out,
+        unsigned int out_size,
+        bencode_canon_flush_f flush,
+        void* udata,
+        unsigned long int max_mem)
+{
+    bencode_canon_t* me;
+
+    if (0 == out_size)
+        return NULL;
+
+    me = calloc(1, sizeof(bencode_canon_t));
+    me->ben = bencode_new(expected_depth, &__cb, me);
+    me->open = calloc(10 + expected_depth, sizeof(__open_t));
+    me->out = out;
+    me->out_size = out_size;
+    me->flush = flush;
+    me->udata = udata;
+    me->max_mem = max_mem;
+    return me;
+}
+
+int bencode_canon_dispatch_from_buffer(
+        bencode_canon_t* me,
+        const char* buf,
+        unsigned int len)
+{
+    if (!bencode_dispatch_from_buffer(me->ben, buf, len))
+        return 0;
+    return !me->failed;
+}
+
+int bencode_canon_finish(bencode_canon_t* me)
+{
+    __flush(me);
+    return !me->failed;
+}
+
+void bencode_canon_free(bencode_canon_t* me)
+{
+    bencode_free(me->ben);
+    free(me->hold);
+    free(me->items);
+    free(me->tmp);
+    free(me->open);
+    free(me);
+}
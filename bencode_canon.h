@@ -0,0 +1,62 @@
+#ifndef BENCODE_CANON_H
+#define BENCODE_CANON_H
+
+typedef struct bencode_canon_s bencode_canon_t;
+
+/**
+ * Called when the output buffer is full, or when we've finished
+ * @param udata User data passed to bencode_canon_new()
+ * @param buf The canonical bencode we've written so far
+ * @param len The length of buf
+ * @return 0 on error; otherwise 1
+ */
+typedef int (*bencode_canon_flush_f)(
+        void* udata,
+        const char* buf,
+        unsigned int len);
+
+/**
+ * Re-encode bencode into canonical form: dict keys sorted, and integers
+ * and lengths without leading zeros or -0. Lists, strings and integers
+ * outside of any dict are written as they stream in; a dict is held until
+ * it ends, as a key that's out of order can belong before any of those
+ * that came ahead of it. Only a dict whose keys are out of order is
+ * sorted, and only its items from the first one out of place are copied.
+ *
+ * @param expected_depth The expected depth of the bencode
+ * @param out Buffer that we write into; reused after every flush
+ * @param out_size The size of the buffer
+ * @param flush Called to hand over the contents of the output buffer
+ * @param udata User data for flush
+ * @param max_mem Most heap we'll use holding dicts; 0 for no limit
+ * @return new re-encoder
+ */
+bencode_canon_t* bencode_canon_new(
+        int expected_depth,
+        char* out,
+        unsigned int out_size,
+        bencode_canon_flush_f flush,
+        void* udata,
+        unsigned long int max_mem);
+
+/**
+ * Re-encode the next chunk of bencode. Fails on malformed input, a dict
+ * with a repeated key, or going over max_mem.
+ * @param buf The buffer to read new input from
+ * @param len The size of the buffer
+ * @return 0 on error; otherwise 1
+ */
+int bencode_canon_dispatch_from_buffer(
+        bencode_canon_t*,
+        const char* buf,
+        unsigned int len);
+
+/**
+ * Flush whatever is still sitting in the output buffer
+ * @return 0 on error; otherwise 1
+ */
+int bencode_canon_finish(bencode_canon_t*);
+
+void bencode_canon_free(bencode_canon_t*);
+
+#endif /* BENCODE_CANON_H */
@@ -0,0 +1,216 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Unpack compact peer and node strings
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+/* the shuffle is built whatever -m flags we get, and picked at runtime if
+ * the CPU has SSSE3 */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_SSSE3 1
+#include <tmmintrin.h>
+#endif
+
+#include "bencode_compact.h"
+
+#ifdef HAVE_SSSE3
+/* the shuffle writes whole peers, padding included */
+typedef char __peer_is_8_bytes[sizeof(bencode_peer_t) == 8 ? 1 : -1];
+#endif
+
+/**
+ * Unpack n whole records into out */
+typedef void (*__unpack_f)(const unsigned char* in, unsigned int n, void* out);
+
+static uint16_t __port(const unsigned char* in)
+{
+    return (uint16_t)(in[0] << 8 | in[1]);
+}
+
+#ifdef HAVE_SSSE3
+/**
+ * Unpack peers two records per shuffle: copy each address, swap each port,
+ * and zero the padding
+ * @return number of records unpacked */
+__attribute__((target("ssse3")))
+static unsigned int __unpack_peers_ssse3(
+        const unsigned char* in,
+        unsigned int n,
+        bencode_peer_t* out)
+{
+    const __m128i shuf = _mm_setr_epi8(
+            0, 1, 2, 3, 5, 4, -1, -1,
+            6, 7, 8, 9, 11, 10, -1, -1);
+    unsigned int i;
+
+    /* each load reads 16 bytes to get 12, so leave the last record or two
+     * to the caller */
+    for (i = 0; i + 2 < n; i += 2)
+        _mm_storeu_si128((__m128i*)(out + i), _mm_shuffle_epi8(
+                    _mm_loadu_si128((const __m128i*)(in + i * 6)), shuf));
+    return i;
+}
+#endif
+
+static void __unpack_peers(const unsigned char* in, unsigned int n, void* o)
+{
+    bencode_peer_t* out = o;
+    unsigned int i = 0;
+
+#ifdef HAVE_SSSE3
+    if (__builtin_cpu_supports("ssse3"))
+        i = __unpack_peers_ssse3(in, n, out);
+#endif
+
+    for (in += i * 6; i < n; i++, in += 6)
+    {
+        memcpy(&out[i].addr, in, 4);
+        out[i].port = __port(in + 4);
+    }
+}
+
+static void __unpack_peers6(const unsigned char* in, unsigned int n, void* o)
+{
+    bencode_peer6_t* out = o;
+    unsigned int i;
+
+    for (i = 0; i < n; i++, in += 18)
+    {
+        memcpy(out[i].addr, in, 16);
+        out[i].port = __port(in + 16);
+    }
+}
+
+static void __unpack_nodes(const unsigned char* in, unsigned int n, void* o)
+{
+    bencode_node_t* out = o;
+    unsigned int i;
+
+    for (i = 0; i < n; i++, in += 26)
+    {
+        memcpy(out[i].id, in, 20);
+        memcpy(&out[i].addr, in + 20, 4);
+        out[i].port = __port(in + 24);
+    }
+}
+
+static void __unpack_nodes6(const unsigned char* in, unsigned int n, void* o)
+{
+    bencode_node6_t* out = o;
+    unsigned int i;
+
+    for (i = 0; i < n; i++, in += 38)
+    {
+        memcpy(out[i].id, in, 20);
+        memcpy(out[i].addr, in + 20, 16);
+        out[i].port = __port(in + 36);
+    }
+}
+
+/**
+ * Finish the record left over from the last piece, unpack all the whole
+ * records in this piece, and keep what's left for the next
+ * @param size Size of a record, which the decoder has to be set up for
+ * @param out_size Size of an unpacked record
+ * @return number of records unpacked */
+static unsigned int __unpack(
+        bencode_compact_t* me,
+        unsigned int size,
+        const unsigned char* buf,
+        unsigned int len,
+        void* out,
+        unsigned int out_size,
+        __unpack_f unpack)
+{
+    unsigned int n = 0, whole;
+
+    if (me->size != size)
+        return 0;
+
+    if (0 < me->carry_len)
+    {
+        unsigned int take = size - me->carry_len;
+
+        if (len < take)
+            take = len;
+        memcpy(me->carry + me->carry_len, buf, take);
+        me->carry_len += take;
+        buf += take;
+        len -= take;
+
+        if (me->carry_len < size)
+            return 0;
+        unpack(me->carry, 1, out);
+        me->carry_len = 0;
+        n = 1;
+    }
+
+    whole = len / size;
+    unpack(buf, whole, (char*)out + n * out_size);
+
+    me->carry_len = len - whole * size;
+    memcpy(me->carry, buf + whole * size, me->carry_len);
+    return n + whole;
+}
+
+void bencode_compact_init(bencode_compact_t* me, unsigned int kind)
+{
+    me->size = kind;
+    me->carry_len = 0;
+}
+
+unsigned int bencode_compact_count(
+        const bencode_compact_t* me,
+        unsigned int len)
+{
+    return (me->carry_len + len) / me->size;
+}
+
+unsigned int bencode_compact_peers(
+        bencode_compact_t* me,
+        const void* buf,
+        unsigned int len,
+        bencode_peer_t* out)
+{
+    return __unpack(me, BENCODE_COMPACT_PEERS, buf, len,
+            out, sizeof(*out), __unpack_peers);
+}
+
+unsigned int bencode_compact_peers6(
+        bencode_compact_t* me,
+        const void* buf,
+        unsigned int len,
+        bencode_peer6_t* out)
+{
+    return __unpack(me, BENCODE_COMPACT_PEERS6, buf, len,
+            out, sizeof(*out), __unpack_peers6);
+}
+
+unsigned int bencode_compact_nodes(
+        bencode_compact_t* me,
+        const void* buf,
+        unsigned int len,
+        bencode_node_t* out)
+{
+    return __unpack(me, BENCODE_COMPACT_NODES, buf, len,
+            out, sizeof(*out), __unpack_nodes);
+}
+
+unsigned int bencode_compact_nodes6(
+        bencode_compact_t* me,
+        const void* buf,
+        unsigned int len,
+        bencode_node6_t* out)
+{
+    return __unpack(me, BENCODE_COMPACT_NODES6, buf, len,
+            out, sizeof(*out), __unpack_nodes6);
+}
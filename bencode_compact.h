@@ -0,0 +1,103 @@
+#ifndef BENCODE_COMPACT_H
+#define BENCODE_COMPACT_H
+
+#include <stdint.h>
+
+/* compact formats, by the size of one of their records */
+enum {
+    /* tracker "peers" (BEP 23): IPv4 address, port */
+    BENCODE_COMPACT_PEERS = 6,
+    /* tracker and DHT "peers6" (BEP 7): IPv6 address, port */
+    BENCODE_COMPACT_PEERS6 = 18,
+    /* DHT "nodes" (BEP 5): node id, IPv4 address, port */
+    BENCODE_COMPACT_NODES = 26,
+    /* DHT "nodes6" (BEP 32): node id, IPv6 address, port */
+    BENCODE_COMPACT_NODES6 = 38
+};
+
+typedef struct {
+    /* network order, ready for struct in_addr */
+    uint32_t addr;
+    /* host order */
+    uint16_t port;
+} bencode_peer_t;
+
+typedef struct {
+    /* network order, ready for struct in6_addr */
+    uint8_t addr[16];
+    /* host order */
+    uint16_t port;
+} bencode_peer6_t;
+
+typedef struct {
+    uint8_t id[20];
+    uint32_t addr;
+    uint16_t port;
+} bencode_node_t;
+
+typedef struct {
+    uint8_t id[20];
+    uint8_t addr[16];
+    uint16_t port;
+} bencode_node6_t;
+
+/* unpacks a compact string, which can arrive in pieces */
+typedef struct {
+    /* BENCODE_COMPACT_* */
+    unsigned int size;
+
+    /* start of a record that was cut off at the end of the last piece */
+    unsigned char carry[BENCODE_COMPACT_NODES6];
+    unsigned int carry_len;
+} bencode_compact_t;
+
+/**
+ * Get ready to unpack a new string
+ * @param kind BENCODE_COMPACT_*
+ */
+void bencode_compact_init(bencode_compact_t*, unsigned int kind);
+
+/**
+ * @param len Length of the next piece
+ * @return most records the next piece can unpack into
+ */
+unsigned int bencode_compact_count(const bencode_compact_t*, unsigned int len);
+
+/**
+ * Unpack the next piece of a "peers" string, eg. from hit_str
+ * @param buf The piece
+ * @param len Length of the piece
+ * @param out Has room for bencode_compact_count() records
+ * @return number of records unpacked
+ */
+unsigned int bencode_compact_peers(
+        bencode_compact_t*,
+        const void* buf,
+        unsigned int len,
+        bencode_peer_t* out);
+
+/**
+ * As bencode_compact_peers(), for "peers6" */
+unsigned int bencode_compact_peers6(
+        bencode_compact_t*,
+        const void* buf,
+        unsigned int len,
+        bencode_peer6_t* out);
+
+/**
+ * As bencode_compact_peers(), for "nodes" */
+unsigned int bencode_compact_nodes(
+        bencode_compact_t*,
+        const void* buf,
+        unsigned int len,
+        bencode_node_t* out);
+
+/**
+ * As bencode_compact_peers(), for "nodes6" */
+unsigned int bencode_compact_nodes6(
+        bencode_compact_t*,
+        const void* buf,
+        unsigned int len,
+        bencode_node6_t* out);
+
+#endif /* BENCODE_COMPACT_H */
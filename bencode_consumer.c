@@ -0,0 +1,103 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Parse many torrent files, printing each one's info hash
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bencode.h"
+#include "bencode_batch.h"
+
+static int __int(bencode_t *s __attribute__((__unused__)),
+        const char *dict_key __attribute__((__unused__)),
+        const long long int val __attribute__((__unused__)))
+{
+    return 1;
+}
+
+static int __str(bencode_t *s __attribute__((__unused__)),
+        const char *dict_key __attribute__((__unused__)),
+        unsigned int v_total_len __attribute__((__unused__)),
+        const unsigned char* val __attribute__((__unused__)),
+        unsigned int v_len __attribute__((__unused__)))
+{
+    return 1;
+}
+
+static bencode_callbacks_t __cb = {
+    .hit_int = __int,
+    .hit_str = __str,
+};
+
+static void __usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s [-j threads] [-q queue depth] "
+            "[-b buffer size] file...\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    bencode_batch_item_t* items;
+    unsigned int nthreads = 0, queue_depth = 0, buf_size = 0;
+    unsigned int i, n, nok;
+    int c;
+
+    while (-1 != (c = getopt(argc, argv, "j:q:b:")))
+    {
+        switch (c)
+        {
+        case 'j': nthreads = atoi(optarg); break;
+        case 'q': queue_depth = atoi(optarg); break;
+        case 'b': buf_size = atoi(optarg); break;
+        default:
+            __usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (argc <= optind)
+    {
+        __usage(argv[0]);
+        return 1;
+    }
+
+    n = argc - optind;
+    items = calloc(n, sizeof(bencode_batch_item_t));
+    for (i = 0; i < n; i++)
+        items[i].path = argv[optind + i];
+
+    nok = bencode_batch_ingest(items, n, &__cb, 32, nthreads, queue_depth,
+            buf_size);
+
+    for (i = 0; i < n; i++)
+    {
+        bencode_batch_item_t* it = &items[i];
+        int j;
+
+        if (0 != it->io_err)
+            printf("%s: %s\n", it->path, strerror(it->io_err));
+        else if (BENCODE_ERR_NONE != it->err)
+            printf("%s: bencode error %d\n", it->path, it->err);
+        else if (!it->has_info_hash)
+            printf("%s: no info dict\n", it->path);
+        else
+        {
+            for (j = 0; j < 20; j++)
+                printf("%02x", it->info_hash[j]);
+            printf("  %s\n", it->path);
+        }
+    }
+
+    free(items);
+    return nok == n ? 0 : 1;
+}
@@ -0,0 +1,389 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Build an arena backed tree out of a document
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bencode.h"
+#include "bencode_dom.h"
+#include "bencode_intern.h"
+
+/* size of the arena's first block; each block after is twice the last */
+#define BLOCK_SIZE 4096
+
+typedef struct __block_s __block_t;
+
+struct __block_s {
+    __block_t* next;
+    unsigned long int size;
+    unsigned long int used;
+    char data[];
+};
+
+struct bencode_dom_s {
+    bencode_t* ben;
+
+    /* everything the tree points to; the newest block is first */
+    __block_t* arena;
+
+    /* nodes whose siblings haven't all arrived yet. A container comes
+     * before its children, which are moved into the arena as one array
+     * once the container ends */
+    bencode_node_t* scratch;
+    unsigned int nscratch;
+    unsigned int scratch_size;
+
+    /* scratch index of the container at each depth */
+    unsigned int* open;
+
+    const bencode_node_t* root;
+
+    /* where short keys and strings come from, instead of the arena */
+    bencode_intern_t* intern;
+
+    /* a callback failed */
+    int failed;
+
+    /* the string we're reading went into the arena through str_sink */
+    int sunk;
+};
+
+static void* __alloc(bencode_dom_t* me, unsigned long int len, int align)
+{
+    __block_t* b = me->arena;
+    unsigned long int used = 0;
+    void* p;
+
+    if (b)
+        used = align ? (b->used + 7) & ~7UL : b->used;
+
+    if (!b || b->size < used + len)
+    {
+        unsigned long int size = b ? b->size * 2 : BLOCK_SIZE;
+
+        if (size < len)
+            size = len;
+        b = malloc(sizeof(__block_t) + size);
+        b->next = me->arena;
+        b->size = size;
+        me->arena = b;
+        used = 0;
+    }
+
+    p = b->data + used;
+    b->used = used + len;
+    return p;
+}
+
+static int __key_cmp(const void* a, const void* b)
+{
+    const bencode_node_t* x = a;
+    const bencode_node_t* y = b;
+    int r;
+
+    r = memcmp(x->key, y->key, x->klen < y->klen ? x->klen : y->klen);
+    if (0 != r)
+        return r;
+    return (x->klen > y->klen) - (x->klen < y->klen);
+}
+
+/**
+ * Add the node for the value that's starting, along with its key if it's
+ * within a dict
+ * @return scratch index of the node */
+static unsigned int __add(bencode_dom_t* me, bencode_t* s, int type)
+{
+    bencode_node_t* n;
+
+    if (me->scratch_size == me->nscratch)
+    {
+        me->scratch_size *= 2;
+        me->scratch = realloc(me->scratch,
+                me->scratch_size * sizeof(bencode_node_t));
+    }
+
+    n = &me->scratch[me->nscratch];
+    memset(n, 0, sizeof(bencode_node_t));
+    n->type = type;
+
+    if (0 < s->d &&
+        BENCODE_TOK_DICT == me->scratch[me->open[s->d - 1]].type)
+    {
+        const char* key = bencode_path_key(s, s->d - 1, &n->klen);
+
+        if (me->intern)
+            n->key = bencode_intern(me->intern, key, n->klen, NULL);
+
+        if (!n->key)
+        {
+            char* k = __alloc(me, n->klen + 1, 0);
+
+            memcpy(k, key, n->klen);
+            k[n->klen] = '\0';
+            n->key = k;
+        }
+    }
+
+    return me->nscratch++;
+}
+
+/**
+ * The value at the current depth is finished. Once the root is finished,
+ * it's moved into the arena too */
+static void __done(bencode_dom_t* me, bencode_t* s)
+{
+    bencode_node_t* root;
+
+    if (0 < s->d)
+        return;
+
+    root = __alloc(me, sizeof(bencode_node_t), 1);
+    *root = me->scratch[0];
+    me->root = root;
+    me->nscratch = 0;
+}
+
+/**
+ * A document is all we take */
+static int __ok(bencode_dom_t* me)
+{
+    if (me->root)
+        me->failed = 1;
+    return !me->failed;
+}
+
+static int __int(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)),
+        const long long int val)
+{
+    bencode_dom_t* me = s->udata;
+    unsigned int i;
+
+    if (!__ok(me))
+        return 0;
+    i = __add(me, s, BENCODE_TOK_INT);
+    me->scratch[i].intval = val;
+    __done(me, s);
+    return 1;
+}
+
+static unsigned char* __sink(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)),
+        unsigned int v_total_len)
+{
+    bencode_dom_t* me = s->udata;
+    bencode_node_t* n;
+    unsigned int i;
+    char* val;
+
+    if (!__ok(me))
+        return NULL;
+
+    /* we'll intern it once the parser has it all */
+    if (me->intern && v_total_len <= bencode_intern_max_len(me->intern))
+        return NULL;
+
+    /* __add can move the scratch nodes */
+    i = __add(me, s, BENCODE_TOK_STR);
+    n = &me->scratch[i];
+    val = __alloc(me, v_total_len + 1, 0);
+    val[v_total_len] = '\0';
+    n->strval = val;
+    n->len = v_total_len;
+    me->sunk = 1;
+    return (unsigned char*)val;
+}
+
+static int __str(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)),
+        unsigned int v_total_len,
+        const unsigned char* val,
+        unsigned int v_len)
+{
+    bencode_dom_t* me = s->udata;
+    unsigned int i;
+
+    /* only empty and interned strings aren't sunk */
+    if (!me->sunk)
+    {
+        if (!__ok(me))
+            return 0;
+        i = __add(me, s, BENCODE_TOK_STR);
+        me->scratch[i].strval = me->intern ?
+            bencode_intern(me->intern, (const char*)val, v_len, NULL) : "";
+        me->scratch[i].len = v_total_len;
+    }
+
+    me->sunk = 0;
+    __done(me, s);
+    return 1;
+}
+
+static int __enter(bencode_t *s, int type)
+{
+    bencode_dom_t* me = s->udata;
+
+    if (!__ok(me))
+        return 0;
+    me->open[s->d] = __add(me, s, type);
+    return 1;
+}
+
+static int __leave(bencode_t *s)
+{
+    bencode_dom_t* me = s->udata;
+    unsigned int i = me->open[s->d];
+    bencode_node_t* n = &me->scratch[i];
+    unsigned int nchild = me->nscratch - i - 1;
+
+    if (0 < nchild)
+    {
+        bencode_node_t* child =
+            __alloc(me, nchild * sizeof(bencode_node_t), 1);
+        unsigned int j;
+
+        memcpy(child, n + 1, nchild * sizeof(bencode_node_t));
+
+        /* canonical documents are already sorted */
+        if (BENCODE_TOK_DICT == n->type)
+            for (j = 1; j < nchild; j++)
+                if (0 < __key_cmp(&child[j - 1], &child[j]))
+                {
+                    qsort(child, nchild, sizeof(bencode_node_t), __key_cmp);
+                    break;
+                }
+
+        n->child = child;
+        n->len = nchild;
+    }
+
+    me->nscratch = i + 1;
+    __done(me, s);
+    return 1;
+}
+
+static int __dict_enter(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)))
+{
+    return __enter(s, BENCODE_TOK_DICT);
+}
+
+static int __dict_leave(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)))
+{
+    return __leave(s);
+}
+
+static int __list_enter(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)))
+{
+    return __enter(s, BENCODE_TOK_LIST);
+}
+
+static int __list_leave(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)))
+{
+    return __leave(s);
+}
+
+static bencode_callbacks_t __cb = {
+    .hit_int = __int,
+    .hit_str = __str,
+    .dict_enter = __dict_enter,
+    .dict_leave = __dict_leave,
+    .list_enter = __list_enter,
+    .list_leave = __list_leave,
+    .str_sink = __sink,
+};
+
+bencode_dom_t* bencode_dom_new(int expected_depth)
+{
+    bencode_dom_t* me;
+
+    me = calloc(1, sizeof(bencode_dom_t));
+    me->ben = bencode_new(expected_depth, &__cb, me);
+    me->open = calloc(10 + expected_depth, sizeof(unsigned int));
+    me->scratch_size = 64;
+    me->scratch = malloc(me->scratch_size * sizeof(bencode_node_t));
+    return me;
+}
+
+void bencode_dom_set_intern(
+        bencode_dom_t* me,
+        bencode_intern_t* intern)
+{
+    me->intern = intern;
+}
+
+int bencode_dom_dispatch_from_buffer(
+        bencode_dom_t* me,
+        const char* buf,
+        unsigned int len)
+{
+    if (!bencode_dispatch_from_buffer(me->ben, buf, len))
+        return 0;
+    return !me->failed;
+}
+
+const bencode_node_t* bencode_dom_root(bencode_dom_t* me)
+{
+    return me->root;
+}
+
+int bencode_dom_error(bencode_dom_t* me)
+{
+    return bencode_error(me->ben);
+}
+
+const bencode_node_t* bencode_dom_get(
+        const bencode_node_t* dict,
+        const char* key,
+        unsigned int klen)
+{
+    bencode_node_t k;
+    unsigned int lo = 0, hi;
+
+    if (BENCODE_TOK_DICT != dict->type)
+        return NULL;
+
+    k.key = key;
+    k.klen = klen;
+    hi = dict->len;
+    while (lo < hi)
+    {
+        unsigned int mid = lo + (hi - lo) / 2;
+        int r = __key_cmp(&k, &dict->child[mid]);
+
+        if (0 == r)
+            return &dict->child[mid];
+        if (r < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return NULL;
+}
+
+void bencode_dom_free(bencode_dom_t* me)
+{
+    while (me->arena)
+    {
+        __block_t* b = me->arena;
+
+        me->arena = b->next;
+        free(b);
+    }
+    bencode_free(me->ben);
+    free(me->scratch);
+    free(me->open);
+    free(me);
+}
@@ -0,0 +1,92 @@
+#ifndef BENCODE_DOM_H
+#define BENCODE_DOM_H
+
+#include "bencode_intern.h"
+
+typedef struct bencode_node_s bencode_node_t;
+
+struct bencode_node_s {
+    /* BENCODE_TOK_INT, _STR, _LIST or _DICT */
+    int type;
+
+    /* bytes in the string, or number of children of a list or dict */
+    unsigned int len;
+
+    /* this node's dict key, '\0' terminated; NULL within a list or at
+     * the root */
+    const char* key;
+    unsigned int klen;
+
+    long long int intval;
+
+    /* '\0' terminated */
+    const char* strval;
+
+    /* a list's elements in order, or a dict's items sorted by key */
+    const bencode_node_t* child;
+};
+
+typedef struct bencode_dom_s bencode_dom_t;
+
+/**
+ * Build a tree out of a document as it streams in. Nodes and strings are
+ * carved out of an arena owned by the DOM, so the tree lives until
+ * bencode_dom_free() and is freed all at once.
+ *
+ * @param expected_depth The expected depth of the bencode
+ * @return new DOM builder
+ */
+bencode_dom_t* bencode_dom_new(int expected_depth);
+
+/**
+ * Take keys and strings no longer than the table's max_len from the
+ * table, so that they're shared with other trees and can be compared by
+ * pointer. Must be set before the first byte is dispatched. The table
+ * must outlive the tree.
+ * @param intern The table; NULL to keep every string in the arena
+ */
+void bencode_dom_set_intern(
+        bencode_dom_t*,
+        bencode_intern_t* intern);
+
+/**
+ * Read the next chunk of the document. Fails on malformed input, or on
+ * anything after the document has ended.
+ * @param buf The buffer to read new input from
+ * @param len The size of the buffer
+ * @return 0 on error; otherwise 1
+ */
+int bencode_dom_dispatch_from_buffer(
+        bencode_dom_t*,
+        const char* buf,
+        unsigned int len);
+
+/**
+ * @return the document's root; NULL until the whole document is read
+ */
+const bencode_node_t* bencode_dom_root(bencode_dom_t*);
+
+/**
+ * @return why dispatching failed, BENCODE_ERR_*
+ */
+int bencode_dom_error(bencode_dom_t*);
+
+/**
+ * Find a dict's item by binary search. If the key is repeated, any one of
+ * its items may be returned.
+ * @param dict The dict to look in
+ * @param key The key to look for
+ * @param klen Length of the key
+ * @return the item; NULL if it isn't there, or dict isn't a dict
+ */
+const bencode_node_t* bencode_dom_get(
+        const bencode_node_t* dict,
+        const char* key,
+        unsigned int klen);
+
+/**
+ * Free the builder, along with every node of its tree
+ */
+void bencode_dom_free(bencode_dom_t*);
+
+#endif /* BENCODE_DOM_H */
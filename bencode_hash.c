@@ -0,0 +1,602 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Hash and compare values by their structure
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "bencode.h"
+#include "bencode_hash.h"
+
+/* deepest we'll go comparing values */
+#define EQUAL_MAX_DEPTH 64
+
+#define P1 0x9e3779b185ebca87ULL
+#define P2 0xc2b2ae3d27d4eb4fULL
+
+/* a hash in progress; bytes are mixed in 8 at a time */
+typedef struct {
+    uint64_t a, b;
+
+    /* bytes that don't make up a whole word yet */
+    uint64_t w;
+    unsigned int nw;
+
+    uint64_t len;
+} __state_t;
+
+/* the value being hashed at each depth */
+typedef struct {
+    __state_t st;
+
+    /* BENCODE_TOK_* */
+    int type;
+
+    /* sum of the item hashes of a dict with BENCODE_HASH_SORT_KEYS, so
+     * that their order doesn't matter */
+    uint64_t sa, sb;
+
+    /* items in a list or dict; bytes of a string we've seen so far */
+    uint64_t n;
+} __frame_t;
+
+struct bencode_hash_s {
+    bencode_t* ben;
+    bencode_selector_t* sel;
+    int flags;
+
+    bencode_hash_f cb;
+    void* udata;
+
+    __frame_t* frames;
+};
+
+/* where we're up to within a value being compared */
+typedef struct {
+    const char* p;
+    const char* end;
+} __cur_t;
+
+static uint64_t __rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t __fmix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static void __init(__state_t* st, char tag)
+{
+    st->a = 0x243f6a8885a308d3ULL;
+    st->b = 0x13198a2e03707344ULL;
+    st->w = (unsigned char)tag;
+    st->nw = 1;
+    st->len = 1;
+}
+
+static void __mix(__state_t* st, uint64_t w)
+{
+    st->a = __rotl((st->a ^ w) * P1, 31) * P2;
+    st->b = __rotl((st->b + w) * P2, 27) * P1 + st->a;
+}
+
+static void __feed(__state_t* st, const void* buf, unsigned long int len)
+{
+    const unsigned char* p = buf;
+
+    st->len += len;
+    while (0 < len)
+    {
+        /* a whole word at a time where we can; read little endian so the
+         * hash is the same everywhere */
+        if (0 == st->nw && 8 <= len)
+        {
+            uint64_t w = 0;
+            int i;
+
+            for (i = 7; 0 <= i; i--)
+                w = (w << 8) | p[i];
+            __mix(st, w);
+            p += 8;
+            len -= 8;
+            continue;
+        }
+
+        st->w |= (uint64_t)*p++ << (8 * st->nw);
+        len--;
+        if (8 == ++st->nw)
+        {
+            __mix(st, st->w);
+            st->w = 0;
+            st->nw = 0;
+        }
+    }
+}
+
+static void __feed_u64(__state_t* st, uint64_t v)
+{
+    unsigned char b[8];
+    int i;
+
+    for (i = 0; i < 8; i++)
+        b[i] = v >> (8 * i);
+    __feed(st, b, 8);
+}
+
+static void __final(__state_t* st, unsigned char out[16])
+{
+    uint64_t a, b;
+    int i;
+
+    __mix(st, st->w);
+    __mix(st, st->len);
+    a = __fmix(st->a);
+    b = __fmix(st->b);
+    a += b;
+    b += a;
+
+    for (i = 0; i < 8; i++)
+    {
+        out[i] = a >> (8 * i);
+        out[8 + i] = b >> (8 * i);
+    }
+}
+
+static uint64_t __u64(const unsigned char* p)
+{
+    uint64_t v = 0;
+    int i;
+
+    for (i = 7; 0 <= i; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+/**
+ * Drop the sign and leading zeros from an integer's digits
+ * @return 0 if they aren't an integer; otherwise 1 */
+static int __digits(
+        const char* p,
+        unsigned int len,
+        int* neg,
+        const char** digits,
+        unsigned int* dlen)
+{
+    unsigned int i;
+
+    *neg = 0 < len && '-' == *p;
+    if (*neg)
+    {
+        p++;
+        len--;
+    }
+
+    if (0 == len)
+        return 0;
+    for (i = 0; i < len; i++)
+        if (p[i] < '0' || '9' < p[i])
+            return 0;
+
+    while (0 < len && '0' == *p)
+    {
+        p++;
+        len--;
+    }
+
+    /* -0 */
+    if (0 == len)
+        *neg = 0;
+    *digits = p;
+    *dlen = len;
+    return 1;
+}
+
+/**
+ * The value at the current depth is finished. Hand its hash to its
+ * container, or to the user if it's a value they chose */
+static int __done(bencode_hash_t* me, bencode_t* s)
+{
+    __frame_t* f = &me->frames[s->d];
+    unsigned char h[16];
+
+    if (BENCODE_TOK_DICT == f->type && (me->flags & BENCODE_HASH_SORT_KEYS))
+    {
+        __feed_u64(&f->st, f->sa);
+        __feed_u64(&f->st, f->sb);
+    }
+    __feed_u64(&f->st, f->n);
+    __final(&f->st, h);
+
+    if (0 < s->d && BENCODE_SEL_DELIVER == s->stk[s->d - 1].sel_mode)
+    {
+        __frame_t* parent = &me->frames[s->d - 1];
+        unsigned int klen = 0;
+        const char* key = NULL;
+
+        if (BENCODE_TOK_DICT == parent->type)
+            key = bencode_path_key(s, s->d - 1, &klen);
+
+        if (key && (me->flags & BENCODE_HASH_SORT_KEYS))
+        {
+            __state_t item;
+            unsigned char ih[16];
+
+            __init(&item, 'k');
+            __feed_u64(&item, klen);
+            __feed(&item, key, klen);
+            __feed(&item, h, 16);
+            __final(&item, ih);
+            parent->sa += __u64(ih);
+            parent->sb += __u64(ih + 8);
+        }
+        else
+        {
+            if (key)
+            {
+                __feed_u64(&parent->st, klen);
+                __feed(&parent->st, key, klen);
+            }
+            __feed(&parent->st, h, 16);
+        }
+        parent->n++;
+        return 1;
+    }
+
+    return me->cb(me->udata, bencode_path(s), h);
+}
+
+static int __value_start(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)),
+        int type)
+{
+    bencode_hash_t* me = s->udata;
+    __frame_t* f = &me->frames[s->d];
+
+    switch (type)
+    {
+    case BENCODE_TOK_INT: __init(&f->st, 'i'); break;
+    case BENCODE_TOK_STR: __init(&f->st, 's'); break;
+    case BENCODE_TOK_LIST: __init(&f->st, 'l'); break;
+    case BENCODE_TOK_DICT: __init(&f->st, 'd'); break;
+    }
+    f->type = type;
+    f->sa = f->sb = 0;
+    f->n = 0;
+    return 1;
+}
+
+static int __int_raw(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)),
+        const char *digits,
+        unsigned int len)
+{
+    bencode_hash_t* me = s->udata;
+    __frame_t* f = &me->frames[s->d];
+    const char* d;
+    unsigned int dlen;
+    int neg;
+
+    if (!__digits(digits, len, &neg, &d, &dlen))
+        return 0;
+    __feed(&f->st, neg ? "-" : "+", 1);
+    __feed(&f->st, d, dlen);
+    f->n = dlen;
+    return __done(me, s);
+}
+
+/* hashed by __int_raw, which sees every integer first */
+static int __int(bencode_t *s __attribute__((__unused__)),
+        const char *dict_key __attribute__((__unused__)),
+        const long long int val __attribute__((__unused__)))
+{
+    return 1;
+}
+
+static int __str(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)),
+        unsigned int v_total_len,
+        const unsigned char* val,
+        unsigned int v_len)
+{
+    bencode_hash_t* me = s->udata;
+    __frame_t* f = &me->frames[s->d];
+
+    __feed(&f->st, val, v_len);
+    f->n += v_len;
+    if (f->n < v_total_len)
+        return 1;
+    return __done(me, s);
+}
+
+static int __leave(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)))
+{
+    return __done(s->udata, s);
+}
+
+static bencode_callbacks_t __cb = {
+    .hit_int = __int,
+    .hit_str = __str,
+    .dict_leave = __leave,
+    .list_leave = __leave,
+    .hit_int_raw = __int_raw,
+    .value_start = __value_start,
+};
+
+bencode_hash_t* bencode_hash_new(
+        int expected_depth,
+        const char** paths,
+        unsigned int npaths,
+        int flags,
+        bencode_hash_f cb,
+        void* udata)
+{
+    bencode_hash_t* me;
+
+    me = calloc(1, sizeof(bencode_hash_t));
+    if (paths && !(me->sel = bencode_selector_new(paths, npaths)))
+    {
+        free(me);
+        return NULL;
+    }
+
+    me->ben = bencode_new(expected_depth, &__cb, me);
+    bencode_set_selector(me->ben, me->sel);
+    me->flags = flags;
+    me->cb = cb;
+    me->udata = udata;
+    me->frames = calloc(10 + expected_depth, sizeof(__frame_t));
+    return me;
+}
+
+int bencode_hash_dispatch_from_buffer(
+        bencode_hash_t* me,
+        const char* buf,
+        unsigned int len)
+{
+    return bencode_dispatch_from_buffer(me->ben, buf, len);
+}
+
+int bencode_hash_error(bencode_hash_t* me)
+{
+    return bencode_error(me->ben);
+}
+
+void bencode_hash_free(bencode_hash_t* me)
+{
+    bencode_free(me->ben);
+    if (me->sel)
+        bencode_selector_free(me->sel);
+    free(me->frames);
+    free(me);
+}
+
+static int __cur_str(__cur_t* c, const char** val, unsigned int* len)
+{
+    unsigned long int n = 0;
+    unsigned int ndigits = 0;
+
+    while (c->p < c->end && '0' <= *c->p && *c->p <= '9')
+    {
+        /* longer than anything we could be given */
+        if (10 < ++ndigits)
+            return 0;
+        n = n * 10 + (*c->p++ - '0');
+    }
+
+    if (0 == ndigits || c->end <= c->p || ':' != *c->p++ ||
+        (unsigned long int)(c->end - c->p) < n)
+        return 0;
+
+    *val = c->p;
+    *len = n;
+    c->p += n;
+    return 1;
+}
+
+static int __cur_int(__cur_t* c, int* neg, const char** d, unsigned int* dlen)
+{
+    const char* e;
+
+    if (c->end <= c->p || 'i' != *c->p)
+        return 0;
+    c->p++;
+
+    if (!(e = memchr(c->p, 'e', c->end - c->p)) ||
+        !__digits(c->p, e - c->p, neg, d, dlen))
+        return 0;
+    c->p = e + 1;
+    return 1;
+}
+
+/**
+ * Step over a value, checking it's well formed */
+static int __skip(__cur_t* c, int depth)
+{
+    const char* s;
+    unsigned int len;
+    int neg;
+
+    if (c->end <= c->p || EQUAL_MAX_DEPTH < depth)
+        return 0;
+
+    switch (*c->p)
+    {
+    case 'i':
+        return __cur_int(c, &neg, &s, &len);
+    case 'l':
+    case 'd':
+        {
+            int dict = 'd' == *c->p++;
+
+            while (c->p < c->end && 'e' != *c->p)
+                if ((dict && !__cur_str(c, &s, &len)) ||
+                    !__skip(c, depth + 1))
+                    return 0;
+            if (c->end <= c->p)
+                return 0;
+            c->p++;
+            return 1;
+        }
+    default:
+        return __cur_str(c, &s, &len);
+    }
+}
+
+static int __same(const char* a, unsigned int alen,
+        const char* b, unsigned int blen)
+{
+    return alen == blen && 0 == memcmp(a, b, alen);
+}
+
+static int __eq(__cur_t* a, __cur_t* b, int flags, int depth);
+
+/**
+ * Compare dicts whose keys might be in different orders. Each of a's items
+ * is looked for where it'd be if the orders matched, and then throughout
+ * b */
+static int __eq_unordered(__cur_t* a, __cur_t* b, int flags, int depth)
+{
+    const char* bstart;
+    __cur_t next, q;
+    unsigned int na = 0, nb = 0;
+
+    a->p++;
+    b->p++;
+    bstart = b->p;
+    next = *b;
+
+    while (a->p < a->end && 'e' != *a->p)
+    {
+        const char* ka, *kb;
+        unsigned int kalen, kblen;
+        int found = 0;
+
+        if (!__cur_str(a, &ka, &kalen))
+            return 0;
+
+        q = next;
+        if (q.p < q.end && 'e' != *q.p && __cur_str(&q, &kb, &kblen) &&
+            __same(ka, kalen, kb, kblen))
+            found = 1;
+
+        for (q.p = bstart; !found && q.p < q.end && 'e' != *q.p; )
+        {
+            if (!__cur_str(&q, &kb, &kblen))
+                return 0;
+            if (__same(ka, kalen, kb, kblen))
+                found = 1;
+            else if (!__skip(&q, depth + 1))
+                return 0;
+        }
+
+        if (!found || !__eq(a, &q, flags, depth + 1))
+            return 0;
+        next = q;
+        na++;
+    }
+
+    if (a->end <= a->p)
+        return 0;
+    a->p++;
+
+    /* b mustn't have anything a doesn't */
+    for (q = *b; q.p < q.end && 'e' != *q.p; nb++)
+    {
+        const char* k;
+        unsigned int klen;
+
+        if (!__cur_str(&q, &k, &klen) || !__skip(&q, depth + 1))
+            return 0;
+    }
+    if (q.end <= q.p)
+        return 0;
+    b->p = q.p + 1;
+    return na == nb;
+}
+
+static int __eq(__cur_t* a, __cur_t* b, int flags, int depth)
+{
+    const char* x, *y;
+    unsigned int xlen, ylen;
+
+    if (a->end <= a->p || b->end <= b->p || EQUAL_MAX_DEPTH < depth)
+        return 0;
+
+    switch (*a->p)
+    {
+    case 'i':
+        {
+            int xneg, yneg;
+
+            return __cur_int(a, &xneg, &x, &xlen) &&
+                __cur_int(b, &yneg, &y, &ylen) &&
+                xneg == yneg && __same(x, xlen, y, ylen);
+        }
+    case 'd':
+        if ('d' == *b->p && (flags & BENCODE_HASH_SORT_KEYS))
+            return __eq_unordered(a, b, flags, depth);
+        /* fall through */
+    case 'l':
+        {
+            int dict = 'd' == *a->p;
+
+            if (*a->p != *b->p)
+                return 0;
+            a->p++;
+            b->p++;
+
+            while (a->p < a->end && b->p < b->end)
+            {
+                if ('e' == *a->p || 'e' == *b->p)
+                {
+                    if (*a->p != *b->p)
+                        return 0;
+                    a->p++;
+                    b->p++;
+                    return 1;
+                }
+
+                if (dict && (!__cur_str(a, &x, &xlen) ||
+                        !__cur_str(b, &y, &ylen) ||
+                        !__same(x, xlen, y, ylen)))
+                    return 0;
+
+                if (!__eq(a, b, flags, depth + 1))
+                    return 0;
+            }
+            return 0;
+        }
+    default:
+        return __cur_str(a, &x, &xlen) && __cur_str(b, &y, &ylen) &&
+            __same(x, xlen, y, ylen);
+    }
+}
+
+int bencode_equal(
+        const char* a,
+        unsigned int alen,
+        const char* b,
+        unsigned int blen,
+        int flags)
+{
+    __cur_t x = { a, a + alen }, y = { b, b + blen };
+
+    return __eq(&x, &y, flags, 0) && x.p == x.end && y.p == y.end;
+}
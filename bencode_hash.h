@@ -0,0 +1,83 @@
+#ifndef BENCODE_HASH_H
+#define BENCODE_HASH_H
+
+/* dicts hash the same whatever order their keys are in, as if sorted */
+#define BENCODE_HASH_SORT_KEYS 1
+
+typedef struct bencode_hash_s bencode_hash_t;
+
+/**
+ * Called when a chosen value has been hashed
+ * @param udata User data passed to bencode_hash_new()
+ * @param path The value's path, see bencode_path()
+ * @param hash The value's 128 bit hash. The first 8 bytes make a 64 bit
+ *        hash of their own
+ * @return 0 on error; otherwise 1
+ */
+typedef int (*bencode_hash_f)(
+        void* udata,
+        const char* path,
+        const unsigned char hash[16]);
+
+/**
+ * Hash values by their structure as they stream in, without keeping them.
+ * The hash is stable across runs and machines, and doesn't depend on how
+ * the document is split into buffers. Lists are hashed in order; dicts
+ * are too, unless BENCODE_HASH_SORT_KEYS is set. Integers are compared by
+ * value, so "i007e" hashes the same as "i7e".
+ *
+ * @param expected_depth The expected depth of the bencode
+ * @param paths Selectors for the values to hash, see
+ *        bencode_selector_new(); NULL to hash the whole document
+ * @param npaths Number of selectors
+ * @param flags BENCODE_HASH_*
+ * @param cb Called with each hash
+ * @param udata User data for cb
+ * @return new hasher; NULL if a selector is invalid
+ */
+bencode_hash_t* bencode_hash_new(
+        int expected_depth,
+        const char** paths,
+        unsigned int npaths,
+        int flags,
+        bencode_hash_f cb,
+        void* udata);
+
+/**
+ * Hash the next chunk of the document
+ * @param buf The buffer to read new input from
+ * @param len The size of the buffer
+ * @return 0 on error; otherwise 1
+ */
+int bencode_hash_dispatch_from_buffer(
+        bencode_hash_t*,
+        const char* buf,
+        unsigned int len);
+
+/**
+ * @return why dispatching failed, BENCODE_ERR_*
+ */
+int bencode_hash_error(bencode_hash_t*);
+
+void bencode_hash_free(bencode_hash_t*);
+
+/**
+ * Compare two encoded values by walking both in step, without
+ * allocating. Equal values hash the same with the same flags. Dicts with
+ * repeated keys aren't compared reliably.
+ *
+ * @param a The first value
+ * @param alen The length of a
+ * @param b The second value
+ * @param blen The length of b
+ * @param flags BENCODE_HASH_SORT_KEYS to ignore the order of dict keys
+ * @return 1 if both are well formed and equal; otherwise 0
+ */
+int bencode_equal(
+        const char* a,
+        unsigned int alen,
+        const char* b,
+        unsigned int blen,
+        int flags);
+
+#endif /* BENCODE_HASH_H */
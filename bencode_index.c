@@ -0,0 +1,601 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Persistent index of where every value sits within a document
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bencode.h"
+#include "bencode_index.h"
+
+struct bencode_index_s {
+    bencode_index_header_t* hdr;
+    bencode_index_entry_t* e;
+
+    /* number of entries we have room for while building */
+    unsigned int size;
+
+    /* entries of the containers we're inside while building */
+    unsigned int* open;
+
+    /* length of the mapping; 0 if we were built on the heap */
+    size_t map_len;
+};
+
+/* a key within a hashed dict */
+typedef struct {
+    /* top half of the key's hash, to skip most keys without comparing */
+    uint32_t hash;
+
+    /* entry of the key; 0 if the slot is empty, as entry 0 is never a key */
+    uint32_t key;
+
+    /* the rebuild that last found this key in the dict */
+    uint32_t gen;
+} __slot_t;
+
+struct bencode_index_keys_s {
+    bencode_index_t* idx;
+
+    /* a power of two, at least twice the number of keys */
+    __slot_t* slots;
+    unsigned int size;
+
+    /* slots in use */
+    unsigned int nkeys;
+
+    /* bumped by every rebuild */
+    uint32_t gen;
+};
+
+uint64_t bencode_index_hash(
+        const char* src,
+        unsigned int len)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    while (0 < len--)
+    {
+        h ^= (unsigned char)*src++;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static bencode_index_entry_t* __add(
+        bencode_index_t* me,
+        uint32_t type,
+        uint64_t off)
+{
+    bencode_index_entry_t* e;
+
+    if (me->size == me->hdr->nentries)
+    {
+        me->size *= 2;
+        me->e = realloc(me->e, me->size * sizeof(bencode_index_entry_t));
+    }
+
+    e = &me->e[me->hdr->nentries++];
+    e->type = type;
+    e->skip = 1;
+    e->off = off;
+    e->len = 0;
+    return e;
+}
+
+/**
+ * Add entries for the dict key (if any) and the value that's starting */
+static bencode_index_entry_t* __begin(
+        bencode_t *s,
+        const char *dict_key,
+        uint32_t type)
+{
+    bencode_index_t* me = s->udata;
+    unsigned long int start = bencode_value_offset(s);
+
+    if (dict_key)
+    {
+        bencode_index_entry_t* k;
+
+        k = __add(me, BENCODE_TOK_DICT_KEY, bencode_key_offset(s));
+        k->len = start - k->off;
+    }
+
+    return __add(me, type, start);
+}
+
+static int __int(bencode_t *s,
+        const char *dict_key,
+        const long long int val __attribute__((__unused__)))
+{
+    bencode_index_entry_t* e = __begin(s, dict_key, BENCODE_TOK_INT);
+
+    e->len = bencode_offset(s) + 1 - e->off;
+    return 1;
+}
+
+static int __str(bencode_t *s,
+        const char *dict_key,
+        unsigned int v_total_len __attribute__((__unused__)),
+        const unsigned char* val __attribute__((__unused__)),
+        unsigned int v_len __attribute__((__unused__)))
+{
+    bencode_index_t* me = s->udata;
+    bencode_index_entry_t* e;
+
+    /* strings can arrive in pieces; only the first piece adds an entry */
+    if (0 == me->hdr->nentries ||
+        me->e[me->hdr->nentries - 1].off != bencode_value_offset(s))
+        e = __begin(s, dict_key, BENCODE_TOK_STR);
+    else
+        e = &me->e[me->hdr->nentries - 1];
+
+    e->len = bencode_offset(s) + 1 - e->off;
+    return 1;
+}
+
+static int __enter(bencode_t *s, const char *dict_key, uint32_t type)
+{
+    bencode_index_t* me = s->udata;
+
+    __begin(s, dict_key, type);
+    me->open[s->d] = me->hdr->nentries - 1;
+    return 1;
+}
+
+static int __leave(bencode_t *s)
+{
+    bencode_index_t* me = s->udata;
+    bencode_index_entry_t* e = &me->e[me->open[s->d]];
+
+    e->len = bencode_offset(s) + 1 - e->off;
+    e->skip = me->hdr->nentries - me->open[s->d];
+    return 1;
+}
+
+static int __dict_enter(bencode_t *s, const char *dict_key)
+{
+    return __enter(s, dict_key, BENCODE_TOK_DICT);
+}
+
+static int __dict_leave(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)))
+{
+    return __leave(s);
+}
+
+static int __list_enter(bencode_t *s, const char *dict_key)
+{
+    return __enter(s, dict_key, BENCODE_TOK_LIST);
+}
+
+static int __list_leave(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)))
+{
+    return __leave(s);
+}
+
+static bencode_callbacks_t __cb = {
+    .hit_int = __int,
+    .hit_str = __str,
+    .dict_enter = __dict_enter,
+    .dict_leave = __dict_leave,
+    .list_enter = __list_enter,
+    .list_leave = __list_leave,
+};
+
+bencode_index_t* bencode_index_new(
+        const char* buf,
+        unsigned int len,
+        int expected_depth)
+{
+    bencode_index_t* me;
+    bencode_t* ben;
+    int ok;
+
+    me = calloc(1, sizeof(bencode_index_t));
+    me->hdr = calloc(1, sizeof(bencode_index_header_t));
+    memcpy(me->hdr->magic, "BIDX", 4);
+    me->hdr->version = BENCODE_INDEX_VERSION;
+    me->hdr->src_size = len;
+    me->hdr->src_hash = bencode_index_hash(buf, len);
+    me->size = 64;
+    me->e = malloc(me->size * sizeof(bencode_index_entry_t));
+    me->open = calloc(10 + expected_depth, sizeof(unsigned int));
+
+    ben = bencode_new(expected_depth, &__cb, me);
+    ok = bencode_dispatch_from_buffer(ben, buf, len);
+    free(me->open);
+    me->open = NULL;
+
+    /* a document that's been cut short would leave containers open */
+    if (!ok || 0 == me->hdr->nentries ||
+        !(0 == ben->d && BENCODE_TOK_NONE == ben->stk[0].type))
+    {
+        bencode_free(ben);
+        bencode_index_free(me);
+        return NULL;
+    }
+    bencode_free(ben);
+    return me;
+}
+
+int bencode_index_save(
+        bencode_index_t* me,
+        const char* path,
+        const char* src_path)
+{
+    struct stat st;
+    FILE* fp;
+    int ok;
+
+    if (-1 == stat(src_path, &st) ||
+        (uint64_t)st.st_size != me->hdr->src_size)
+        return 0;
+    me->hdr->src_mtime = st.st_mtim.tv_sec;
+    me->hdr->src_mtime_nsec = st.st_mtim.tv_nsec;
+
+    if (!(fp = fopen(path, "wb")))
+        return 0;
+
+    ok = 1 == fwrite(me->hdr, sizeof(bencode_index_header_t), 1, fp) &&
+        me->hdr->nentries == fwrite(me->e, sizeof(bencode_index_entry_t),
+                me->hdr->nentries, fp);
+    return 0 == fclose(fp) && ok;
+}
+
+/**
+ * Check the entries can be followed without leaving the source or the
+ * index, whatever state the file is in
+ * @return 0 if an entry is out of bounds; otherwise 1 */
+static int __entries_ok(const bencode_index_header_t* hdr)
+{
+    const bencode_index_entry_t* e = (const bencode_index_entry_t*)(hdr + 1);
+    uint64_t i;
+
+    for (i = 0; i < hdr->nentries; i++)
+    {
+        if (hdr->src_size < e[i].off ||
+            hdr->src_size - e[i].off < e[i].len ||
+            0 == e[i].skip || hdr->nentries - i < e[i].skip)
+            return 0;
+
+        switch (e[i].type)
+        {
+        case BENCODE_TOK_INT:
+        case BENCODE_TOK_STR:
+        case BENCODE_TOK_LIST:
+        case BENCODE_TOK_DICT:
+            break;
+        /* a key is always followed by its value */
+        case BENCODE_TOK_DICT_KEY:
+            if (1 != e[i].skip || hdr->nentries <= i + 1)
+                return 0;
+            break;
+        default:
+            return 0;
+        }
+    }
+    return 1;
+}
+
+bencode_index_t* bencode_index_load(
+        const char* path,
+        const char* src_path,
+        const char* src,
+        unsigned int src_len)
+{
+    bencode_index_t* me;
+    bencode_index_header_t* hdr;
+    struct stat st, src_st;
+    void* map;
+    int fd;
+
+    if (-1 == stat(src_path, &src_st))
+        return NULL;
+
+    if (-1 == (fd = open(path, O_RDONLY)))
+        return NULL;
+
+    if (-1 == fstat(fd, &st) ||
+        st.st_size < (off_t)sizeof(bencode_index_header_t))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == map)
+        return NULL;
+
+    hdr = map;
+    if (0 != memcmp(hdr->magic, "BIDX", 4) ||
+        BENCODE_INDEX_VERSION != hdr->version ||
+        (st.st_size - sizeof(bencode_index_header_t)) /
+            sizeof(bencode_index_entry_t) < hdr->nentries ||
+        (uint64_t)st.st_size != sizeof(bencode_index_header_t) +
+            hdr->nentries * sizeof(bencode_index_entry_t) ||
+        (uint64_t)src_st.st_size != hdr->src_size ||
+        src_st.st_mtim.tv_sec != hdr->src_mtime ||
+        src_st.st_mtim.tv_nsec != hdr->src_mtime_nsec ||
+        (src && (src_len != hdr->src_size ||
+                 bencode_index_hash(src, src_len) != hdr->src_hash)) ||
+        !__entries_ok(hdr))
+    {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    me = calloc(1, sizeof(bencode_index_t));
+    me->hdr = hdr;
+    me->e = (bencode_index_entry_t*)(hdr + 1);
+    me->map_len = st.st_size;
+    return me;
+}
+
+void bencode_index_free(bencode_index_t* me)
+{
+    if (me->map_len)
+        munmap(me->hdr, me->map_len);
+    else
+    {
+        free(me->hdr);
+        free(me->e);
+    }
+    free(me);
+}
+
+unsigned int bencode_index_count(bencode_index_t* me)
+{
+    return me->hdr->nentries;
+}
+
+const bencode_index_entry_t* bencode_index_entries(bencode_index_t* me)
+{
+    return me->e;
+}
+
+/**
+ * @param len Set to the length of the key
+ * @return the bytes of the key entry k, past its length prefix */
+static const char* __key(
+        const char* src,
+        const bencode_index_entry_t* k,
+        unsigned int* len)
+{
+    const char* colon = memchr(src + k->off, ':', k->len);
+
+    if (!colon)
+        return NULL;
+    *len = src + k->off + k->len - colon - 1;
+    return colon + 1;
+}
+
+long int bencode_index_dict_get(
+        bencode_index_t* me,
+        const char* src,
+        unsigned int dict,
+        const char* key,
+        unsigned int klen)
+{
+    unsigned int i, end;
+
+    if (me->hdr->nentries <= dict || BENCODE_TOK_DICT != me->e[dict].type)
+        return -1;
+
+    end = dict + me->e[dict].skip;
+    for (i = dict + 1; i + 1 < end; i += 1 + me->e[i + 1].skip)
+    {
+        unsigned int len;
+        const char* k = __key(src, &me->e[i], &len);
+
+        if (k && len == klen && 0 == memcmp(k, key, klen))
+            return i + 1;
+    }
+
+    return -1;
+}
+
+/**
+ * Find the key's slot, or the empty slot where it would go */
+static __slot_t* __slot(
+        bencode_index_keys_t* me,
+        const char* src,
+        const char* key,
+        unsigned int klen,
+        uint32_t hash)
+{
+    unsigned int i = hash & (me->size - 1);
+
+    while (1)
+    {
+        __slot_t* sl = &me->slots[i];
+        unsigned int len;
+        const char* k;
+
+        if (0 == sl->key)
+            return sl;
+
+        if (sl->hash == hash &&
+            (k = __key(src, &me->idx->e[sl->key], &len)) &&
+            len == klen && 0 == memcmp(k, key, klen))
+            return sl;
+
+        i = (i + 1) & (me->size - 1);
+    }
+}
+
+/**
+ * Find the key's slot while rebuilding. A slot the key had last time has
+ * the same hash, so is in the same probe sequence; any such slot not yet
+ * claimed by this rebuild will do, and saves moving the key. */
+static __slot_t* __claim(
+        bencode_index_keys_t* me,
+        const char* src,
+        const char* key,
+        unsigned int klen,
+        uint32_t hash)
+{
+    unsigned int i = hash & (me->size - 1);
+
+    while (1)
+    {
+        __slot_t* sl = &me->slots[i];
+        unsigned int len;
+        const char* k;
+
+        if (0 == sl->key)
+            return sl;
+
+        if (sl->hash == hash && (sl->gen != me->gen ||
+            ((k = __key(src, &me->idx->e[sl->key], &len)) &&
+             len == klen && 0 == memcmp(k, key, klen))))
+            return sl;
+
+        i = (i + 1) & (me->size - 1);
+    }
+}
+
+/**
+ * Empty slot i, and move back the keys after it that probed past it */
+static void __unclaim(bencode_index_keys_t* me, unsigned int i)
+{
+    unsigned int mask = me->size - 1, j = i;
+
+    while (1)
+    {
+        unsigned int home;
+
+        j = (j + 1) & mask;
+        if (0 == me->slots[j].key)
+            break;
+
+        /* it can't go before where it hashes to */
+        home = me->slots[j].hash & mask;
+        if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+            continue;
+
+        me->slots[i] = me->slots[j];
+        i = j;
+    }
+
+    me->slots[i].key = 0;
+    me->nkeys--;
+}
+
+int bencode_index_keys_rebuild(
+        bencode_index_keys_t* me,
+        bencode_index_t* idx,
+        const char* src,
+        unsigned int dict)
+{
+    unsigned int i, end, size = 16;
+    int full;
+
+    if (idx->hdr->nentries <= dict || BENCODE_TOK_DICT != idx->e[dict].type)
+        return 0;
+
+    /* at most half of the dict's entries are keys */
+    while (size < idx->e[dict].skip)
+        size *= 2;
+
+    /* start afresh if the old keys and the new ones might not fit together */
+    full = me->size < size || me->size <= me->nkeys + idx->e[dict].skip / 2;
+    if (me->size < size)
+    {
+        __slot_t* slots = malloc(size * sizeof(__slot_t));
+
+        if (!slots)
+            return 0;
+        free(me->slots);
+        me->slots = slots;
+        me->size = size;
+    }
+    if (full)
+    {
+        memset(me->slots, 0, me->size * sizeof(__slot_t));
+        me->nkeys = 0;
+    }
+    me->idx = idx;
+    me->gen++;
+
+    end = dict + idx->e[dict].skip;
+    for (i = dict + 1; i + 1 < end; i += 1 + idx->e[i + 1].skip)
+    {
+        unsigned int len;
+        const char* k = __key(src, &idx->e[i], &len);
+        uint32_t hash;
+        __slot_t* sl;
+
+        if (!k)
+            continue;
+        hash = bencode_index_hash(k, len) >> 32;
+        sl = __claim(me, src, k, len, hash);
+
+        /* a repeated key keeps its first value, as with dict_get */
+        if (sl->gen == me->gen)
+            continue;
+        if (0 == sl->key)
+        {
+            sl->hash = hash;
+            me->nkeys++;
+        }
+        sl->key = i;
+        sl->gen = me->gen;
+    }
+
+    /* drop the keys the dict no longer has */
+    if (!full)
+        for (i = 0; i < me->size; i++)
+            while (me->slots[i].key && me->slots[i].gen != me->gen)
+                __unclaim(me, i);
+
+    return 1;
+}
+
+bencode_index_keys_t* bencode_index_keys_new(
+        bencode_index_t* idx,
+        const char* src,
+        unsigned int dict)
+{
+    bencode_index_keys_t* me = calloc(1, sizeof(bencode_index_keys_t));
+
+    if (!bencode_index_keys_rebuild(me, idx, src, dict))
+    {
+        bencode_index_keys_free(me);
+        return NULL;
+    }
+    return me;
+}
+
+long int bencode_index_keys_get(
+        bencode_index_keys_t* me,
+        const char* src,
+        const char* key,
+        unsigned int klen)
+{
+    __slot_t* sl = __slot(me, src, key, klen,
+            bencode_index_hash(key, klen) >> 32);
+
+    return 0 == sl->key ? -1 : (long int)sl->key + 1;
+}
+
+void bencode_index_keys_free(bencode_index_keys_t* me)
+{
+    free(me->slots);
+    free(me);
+}
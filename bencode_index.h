@@ -0,0 +1,161 @@
+#ifndef BENCODE_INDEX_H
+#define BENCODE_INDEX_H
+
+#include <stdint.h>
+
+#define BENCODE_INDEX_VERSION 2
+
+/* an entry for every dict key and value in the document, in document
+ * order. A dict's entries alternate between key and value */
+typedef struct {
+    /* BENCODE_TOK_INT, _STR, _LIST, _DICT, or _DICT_KEY */
+    uint32_t type;
+
+    /* number of entries this value spans, including itself; ie. the next
+     * sibling is this many entries along */
+    uint32_t skip;
+
+    /* offset of the value within the source */
+    uint64_t off;
+
+    /* length of the value in bytes, including its delimiters */
+    uint64_t len;
+} bencode_index_entry_t;
+
+/* the file starts with this header, followed by the entries */
+typedef struct {
+    char magic[4];
+    uint32_t version;
+
+    /* the source this index was built from */
+    uint64_t src_size;
+    int64_t src_mtime;
+    int64_t src_mtime_nsec;
+    uint64_t src_hash;
+
+    uint64_t nentries;
+} bencode_index_header_t;
+
+typedef struct bencode_index_s bencode_index_t;
+
+/**
+ * Parse a whole document and build an index of it
+ * @param buf The document
+ * @param len The size of the document
+ * @param expected_depth The expected depth of the bencode
+ * @return new index; NULL if the document couldn't be parsed, or was cut
+ *         short
+ */
+bencode_index_t* bencode_index_new(
+        const char* buf,
+        unsigned int len,
+        int expected_depth);
+
+/**
+ * Write the index to disk. The source file's size and mtime are recorded
+ * so that a stale index can be detected when it's loaded.
+ * @param path Where to save the index, eg. next to the source
+ * @param src_path The file the index was built from
+ * @return 0 on error; otherwise 1
+ */
+int bencode_index_save(
+        bencode_index_t*,
+        const char* path,
+        const char* src_path);
+
+/**
+ * Map a saved index into memory. Nothing is parsed, but every entry is
+ * checked to lie within the source and within the index.
+ * @param path Where the index was saved
+ * @param src_path The file the index was built from
+ * @param src The source's contents if the caller wants its hash checked;
+ *        NULL to only check size and mtime
+ * @param src_len The size of src
+ * @return the index; NULL if it's missing, corrupt, or stale
+ */
+bencode_index_t* bencode_index_load(
+        const char* path,
+        const char* src_path,
+        const char* src,
+        unsigned int src_len);
+
+void bencode_index_free(bencode_index_t*);
+
+/**
+ * @return number of entries in the index
+ */
+unsigned int bencode_index_count(bencode_index_t*);
+
+/**
+ * @return the entries, in document order
+ */
+const bencode_index_entry_t* bencode_index_entries(bencode_index_t*);
+
+/**
+ * Find a key within a dict, jumping over each value using skip
+ * @param src The source document
+ * @param dict Entry of the dict to look in
+ * @param key The key to look for
+ * @param klen Length of the key
+ * @return entry of the key's value; -1 if it couldn't be found
+ */
+long int bencode_index_dict_get(
+        bencode_index_t*,
+        const char* src,
+        unsigned int dict,
+        const char* key,
+        unsigned int klen);
+
+typedef struct bencode_index_keys_s bencode_index_keys_t;
+
+/**
+ * Hash the keys of a dict into an open addressing table, for dicts too big
+ * to scan with bencode_index_dict_get()
+ * @param src The source document
+ * @param dict Entry of the dict to hash
+ * @return new table; NULL if dict isn't a dict
+ */
+bencode_index_keys_t* bencode_index_keys_new(
+        bencode_index_t*,
+        const char* src,
+        unsigned int dict);
+
+/**
+ * Update the table after the dict's been re-read, eg. into a new index.
+ * Keys still in the dict keep their slots, and only have their entry
+ * changed if it moved; new keys are added and missing ones dropped. The
+ * table is only cleared and hashed afresh if it has to grow.
+ * @param src The source document
+ * @param dict Entry of the dict to hash
+ * @return 0 if dict isn't a dict or we're out of memory; otherwise 1
+ */
+int bencode_index_keys_rebuild(
+        bencode_index_keys_t*,
+        bencode_index_t*,
+        const char* src,
+        unsigned int dict);
+
+/**
+ * As bencode_index_dict_get(), in O(1)
+ * @param src The source document
+ * @param key The key to look for
+ * @param klen Length of the key
+ * @return entry of the key's value; -1 if it couldn't be found
+ */
+long int bencode_index_keys_get(
+        bencode_index_keys_t*,
+        const char* src,
+        const char* key,
+        unsigned int klen);
+
+void bencode_index_keys_free(bencode_index_keys_t*);
+
+/**
+ * 64-bit FNV-1a, as stored in the header to validate the source
+ * @return hash of the source
+ */
+uint64_t bencode_index_hash(
+        const char* src,
+        unsigned int len);
+
+#endif /* BENCODE_INDEX_H */
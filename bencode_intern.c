@@ -0,0 +1,266 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Keep one copy of strings that repeat across documents
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "bencode_intern.h"
+
+/* size of the arena's first block; each block after is twice the last */
+#define BLOCK_SIZE 4096
+
+typedef struct __block_s __block_t;
+
+struct __block_s {
+    __block_t* next;
+    unsigned long int size;
+    unsigned long int used;
+    char data[];
+};
+
+typedef struct {
+    const char* str;
+    unsigned int len;
+    uint32_t hash;
+} __str_t;
+
+struct bencode_intern_s {
+    unsigned int max_len;
+
+    int shared;
+    pthread_mutex_t lock;
+
+    /* where the strings live; the newest block is first */
+    __block_t* arena;
+
+    /* strings by ID */
+    __str_t* strs;
+    unsigned int nstrs;
+    unsigned int strs_size;
+
+    /* open addressing with linear probing; each slot holds a string's ID
+     * plus 1, or 0 if it's empty */
+    uint32_t* slots;
+    unsigned int nslots;
+
+    unsigned long int mem;
+};
+
+static uint32_t __hash(const char* str, unsigned int len)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    unsigned int i;
+
+    for (i = 0; i < len; i++)
+    {
+        h ^= (unsigned char)str[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h >> 32;
+}
+
+static char* __alloc(bencode_intern_t* me, unsigned long int len)
+{
+    __block_t* b = me->arena;
+    char* p;
+
+    if (!b || b->size < b->used + len)
+    {
+        unsigned long int size = b ? b->size * 2 : BLOCK_SIZE;
+
+        if (size < len)
+            size = len;
+        b = malloc(sizeof(__block_t) + size);
+        b->next = me->arena;
+        b->size = size;
+        b->used = 0;
+        me->arena = b;
+        me->mem += sizeof(__block_t) + size;
+    }
+
+    p = b->data + b->used;
+    b->used += len;
+    return p;
+}
+
+static void __grow(bencode_intern_t* me)
+{
+    unsigned int nslots = me->nslots * 2, i;
+    uint32_t* slots = calloc(nslots, sizeof(uint32_t));
+
+    for (i = 0; i < me->nstrs; i++)
+    {
+        unsigned int j = me->strs[i].hash & (nslots - 1);
+
+        while (slots[j])
+            j = (j + 1) & (nslots - 1);
+        slots[j] = i + 1;
+    }
+
+    me->mem += (nslots - me->nslots) * sizeof(uint32_t);
+    free(me->slots);
+    me->slots = slots;
+    me->nslots = nslots;
+}
+
+static const char* __intern(
+        bencode_intern_t* me,
+        const char* str,
+        unsigned int len,
+        unsigned int* id)
+{
+    uint32_t h = __hash(str, len);
+    unsigned int i = h & (me->nslots - 1);
+    __str_t* s;
+    char* copy;
+
+    for (; me->slots[i]; i = (i + 1) & (me->nslots - 1))
+    {
+        s = &me->strs[me->slots[i] - 1];
+        if (s->hash == h && s->len == len && 0 == memcmp(s->str, str, len))
+        {
+            if (id)
+                *id = me->slots[i] - 1;
+            return s->str;
+        }
+    }
+
+    if (me->strs_size == me->nstrs)
+    {
+        me->mem += me->strs_size * sizeof(__str_t);
+        me->strs_size *= 2;
+        me->strs = realloc(me->strs, me->strs_size * sizeof(__str_t));
+    }
+
+    copy = __alloc(me, len + 1);
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+
+    s = &me->strs[me->nstrs];
+    s->str = copy;
+    s->len = len;
+    s->hash = h;
+    me->slots[i] = ++me->nstrs;
+    if (id)
+        *id = me->nstrs - 1;
+
+    /* keep probes short */
+    if (me->nslots < me->nstrs * 2)
+        __grow(me);
+    return copy;
+}
+
+bencode_intern_t* bencode_intern_new(
+        unsigned int max_len,
+        int shared)
+{
+    bencode_intern_t* me;
+
+    me = calloc(1, sizeof(bencode_intern_t));
+    me->max_len = max_len;
+    me->shared = shared;
+    if (shared)
+        pthread_mutex_init(&me->lock, NULL);
+    me->strs_size = 64;
+    me->strs = malloc(me->strs_size * sizeof(__str_t));
+    me->nslots = 256;
+    me->slots = calloc(me->nslots, sizeof(uint32_t));
+    me->mem = sizeof(bencode_intern_t) + me->strs_size * sizeof(__str_t) +
+        me->nslots * sizeof(uint32_t);
+    return me;
+}
+
+const char* bencode_intern(
+        bencode_intern_t* me,
+        const char* str,
+        unsigned int len,
+        unsigned int* id)
+{
+    const char* s;
+
+    if (me->max_len < len)
+        return NULL;
+
+    if (me->shared)
+        pthread_mutex_lock(&me->lock);
+    s = __intern(me, str, len, id);
+    if (me->shared)
+        pthread_mutex_unlock(&me->lock);
+    return s;
+}
+
+const char* bencode_intern_lookup(
+        bencode_intern_t* me,
+        unsigned int id,
+        unsigned int* len)
+{
+    const char* s = NULL;
+
+    if (me->shared)
+        pthread_mutex_lock(&me->lock);
+    if (id < me->nstrs)
+    {
+        s = me->strs[id].str;
+        if (len)
+            *len = me->strs[id].len;
+    }
+    if (me->shared)
+        pthread_mutex_unlock(&me->lock);
+    return s;
+}
+
+unsigned int bencode_intern_max_len(bencode_intern_t* me)
+{
+    return me->max_len;
+}
+
+unsigned int bencode_intern_count(bencode_intern_t* me)
+{
+    unsigned int n;
+
+    if (me->shared)
+        pthread_mutex_lock(&me->lock);
+    n = me->nstrs;
+    if (me->shared)
+        pthread_mutex_unlock(&me->lock);
+    return n;
+}
+
+unsigned long int bencode_intern_mem(bencode_intern_t* me)
+{
+    unsigned long int mem;
+
+    if (me->shared)
+        pthread_mutex_lock(&me->lock);
+    mem = me->mem;
+    if (me->shared)
+        pthread_mutex_unlock(&me->lock);
+    return mem;
+}
+
+void bencode_intern_free(bencode_intern_t* me)
+{
+    while (me->arena)
+    {
+        __block_t* b = me->arena;
+
+        me->arena = b->next;
+        free(b);
+    }
+    if (me->shared)
+        pthread_mutex_destroy(&me->lock);
+    free(me->strs);
+    free(me->slots);
+    free(me);
+}
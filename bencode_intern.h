@@ -0,0 +1,61 @@
+#ifndef BENCODE_INTERN_H
+#define BENCODE_INTERN_H
+
+typedef struct bencode_intern_s bencode_intern_t;
+
+/**
+ * A table of strings where each string is kept once. Interning a string
+ * gives a pointer and ID that are the same for every copy of it, so
+ * interned strings can be compared by pointer or ID. Strings stay put
+ * until the table is freed.
+ *
+ * @param max_len Longest string we'll intern
+ * @param shared Non-zero if threads will use the table at the same time;
+ *        otherwise there's no locking
+ * @return new table
+ */
+bencode_intern_t* bencode_intern_new(
+        unsigned int max_len,
+        int shared);
+
+/**
+ * @param str The string, which needn't be '\0' terminated
+ * @param len The length of str
+ * @param id Set to the string's ID if not NULL. IDs count up from 0 in
+ *        the order strings are first seen
+ * @return the interned copy, '\0' terminated; NULL if len is over max_len
+ */
+const char* bencode_intern(
+        bencode_intern_t*,
+        const char* str,
+        unsigned int len,
+        unsigned int* id);
+
+/**
+ * @param id The string's ID
+ * @param len Set to the length of the string if not NULL
+ * @return the interned string; NULL if there's no such ID
+ */
+const char* bencode_intern_lookup(
+        bencode_intern_t*,
+        unsigned int id,
+        unsigned int* len);
+
+/**
+ * @return the longest string we'll intern
+ */
+unsigned int bencode_intern_max_len(bencode_intern_t*);
+
+/**
+ * @return number of strings in the table
+ */
+unsigned int bencode_intern_count(bencode_intern_t*);
+
+/**
+ * @return bytes of heap the table is holding
+ */
+unsigned long int bencode_intern_mem(bencode_intern_t*);
+
+void bencode_intern_free(bencode_intern_t*);
+
+#endif /* BENCODE_INTERN_H */
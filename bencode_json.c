@@ -0,0 +1,432 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Transcode bencoded data into JSON as it streams in
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bencode.h"
+#include "bencode_json.h"
+
+struct bencode_json_s {
+    bencode_t* ben;
+
+    /* caller's output buffer */
+    char* out;
+    unsigned int out_size;
+    unsigned int out_len;
+
+    bencode_json_flush_f flush;
+    void* udata;
+
+    int bin_mode;
+
+    /* whether the container at each depth needs a comma before its next
+     * item */
+    char* comma;
+
+    /* the flush callback failed */
+    int failed;
+};
+
+/* 1 = always escape, 2 = escape if writing a non UTF-8 string */
+static const unsigned char __esc[256] = {
+    1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+    0,0,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,
+    2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,
+    2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,
+    2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2
+};
+
+static const char __hex[] = "0123456789abcdef";
+
+static const char __b64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static void __flush(bencode_json_t* me)
+{
+    if (0 == me->out_len)
+        return;
+    if (!me->flush(me->udata, me->out, me->out_len))
+        me->failed = 1;
+    me->out_len = 0;
+}
+
+static void __put(bencode_json_t* me, const char* s, unsigned int len)
+{
+    while (0 < len)
+    {
+        unsigned int n = me->out_size - me->out_len;
+
+        if (0 == n)
+        {
+            __flush(me);
+            n = me->out_size;
+        }
+        if (len < n)
+            n = len;
+        memcpy(me->out + me->out_len, s, n);
+        me->out_len += n;
+        s += n;
+        len -= n;
+    }
+}
+
+static void __put_char(bencode_json_t* me, const char c)
+{
+    if (me->out_len == me->out_size)
+        __flush(me);
+    me->out[me->out_len++] = c;
+}
+
+static void __put_int(bencode_json_t* me, long long int val)
+{
+    char tmp[24];
+    int i = sizeof(tmp);
+    unsigned long long int v = val < 0 ?
+        -(unsigned long long int)val : (unsigned long long int)val;
+
+    do
+    {
+        tmp[--i] = '0' + v % 10;
+        v /= 10;
+    }
+    while (v);
+    if (val < 0)
+        tmp[--i] = '-';
+    __put(me, tmp + i, sizeof(tmp) - i);
+}
+
+static int __is_utf8(const unsigned char* s, unsigned int len)
+{
+    const unsigned char* end = s + len;
+
+    while (s < end)
+    {
+        unsigned long long w;
+        int i, n;
+
+        /* skip plain ASCII 8 bytes at a time */
+        while (8 <= end - s)
+        {
+            memcpy(&w, s, 8);
+            if (w & 0x8080808080808080ULL)
+                break;
+            s += 8;
+        }
+
+        if (s == end)
+            break;
+
+        if (*s < 0x80)
+        {
+            s++;
+            continue;
+        }
+        else if (0xc2 <= *s && *s <= 0xdf)
+            n = 1;
+        else if (0xe0 <= *s && *s <= 0xef)
+            n = 2;
+        else if (0xf0 <= *s && *s <= 0xf4)
+            n = 3;
+        else
+            return 0;
+
+        if (end - s <= n)
+            return 0;
+
+        /* overlong encodings, surrogates and code points past U+10FFFF */
+        if ((0xe0 == *s && s[1] < 0xa0) ||
+            (0xed == *s && 0x9f < s[1]) ||
+            (0xf0 == *s && s[1] < 0x90) ||
+            (0xf4 == *s && 0x8f < s[1]))
+            return 0;
+
+        for (i = 1; i <= n; i++)
+            if (0x80 != (s[i] & 0xc0))
+                return 0;
+        s += n + 1;
+    }
+
+    return 1;
+}
+
+/**
+ * Write the string, escaping only the bytes that need it. Runs of bytes
+ * that don't need escaping are copied in one go. */
+static void __put_text(
+        bencode_json_t* me,
+        const unsigned char* s,
+        unsigned int len,
+        int escape_high)
+{
+    const unsigned char* end = s + len;
+    const unsigned char mask = escape_high ? 3 : 1;
+
+    while (s < end)
+    {
+        const unsigned char* run = s;
+        char tmp[6];
+
+        while (s < end && !(__esc[*s] & mask))
+            s++;
+        __put(me, (const char*)run, s - run);
+
+        if (s == end)
+            break;
+
+        switch (*s)
+        {
+        case '"': __put(me, "\\\"", 2); break;
+        case '\\': __put(me, "\\\\", 2); break;
+        case '\b': __put(me, "\\b", 2); break;
+        case '\f': __put(me, "\\f", 2); break;
+        case '\n': __put(me, "\\n", 2); break;
+        case '\r': __put(me, "\\r", 2); break;
+        case '\t': __put(me, "\\t", 2); break;
+        default:
+            memcpy(tmp, "\\u00", 4);
+            tmp[4] = __hex[*s >> 4];
+            tmp[5] = __hex[*s & 0xf];
+            __put(me, tmp, 6);
+            break;
+        }
+        s++;
+    }
+}
+
+static void __put_hex(
+        bencode_json_t* me,
+        const unsigned char* s,
+        unsigned int len)
+{
+    char tmp[128];
+
+    while (0 < len)
+    {
+        unsigned int i, n = len < sizeof(tmp) / 2 ? len : sizeof(tmp) / 2;
+
+        for (i = 0; i < n; i++)
+        {
+            tmp[i * 2] = __hex[s[i] >> 4];
+            tmp[i * 2 + 1] = __hex[s[i] & 0xf];
+        }
+        __put(me, tmp, n * 2);
+        s += n;
+        len -= n;
+    }
+}
+
+static void __put_b64_quad(char* out, const unsigned char* in, int n)
+{
+    out[0] = __b64[in[0] >> 2];
+    out[1] = __b64[((in[0] & 0x3) << 4) | (1 < n ? in[1] >> 4 : 0)];
+    out[2] = 1 < n ? __b64[((in[1] & 0xf) << 2) | (2 < n ? in[2] >> 6 : 0)] : '=';
+    out[3] = 2 < n ? __b64[in[2] & 0x3f] : '=';
+}
+
+static void __put_base64(
+        bencode_json_t* me,
+        const unsigned char* s,
+        unsigned int len)
+{
+    char tmp[128];
+    unsigned int n = 0;
+
+    while (3 <= len)
+    {
+        if (sizeof(tmp) < n + 4)
+        {
+            __put(me, tmp, n);
+            n = 0;
+        }
+        __put_b64_quad(tmp + n, s, 3);
+        n += 4;
+        s += 3;
+        len -= 3;
+    }
+    if (0 < n)
+        __put(me, tmp, n);
+
+    /* padded last group */
+    if (0 < len)
+    {
+        __put_b64_quad(tmp, s, len);
+        __put(me, tmp, 4);
+    }
+}
+
+/**
+ * Hex and base64 apply to every string, so that text and binary can't be
+ * confused; otherwise only strings that aren't UTF-8 are escaped */
+static void __put_string(
+        bencode_json_t* me,
+        const unsigned char* s,
+        unsigned int len)
+{
+    __put_char(me, '"');
+    if (BENCODE_JSON_BIN_HEX == me->bin_mode)
+        __put_hex(me, s, len);
+    else if (BENCODE_JSON_BIN_BASE64 == me->bin_mode)
+        __put_base64(me, s, len);
+    else
+        __put_text(me, s, len, !__is_utf8(s, len));
+    __put_char(me, '"');
+}
+
+/**
+ * Write the comma and dict key that come before a value */
+static void __begin_value(
+        bencode_json_t* me,
+        bencode_t* s,
+        const char *dict_key)
+{
+    if (0 < s->d)
+    {
+        if (me->comma[s->d - 1])
+            __put_char(me, ',');
+        me->comma[s->d - 1] = 1;
+    }
+
+    if (dict_key)
+    {
+        unsigned int len;
+
+        /* keys can hold a '\0' */
+        if (!bencode_path_key(s, bencode_path_depth(s) - 1, &len))
+            len = strlen(dict_key);
+        __put_string(me, (const unsigned char*)dict_key, len);
+        __put_char(me, ':');
+    }
+}
+
+static int __int(bencode_t *s,
+        const char *dict_key,
+        const long long int val)
+{
+    bencode_json_t* me = s->udata;
+
+    __begin_value(me, s, dict_key);
+    __put_int(me, val);
+    return !me->failed;
+}
+
+/**
+ * The parser always hands over whole strings, so each is written in one go */
+static int __str(bencode_t *s,
+        const char *dict_key,
+        unsigned int v_total_len __attribute__((__unused__)),
+        const unsigned char* val,
+        unsigned int v_len)
+{
+    bencode_json_t* me = s->udata;
+
+    __begin_value(me, s, dict_key);
+    __put_string(me, val, v_len);
+    return !me->failed;
+}
+
+static int __dict_enter(bencode_t *s, const char *dict_key)
+{
+    bencode_json_t* me = s->udata;
+
+    __begin_value(me, s, dict_key);
+    __put_char(me, '{');
+    me->comma[s->d] = 0;
+    return !me->failed;
+}
+
+static int __dict_leave(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)))
+{
+    bencode_json_t* me = s->udata;
+
+    __put_char(me, '}');
+    return !me->failed;
+}
+
+static int __list_enter(bencode_t *s, const char *dict_key)
+{
+    bencode_json_t* me = s->udata;
+
+    __begin_value(me, s, dict_key);
+    __put_char(me, '[');
+    me->comma[s->d] = 0;
+    return !me->failed;
+}
+
+static int __list_leave(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)))
+{
+    bencode_json_t* me = s->udata;
+
+    __put_char(me, ']');
+    return !me->failed;
+}
+
+static bencode_callbacks_t __cb = {
+    .hit_int = __int,
+    .hit_str = __str,
+    .dict_enter = __dict_enter,
+    .dict_leave = __dict_leave,
+    .list_enter = __list_enter,
+    .list_leave = __list_leave,
+};
+
+bencode_json_t* bencode_json_new(
+        int expected_depth,
+        char* out,
+        unsigned int out_size,
+        bencode_json_flush_f flush,
+        void* udata,
+        int bin_mode)
+{
+    bencode_json_t* me;
+
+    if (out_size < 16)
+        return NULL;
+
+    me = calloc(1, sizeof(bencode_json_t));
+    me->ben = bencode_new(expected_depth, &__cb, me);
+    me->comma = calloc(10 + expected_depth, 1);
+    me->out = out;
+    me->out_size = out_size;
+    me->flush = flush;
+    me->udata = udata;
+    me->bin_mode = bin_mode;
+    return me;
+}
+
+int bencode_json_dispatch_from_buffer(
+        bencode_json_t* me,
+        const char* buf,
+        unsigned int len)
+{
+    if (!bencode_dispatch_from_buffer(me->ben, buf, len))
+        return 0;
+    return !me->failed;
+}
+
+int bencode_json_finish(bencode_json_t* me)
+{
+    __flush(me);
+    return !me->failed;
+}
+
+void bencode_json_free(bencode_json_t* me)
+{
+    bencode_free(me->ben);
+    free(me->comma);
+    free(me);
+}
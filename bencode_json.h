@@ -0,0 +1,65 @@
+#ifndef BENCODE_JSON_H
+#define BENCODE_JSON_H
+
+/* how strings and dict keys are written */
+enum {
+    /* as text when they're valid UTF-8; otherwise bytes above 0x7f are
+     * written as \u00XX, which a reader can't tell apart from text */
+    BENCODE_JSON_BIN_ESCAPE,
+    /* every string is written as lowercase hex */
+    BENCODE_JSON_BIN_HEX,
+    /* every string is written as base64 */
+    BENCODE_JSON_BIN_BASE64
+};
+
+typedef struct bencode_json_s bencode_json_t;
+
+/**
+ * Called when the output buffer is full, or when we've finished
+ * @param udata User data passed to bencode_json_new()
+ * @param buf The JSON we've written so far
+ * @param len The length of the JSON
+ * @return 0 on error; otherwise 1
+ */
+typedef int (*bencode_json_flush_f)(
+        void* udata,
+        const char* buf,
+        unsigned int len);
+
+/**
+ * @param expected_depth The expected depth of the bencode
+ * @param out Buffer that we write JSON into; reused after every flush
+ * @param out_size The size of the buffer; must be at least 16 bytes
+ * @param flush Called to hand over the contents of the output buffer
+ * @param udata User data for flush
+ * @param bin_mode How to write strings, BENCODE_JSON_BIN_*
+ * @return new bencode to JSON transcoder
+ */
+bencode_json_t* bencode_json_new(
+        int expected_depth,
+        char* out,
+        unsigned int out_size,
+        bencode_json_flush_f flush,
+        void* udata,
+        int bin_mode);
+
+/**
+ * Transcode the next chunk of bencode
+ * @param buf The buffer to read new input from
+ * @param len The size of the buffer
+ * @return 0 on error; otherwise 1
+ */
+int bencode_json_dispatch_from_buffer(
+        bencode_json_t*,
+        const char* buf,
+        unsigned int len);
+
+/**
+ * Flush whatever JSON is still sitting in the output buffer
+ * @return 0 on error; otherwise 1
+ */
+int bencode_json_finish(bencode_json_t*);
+
+void bencode_json_free(bencode_json_t*);
+
+#endif /* BENCODE_JSON_H */
@@ -0,0 +1,303 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Decode DHT messages straight into a struct
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bencode.h"
+#include "bencode_krpc.h"
+
+/* deepest we'll go skipping a value we don't know */
+#define SKIP_MAX_DEPTH 32
+
+/* what's next within each container we're skipping over */
+enum {
+    SKIP_LIST_ITEM,
+    SKIP_DICT_KEY,
+    SKIP_DICT_VAL
+};
+
+/* where we're up to within the packet */
+typedef struct {
+    const char* p;
+    const char* end;
+} __cur_t;
+
+/**
+ * Packets come off the network; isdigit() on a byte over 0x7f would be a
+ * negative char */
+static int __is_digit(const char c)
+{
+    return '0' <= c && c <= '9';
+}
+
+static int __str(__cur_t* c, bencode_krpc_str_t* out)
+{
+    unsigned int len = 0, n = 0;
+
+    while (c->p < c->end && __is_digit(*c->p))
+    {
+        /* no packet is this long */
+        if (9 < ++n)
+            return 0;
+        len = len * 10 + (*c->p++ - '0');
+    }
+
+    if (0 == n || c->end <= c->p || ':' != *c->p++ ||
+        (unsigned int)(c->end - c->p) < len)
+        return 0;
+
+    out->val = c->p;
+    out->len = len;
+    c->p += len;
+    return 1;
+}
+
+static int __int(__cur_t* c, long long int* val)
+{
+    const char* e;
+
+    if (c->end <= c->p || 'i' != *c->p)
+        return 0;
+    c->p++;
+
+    if (!(e = memchr(c->p, 'e', c->end - c->p)) ||
+        !bencode_slice_int(c->p, e - c->p, val))
+        return 0;
+    c->p = e + 1;
+    return 1;
+}
+
+/**
+ * Step over a value we don't know, checking it's well formed */
+static int __skip(__cur_t* c)
+{
+    char next[SKIP_MAX_DEPTH];
+    int d = 0;
+
+    do
+    {
+        bencode_krpc_str_t s;
+        long long int i;
+
+        if (c->end <= c->p)
+            return 0;
+
+        if (0 < d && 'e' == *c->p && SKIP_DICT_VAL != next[d - 1])
+        {
+            c->p++;
+            d--;
+        }
+        else if (0 < d && SKIP_DICT_KEY == next[d - 1])
+        {
+            if (!__str(c, &s))
+                return 0;
+            next[d - 1] = SKIP_DICT_VAL;
+            continue;
+        }
+        else if ('i' == *c->p)
+        {
+            if (!__int(c, &i))
+                return 0;
+        }
+        else if ('l' == *c->p || 'd' == *c->p)
+        {
+            if (SKIP_MAX_DEPTH == d)
+                return 0;
+            next[d++] = 'd' == *c->p ? SKIP_DICT_KEY : SKIP_LIST_ITEM;
+            c->p++;
+            continue;
+        }
+        else if (!__str(c, &s))
+            return 0;
+
+        /* we've finished a value */
+        if (0 < d && SKIP_DICT_VAL == next[d - 1])
+            next[d - 1] = SKIP_DICT_KEY;
+    }
+    while (0 < d);
+
+    return 1;
+}
+
+static int __is(const bencode_krpc_str_t* key, const char* name)
+{
+    unsigned int len = strlen(name);
+
+    return key->len == len && 0 == memcmp(key->val, name, len);
+}
+
+static int __values(__cur_t* c, bencode_krpc_msg_t* msg)
+{
+    c->p++;
+    while (c->p < c->end && 'e' != *c->p)
+    {
+        bencode_krpc_str_t s;
+
+        if (!__str(c, &s))
+            return 0;
+        if (BENCODE_KRPC_MAX_VALUES == msg->nvalues)
+            msg->values_truncated = 1;
+        else
+            msg->values[msg->nvalues++] = s;
+    }
+    if (c->end <= c->p)
+        return 0;
+    c->p++;
+    return 1;
+}
+
+/**
+ * The contents of "a" or "r" */
+static int __args(__cur_t* c, bencode_krpc_msg_t* msg)
+{
+    c->p++;
+    while (c->p < c->end && 'e' != *c->p)
+    {
+        bencode_krpc_str_t key;
+        bencode_krpc_str_t* s = NULL;
+        long long int* i = NULL;
+
+        if (!__str(c, &key) || c->end <= c->p)
+            return 0;
+
+        if (__is(&key, "id"))
+            s = &msg->id;
+        else if (__is(&key, "target"))
+            s = &msg->target;
+        else if (__is(&key, "info_hash"))
+            s = &msg->info_hash;
+        else if (__is(&key, "token"))
+            s = &msg->token;
+        else if (__is(&key, "nodes"))
+            s = &msg->nodes;
+        else if (__is(&key, "nodes6"))
+            s = &msg->nodes6;
+        else if (__is(&key, "port"))
+            i = &msg->port;
+        else if (__is(&key, "implied_port"))
+            i = &msg->implied_port;
+        else if (__is(&key, "values") && 'l' == *c->p)
+        {
+            if (!__values(c, msg))
+                return 0;
+            continue;
+        }
+
+        if (s && __is_digit(*c->p))
+        {
+            if (!__str(c, s))
+                return 0;
+        }
+        else if (i && 'i' == *c->p)
+        {
+            if (!__int(c, i))
+                return 0;
+        }
+        else
+        {
+            /* not a key we know, or not the type we expected */
+            if (!__skip(c))
+                return 0;
+            msg->unknown++;
+        }
+    }
+    if (c->end <= c->p)
+        return 0;
+    c->p++;
+    return 1;
+}
+
+/**
+ * The "e" list: error code then message */
+static int __error(__cur_t* c, bencode_krpc_msg_t* msg)
+{
+    c->p++;
+    if (!__int(c, &msg->err_code) || !__str(c, &msg->err_msg))
+        return 0;
+    while (c->p < c->end && 'e' != *c->p)
+    {
+        if (!__skip(c))
+            return 0;
+        msg->unknown++;
+    }
+    if (c->end <= c->p)
+        return 0;
+    c->p++;
+    return 1;
+}
+
+int bencode_krpc_decode(
+        const char* buf,
+        unsigned int len,
+        bencode_krpc_msg_t* msg)
+{
+    __cur_t c = { .p = buf, .end = buf + len };
+
+    memset(msg, 0, sizeof(bencode_krpc_msg_t));
+    msg->port = msg->implied_port = msg->err_code = -1;
+
+    if (0 == len || 'd' != *c.p++)
+        return 0;
+
+    while (c.p < c.end && 'e' != *c.p)
+    {
+        bencode_krpc_str_t key;
+        bencode_krpc_str_t* s = NULL;
+
+        if (!__str(&c, &key) || c.end <= c.p)
+            return 0;
+
+        if (__is(&key, "t"))
+            s = &msg->t;
+        else if (__is(&key, "y"))
+            s = &msg->y;
+        else if (__is(&key, "q"))
+            s = &msg->q;
+        else if (__is(&key, "v"))
+            s = &msg->v;
+        else if (__is(&key, "ip"))
+            s = &msg->ip;
+        else if ((__is(&key, "a") || __is(&key, "r")) && 'd' == *c.p)
+        {
+            if (!__args(&c, msg))
+                return 0;
+            continue;
+        }
+        else if (__is(&key, "e") && 'l' == *c.p)
+        {
+            if (!__error(&c, msg))
+                return 0;
+            continue;
+        }
+
+        if (s && __is_digit(*c.p))
+        {
+            if (!__str(&c, s))
+                return 0;
+        }
+        else
+        {
+            if (!__skip(&c))
+                return 0;
+            msg->unknown++;
+        }
+    }
+
+    /* the dict has to end, and be all there is */
+    if (c.end <= c.p || c.p + 1 != c.end)
+        return 0;
+
+    /* every message has a transaction and says what sort it is */
+    return msg->t.val && 1 == msg->y.len &&
+        ('q' == *msg->y.val || 'r' == *msg->y.val || 'e' == *msg->y.val);
+}
@@ -0,0 +1,74 @@
+#ifndef BENCODE_KRPC_H
+#define BENCODE_KRPC_H
+
+/* most peers we keep from a get_peers response's "values" */
+#ifndef BENCODE_KRPC_MAX_VALUES
+#define BENCODE_KRPC_MAX_VALUES 64
+#endif
+
+/* a string within the packet; not '\0' terminated */
+typedef struct {
+    const char* val;
+    unsigned int len;
+} bencode_krpc_str_t;
+
+/* a KRPC message, as used by the BitTorrent DHT (BEP 5). Strings that
+ * aren't in the message have a NULL val */
+typedef struct {
+    /* transaction id */
+    bencode_krpc_str_t t;
+
+    /* "q", "r" or "e" */
+    bencode_krpc_str_t y;
+
+    /* method name of a query, eg. "get_peers" */
+    bencode_krpc_str_t q;
+
+    /* client version */
+    bencode_krpc_str_t v;
+
+    /* our external address, as seen by the other side (BEP 42) */
+    bencode_krpc_str_t ip;
+
+    /* from the query's arguments ("a") or the response ("r") */
+    bencode_krpc_str_t id;
+    bencode_krpc_str_t target;
+    bencode_krpc_str_t info_hash;
+    bencode_krpc_str_t token;
+    bencode_krpc_str_t nodes;
+    bencode_krpc_str_t nodes6;
+    bencode_krpc_str_t values[BENCODE_KRPC_MAX_VALUES];
+    unsigned int nvalues;
+
+    /* there were more than BENCODE_KRPC_MAX_VALUES values */
+    int values_truncated;
+
+    /* -1 if not in the message */
+    long long int port;
+    long long int implied_port;
+
+    /* from an error's "e" list; err_code is -1 if not in the message */
+    long long int err_code;
+    bencode_krpc_str_t err_msg;
+
+    /* number of keys we didn't recognise and skipped. Hand the packet to
+     * the generic parser if you need them */
+    unsigned int unknown;
+} bencode_krpc_msg_t;
+
+/**
+ * Decode a whole KRPC packet. Strings are left where they are within the
+ * packet, so it must outlive the message. Nothing is allocated.
+ *
+ * @param buf The packet
+ * @param len The size of the packet
+ * @param msg The message to fill in
+ * @return 0 if the packet is malformed, or isn't a KRPC message;
+ *         otherwise 1
+ */
+int bencode_krpc_decode(
+        const char* buf,
+        unsigned int len,
+        bencode_krpc_msg_t* msg);
+
+#endif /* BENCODE_KRPC_H */
@@ -0,0 +1,892 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Replay the callbacks of messages we've parsed before
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "bencode.h"
+#include "bencode_memo.h"
+
+#define P1 0x9e3779b185ebca87ULL
+#define P2 0xc2b2ae3d27d4eb4fULL
+#define P3 0x165667b19e3779f9ULL
+#define P4 0x85ebca77c2b2ae63ULL
+#define P5 0x27d4eb2f165667c5ULL
+
+/* a key of this length means there's no key, ie. we're within a list */
+#define NO_KEY 0xffffffffu
+
+/* the events we record */
+enum {
+    EV_INT,
+    EV_INT_RAW,
+    EV_STR,
+    EV_DICT_ENTER,
+    EV_DICT_LEAVE,
+    EV_LIST_ENTER,
+    EV_LIST_LEAVE,
+    EV_LIST_NEXT,
+    EV_DICT_NEXT,
+    EV_VALUE_START,
+    /* the state the parser is left in */
+    EV_END
+};
+
+/* the parts of a frame that callbacks can see */
+typedef struct {
+    unsigned long int start;
+    unsigned long int kstart;
+    unsigned int path_off;
+    unsigned int idx;
+    int key_off;
+    int type;
+    int sel_mode;
+    int sel_match;
+} __snap_t;
+
+/* what else, besides the message, decides the events we record */
+typedef struct {
+    /* bitmap of the callbacks the parser has */
+    unsigned int cbs;
+
+    /* whether there's a selector, and the size of its paths */
+    int selector;
+    unsigned int sel_len;
+
+    bencode_limits_t limits;
+    int canonical;
+} __ctx_t;
+
+typedef struct __entry_s __entry_t;
+
+struct __entry_s {
+    /* next within our hash bucket */
+    __entry_t* hnext;
+
+    /* most recently used is at the head */
+    __entry_t* prev;
+    __entry_t* next;
+
+    uint64_t hash;
+    __ctx_t ctx;
+    unsigned int len;
+    unsigned int tape_len;
+
+    /* deepest the parser went, and its longest path */
+    unsigned int max_d;
+    unsigned int max_path;
+
+    /* the selector's paths, the message, then its events */
+    char data[];
+};
+
+struct bencode_memo_s {
+    __entry_t** buckets;
+    unsigned int nbuckets;
+
+    __entry_t* head;
+    __entry_t* tail;
+
+    unsigned long int max_mem;
+    bencode_memo_stats_t stats;
+
+    /* events of the message we're parsing */
+    char* tape;
+    unsigned int tape_len;
+    unsigned int tape_size;
+
+    /* we ran out of memory recording; don't keep the tape */
+    int oom;
+
+    /* the parser's frames and path as of the last event we recorded, so
+     * that each event only records what's changed since */
+    __snap_t* shadow;
+    unsigned int shadow_size;
+    int shadow_d;
+    char* spath;
+    unsigned int spath_len;
+    unsigned int spath_size;
+    unsigned int max_d;
+    unsigned int max_path;
+
+    /* what we're parsing for */
+    bencode_callbacks_t cb;
+    void* udata;
+};
+
+static uint64_t __rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t __read64(const unsigned char* p)
+{
+    uint64_t v = 0;
+    int i;
+
+    for (i = 7; 0 <= i; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+static uint64_t __read32(const unsigned char* p)
+{
+    return (uint64_t)p[0] | (uint64_t)p[1] << 8 |
+        (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24;
+}
+
+static uint64_t __round(uint64_t acc, uint64_t input)
+{
+    acc += input * P2;
+    acc = __rotl(acc, 31);
+    return acc * P1;
+}
+
+static uint64_t __merge(uint64_t acc, uint64_t val)
+{
+    acc ^= __round(0, val);
+    return acc * P1 + P4;
+}
+
+uint64_t bencode_xxh64(
+        const void* buf,
+        unsigned long int len,
+        uint64_t seed)
+{
+    const unsigned char* p = buf;
+    const unsigned char* end = p + len;
+    uint64_t h;
+
+    if (32 <= len)
+    {
+        uint64_t v1 = seed + P1 + P2;
+        uint64_t v2 = seed + P2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - P1;
+
+        do
+        {
+            v1 = __round(v1, __read64(p));
+            v2 = __round(v2, __read64(p + 8));
+            v3 = __round(v3, __read64(p + 16));
+            v4 = __round(v4, __read64(p + 24));
+            p += 32;
+        }
+        while (p + 32 <= end);
+
+        h = __rotl(v1, 1) + __rotl(v2, 7) + __rotl(v3, 12) + __rotl(v4, 18);
+        h = __merge(h, v1);
+        h = __merge(h, v2);
+        h = __merge(h, v3);
+        h = __merge(h, v4);
+    }
+    else
+        h = seed + P5;
+
+    h += len;
+
+    for (; p + 8 <= end; p += 8)
+    {
+        h ^= __round(0, __read64(p));
+        h = __rotl(h, 27) * P1 + P4;
+    }
+
+    if (p + 4 <= end)
+    {
+        h ^= __read32(p) * P1;
+        h = __rotl(h, 23) * P2 + P3;
+        p += 4;
+    }
+
+    for (; p < end; p++)
+    {
+        h ^= *p * P5;
+        h = __rotl(h, 11) * P1;
+    }
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+/**
+ * Make room for at least size bytes
+ * @return the buffer, which may have moved; NULL if we're out of memory,
+ *         and buf is left as it was */
+static void* __grow_buf(void* buf, unsigned int* buf_size, unsigned int size)
+{
+    unsigned int n = *buf_size ? *buf_size : 16;
+
+    if (size <= *buf_size)
+        return buf;
+    while (n < size)
+        n *= 2;
+    if (!(buf = realloc(buf, n)))
+        return NULL;
+    *buf_size = n;
+    return buf;
+}
+
+static void __put(bencode_memo_t* me, const void* buf, unsigned int len)
+{
+    char* tape;
+
+    if (me->oom ||
+        !(tape = __grow_buf(me->tape, &me->tape_size, me->tape_len + len)))
+    {
+        me->oom = 1;
+        return;
+    }
+    me->tape = tape;
+    memcpy(me->tape + me->tape_len, buf, len);
+    me->tape_len += len;
+}
+
+static void __snap(__snap_t* sn, const bencode_frame_t* f)
+{
+    /* zeroed so that padding compares the same */
+    memset(sn, 0, sizeof(__snap_t));
+    sn->start = f->start;
+    sn->kstart = f->kstart;
+    sn->path_off = f->path_off;
+    sn->idx = f->idx;
+    sn->key_off = f->key_off;
+    sn->type = f->type;
+    sn->sel_mode = f->sel_mode;
+    sn->sel_match = f->sel_match;
+}
+
+/**
+ * Record the parser's depth, offset, path and frames, as far as they've
+ * changed since the last event */
+static void __put_state(bencode_memo_t* me, bencode_t* s)
+{
+    unsigned int d = s->d, lo, i, prefix = 0, tail;
+    __snap_t* shadow;
+    char* spath;
+    __snap_t sn;
+
+    if (!(shadow = __grow_buf(me->shadow, &me->shadow_size,
+                    (d + 1) * sizeof(__snap_t))))
+    {
+        me->oom = 1;
+        return;
+    }
+    me->shadow = shadow;
+    if (!(spath = __grow_buf(me->spath, &me->spath_size, s->path_len + 1)))
+    {
+        me->oom = 1;
+        return;
+    }
+    me->spath = spath;
+
+    /* frames below the first that changed are as the replay left them */
+    for (lo = 0; lo <= d && (int)lo <= me->shadow_d; lo++)
+    {
+        __snap(&sn, &s->stk[lo]);
+        if (0 != memcmp(&sn, &me->shadow[lo], sizeof(__snap_t)))
+            break;
+    }
+
+    __put(me, &d, sizeof(d));
+    __put(me, &s->off, sizeof(s->off));
+    __put(me, &lo, sizeof(lo));
+    for (i = lo; i <= d; i++)
+    {
+        __snap(&me->shadow[i], &s->stk[i]);
+        __put(me, &me->shadow[i], sizeof(__snap_t));
+    }
+    me->shadow_d = d;
+
+    while (prefix < me->spath_len && prefix < s->path_len &&
+           me->spath[prefix] == s->path[prefix])
+        prefix++;
+    tail = s->path_len - prefix;
+    __put(me, &prefix, sizeof(prefix));
+    __put(me, &tail, sizeof(tail));
+    __put(me, s->path + prefix, tail);
+    memcpy(me->spath + prefix, s->path + prefix, tail);
+    me->spath_len = s->path_len;
+
+    if (me->max_d < d)
+        me->max_d = d;
+    if (me->max_path < s->path_len)
+        me->max_path = s->path_len;
+}
+
+/**
+ * Record an event, along with the dict key it came with */
+static void __put_event(
+        bencode_memo_t* me,
+        bencode_t* s,
+        char ev,
+        const char* dict_key)
+{
+    unsigned int klen = NO_KEY;
+
+    /* keys can hold a '\0' */
+    if (dict_key && !bencode_path_key(s, bencode_path_depth(s) - 1, &klen))
+        klen = strlen(dict_key);
+
+    __put(me, &ev, 1);
+    __put(me, &klen, sizeof(klen));
+    if (dict_key)
+        __put(me, dict_key, klen + 1);
+    __put_state(me, s);
+}
+
+/* call the user's callback with their own udata */
+#define CALL(me, s, call) \
+    do { \
+        int r_; \
+        (s)->udata = (me)->udata; \
+        r_ = (call); \
+        (s)->udata = (me); \
+        if (!r_) \
+            return 0; \
+    } while (0)
+
+static int __int(bencode_t *s,
+        const char *dict_key,
+        const long long int val)
+{
+    bencode_memo_t* me = s->udata;
+
+    CALL(me, s, me->cb.hit_int(s, dict_key, val));
+    __put_event(me, s, EV_INT, dict_key);
+    __put(me, &val, sizeof(val));
+    return 1;
+}
+
+static int __int_raw(bencode_t *s,
+        const char *dict_key,
+        const char *digits,
+        unsigned int len)
+{
+    bencode_memo_t* me = s->udata;
+
+    CALL(me, s, me->cb.hit_int_raw(s, dict_key, digits, len));
+    __put_event(me, s, EV_INT_RAW, dict_key);
+    __put(me, &len, sizeof(len));
+    __put(me, digits, len);
+    return 1;
+}
+
+static int __str(bencode_t *s,
+        const char *dict_key,
+        unsigned int v_total_len,
+        const unsigned char* val,
+        unsigned int v_len)
+{
+    bencode_memo_t* me = s->udata;
+
+    CALL(me, s, me->cb.hit_str(s, dict_key, v_total_len, val, v_len));
+    __put_event(me, s, EV_STR, dict_key);
+    __put(me, &v_total_len, sizeof(v_total_len));
+    __put(me, &v_len, sizeof(v_len));
+    __put(me, val, v_len);
+    return 1;
+}
+
+static unsigned char* __sink(bencode_t *s,
+        const char *dict_key,
+        unsigned int v_total_len)
+{
+    bencode_memo_t* me = s->udata;
+    unsigned char* sink;
+
+    s->udata = me->udata;
+    sink = me->cb.str_sink(s, dict_key, v_total_len);
+    s->udata = me;
+    return sink;
+}
+
+static int __dict_enter(bencode_t *s, const char *dict_key)
+{
+    bencode_memo_t* me = s->udata;
+
+    CALL(me, s, me->cb.dict_enter(s, dict_key));
+    __put_event(me, s, EV_DICT_ENTER, dict_key);
+    return 1;
+}
+
+static int __dict_leave(bencode_t *s, const char *dict_key)
+{
+    bencode_memo_t* me = s->udata;
+
+    CALL(me, s, me->cb.dict_leave(s, dict_key));
+    __put_event(me, s, EV_DICT_LEAVE, dict_key);
+    return 1;
+}
+
+static int __list_enter(bencode_t *s, const char *dict_key)
+{
+    bencode_memo_t* me = s->udata;
+
+    CALL(me, s, me->cb.list_enter(s, dict_key));
+    __put_event(me, s, EV_LIST_ENTER, dict_key);
+    return 1;
+}
+
+static int __list_leave(bencode_t *s, const char *dict_key)
+{
+    bencode_memo_t* me = s->udata;
+
+    CALL(me, s, me->cb.list_leave(s, dict_key));
+    __put_event(me, s, EV_LIST_LEAVE, dict_key);
+    return 1;
+}
+
+static int __list_next(bencode_t *s)
+{
+    bencode_memo_t* me = s->udata;
+
+    CALL(me, s, me->cb.list_next(s));
+    __put_event(me, s, EV_LIST_NEXT, NULL);
+    return 1;
+}
+
+static int __dict_next(bencode_t *s)
+{
+    bencode_memo_t* me = s->udata;
+
+    CALL(me, s, me->cb.dict_next(s));
+    __put_event(me, s, EV_DICT_NEXT, NULL);
+    return 1;
+}
+
+static int __value_start(bencode_t *s, const char *dict_key, int type)
+{
+    bencode_memo_t* me = s->udata;
+
+    CALL(me, s, me->cb.value_start(s, dict_key, type));
+    __put_event(me, s, EV_VALUE_START, dict_key);
+    __put(me, &type, sizeof(type));
+    return 1;
+}
+
+/**
+ * Record the callbacks the user has, and only those; whether a callback
+ * is there can change how the parser behaves */
+static void __recorder(bencode_callbacks_t* rec, const bencode_callbacks_t* cb)
+{
+    memset(rec, 0, sizeof(bencode_callbacks_t));
+    rec->hit_int = __int;
+    rec->hit_str = __str;
+    if (cb->dict_enter) rec->dict_enter = __dict_enter;
+    if (cb->dict_leave) rec->dict_leave = __dict_leave;
+    if (cb->list_enter) rec->list_enter = __list_enter;
+    if (cb->list_leave) rec->list_leave = __list_leave;
+    if (cb->list_next) rec->list_next = __list_next;
+    if (cb->dict_next) rec->dict_next = __dict_next;
+    if (cb->str_sink) rec->str_sink = __sink;
+    if (cb->hit_int_raw) rec->hit_int_raw = __int_raw;
+    if (cb->value_start) rec->value_start = __value_start;
+}
+
+/**
+ * Describe what the parser will record with. Zeroed first so that padding
+ * hashes and compares the same
+ * @return the selector's paths; empty if there's no selector */
+static const char* __context(__ctx_t* ctx, const bencode_t* s)
+{
+    const bencode_callbacks_t* cb = &s->cb;
+
+    memset(ctx, 0, sizeof(__ctx_t));
+    ctx->cbs = (cb->dict_enter ? 1u << 0 : 0) |
+        (cb->dict_leave ? 1u << 1 : 0) |
+        (cb->list_enter ? 1u << 2 : 0) |
+        (cb->list_leave ? 1u << 3 : 0) |
+        (cb->list_next ? 1u << 4 : 0) |
+        (cb->dict_next ? 1u << 5 : 0) |
+        (cb->str_sink ? 1u << 6 : 0) |
+        (cb->hit_int_raw ? 1u << 7 : 0) |
+        (cb->value_start ? 1u << 8 : 0);
+    memcpy(&ctx->limits, &s->limits, sizeof(bencode_limits_t));
+    ctx->canonical = s->canonical;
+    if (!s->selector)
+        return "";
+    ctx->selector = 1;
+    return bencode_selector_paths(s->selector, &ctx->sel_len);
+}
+
+static void __get(const char** p, void* out, unsigned int len)
+{
+    memcpy(out, *p, len);
+    *p += len;
+}
+
+/**
+ * Put the parser back in the state it was in when the event fired */
+static void __get_state(bencode_t* s, const char** p)
+{
+    unsigned int d, lo, i, prefix, tail;
+
+    __get(p, &d, sizeof(d));
+    __get(p, &s->off, sizeof(s->off));
+    __get(p, &lo, sizeof(lo));
+    for (i = lo; i <= d; i++)
+    {
+        bencode_frame_t* f = &s->stk[i];
+        __snap_t sn;
+
+        __get(p, &sn, sizeof(sn));
+        f->start = sn.start;
+        f->kstart = sn.kstart;
+        f->path_off = sn.path_off;
+        f->idx = sn.idx;
+        f->key_off = sn.key_off;
+        f->type = sn.type;
+        f->sel_mode = sn.sel_mode;
+        f->sel_match = sn.sel_match;
+    }
+    s->d = d;
+
+    __get(p, &prefix, sizeof(prefix));
+    __get(p, &tail, sizeof(tail));
+    memcpy(s->path + prefix, *p, tail);
+    *p += tail;
+    s->path_len = prefix + tail;
+    s->path[s->path_len] = '\0';
+}
+
+/**
+ * Call the user's callbacks with the events we recorded, with the parser's
+ * depth, offset, path and frames as they were when each fired
+ * @return 0 on error; otherwise 1 */
+static int __replay(bencode_t* s, __entry_t* e)
+{
+    bencode_callbacks_t* cb = &s->cb;
+    const char* p = e->data + e->ctx.sel_len + e->len;
+    const char* end = p + e->tape_len;
+
+    while (p < end)
+    {
+        const char* key = NULL;
+        unsigned int klen, len, total;
+        long long int val;
+        char ev;
+        int type, ok = 1;
+
+        __get(&p, &ev, 1);
+        __get(&p, &klen, sizeof(klen));
+        if (NO_KEY != klen)
+        {
+            key = p;
+            p += klen + 1;
+        }
+        __get_state(s, &p);
+
+        switch (ev)
+        {
+        case EV_INT:
+            __get(&p, &val, sizeof(val));
+            ok = cb->hit_int(s, key, val);
+            break;
+        case EV_INT_RAW:
+            __get(&p, &len, sizeof(len));
+            ok = cb->hit_int_raw(s, key, p, len);
+            p += len;
+            break;
+        case EV_STR:
+        {
+            const unsigned char* str;
+            unsigned char* sink;
+
+            __get(&p, &total, sizeof(total));
+            __get(&p, &len, sizeof(len));
+            str = (const unsigned char*)p;
+
+            /* the parser fills the sink with the string, so we do too */
+            if (0 < total && cb->str_sink &&
+                    (sink = cb->str_sink(s, key, total)))
+            {
+                memcpy(sink, p, len);
+                str = sink;
+            }
+            ok = cb->hit_str(s, key, total, str, len);
+            p += len;
+            break;
+        }
+        case EV_DICT_ENTER: ok = cb->dict_enter(s, key); break;
+        case EV_DICT_LEAVE: ok = cb->dict_leave(s, key); break;
+        case EV_LIST_ENTER: ok = cb->list_enter(s, key); break;
+        case EV_LIST_LEAVE: ok = cb->list_leave(s, key); break;
+        case EV_LIST_NEXT: ok = cb->list_next(s); break;
+        case EV_DICT_NEXT: ok = cb->dict_next(s); break;
+        case EV_VALUE_START:
+            __get(&p, &type, sizeof(type));
+            ok = cb->value_start(s, key, type);
+            break;
+        case EV_END:
+            break;
+        }
+
+        if (!ok)
+        {
+            s->err = BENCODE_ERR_CALLBACK;
+            s->err_off = s->off;
+            s->err_depth = s->d;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static unsigned long int __size(__entry_t* e)
+{
+    return sizeof(__entry_t) + e->ctx.sel_len + e->len + e->tape_len;
+}
+
+static void __unlink(bencode_memo_t* me, __entry_t* e)
+{
+    if (e->prev)
+        e->prev->next = e->next;
+    else
+        me->head = e->next;
+    if (e->next)
+        e->next->prev = e->prev;
+    else
+        me->tail = e->prev;
+}
+
+static void __push_front(bencode_memo_t* me, __entry_t* e)
+{
+    e->prev = NULL;
+    e->next = me->head;
+    if (me->head)
+        me->head->prev = e;
+    else
+        me->tail = e;
+    me->head = e;
+}
+
+static __entry_t* __find(
+        bencode_memo_t* me,
+        uint64_t hash,
+        const __ctx_t* ctx,
+        const char* paths,
+        const char* buf,
+        unsigned int len)
+{
+    __entry_t* e;
+
+    for (e = me->buckets[hash & (me->nbuckets - 1)]; e; e = e->hnext)
+        if (e->hash == hash && e->len == len &&
+                0 == memcmp(&e->ctx, ctx, sizeof(__ctx_t)) &&
+                0 == memcmp(e->data, paths, ctx->sel_len) &&
+                0 == memcmp(e->data + ctx->sel_len, buf, len))
+            return e;
+    return NULL;
+}
+
+static void __evict(bencode_memo_t* me)
+{
+    __entry_t* e = me->tail;
+    __entry_t** p = &me->buckets[e->hash & (me->nbuckets - 1)];
+
+    while (*p != e)
+        p = &(*p)->hnext;
+    *p = e->hnext;
+
+    __unlink(me, e);
+    me->stats.mem -= __size(e);
+    me->stats.entries--;
+    me->stats.evictions++;
+    free(e);
+}
+
+static void __grow(bencode_memo_t* me)
+{
+    unsigned int nbuckets = me->nbuckets * 2, i;
+    __entry_t** buckets = calloc(nbuckets, sizeof(__entry_t*));
+
+    for (i = 0; i < me->nbuckets; i++)
+        while (me->buckets[i])
+        {
+            __entry_t* e = me->buckets[i];
+
+            me->buckets[i] = e->hnext;
+            e->hnext = buckets[e->hash & (nbuckets - 1)];
+            buckets[e->hash & (nbuckets - 1)] = e;
+        }
+
+    free(me->buckets);
+    me->buckets = buckets;
+    me->nbuckets = nbuckets;
+}
+
+/**
+ * Remember the message and the events we've just recorded for it */
+static void __insert(
+        bencode_memo_t* me,
+        uint64_t hash,
+        const __ctx_t* ctx,
+        const char* paths,
+        const char* buf,
+        unsigned int len)
+{
+    unsigned long int size =
+        sizeof(__entry_t) + ctx->sel_len + len + me->tape_len;
+    __entry_t* e;
+
+    /* it'd push out everything else, and still not fit */
+    if (me->max_mem < size)
+        return;
+
+    while (me->head && me->max_mem < me->stats.mem + size)
+        __evict(me);
+
+    if (me->nbuckets < me->stats.entries)
+        __grow(me);
+
+    e = malloc(size);
+    e->hash = hash;
+    memcpy(&e->ctx, ctx, sizeof(__ctx_t));
+    e->len = len;
+    e->max_d = me->max_d;
+    e->max_path = me->max_path;
+    e->tape_len = me->tape_len;
+    memcpy(e->data, paths, ctx->sel_len);
+    memcpy(e->data + ctx->sel_len, buf, len);
+    memcpy(e->data + ctx->sel_len + len, me->tape, me->tape_len);
+
+    e->hnext = me->buckets[hash & (me->nbuckets - 1)];
+    me->buckets[hash & (me->nbuckets - 1)] = e;
+    __push_front(me, e);
+    me->stats.mem += size;
+    me->stats.entries++;
+}
+
+bencode_memo_t* bencode_memo_new(unsigned long int max_mem)
+{
+    bencode_memo_t* me;
+
+    me = calloc(1, sizeof(bencode_memo_t));
+    me->max_mem = max_mem;
+    me->nbuckets = 64;
+    me->buckets = calloc(me->nbuckets, sizeof(__entry_t*));
+    me->tape_size = 256;
+    me->tape = malloc(me->tape_size);
+    return me;
+}
+
+int bencode_memo_dispatch_from_buffer(
+        bencode_memo_t* me,
+        bencode_t* s,
+        const char* buf,
+        unsigned int len)
+{
+    bencode_callbacks_t rec;
+    const char* paths;
+    __ctx_t ctx;
+    uint64_t hash;
+    __entry_t* e;
+    int ok;
+
+    bencode_reset(s);
+
+    /* a pooled parser has no stack to put the state back into */
+    if (s->cb.hit_slice || (s->cb.hit_batch && s->batch_size) || s->pool)
+        return bencode_dispatch_from_buffer(s, buf, len);
+
+    paths = __context(&ctx, s);
+    hash = bencode_xxh64(&ctx, sizeof(ctx), 0);
+    hash = bencode_xxh64(paths, ctx.sel_len, hash);
+    hash = bencode_xxh64(buf, len, hash);
+    e = __find(me, hash, &ctx, paths, buf, len);
+
+    /* too deep for this parser; let it report so */
+    if (e && s->nframes <= e->max_d)
+    {
+        me->stats.misses++;
+        return bencode_dispatch_from_buffer(s, buf, len);
+    }
+
+    if (e)
+    {
+        if (s->path_size <= e->max_path)
+        {
+            char* path = realloc(s->path, e->max_path + 1);
+
+            if (!path)
+            {
+                s->err = BENCODE_ERR_MEMORY;
+                return 0;
+            }
+            s->mem += e->max_path + 1 - s->path_size;
+            s->path = path;
+            s->path_size = e->max_path + 1;
+        }
+
+        me->stats.hits++;
+        __unlink(me, e);
+        __push_front(me, e);
+        return __replay(s, e);
+    }
+    me->stats.misses++;
+
+    /* parse with our callbacks in front of the user's */
+    memcpy(&me->cb, &s->cb, sizeof(bencode_callbacks_t));
+    me->udata = s->udata;
+    me->tape_len = 0;
+    me->oom = 0;
+    me->shadow_d = -1;
+    me->spath_len = 0;
+    me->max_d = 0;
+    me->max_path = 0;
+    __recorder(&rec, &me->cb);
+    bencode_set_callbacks(s, &rec);
+    s->udata = me;
+
+    ok = bencode_dispatch_from_buffer(s, buf, len);
+
+    bencode_set_callbacks(s, &me->cb);
+    s->udata = me->udata;
+
+    /* a message that's cut short isn't worth remembering */
+    if (ok && 0 == s->d && BENCODE_TOK_NONE == s->stk[0].type)
+    {
+        __put_event(me, s, EV_END, NULL);
+        if (!me->oom)
+            __insert(me, hash, &ctx, paths, buf, len);
+    }
+    return ok;
+}
+
+void bencode_memo_stats(
+        bencode_memo_t* me,
+        bencode_memo_stats_t* stats)
+{
+    memcpy(stats, &me->stats, sizeof(bencode_memo_stats_t));
+}
+
+void bencode_memo_free(bencode_memo_t* me)
+{
+    while (me->head)
+    {
+        __entry_t* e = me->head;
+
+        me->head = e->next;
+        free(e);
+    }
+    free(me->buckets);
+    free(me->tape);
+    free(me->shadow);
+    free(me->spath);
+    free(me);
+}
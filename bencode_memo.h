@@ -0,0 +1,80 @@
+#ifndef BENCODE_MEMO_H
+#define BENCODE_MEMO_H
+
+#include <stdint.h>
+
+typedef struct bencode_memo_s bencode_memo_t;
+
+typedef struct {
+    /* messages whose events were replayed */
+    unsigned long int hits;
+
+    /* messages that were parsed */
+    unsigned long int misses;
+
+    /* messages dropped to stay under max_mem */
+    unsigned long int evictions;
+
+    /* messages held */
+    unsigned int entries;
+
+    /* bytes held by the messages and their events */
+    unsigned long int mem;
+} bencode_memo_stats_t;
+
+/**
+ * Remember the callbacks each message produced, so that a message seen
+ * before has them replayed instead of being parsed again. Messages are
+ * known by their xxHash64, and compared byte for byte on a hit. A
+ * message is only replayed into a parser with the same callbacks set,
+ * selector paths, limits and canonical check as the one it was parsed
+ * with; parsers alike in those can share a cache. The least recently used are
+ * dropped once max_mem is reached.
+ *
+ * @param max_mem Most heap the messages and their events may take up
+ * @return new cache
+ */
+bencode_memo_t* bencode_memo_new(unsigned long int max_mem);
+
+/**
+ * Parse a buffer holding whole messages, or replay the callbacks it
+ * produced last time. The parser is reset first.
+ *
+ * Replayed callbacks get the same arguments as when the message was
+ * parsed, and see the same depth, path, offsets and frames through the
+ * parser. Strings go through str_sink as they would when parsed. Only
+ * messages that parse without error are remembered. Lazy mode, batching
+ * and pooled parsers bypass the cache.
+ *
+ * @param s The parser, with the callbacks to deliver to
+ * @param buf The messages
+ * @param len The size of the buffer
+ * @return 0 on error; otherwise 1
+ */
+int bencode_memo_dispatch_from_buffer(
+        bencode_memo_t*,
+        bencode_t* s,
+        const char* buf,
+        unsigned int len);
+
+/**
+ * @param stats Filled in with the cache's counters
+ */
+void bencode_memo_stats(
+        bencode_memo_t*,
+        bencode_memo_stats_t* stats);
+
+void bencode_memo_free(bencode_memo_t*);
+
+/**
+ * @param buf The bytes to hash
+ * @param len Number of bytes
+ * @param seed Seed for the hash
+ * @return xxHash64 of buf
+ */
+uint64_t bencode_xxh64(
+        const void* buf,
+        unsigned long int len,
+        uint64_t seed);
+
+#endif /* BENCODE_MEMO_H */
@@ -0,0 +1,706 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Scan on one thread, and fire callbacks on another
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "bencode.h"
+#include "bencode_pipe.h"
+
+/* records start with their type and a 4 byte length; strings, keys and
+ * integers are followed by that many bytes */
+enum {
+    R_FIN,
+    R_INT,
+    R_STR,
+    R_KEY,
+    R_LIST,
+    R_DICT,
+    R_END
+};
+
+/* what the scanner is in the middle of */
+enum {
+    T_NONE,
+    T_INT,
+    T_LEN,
+    T_BODY
+};
+
+/* a container, as the callbacks thread sees it */
+typedef struct {
+    int type;
+
+    /* key of the item at this depth, if its container is a dict */
+    char* key;
+    unsigned int ksize;
+} __frame_t;
+
+struct bencode_pipe_s {
+    /* what the callbacks are given */
+    bencode_t* ben;
+    bencode_callbacks_t cb;
+    pthread_t thread;
+    int joined;
+
+    char* ring;
+    uint64_t mask;
+
+    /* the scanner's side. The tail is how far we've written, and is
+     * published every so often to pub_tail */
+    char pad0[64];
+    uint64_t tail;
+    uint64_t head_seen;
+
+    /* containers the scanner is within, BENCODE_TOK_LIST or _DICT */
+    int* open;
+    /* each dict is waiting for a key */
+    char* want_key;
+    unsigned int d;
+    unsigned int nframes;
+
+    int tok;
+    int is_key;
+    unsigned long int len;
+    char* digits;
+    unsigned int ndigits;
+    unsigned int digits_size;
+
+    /* we've written R_FIN */
+    int fin;
+    int err;
+
+    /* the callbacks thread's side */
+    char pad1[64];
+    uint64_t head;
+    uint64_t tail_seen;
+    uint64_t head_pub;
+
+    __frame_t* frames;
+    unsigned int cd;
+    char* sbuf;
+    unsigned int sbuf_size;
+
+    /* shared between the threads */
+    char pad2[64];
+    uint64_t pub_tail;
+    uint64_t pub_head;
+    /* BENCODE_ERR_* the callbacks thread stopped with */
+    int cb_failed;
+    char pad3[64];
+};
+
+/**
+ * Back off while the other thread catches up. We spin at first, since the
+ * other thread is usually only a moment away */
+static void __pause(unsigned int* spins)
+{
+    if (++(*spins) < 64)
+        return;
+    else if (*spins < 128)
+        sched_yield();
+    else
+    {
+        struct timespec ts = { 0, 20000 };
+
+        nanosleep(&ts, NULL);
+    }
+}
+
+static int __failed(bencode_pipe_t* me)
+{
+    return __atomic_load_n(&me->cb_failed, __ATOMIC_ACQUIRE);
+}
+
+static void __publish_tail(bencode_pipe_t* me)
+{
+    __atomic_store_n(&me->pub_tail, me->tail, __ATOMIC_RELEASE);
+}
+
+/**
+ * Write into the ring, waiting for room as we go
+ * @return 0 if the callbacks have failed; otherwise 1 */
+static int __put(bencode_pipe_t* me, const void* buf, unsigned long int len)
+{
+    const char* p = buf;
+    uint64_t size = me->mask + 1;
+    unsigned int spins = 0;
+
+    while (0 < len)
+    {
+        uint64_t room = size - (me->tail - me->head_seen);
+        uint64_t n, at;
+
+        if (0 == room)
+        {
+            __publish_tail(me);
+            me->head_seen = __atomic_load_n(&me->pub_head, __ATOMIC_ACQUIRE);
+            if (me->head_seen == me->tail - size)
+            {
+                if (__failed(me))
+                    return 0;
+                __pause(&spins);
+            }
+            continue;
+        }
+
+        at = me->tail & me->mask;
+        n = len < room ? len : room;
+        if (size - at < n)
+            n = size - at;
+        memcpy(me->ring + at, p, n);
+        me->tail += n;
+        p += n;
+        len -= n;
+        spins = 0;
+    }
+
+    return 1;
+}
+
+static int __put_hdr(bencode_pipe_t* me, char type, uint32_t len)
+{
+    char hdr[5];
+
+    hdr[0] = type;
+    memcpy(hdr + 1, &len, 4);
+    return __put(me, hdr, 5);
+}
+
+static int __fail(bencode_pipe_t* me, int err)
+{
+    /* the callbacks thread may have stopped for a reason of its own */
+    if (BENCODE_ERR_CALLBACK == err && __failed(me))
+        err = __failed(me);
+    if (BENCODE_ERR_NONE == me->err)
+        me->err = err;
+    return 0;
+}
+
+/**
+ * A value has ended; a dict it's within wants a key next */
+static void __value_done(bencode_pipe_t* me)
+{
+    if (0 < me->d && BENCODE_TOK_DICT == me->open[me->d - 1])
+        me->want_key[me->d - 1] = 1;
+}
+
+static int __int_done(bencode_pipe_t* me)
+{
+    long long int val;
+    unsigned int i, neg = 0 < me->ndigits && '-' == me->digits[0];
+
+    if (me->ndigits == neg)
+        return __fail(me, BENCODE_ERR_BAD_INT);
+    for (i = neg; i < me->ndigits; i++)
+        if (me->digits[i] < '0' || '9' < me->digits[i])
+            return __fail(me, BENCODE_ERR_BAD_INT);
+
+    /* only hit_int_raw can take this */
+    if (!me->cb.hit_int_raw &&
+        !bencode_slice_int(me->digits, me->ndigits, &val))
+        return __fail(me, BENCODE_ERR_INT_OVERFLOW);
+
+    if (!__put_hdr(me, R_INT, me->ndigits) ||
+        !__put(me, me->digits, me->ndigits))
+        return __fail(me, BENCODE_ERR_CALLBACK);
+    me->tok = T_NONE;
+    __value_done(me);
+    return 1;
+}
+
+static void __str_done(bencode_pipe_t* me)
+{
+    me->tok = T_NONE;
+    if (me->is_key)
+        me->want_key[me->d - 1] = 0;
+    else
+        __value_done(me);
+}
+
+/**
+ * Scan what we can of the buffer
+ * @return 0 on error; otherwise 1 */
+static int __scan(bencode_pipe_t* me, const char* buf, unsigned int len)
+{
+    const char* end = buf + len;
+
+    while (buf < end)
+    {
+        char c = *buf;
+
+        switch (me->tok)
+        {
+        case T_NONE:
+            {
+                int top = 0 < me->d ? me->open[me->d - 1] : 0;
+
+                if (BENCODE_TOK_DICT == top && me->want_key[me->d - 1])
+                {
+                    if ('e' != c && (c < '0' || '9' < c))
+                        return __fail(me, BENCODE_ERR_BAD_KEY);
+                }
+
+                if ('e' == c && (BENCODE_TOK_LIST == top ||
+                        (BENCODE_TOK_DICT == top && me->want_key[me->d - 1])))
+                {
+                    if (!__put_hdr(me, R_END, 0))
+                        return __fail(me, BENCODE_ERR_CALLBACK);
+                    me->d--;
+                    __value_done(me);
+                }
+                else if ('0' <= c && c <= '9')
+                {
+                    me->tok = T_LEN;
+                    me->is_key = BENCODE_TOK_DICT == top &&
+                        me->want_key[me->d - 1];
+                    me->len = c - '0';
+                }
+                else if ('i' == c)
+                {
+                    me->tok = T_INT;
+                    me->ndigits = 0;
+                }
+                else if ('l' == c || 'd' == c)
+                {
+                    if (me->nframes <= me->d + 1)
+                        return __fail(me, BENCODE_ERR_TOO_DEEP);
+                    if (!__put_hdr(me, 'l' == c ? R_LIST : R_DICT, 0))
+                        return __fail(me, BENCODE_ERR_CALLBACK);
+                    me->open[me->d] = 'l' == c ?
+                        BENCODE_TOK_LIST : BENCODE_TOK_DICT;
+                    me->want_key[me->d] = 'd' == c;
+                    me->d++;
+                }
+                else
+                    return __fail(me, BENCODE_ERR_BAD_VALUE);
+                buf++;
+                break;
+            }
+        case T_INT:
+            if ('e' == c)
+            {
+                if (!__int_done(me))
+                    return 0;
+            }
+            else
+            {
+                /* "-9223372036854775808" is the longest that fits */
+                if (!me->cb.hit_int_raw && 20 <= me->ndigits)
+                    return __fail(me, BENCODE_ERR_INT_OVERFLOW);
+                if (me->digits_size == me->ndigits)
+                {
+                    char* digits = realloc(me->digits, me->digits_size * 2);
+
+                    if (!digits)
+                        return __fail(me, BENCODE_ERR_MEMORY);
+                    me->digits = digits;
+                    me->digits_size *= 2;
+                }
+                me->digits[me->ndigits++] = c;
+            }
+            buf++;
+            break;
+        case T_LEN:
+            if ('0' <= c && c <= '9')
+            {
+                me->len = me->len * 10 + (c - '0');
+                if (INT_MAX < me->len)
+                    return __fail(me, BENCODE_ERR_TOO_LONG);
+            }
+            else if (':' == c)
+            {
+                if (!__put_hdr(me, me->is_key ? R_KEY : R_STR, me->len))
+                    return __fail(me, BENCODE_ERR_CALLBACK);
+                if (0 == me->len)
+                    __str_done(me);
+                else
+                    me->tok = T_BODY;
+            }
+            else
+                return __fail(me, BENCODE_ERR_BAD_STR_LEN);
+            buf++;
+            break;
+        case T_BODY:
+            {
+                unsigned long int n = end - buf;
+
+                /* take as much of the string as we have in one go */
+                if (me->len < n)
+                    n = me->len;
+                if (!__put(me, buf, n))
+                    return __fail(me, BENCODE_ERR_CALLBACK);
+                buf += n;
+                me->len -= n;
+                if (0 == me->len)
+                    __str_done(me);
+                break;
+            }
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Wait for the scanner to write something
+ * @param len The most we want
+ * @param n Set to how many bytes we can have in a row, 1 to len
+ * @return where they are in the ring */
+static const char* __peek(bencode_pipe_t* me, unsigned long int len,
+        unsigned long int* n)
+{
+    uint64_t size = me->mask + 1;
+    uint64_t avail, at;
+    unsigned int spins = 0;
+
+    while (0 == (avail = me->tail_seen - me->head))
+    {
+        __atomic_store_n(&me->pub_head, me->head, __ATOMIC_RELEASE);
+        me->head_pub = me->head;
+        me->tail_seen = __atomic_load_n(&me->pub_tail, __ATOMIC_ACQUIRE);
+        if (me->tail_seen == me->head)
+            __pause(&spins);
+    }
+
+    at = me->head & me->mask;
+    *n = len < avail ? len : avail;
+    if (size - at < *n)
+        *n = size - at;
+    return me->ring + at;
+}
+
+/**
+ * We're done with bytes we peeked at */
+static void __consumed(bencode_pipe_t* me, unsigned long int n)
+{
+    me->head += n;
+
+    /* let the scanner have the room back before it runs out */
+    if ((me->mask + 1) / 4 <= me->head - me->head_pub)
+    {
+        __atomic_store_n(&me->pub_head, me->head, __ATOMIC_RELEASE);
+        me->head_pub = me->head;
+    }
+}
+
+/**
+ * Read from the ring, waiting for the scanner as we go */
+static void __get(bencode_pipe_t* me, void* buf, unsigned long int len)
+{
+    char* p = buf;
+
+    while (0 < len)
+    {
+        unsigned long int n;
+        const char* at = __peek(me, len, &n);
+
+        memcpy(p, at, n);
+        __consumed(me, n);
+        p += n;
+        len -= n;
+    }
+}
+
+/**
+ * @return the dict key of the value at the current depth; NULL if it's
+ *         not within a dict */
+static const char* __key(bencode_pipe_t* me)
+{
+    if (0 < me->cd && BENCODE_TOK_DICT == me->frames[me->cd - 1].type)
+        return me->frames[me->cd].key;
+    return NULL;
+}
+
+/**
+ * A value has finished; tell the container it's in */
+static int __next(bencode_pipe_t* me)
+{
+    bencode_t* s = me->ben;
+    bencode_callbacks_t* cb = &me->cb;
+
+    if (0 == me->cd)
+        return 1;
+    if (BENCODE_TOK_LIST == me->frames[me->cd - 1].type)
+        return !cb->list_next || cb->list_next(s);
+    return !cb->dict_next || cb->dict_next(s);
+}
+
+/**
+ * Make sure the buffer can take len bytes and a NUL
+ * @return 0 if we're out of memory; otherwise 1 */
+static int __reserve(char** buf, unsigned int* size, uint32_t len)
+{
+    char* p;
+
+    if (len < *size)
+        return 1;
+    if (!(p = realloc(*buf, (unsigned long int)len + 1)))
+        return 0;
+    *buf = p;
+    *size = len + 1;
+    return 1;
+}
+
+/**
+ * Hand the string to hit_str straight out of the ring, as much as is in a
+ * row at a time
+ * @return 0 if hit_str failed; otherwise 1 */
+static int __str_chunks(bencode_pipe_t* me, const char* key, uint32_t len)
+{
+    bencode_t* s = me->ben;
+    unsigned long int left = len;
+
+    /* the parser gives empty strings as NULL */
+    if (0 == len)
+        return me->cb.hit_str(s, key, 0, NULL, 0);
+
+    while (0 < left)
+    {
+        unsigned long int n;
+        const char* p = __peek(me, left, &n);
+
+        /* the scanner can't have the bytes back until we're done */
+        if (!me->cb.hit_str(s, key, len, (const unsigned char*)p, n))
+            return 0;
+        __consumed(me, n);
+        left -= n;
+    }
+    return 1;
+}
+
+/**
+ * Fire the callbacks for a record
+ * @return BENCODE_ERR_NONE, or why we had to stop */
+static int __event(bencode_pipe_t* me, char type, uint32_t len)
+{
+    bencode_t* s = me->ben;
+    bencode_callbacks_t* cb = &me->cb;
+    const char* key = __key(me);
+
+    switch (type)
+    {
+    case R_KEY:
+        {
+            __frame_t* f = &me->frames[me->cd];
+
+            /* callbacks want the key whole */
+            if (!__reserve(&f->key, &f->ksize, len))
+                return BENCODE_ERR_MEMORY;
+            __get(me, f->key, len);
+            f->key[len] = '\0';
+            return BENCODE_ERR_NONE;
+        }
+    case R_INT:
+        {
+            long long int val;
+
+            if (!__reserve(&me->sbuf, &me->sbuf_size, len))
+                return BENCODE_ERR_MEMORY;
+            __get(me, me->sbuf, len);
+            me->sbuf[len] = '\0';
+
+            if (cb->value_start && !cb->value_start(s, key, BENCODE_TOK_INT))
+                return BENCODE_ERR_CALLBACK;
+            if (cb->hit_int_raw && !cb->hit_int_raw(s, key, me->sbuf, len))
+                return BENCODE_ERR_CALLBACK;
+            if (bencode_slice_int(me->sbuf, len, &val) &&
+                !cb->hit_int(s, key, val))
+                return BENCODE_ERR_CALLBACK;
+            return __next(me) ? BENCODE_ERR_NONE : BENCODE_ERR_CALLBACK;
+        }
+    case R_STR:
+        {
+            unsigned char* sink = NULL;
+
+            if (cb->value_start && !cb->value_start(s, key, BENCODE_TOK_STR))
+                return BENCODE_ERR_CALLBACK;
+            if (cb->str_sink)
+                sink = cb->str_sink(s, key, len);
+            if (sink)
+            {
+                __get(me, sink, len);
+                if (!cb->hit_str(s, key, len, sink, len))
+                    return BENCODE_ERR_CALLBACK;
+            }
+            else if (!__str_chunks(me, key, len))
+                return BENCODE_ERR_CALLBACK;
+            return __next(me) ? BENCODE_ERR_NONE : BENCODE_ERR_CALLBACK;
+        }
+    case R_LIST:
+    case R_DICT:
+        {
+            int t = R_LIST == type ? BENCODE_TOK_LIST : BENCODE_TOK_DICT;
+
+            if (cb->value_start && !cb->value_start(s, key, t))
+                return BENCODE_ERR_CALLBACK;
+            if (BENCODE_TOK_LIST == t ?
+                    cb->list_enter && !cb->list_enter(s, key) :
+                    cb->dict_enter && !cb->dict_enter(s, key))
+                return BENCODE_ERR_CALLBACK;
+            me->frames[me->cd++].type = t;
+            return BENCODE_ERR_NONE;
+        }
+    case R_END:
+        {
+            int t = me->frames[--me->cd].type;
+
+            key = __key(me);
+            if (BENCODE_TOK_LIST == t ?
+                    cb->list_leave && !cb->list_leave(s, key) :
+                    cb->dict_leave && !cb->dict_leave(s, key))
+                return BENCODE_ERR_CALLBACK;
+            return __next(me) ? BENCODE_ERR_NONE : BENCODE_ERR_CALLBACK;
+        }
+    }
+
+    return BENCODE_ERR_NONE;
+}
+
+static void* __consume(void* arg)
+{
+    bencode_pipe_t* me = arg;
+
+    while (1)
+    {
+        char hdr[5];
+        uint32_t len;
+        int err;
+
+        __get(me, hdr, 5);
+        if (R_FIN == hdr[0])
+            break;
+
+        memcpy(&len, hdr + 1, 4);
+        if (BENCODE_ERR_NONE != (err = __event(me, hdr[0], len)))
+        {
+            __atomic_store_n(&me->cb_failed, err, __ATOMIC_RELEASE);
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+bencode_pipe_t* bencode_pipe_new(
+        int expected_depth,
+        bencode_callbacks_t* cb,
+        void* udata,
+        unsigned int ring_size)
+{
+    bencode_pipe_t* me;
+    uint64_t size = 64;
+
+    if (0 == ring_size)
+        ring_size = 1 << 20;
+    while (size < ring_size)
+        size *= 2;
+
+    me = calloc(1, sizeof(bencode_pipe_t));
+    me->ben = bencode_new(expected_depth, cb, udata);
+    memcpy(&me->cb, cb, sizeof(bencode_callbacks_t));
+    me->ring = malloc(size);
+    me->mask = size - 1;
+    me->nframes = 10 + expected_depth;
+    me->open = calloc(me->nframes, sizeof(int));
+    me->want_key = calloc(me->nframes, 1);
+    me->frames = calloc(me->nframes + 1, sizeof(__frame_t));
+    me->digits_size = 32;
+    me->digits = malloc(me->digits_size);
+
+    if (0 != pthread_create(&me->thread, NULL, __consume, me))
+    {
+        me->joined = 1;
+        bencode_pipe_free(me);
+        return NULL;
+    }
+    return me;
+}
+
+int bencode_pipe_dispatch_from_buffer(
+        bencode_pipe_t* me,
+        const char* buf,
+        unsigned int len)
+{
+    int ok;
+
+    if (me->fin || me->err)
+        return 0;
+
+    if (__failed(me))
+        return __fail(me, BENCODE_ERR_CALLBACK);
+
+    ok = __scan(me, buf, len);
+    __publish_tail(me);
+
+    /* let the callbacks finish what was good */
+    if (!ok)
+        bencode_pipe_finish(me);
+    return ok;
+}
+
+/**
+ * Wait for the callbacks thread to finish */
+static void __join(bencode_pipe_t* me)
+{
+    if (me->joined)
+        return;
+
+    /* if the callbacks failed, nobody's reading the ring */
+    if (!me->fin && (__failed(me) || __put_hdr(me, R_FIN, 0)))
+        __publish_tail(me);
+    me->fin = 1;
+    pthread_join(me->thread, NULL);
+    me->joined = 1;
+}
+
+int bencode_pipe_finish(bencode_pipe_t* me)
+{
+    /* cut short */
+    if (!me->fin && (0 != me->d || T_NONE != me->tok))
+        __fail(me, BENCODE_ERR_BAD_STATE);
+
+    __join(me);
+
+    if (__failed(me))
+        __fail(me, BENCODE_ERR_CALLBACK);
+    return BENCODE_ERR_NONE == me->err;
+}
+
+int bencode_pipe_error(bencode_pipe_t* me)
+{
+    if (BENCODE_ERR_NONE == me->err && __failed(me))
+        return __failed(me);
+    return me->err;
+}
+
+void bencode_pipe_free(bencode_pipe_t* me)
+{
+    unsigned int i;
+
+    __join(me);
+    for (i = 0; i < me->nframes + 1; i++)
+        free(me->frames[i].key);
+    bencode_free(me->ben);
+    free(me->frames);
+    free(me->open);
+    free(me->want_key);
+    free(me->digits);
+    free(me->sbuf);
+    free(me->ring);
+    free(me);
+}
@@ -0,0 +1,63 @@
+#ifndef BENCODE_PIPE_H
+#define BENCODE_PIPE_H
+
+typedef struct bencode_pipe_s bencode_pipe_t;
+
+/**
+ * Parse one long stream on two threads. The thread that dispatches scans
+ * the input and checks it's well formed, writing a compact record of each
+ * token into a ring. A thread of our own reads the records and fires the
+ * callbacks. Reading the input, scanning it and handling the callbacks
+ * all overlap.
+ *
+ * The callbacks run on our thread, in the same order and with the same
+ * arguments they would get from bencode_dispatch_from_buffer(). s->udata
+ * is udata; the parser's path, offsets and stack aren't maintained.
+ * Strings are handed to hit_str straight out of the ring, a piece at a
+ * time when they're longer than what's in a row of it, and aren't NUL
+ * terminated; or they're copied into str_sink's buffer.
+ * Selectors, lazy mode, batching, limits and canonical checking aren't
+ * supported.
+ *
+ * @param expected_depth The expected depth of the bencode
+ * @param cb The callbacks we need to parse the bencode
+ * @param udata User data for the callbacks
+ * @param ring_size Bytes of records in flight between the threads,
+ *        rounded up to a power of 2; 0 for 1MB
+ * @return new pipeline; NULL if the thread couldn't be started
+ */
+bencode_pipe_t* bencode_pipe_new(
+        int expected_depth,
+        bencode_callbacks_t* cb,
+        void* udata,
+        unsigned int ring_size);
+
+/**
+ * Scan the next chunk of the stream. The callbacks for it may still be
+ * running when this returns, but the buffer can be reused straight away.
+ * @param buf The buffer to read new input from
+ * @param len The size of the buffer
+ * @return 0 on error, including a callback that has already failed;
+ *         otherwise 1
+ */
+int bencode_pipe_dispatch_from_buffer(
+        bencode_pipe_t*,
+        const char* buf,
+        unsigned int len);
+
+/**
+ * Wait for the callbacks to catch up with everything dispatched so far.
+ * Nothing can be dispatched afterwards.
+ * @return 0 if the stream was malformed or cut short, or a callback
+ *         failed; otherwise 1
+ */
+int bencode_pipe_finish(bencode_pipe_t*);
+
+/**
+ * @return why the pipeline failed, BENCODE_ERR_*
+ */
+int bencode_pipe_error(bencode_pipe_t*);
+
+void bencode_pipe_free(bencode_pipe_t*);
+
+#endif /* BENCODE_PIPE_H */
@@ -0,0 +1,443 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Rewrite a document as it streams through
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bencode.h"
+#include "bencode_rewrite.h"
+
+/* which of the user's callbacks we're in, ie. what a mark applies to */
+enum {
+    CTX_NONE,
+    CTX_START,
+    CTX_INT,
+    CTX_LEAVE
+};
+
+struct bencode_rewrite_s {
+    bencode_t* ben;
+
+    bencode_callbacks_t cb;
+    void* udata;
+
+    bencode_rewrite_write_f write;
+    void* wudata;
+
+    /* the buffer we're dispatching, and the offset of its first byte */
+    const char* buf;
+    unsigned long int base;
+
+    /* input before this offset has been written out or dropped */
+    unsigned long int out_off;
+
+    /* input held over from earlier buffers, starting at carry_off */
+    char* carry;
+    unsigned int carry_len;
+    unsigned int carry_size;
+    unsigned long int carry_off;
+
+    /* CTX_* */
+    int ctx;
+
+    /* we're dropping the value at this depth until it ends */
+    int dropping;
+    unsigned int drop_d;
+
+    /* the write callback failed */
+    int failed;
+};
+
+static void __write(bencode_rewrite_t* me, const char* buf, unsigned int len)
+{
+    if (0 < len && !me->failed && !me->write(me->wudata, buf, len))
+        me->failed = 1;
+}
+
+/**
+ * Write out the input up to this offset, from what we've held over and
+ * then from the buffer */
+static void __copy_to(bencode_rewrite_t* me, unsigned long int to)
+{
+    unsigned long int from = me->out_off;
+
+    if (to <= from)
+        return;
+
+    if (from < me->base)
+    {
+        unsigned long int end = to < me->base ? to : me->base;
+
+        __write(me, me->carry + (from - me->carry_off), end - from);
+        from = end;
+    }
+
+    __write(me, me->buf + (from - me->base), to - from);
+    me->out_off = to;
+}
+
+/**
+ * @return offset of the current item, including its key within a dict */
+static unsigned long int __item_start(bencode_t* s)
+{
+    if (0 < s->d && BENCODE_TOK_DICT == s->stk[s->d - 1].type)
+        return bencode_key_offset(s);
+    return bencode_value_offset(s);
+}
+
+/**
+ * The value at the current depth has ended at this byte */
+static void __end(bencode_rewrite_t* me, bencode_t* s)
+{
+    if (me->dropping && me->drop_d == s->d)
+    {
+        me->out_off = bencode_offset(s) + 1;
+        me->dropping = 0;
+    }
+}
+
+int bencode_rewrite_insert(
+        bencode_rewrite_t* me,
+        const char* buf,
+        unsigned int len)
+{
+    bencode_t* s = me->ben;
+
+    /* it's all going anyway */
+    if (me->dropping)
+        return 1;
+
+    switch (me->ctx)
+    {
+    case CTX_START:
+        __copy_to(me, __item_start(s));
+        break;
+    case CTX_INT:
+        __copy_to(me, bencode_offset(s) + 1);
+        break;
+    case CTX_LEAVE:
+        __copy_to(me, bencode_offset(s));
+        break;
+    default:
+        return 0;
+    }
+
+    __write(me, buf, len);
+    return 1;
+}
+
+int bencode_rewrite_replace(
+        bencode_rewrite_t* me,
+        const char* buf,
+        unsigned int len)
+{
+    bencode_t* s = me->ben;
+
+    if (me->dropping)
+        return 1;
+    if (CTX_START != me->ctx && CTX_INT != me->ctx)
+        return 0;
+
+    __copy_to(me, bencode_value_offset(s));
+    __write(me, buf, len);
+    me->dropping = 1;
+    me->drop_d = s->d;
+
+    /* the integer has already ended */
+    if (CTX_INT == me->ctx)
+        __end(me, s);
+    return 1;
+}
+
+int bencode_rewrite_delete(bencode_rewrite_t* me)
+{
+    bencode_t* s = me->ben;
+
+    if (me->dropping)
+        return 1;
+    if (CTX_START != me->ctx && CTX_INT != me->ctx)
+        return 0;
+
+    __copy_to(me, __item_start(s));
+    me->dropping = 1;
+    me->drop_d = s->d;
+
+    if (CTX_INT == me->ctx)
+        __end(me, s);
+    return 1;
+}
+
+/* the user's callbacks get their own udata, and can only mark what's
+ * appropriate for the callback they're in */
+#define CALL(me, s, ctx_, call) \
+    do { \
+        int r_; \
+        (me)->ctx = (ctx_); \
+        (s)->udata = (me)->udata; \
+        r_ = (call); \
+        (s)->udata = (me); \
+        (me)->ctx = CTX_NONE; \
+        if (!r_) \
+            return 0; \
+    } while (0)
+
+static int __value_start(bencode_t *s, const char *dict_key, int type)
+{
+    bencode_rewrite_t* me = s->udata;
+
+    if (me->cb.value_start)
+        CALL(me, s, CTX_START, me->cb.value_start(s, dict_key, type));
+    return !me->failed;
+}
+
+static int __int(bencode_t *s,
+        const char *dict_key,
+        const long long int val)
+{
+    bencode_rewrite_t* me = s->udata;
+
+    if (me->cb.hit_int)
+        CALL(me, s, CTX_INT, me->cb.hit_int(s, dict_key, val));
+    __end(me, s);
+    return !me->failed;
+}
+
+static int __int_raw(bencode_t *s,
+        const char *dict_key,
+        const char *digits,
+        unsigned int len)
+{
+    bencode_rewrite_t* me = s->udata;
+    long long int val;
+
+    if (me->cb.hit_int_raw)
+        CALL(me, s, CTX_NONE, me->cb.hit_int_raw(s, dict_key, digits, len));
+
+    /* too big for hit_int, which would otherwise end it */
+    if (!bencode_slice_int(digits, len, &val))
+        __end(me, s);
+    return !me->failed;
+}
+
+static int __str(bencode_t *s,
+        const char *dict_key,
+        unsigned int v_total_len,
+        const unsigned char* val,
+        unsigned int v_len)
+{
+    bencode_rewrite_t* me = s->udata;
+
+    if (me->cb.hit_str)
+        CALL(me, s, CTX_NONE,
+                me->cb.hit_str(s, dict_key, v_total_len, val, v_len));
+    __end(me, s);
+    return !me->failed;
+}
+
+static unsigned char* __sink(bencode_t *s,
+        const char *dict_key,
+        unsigned int v_total_len)
+{
+    bencode_rewrite_t* me = s->udata;
+    unsigned char* sink;
+
+    if (!me->cb.str_sink)
+        return NULL;
+    s->udata = me->udata;
+    sink = me->cb.str_sink(s, dict_key, v_total_len);
+    s->udata = me;
+    return sink;
+}
+
+static int __dict_enter(bencode_t *s, const char *dict_key)
+{
+    bencode_rewrite_t* me = s->udata;
+
+    if (me->cb.dict_enter)
+        CALL(me, s, CTX_NONE, me->cb.dict_enter(s, dict_key));
+    return 1;
+}
+
+static int __list_enter(bencode_t *s, const char *dict_key)
+{
+    bencode_rewrite_t* me = s->udata;
+
+    if (me->cb.list_enter)
+        CALL(me, s, CTX_NONE, me->cb.list_enter(s, dict_key));
+    return 1;
+}
+
+static int __dict_leave(bencode_t *s, const char *dict_key)
+{
+    bencode_rewrite_t* me = s->udata;
+
+    if (me->cb.dict_leave)
+        CALL(me, s, CTX_LEAVE, me->cb.dict_leave(s, dict_key));
+    __end(me, s);
+    return !me->failed;
+}
+
+static int __list_leave(bencode_t *s, const char *dict_key)
+{
+    bencode_rewrite_t* me = s->udata;
+
+    if (me->cb.list_leave)
+        CALL(me, s, CTX_LEAVE, me->cb.list_leave(s, dict_key));
+    __end(me, s);
+    return !me->failed;
+}
+
+static int __list_next(bencode_t *s)
+{
+    bencode_rewrite_t* me = s->udata;
+
+    if (me->cb.list_next)
+        CALL(me, s, CTX_NONE, me->cb.list_next(s));
+    return 1;
+}
+
+static int __dict_next(bencode_t *s)
+{
+    bencode_rewrite_t* me = s->udata;
+
+    if (me->cb.dict_next)
+        CALL(me, s, CTX_NONE, me->cb.dict_next(s));
+    return 1;
+}
+
+static bencode_callbacks_t __cb = {
+    .hit_int = __int,
+    .hit_str = __str,
+    .dict_enter = __dict_enter,
+    .dict_leave = __dict_leave,
+    .list_enter = __list_enter,
+    .list_leave = __list_leave,
+    .list_next = __list_next,
+    .dict_next = __dict_next,
+    .str_sink = __sink,
+    .hit_int_raw = __int_raw,
+    .value_start = __value_start,
+};
+
+/**
+ * @return offset where we have to start holding input, in case the item
+ *         that's in progress gets changed */
+static unsigned long int __hold(bencode_rewrite_t* me)
+{
+    bencode_t* s = me->ben;
+    bencode_frame_t* f = &s->stk[s->d];
+
+    if (me->dropping)
+        return bencode_offset(s);
+
+    switch (f->type)
+    {
+    case BENCODE_TOK_DICT_KEYLEN:
+        /* no key yet */
+        if (0 == f->pos)
+            break;
+        /* fall through */
+    case BENCODE_TOK_DICT_KEY:
+    case BENCODE_TOK_DICT_VAL:
+    case BENCODE_TOK_INT:
+        return __item_start(s);
+    }
+
+    return bencode_offset(s);
+}
+
+bencode_rewrite_t* bencode_rewrite_new(
+        int expected_depth,
+        bencode_callbacks_t* cb,
+        void* udata,
+        bencode_rewrite_write_f write,
+        void* wudata)
+{
+    bencode_rewrite_t* me;
+
+    me = calloc(1, sizeof(bencode_rewrite_t));
+    me->ben = bencode_new(expected_depth, &__cb, me);
+    memcpy(&me->cb, cb, sizeof(bencode_callbacks_t));
+    me->udata = udata;
+    me->write = write;
+    me->wudata = wudata;
+    return me;
+}
+
+int bencode_rewrite_dispatch_from_buffer(
+        bencode_rewrite_t* me,
+        const char* buf,
+        unsigned int len)
+{
+    unsigned long int hold, end;
+    int ok;
+
+    me->buf = buf;
+    me->base = bencode_offset(me->ben);
+
+    ok = bencode_dispatch_from_buffer(me->ben, buf, len);
+    if (!ok || me->failed)
+        return 0;
+
+    end = bencode_offset(me->ben);
+    hold = __hold(me);
+    if (hold < me->out_off)
+        hold = me->out_off;
+
+    if (me->dropping)
+    {
+        me->out_off = end;
+        me->carry_len = 0;
+        return 1;
+    }
+
+    __copy_to(me, hold);
+
+    /* hold on to the rest; some of it might already be held over */
+    if (hold < me->base)
+    {
+        memmove(me->carry, me->carry + (hold - me->carry_off),
+                me->base - hold);
+        me->carry_len = me->base - hold;
+    }
+    else
+        me->carry_len = 0;
+
+    if (me->carry_size < end - hold)
+    {
+        me->carry_size = end - hold;
+        me->carry = realloc(me->carry, me->carry_size);
+    }
+
+    if (me->base < end && hold < end)
+    {
+        unsigned long int from = hold < me->base ? me->base : hold;
+
+        memcpy(me->carry + me->carry_len, buf + (from - me->base), end - from);
+        me->carry_len += end - from;
+    }
+    me->carry_off = hold;
+    me->out_off = hold;
+    return 1;
+}
+
+bencode_t* bencode_rewrite_parser(bencode_rewrite_t* me)
+{
+    return me->ben;
+}
+
+void bencode_rewrite_free(bencode_rewrite_t* me)
+{
+    bencode_free(me->ben);
+    free(me->carry);
+    free(me);
+}
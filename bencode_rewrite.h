@@ -0,0 +1,101 @@
+#ifndef BENCODE_REWRITE_H
+#define BENCODE_REWRITE_H
+
+typedef struct bencode_rewrite_s bencode_rewrite_t;
+
+/**
+ * Called with the next piece of the rewritten document. Untouched input
+ * is handed over where it sits within the buffer given to
+ * bencode_rewrite_dispatch_from_buffer(), without being copied.
+ * @param udata User data passed to bencode_rewrite_new()
+ * @param buf The next piece of output; only valid during the call
+ * @param len The length of buf
+ * @return 0 on error; otherwise 1
+ */
+typedef int (*bencode_rewrite_write_f)(
+        void* udata,
+        const char* buf,
+        unsigned int len);
+
+/**
+ * Rewrite a document as it streams through, copying everything that
+ * isn't touched to the output as it is.
+ *
+ * Values are changed from within the callbacks, which get the parser as
+ * usual with s->udata set to udata:
+ *
+ * - value_start: bencode_rewrite_insert() puts bytes before the value (and
+ *   its key, within a dict), bencode_rewrite_replace() swaps the value for
+ *   new bytes and bencode_rewrite_delete() drops the value along with its
+ *   key.
+ * - hit_int: as value_start, except bencode_rewrite_insert() puts bytes
+ *   after the integer. This is the place to change an integer based on
+ *   its value.
+ * - dict_leave and list_leave: bencode_rewrite_insert() puts bytes before
+ *   the container's 'e', eg. to append a dict item.
+ *
+ * The bytes of a dict key are held until its value starts, and an integer
+ * is held until it ends; everything else goes straight through. Lazy mode
+ * and batching aren't supported.
+ *
+ * @param expected_depth The expected depth of the bencode
+ * @param cb The callbacks that decide what to change; any may be NULL
+ * @param udata User data for the callbacks
+ * @param write Called to hand over the output
+ * @param wudata User data for write
+ * @return new rewriter
+ */
+bencode_rewrite_t* bencode_rewrite_new(
+        int expected_depth,
+        bencode_callbacks_t* cb,
+        void* udata,
+        bencode_rewrite_write_f write,
+        void* wudata);
+
+/**
+ * Rewrite the next chunk of the document
+ * @param buf The buffer to read new input from
+ * @param len The size of the buffer
+ * @return 0 on error; otherwise 1
+ */
+int bencode_rewrite_dispatch_from_buffer(
+        bencode_rewrite_t*,
+        const char* buf,
+        unsigned int len);
+
+/**
+ * Put bytes into the output; see bencode_rewrite_new() for where
+ * @param buf The bytes, which should be valid bencode where they go
+ * @param len The length of buf
+ * @return 0 if not called from a callback that can insert; otherwise 1
+ */
+int bencode_rewrite_insert(
+        bencode_rewrite_t*,
+        const char* buf,
+        unsigned int len);
+
+/**
+ * Swap the current value for new bytes, keeping its key
+ * @param buf The new value
+ * @param len The length of buf
+ * @return 0 if not called from value_start or hit_int; otherwise 1
+ */
+int bencode_rewrite_replace(
+        bencode_rewrite_t*,
+        const char* buf,
+        unsigned int len);
+
+/**
+ * Drop the current value, along with its key
+ * @return 0 if not called from value_start or hit_int; otherwise 1
+ */
+int bencode_rewrite_delete(bencode_rewrite_t*);
+
+/**
+ * @return the parser, for bencode_error() and friends
+ */
+bencode_t* bencode_rewrite_parser(bencode_rewrite_t*);
+
+void bencode_rewrite_free(bencode_rewrite_t*);
+
+#endif /* BENCODE_REWRITE_H */
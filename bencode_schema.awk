@@ -0,0 +1,305 @@
+#!/usr/bin/awk -f
+
+# Generate typed decoders from a schema.
+#
+#   awk -f bencode_schema.awk -v out=schemas/torrent schemas/torrent.schema
+#
+# writes schemas/torrent.h and schemas/torrent.c. A schema describes dicts
+# as structs:
+#
+#   # the info dict of a .torrent
+#   struct torrent_info "info"
+#       int  length        "length"        optional
+#       str  name          "name"          required
+#       int  piece_length  "piece length"  required
+#   end
+#
+# The quoted path after the struct's name says where the dict is, written
+# like a selector; "" is the document itself. Each field has a type (int or
+# str), a C name, the dict key it's read from, and whether it's required.
+# At most 32 fields per struct.
+#
+# Values the schema doesn't mention are skipped, however they're nested, up
+# to -v skip_depth=N levels below the struct (32 unless set).
+
+function fail(msg)
+{
+    printf("%s:%d: %s\n", FILENAME, FNR, msg) > "/dev/stderr"
+    failed = 1
+    exit 1
+}
+
+# the quoted string starting at or after position 'from' of $0
+# Sets q_end to the position just after the closing quote
+function quoted(from,    s, i, j)
+{
+    s = substr($0, from)
+    i = index(s, "\"")
+    if (0 == i)
+        fail("expected a quoted string")
+    s = substr(s, i + 1)
+    j = index(s, "\"")
+    if (0 == j)
+        fail("unterminated string")
+    q_end = from + i + j
+    s = substr(s, 1, j - 1)
+    if (s ~ /\\/)
+        fail("backslashes aren't allowed in keys or paths")
+    return s
+}
+
+# number of path components, which is the parser depth of the dict's items
+# minus one
+function ncomponents(path,    n, s)
+{
+    if ("" == path)
+        return 0
+    n = 1
+    s = path
+    n += gsub(/\./, "", s)
+    n += gsub(/\[/, "", s)
+    return n
+}
+
+BEGIN {
+    if ("" == out)
+    {
+        print "usage: awk -f bencode_schema.awk -v out=<basename> <schema>" > "/dev/stderr"
+        failed = 1
+        exit 1
+    }
+    ns = 0
+    in_struct = 0
+}
+
+/^[ \t]*(#|$)/ { next }
+
+$1 == "struct" {
+    if (in_struct)
+        fail("missing 'end'")
+    if ($2 !~ /^[A-Za-z_][A-Za-z0-9_]*$/)
+        fail("bad struct name '" $2 "'")
+    ns++
+    sname[ns] = $2
+    spath[ns] = quoted(index($0, $2) + length($2))
+    nf[ns] = 0
+    in_struct = 1
+    next
+}
+
+$1 == "end" {
+    if (!in_struct)
+        fail("'end' without 'struct'")
+    if (0 == nf[ns])
+        fail("struct " sname[ns] " has no fields")
+    in_struct = 0
+    next
+}
+
+{
+    if (!in_struct)
+        fail("field outside of a struct")
+    if ("int" != $1 && "str" != $1)
+        fail("unknown type '" $1 "'")
+    if ($2 !~ /^[A-Za-z_][A-Za-z0-9_]*$/)
+        fail("bad field name '" $2 "'")
+    if (32 == nf[ns])
+        fail("more than 32 fields")
+
+    n = ++nf[ns]
+    ftype[ns, n] = $1
+    fname[ns, n] = $2
+    fkey[ns, n] = quoted(index($0, $2) + length($2))
+    if (fkey[ns, n] ~ /[.*[\]]/)
+        fail("keys with '.', '*', '[' or ']' can't be selected")
+    if (1024 < length(fkey[ns, n]))
+        fail("key is too long")
+
+    rest = substr($0, q_end)
+    gsub(/[ \t]/, "", rest)
+    if ("required" != rest && "optional" != rest)
+        fail("expected 'required' or 'optional'")
+    freq[ns, n] = "required" == rest
+
+    for (i = 1; i < n; i++)
+        if (fkey[ns, i] == fkey[ns, n])
+            fail("key \"" fkey[ns, n] "\" used twice")
+}
+
+END {
+    if (failed)
+        exit 1
+    if (in_struct)
+    {
+        printf("%s: missing 'end'\n", FILENAME) > "/dev/stderr"
+        exit 1
+    }
+
+    h = out ".h"
+    c = out ".c"
+    base = out
+    sub(/.*\//, "", base)
+    guard = toupper(base) "_SCHEMA_H"
+
+    printf("/* Generated from %s by bencode_schema.awk. Do not edit. */\n\n", FILENAME) > h
+    printf("#ifndef %s\n#define %s\n\n#include \"bencode.h\"\n", guard, guard) > h
+
+    printf("/* Generated from %s by bencode_schema.awk. Do not edit. */\n\n", FILENAME) > c
+    printf("#include <stdlib.h>\n#include <string.h>\n\n") > c
+    printf("#include \"bencode.h\"\n#include \"%s.h\"\n", base) > c
+
+    for (s = 1; s <= ns; s++)
+        gen_struct(s)
+
+    printf("\n#endif /* %s */\n", guard) > h
+}
+
+function gen_struct(s,    p, P, i, depth, req, klen, first, has_int)
+{
+    p = sname[s]
+    P = toupper(p)
+    depth = ncomponents(spath[s]) + 1 + (skip_depth ? skip_depth : 32)
+    has_int = 0
+    for (i = 1; i <= nf[s]; i++)
+        if ("int" == ftype[s, i])
+            has_int = 1
+
+    # header
+    printf("\n/* the dict at \"%s\" */\ntypedef struct {\n", spath[s]) > h
+    for (i = 1; i <= nf[s]; i++)
+    {
+        printf("    /* \"%s\", %s */\n", fkey[s, i], freq[s, i] ? "required" : "optional") > h
+        if ("int" == ftype[s, i])
+            printf("    long long int %s;\n", fname[s, i]) > h
+        else
+            printf("    char* %s;\n    unsigned int %s_len;\n", fname[s, i], fname[s, i]) > h
+        printf("\n") > h
+    }
+    printf("    /* %s_* bits of the fields we've read */\n    unsigned int seen;\n} %s_t;\n\n", P, p) > h
+
+    req = ""
+    for (i = 1; i <= nf[s]; i++)
+    {
+        printf("#define %s_%s (1u << %d)\n", P, toupper(fname[s, i]), i - 1) > h
+        if (freq[s, i])
+            req = req ("" == req ? "" : " | ") P "_" toupper(fname[s, i])
+    }
+    printf("#define %s_REQUIRED (%s)\n\n", P, "" == req ? "0" : req) > h
+
+    printf("/**\n * @param out Where the fields are written; zeroed first\n") > h
+    printf(" * @return parser that fills in out. Dispatch to it, then call\n") > h
+    printf(" *         %s_finish(). NULL if we're out of memory\n */\n", p) > h
+    printf("bencode_t* %s_parser_new(%s_t* out);\n\n", p, p) > h
+    printf("/**\n * Free the parser\n") > h
+    printf(" * @return 0 if the input was malformed, a field had the wrong type, or a\n") > h
+    printf(" *         required field is missing; otherwise 1\n */\n") > h
+    printf("int %s_finish(bencode_t*);\n\n", p) > h
+    printf("/**\n * Decode a whole document\n") > h
+    printf(" * @return 0 on error; otherwise 1\n */\n") > h
+    printf("int %s_decode(const char* buf, unsigned int len, %s_t* out);\n\n", p, p) > h
+    printf("/**\n * Free the strings we've read */\n") > h
+    printf("void %s_free(%s_t*);\n", p, p) > h
+
+    # selectors for exactly our fields, so everything else is skipped
+    printf("\nstatic const char* __%s_paths[] = {\n", p) > c
+    for (i = 1; i <= nf[s]; i++)
+        printf("    \"%s%s%s\",\n", spath[s], "" == spath[s] ? "" : ".", fkey[s, i]) > c
+    printf("};\n") > c
+
+    # key matching, grouped by length
+    printf("\n/**\n * @return the field with this key; -1 if there isn't one */\n") > c
+    printf("static int __%s_field(const char* key)\n{\n", p) > c
+    printf("    if (!key)\n        return -1;\n\n    switch (strlen(key))\n    {\n") > c
+    for (klen = 0; klen <= 1024; klen++)
+    {
+        first = 1
+        for (i = 1; i <= nf[s]; i++)
+        {
+            if (length(fkey[s, i]) != klen)
+                continue
+            if (first)
+                printf("    case %d:\n", klen) > c
+            first = 0
+            printf("        if (0 == memcmp(key, \"%s\", %d))\n            return %d;\n", fkey[s, i], klen, i - 1) > c
+        }
+        if (!first)
+            printf("        break;\n") > c
+    }
+    printf("    }\n    return -1;\n}\n") > c
+
+    # integers
+    printf("\nstatic int __%s_int(bencode_t *s,\n        const char *dict_key,\n", p) > c
+    printf("        const long long int val%s)\n{\n", has_int ? "" : " __attribute__((__unused__))") > c
+    printf("    %s_t* me = s->udata;\n    int i = __%s_field(dict_key);\n\n", p, p) > c
+    printf("    switch (i)\n    {\n") > c
+    for (i = 1; i <= nf[s]; i++)
+        if ("int" == ftype[s, i])
+            printf("    case %d: me->%s = val; break;\n", i - 1, fname[s, i]) > c
+    printf("    /* not an integer field */\n    default: return 0;\n    }\n") > c
+    printf("    me->seen |= 1u << i;\n    return 1;\n}\n") > c
+
+    # strings are written by the parser straight into the struct
+    printf("\nstatic unsigned char* __%s_sink(bencode_t *s,\n", p) > c
+    printf("        const char *dict_key,\n        unsigned int v_total_len)\n{\n") > c
+    printf("    %s_t* me = s->udata;\n    char** str;\n\n", p) > c
+    printf("    switch (__%s_field(dict_key))\n    {\n", p) > c
+    for (i = 1; i <= nf[s]; i++)
+        if ("str" == ftype[s, i])
+            printf("    case %d: str = &me->%s; break;\n", i - 1, fname[s, i]) > c
+    printf("    default: return NULL;\n    }\n") > c
+    printf("    free(*str);\n    *str = malloc(v_total_len + 1);\n") > c
+    printf("    /* if NULL, __%s_str fails us */\n", p) > c
+    printf("    return (unsigned char*)*str;\n}\n") > c
+
+    printf("\nstatic int __%s_str(bencode_t *s,\n        const char *dict_key,\n", p) > c
+    printf("        unsigned int v_total_len,\n") > c
+    printf("        const unsigned char* val __attribute__((__unused__)),\n") > c
+    printf("        unsigned int v_len __attribute__((__unused__)))\n{\n") > c
+    printf("    %s_t* me = s->udata;\n    int i = __%s_field(dict_key);\n", p, p) > c
+    printf("    char** str;\n    unsigned int* len;\n\n") > c
+    printf("    switch (i)\n    {\n") > c
+    for (i = 1; i <= nf[s]; i++)
+        if ("str" == ftype[s, i])
+            printf("    case %d: str = &me->%s; len = &me->%s_len; break;\n", i - 1, fname[s, i], fname[s, i]) > c
+    printf("    /* not a string field */\n    default: return 0;\n    }\n\n") > c
+    printf("    /* empty strings don't go through the sink */\n") > c
+    printf("    if (0 == v_total_len)\n    {\n        free(*str);\n        *str = malloc(1);\n    }\n") > c
+    printf("    /* out of memory */\n    if (!*str)\n        return 0;\n") > c
+    printf("    (*str)[v_total_len] = '\\0';\n    *len = v_total_len;\n") > c
+    printf("    me->seen |= 1u << i;\n    return 1;\n}\n") > c
+
+    printf("\n/**\n * Fields are integers or strings, never lists or dicts */\n") > c
+    printf("static int __%s_container(bencode_t *s __attribute__((__unused__)),\n", p) > c
+    printf("        const char *dict_key __attribute__((__unused__)))\n{\n    return 0;\n}\n") > c
+
+    printf("\nstatic bencode_callbacks_t __%s_cb = {\n", p) > c
+    printf("    .hit_int = __%s_int,\n    .hit_str = __%s_str,\n", p, p) > c
+    printf("    .dict_enter = __%s_container,\n    .list_enter = __%s_container,\n", p, p) > c
+    printf("    .str_sink = __%s_sink,\n};\n", p) > c
+
+    printf("\nbencode_t* %s_parser_new(%s_t* out)\n{\n", p, p) > c
+    printf("    bencode_selector_t* sel;\n    bencode_t* s;\n\n") > c
+    printf("    memset(out, 0, sizeof(%s_t));\n", p) > c
+    printf("    if (!(sel = bencode_selector_new(__%s_paths, %d)))\n        return NULL;\n", p, nf[s]) > c
+    printf("    if (!(s = bencode_new(%d, &__%s_cb, out)))\n    {\n", depth, p) > c
+    printf("        bencode_selector_free(sel);\n        return NULL;\n    }\n") > c
+    printf("    bencode_set_selector(s, sel);\n    return s;\n}\n") > c
+
+    printf("\nint %s_finish(bencode_t* s)\n{\n    %s_t* out = s->udata;\n", p, p) > c
+    printf("    bencode_selector_t* sel = s->selector;\n") > c
+    printf("    int ok = BENCODE_ERR_NONE == bencode_error(s) &&\n") > c
+    printf("        0 == s->d && BENCODE_TOK_NONE == s->stk[0].type &&\n") > c
+    printf("        %s_REQUIRED == (out->seen & %s_REQUIRED);\n\n", P, P) > c
+    printf("    bencode_free(s);\n    bencode_selector_free(sel);\n    return ok;\n}\n") > c
+
+    printf("\nint %s_decode(const char* buf, unsigned int len, %s_t* out)\n{\n", p, p) > c
+    printf("    bencode_t* s = %s_parser_new(out);\n\n", p) > c
+    printf("    if (!s)\n        return 0;\n") > c
+    printf("    bencode_dispatch_from_buffer(s, buf, len);\n    return %s_finish(s);\n}\n", p) > c
+
+    printf("\nvoid %s_free(%s_t* me)\n{\n", p, p) > c
+    for (i = 1; i <= nf[s]; i++)
+        if ("str" == ftype[s, i])
+            printf("    free(me->%s);\n", fname[s, i]) > c
+    printf("    memset(me, 0, sizeof(%s_t));\n}\n", p) > c
+}
@@ -0,0 +1,319 @@
+
+
+/* This is auto-generated code. Edit at your own peril. */
+#include <stdio.h>
+#include "CuTest.h"
+
+
+extern void TestBencodeTest_add_sibling_adds_sibling(CuTest*);
+extern void TestBencodeTest_add_child_adds_child(CuTest*);
+extern void TestBencode_fail_if_depth_not_sufficient(CuTest*);
+extern void TestBencodeIntValue(CuTest*);
+extern void TestBencodeIntValue2(CuTest*);
+extern void TestBencodeIntValueLarge(CuTest*);
+extern void TestBencodeIntValue64(CuTest*);
+extern void TestBencodeIntValueNegative(CuTest*);
+extern void TestBencodeIntValueExtremes(CuTest*);
+extern void TestBencodeIntValueSplitAcrossBuffers(CuTest*);
+extern void TestBencodeIntOverflow(CuTest*);
+extern void TestBencodeIntMalformed(CuTest*);
+extern void TestBencodeIntRawDigits(CuTest*);
+extern void TestBencodeIsIntEmpty(CuTest*);
+extern void TestBencodeStringValue(CuTest*);
+extern void TestBencodeStringValue2(CuTest*);
+extern void TestBencodeStringHandlesNonAscii0(CuTest*);
+extern void TestBencodeStringValueWithColon(CuTest*);
+extern void TestBencodeIsList(CuTest*);
+extern void TestBencodeListGetNext(CuTest*);
+extern void TestBencodeListInListWithValue(CuTest*);
+extern void TestBencodeListDoesntHasNextWhenEmpty(CuTest*);
+extern void TestBencodeEmptyListInListWontGetNextIfEmpty(CuTest*);
+extern void TestBencodeEmptyListInListWontGetNextTwiceIfEmpty(CuTest*);
+extern void TestBencodeListGetNextTwiceWhereOnlyOneAvailable(CuTest*);
+extern void TestBencodeListGetNextTwice(CuTest*);
+extern void TestBencodeDictGetNext(CuTest*);
+extern void TestBencodeDictWontGetNextIfEmpty(CuTest*);
+extern void TestBencodeDictGetNextTwice(CuTest*);
+extern void TestBencodeDictGetNextTwiceOnlyIfSecondKeyValid(CuTest*);
+extern void TestBencodeDictGetNextInnerList(CuTest*);
+extern void TestBencodeDictInnerList(CuTest*);
+extern void TestBencodeStringValueIsZeroLength(CuTest*);
+extern void TestBencodeListNextGetsCalled(CuTest*);
+extern void TestBencodeDictNextGetsCalled(CuTest*);
+extern void TestBencodeListLeaveGetsCalled(CuTest*);
+extern void TestBencodeDictLeaveGetsCalled(CuTest*);
+extern void TestBencodePathIncludesKeysAndListIndices(CuTest*);
+extern void TestBencodePathOfTopLevelList(CuTest*);
+extern void TestBencodePathComponents(CuTest*);
+extern void TestBencodeSelectorOnlyDeliversMatchingValues(CuTest*);
+extern void TestBencodeSelectorDeliversWholeSubtree(CuTest*);
+extern void TestBencodeSelectorSkipsAcrossBufferBoundaries(CuTest*);
+extern void TestBencodeSelectorRejectsInvalidSelectors(CuTest*);
+extern void TestBencodeStringSinkReceivesBytesDirectly(CuTest*);
+extern void TestBencodeStringSinkDeclined(CuTest*);
+extern void TestBencodePooledParserHoldsNothingWhileIdle(CuTest*);
+extern void TestBencodePooledParserLetsGoBetweenTokens(CuTest*);
+extern void TestBencodeParsesConsecutiveDocuments(CuTest*);
+extern void TestBencodeLimitRejectsLongStringBeforeBuffering(CuTest*);
+extern void TestBencodeStringLengthOverflowFails(CuTest*);
+extern void TestBencodeLimitKeyLength(CuTest*);
+extern void TestBencodeLimitItems(CuTest*);
+extern void TestBencodeLimitDocumentBytes(CuTest*);
+extern void TestBencodeLimitMemory(CuTest*);
+extern void TestBencodeErrorBadInt(CuTest*);
+extern void TestBencodeErrorBadValueAndKey(CuTest*);
+extern void TestBencodeBytesOutsideAscii(CuTest*);
+extern void TestBencodeErrorTooDeep(CuTest*);
+extern void TestBencodeErrorLimits(CuTest*);
+extern void TestBencodeErrorCallbackFailed(CuTest*);
+extern void TestBencodeCanonicalAccepted(CuTest*);
+extern void TestBencodeCanonicalKeyOrder(CuTest*);
+extern void TestBencodeCanonicalKeyOrderAcrossBuffers(CuTest*);
+extern void TestBencodeCanonicalNumbers(CuTest*);
+extern void TestBencodeCanonicalLeadingZeroAcrossBuffers(CuTest*);
+extern void TestBencodeLazySlices(CuTest*);
+extern void TestBencodeLazySlicesAcrossBuffers(CuTest*);
+extern void TestBencodeLazyStillValidates(CuTest*);
+extern void TestBencodeSliceConversion(CuTest*);
+extern void TestBencodeBatchedList(CuTest*);
+extern void TestBencodeBatchedListFlushesBeforeContainers(CuTest*);
+extern void TestBencodeBatchedListKeepsOrderWithUnbatchedElements(CuTest*);
+extern void TestBencodeBatchCountsTowardsMaxMem(CuTest*);
+extern void TestBencodeValueStart(CuTest*);
+extern void TestBencodeJsonNested(CuTest*);
+extern void TestBencodeJsonEmptyDict(CuTest*);
+extern void TestBencodeJsonEscapesText(CuTest*);
+extern void TestBencodeJsonBinaryAsHex(CuTest*);
+extern void TestBencodeJsonBinaryAsBase64(CuTest*);
+extern void TestBencodeJsonBinaryEscaped(CuTest*);
+extern void TestBencodeJsonHexWritesEveryString(CuTest*);
+extern void TestBencodeJsonKeyWithNul(CuTest*);
+extern void TestBencodeIndexEntries(CuTest*);
+extern void TestBencodeIndexSaveAndLoad(CuTest*);
+extern void TestBencodeIndexTruncated(CuTest*);
+extern void TestBencodeIndexLoadRejectsBadEntries(CuTest*);
+extern void TestBencodeIndexKeys(CuTest*);
+extern void TestBencodeIndexKeysRebuild(CuTest*);
+extern void TestBencodeIndexKeysRebuildKeepsSlots(CuTest*);
+extern void TestBencodeCanonSortsKeys(CuTest*);
+extern void TestBencodeCanonSortsNestedDicts(CuTest*);
+extern void TestBencodeCanonFixesNumbers(CuTest*);
+extern void TestBencodeCanonRepeatedKeyFails(CuTest*);
+extern void TestBencodeCanonMemoryLimit(CuTest*);
+extern void TestBencodeCanonOnlyMovesItemsOutOfPlace(CuTest*);
+extern void TestBencodeKrpcQuery(CuTest*);
+extern void TestBencodeKrpcResponseWithValues(CuTest*);
+extern void TestBencodeKrpcError(CuTest*);
+extern void TestBencodeKrpcBytesOutsideAscii(CuTest*);
+extern void TestBencodeKrpcUnknownKeysAreSkipped(CuTest*);
+extern void TestBencodeKrpcTruncatedPacketsFail(CuTest*);
+extern void TestBencodeKrpcNotAMessage(CuTest*);
+extern void TestBencodeCompactPeers(CuTest*);
+extern void TestBencodeCompactPeersInPieces(CuTest*);
+extern void TestBencodeCompactNodes(CuTest*);
+extern void TestBencodeCompactPeers6(CuTest*);
+extern void TestBencodeSchemaDecodesInfo(CuTest*);
+extern void TestBencodeSchemaDecodesRootInPieces(CuTest*);
+extern void TestBencodeSchemaRequiredField(CuTest*);
+extern void TestBencodeSchemaWrongType(CuTest*);
+extern void TestBencodeSchemaRejectsSelectorSyntaxInKeys(CuTest*);
+extern void TestBencodeDomInt(CuTest*);
+extern void TestBencodeDomListIsContiguous(CuTest*);
+extern void TestBencodeDomDictIsSorted(CuTest*);
+extern void TestBencodeDomInPieces(CuTest*);
+extern void TestBencodeDomBigDocument(CuTest*);
+extern void TestBencodeDomOneDocumentOnly(CuTest*);
+extern void TestBencodeDomBadInput(CuTest*);
+extern void TestBencodeRewrite(CuTest*);
+extern void TestBencodeRewriteInPieces(CuTest*);
+extern void TestBencodeRewriteUntouchedIsNotCopied(CuTest*);
+extern void TestBencodeRewriteBigInt(CuTest*);
+extern void TestBencodeRewriteMarkOutsideCallback(CuTest*);
+extern void TestBencodeSha1(CuTest*);
+extern void TestBencodeBatch(CuTest*);
+extern void TestBencodeBatchFiles(CuTest*);
+extern void TestBencodeBatchIngest(CuTest*);
+extern void TestBencodeHash(CuTest*);
+extern void TestBencodeHashSelector(CuTest*);
+extern void TestBencodeEqual(CuTest*);
+extern void TestBencodeXxh64(CuTest*);
+extern void TestBencodeMemo(CuTest*);
+extern void TestBencodeMemoEvicts(CuTest*);
+extern void TestBencodeMemoReplaysIntoSink(CuTest*);
+extern void TestBencodeMemoKeyedOnCallbacks(CuTest*);
+extern void TestBencodeMemoKeyedOnSelector(CuTest*);
+extern void TestBencodeMemoKeyWithNul(CuTest*);
+extern void TestBencodeMemoRestoresParserState(CuTest*);
+extern void TestBencodeIntern(CuTest*);
+extern void TestBencodeInternShared(CuTest*);
+extern void TestBencodeInternDom(CuTest*);
+extern void TestBencodePipe(CuTest*);
+extern void TestBencodePipeErrors(CuTest*);
+extern void TestBencodePipeLongRawInt(CuTest*);
+extern void TestBencodePipeStringsComeOutOfTheRing(CuTest*);
+
+
+void RunAllTests(void) 
+{
+    CuString *output = CuStringNew();
+    CuSuite* suite = CuSuiteNew();
+
+
+    SUITE_ADD_TEST(suite, TestBencodeTest_add_sibling_adds_sibling);
+    SUITE_ADD_TEST(suite, TestBencodeTest_add_child_adds_child);
+    SUITE_ADD_TEST(suite, TestBencode_fail_if_depth_not_sufficient);
+    SUITE_ADD_TEST(suite, TestBencodeIntValue);
+    SUITE_ADD_TEST(suite, TestBencodeIntValue2);
+    SUITE_ADD_TEST(suite, TestBencodeIntValueLarge);
+    SUITE_ADD_TEST(suite, TestBencodeIntValue64);
+    SUITE_ADD_TEST(suite, TestBencodeIntValueNegative);
+    SUITE_ADD_TEST(suite, TestBencodeIntValueExtremes);
+    SUITE_ADD_TEST(suite, TestBencodeIntValueSplitAcrossBuffers);
+    SUITE_ADD_TEST(suite, TestBencodeIntOverflow);
+    SUITE_ADD_TEST(suite, TestBencodeIntMalformed);
+    SUITE_ADD_TEST(suite, TestBencodeIntRawDigits);
+    SUITE_ADD_TEST(suite, TestBencodeIsIntEmpty);
+    SUITE_ADD_TEST(suite, TestBencodeStringValue);
+    SUITE_ADD_TEST(suite, TestBencodeStringValue2);
+    SUITE_ADD_TEST(suite, TestBencodeStringHandlesNonAscii0);
+    SUITE_ADD_TEST(suite, TestBencodeStringValueWithColon);
+    SUITE_ADD_TEST(suite, TestBencodeIsList);
+    SUITE_ADD_TEST(suite, TestBencodeListGetNext);
+    SUITE_ADD_TEST(suite, TestBencodeListInListWithValue);
+    SUITE_ADD_TEST(suite, TestBencodeListDoesntHasNextWhenEmpty);
+    SUITE_ADD_TEST(suite, TestBencodeEmptyListInListWontGetNextIfEmpty);
+    SUITE_ADD_TEST(suite, TestBencodeEmptyListInListWontGetNextTwiceIfEmpty);
+    SUITE_ADD_TEST(suite, TestBencodeListGetNextTwiceWhereOnlyOneAvailable);
+    SUITE_ADD_TEST(suite, TestBencodeListGetNextTwice);
+    SUITE_ADD_TEST(suite, TestBencodeDictGetNext);
+    SUITE_ADD_TEST(suite, TestBencodeDictWontGetNextIfEmpty);
+    SUITE_ADD_TEST(suite, TestBencodeDictGetNextTwice);
+    SUITE_ADD_TEST(suite, TestBencodeDictGetNextTwiceOnlyIfSecondKeyValid);
+    SUITE_ADD_TEST(suite, TestBencodeDictGetNextInnerList);
+    SUITE_ADD_TEST(suite, TestBencodeDictInnerList);
+    SUITE_ADD_TEST(suite, TestBencodeStringValueIsZeroLength);
+    SUITE_ADD_TEST(suite, TestBencodeListNextGetsCalled);
+    SUITE_ADD_TEST(suite, TestBencodeDictNextGetsCalled);
+    SUITE_ADD_TEST(suite, TestBencodeListLeaveGetsCalled);
+    SUITE_ADD_TEST(suite, TestBencodeDictLeaveGetsCalled);
+    SUITE_ADD_TEST(suite, TestBencodePathIncludesKeysAndListIndices);
+    SUITE_ADD_TEST(suite, TestBencodePathOfTopLevelList);
+    SUITE_ADD_TEST(suite, TestBencodePathComponents);
+    SUITE_ADD_TEST(suite, TestBencodeSelectorOnlyDeliversMatchingValues);
+    SUITE_ADD_TEST(suite, TestBencodeSelectorDeliversWholeSubtree);
+    SUITE_ADD_TEST(suite, TestBencodeSelectorSkipsAcrossBufferBoundaries);
+    SUITE_ADD_TEST(suite, TestBencodeSelectorRejectsInvalidSelectors);
+    SUITE_ADD_TEST(suite, TestBencodeStringSinkReceivesBytesDirectly);
+    SUITE_ADD_TEST(suite, TestBencodeStringSinkDeclined);
+    SUITE_ADD_TEST(suite, TestBencodePooledParserHoldsNothingWhileIdle);
+    SUITE_ADD_TEST(suite, TestBencodePooledParserLetsGoBetweenTokens);
+    SUITE_ADD_TEST(suite, TestBencodeParsesConsecutiveDocuments);
+    SUITE_ADD_TEST(suite, TestBencodeLimitRejectsLongStringBeforeBuffering);
+    SUITE_ADD_TEST(suite, TestBencodeStringLengthOverflowFails);
+    SUITE_ADD_TEST(suite, TestBencodeLimitKeyLength);
+    SUITE_ADD_TEST(suite, TestBencodeLimitItems);
+    SUITE_ADD_TEST(suite, TestBencodeLimitDocumentBytes);
+    SUITE_ADD_TEST(suite, TestBencodeLimitMemory);
+    SUITE_ADD_TEST(suite, TestBencodeErrorBadInt);
+    SUITE_ADD_TEST(suite, TestBencodeErrorBadValueAndKey);
+    SUITE_ADD_TEST(suite, TestBencodeBytesOutsideAscii);
+    SUITE_ADD_TEST(suite, TestBencodeErrorTooDeep);
+    SUITE_ADD_TEST(suite, TestBencodeErrorLimits);
+    SUITE_ADD_TEST(suite, TestBencodeErrorCallbackFailed);
+    SUITE_ADD_TEST(suite, TestBencodeCanonicalAccepted);
+    SUITE_ADD_TEST(suite, TestBencodeCanonicalKeyOrder);
+    SUITE_ADD_TEST(suite, TestBencodeCanonicalKeyOrderAcrossBuffers);
+    SUITE_ADD_TEST(suite, TestBencodeCanonicalNumbers);
+    SUITE_ADD_TEST(suite, TestBencodeCanonicalLeadingZeroAcrossBuffers);
+    SUITE_ADD_TEST(suite, TestBencodeLazySlices);
+    SUITE_ADD_TEST(suite, TestBencodeLazySlicesAcrossBuffers);
+    SUITE_ADD_TEST(suite, TestBencodeLazyStillValidates);
+    SUITE_ADD_TEST(suite, TestBencodeSliceConversion);
+    SUITE_ADD_TEST(suite, TestBencodeBatchedList);
+    SUITE_ADD_TEST(suite, TestBencodeBatchedListFlushesBeforeContainers);
+    SUITE_ADD_TEST(suite, TestBencodeBatchedListKeepsOrderWithUnbatchedElements);
+    SUITE_ADD_TEST(suite, TestBencodeBatchCountsTowardsMaxMem);
+    SUITE_ADD_TEST(suite, TestBencodeValueStart);
+    SUITE_ADD_TEST(suite, TestBencodeJsonNested);
+    SUITE_ADD_TEST(suite, TestBencodeJsonEmptyDict);
+    SUITE_ADD_TEST(suite, TestBencodeJsonEscapesText);
+    SUITE_ADD_TEST(suite, TestBencodeJsonBinaryAsHex);
+    SUITE_ADD_TEST(suite, TestBencodeJsonBinaryAsBase64);
+    SUITE_ADD_TEST(suite, TestBencodeJsonBinaryEscaped);
+    SUITE_ADD_TEST(suite, TestBencodeJsonHexWritesEveryString);
+    SUITE_ADD_TEST(suite, TestBencodeJsonKeyWithNul);
+    SUITE_ADD_TEST(suite, TestBencodeIndexEntries);
+    SUITE_ADD_TEST(suite, TestBencodeIndexSaveAndLoad);
+    SUITE_ADD_TEST(suite, TestBencodeIndexTruncated);
+    SUITE_ADD_TEST(suite, TestBencodeIndexLoadRejectsBadEntries);
+    SUITE_ADD_TEST(suite, TestBencodeIndexKeys);
+    SUITE_ADD_TEST(suite, TestBencodeIndexKeysRebuild);
+    SUITE_ADD_TEST(suite, TestBencodeIndexKeysRebuildKeepsSlots);
+    SUITE_ADD_TEST(suite, TestBencodeCanonSortsKeys);
+    SUITE_ADD_TEST(suite, TestBencodeCanonSortsNestedDicts);
+    SUITE_ADD_TEST(suite, TestBencodeCanonFixesNumbers);
+    SUITE_ADD_TEST(suite, TestBencodeCanonRepeatedKeyFails);
+    SUITE_ADD_TEST(suite, TestBencodeCanonMemoryLimit);
+    SUITE_ADD_TEST(suite, TestBencodeCanonOnlyMovesItemsOutOfPlace);
+    SUITE_ADD_TEST(suite, TestBencodeKrpcQuery);
+    SUITE_ADD_TEST(suite, TestBencodeKrpcResponseWithValues);
+    SUITE_ADD_TEST(suite, TestBencodeKrpcError);
+    SUITE_ADD_TEST(suite, TestBencodeKrpcBytesOutsideAscii);
+    SUITE_ADD_TEST(suite, TestBencodeKrpcUnknownKeysAreSkipped);
+    SUITE_ADD_TEST(suite, TestBencodeKrpcTruncatedPacketsFail);
+    SUITE_ADD_TEST(suite, TestBencodeKrpcNotAMessage);
+    SUITE_ADD_TEST(suite, TestBencodeCompactPeers);
+    SUITE_ADD_TEST(suite, TestBencodeCompactPeersInPieces);
+    SUITE_ADD_TEST(suite, TestBencodeCompactNodes);
+    SUITE_ADD_TEST(suite, TestBencodeCompactPeers6);
+    SUITE_ADD_TEST(suite, TestBencodeSchemaDecodesInfo);
+    SUITE_ADD_TEST(suite, TestBencodeSchemaDecodesRootInPieces);
+    SUITE_ADD_TEST(suite, TestBencodeSchemaRequiredField);
+    SUITE_ADD_TEST(suite, TestBencodeSchemaWrongType);
+    SUITE_ADD_TEST(suite, TestBencodeSchemaRejectsSelectorSyntaxInKeys);
+    SUITE_ADD_TEST(suite, TestBencodeDomInt);
+    SUITE_ADD_TEST(suite, TestBencodeDomListIsContiguous);
+    SUITE_ADD_TEST(suite, TestBencodeDomDictIsSorted);
+    SUITE_ADD_TEST(suite, TestBencodeDomInPieces);
+    SUITE_ADD_TEST(suite, TestBencodeDomBigDocument);
+    SUITE_ADD_TEST(suite, TestBencodeDomOneDocumentOnly);
+    SUITE_ADD_TEST(suite, TestBencodeDomBadInput);
+    SUITE_ADD_TEST(suite, TestBencodeRewrite);
+    SUITE_ADD_TEST(suite, TestBencodeRewriteInPieces);
+    SUITE_ADD_TEST(suite, TestBencodeRewriteUntouchedIsNotCopied);
+    SUITE_ADD_TEST(suite, TestBencodeRewriteBigInt);
+    SUITE_ADD_TEST(suite, TestBencodeRewriteMarkOutsideCallback);
+    SUITE_ADD_TEST(suite, TestBencodeSha1);
+    SUITE_ADD_TEST(suite, TestBencodeBatch);
+    SUITE_ADD_TEST(suite, TestBencodeBatchFiles);
+    SUITE_ADD_TEST(suite, TestBencodeBatchIngest);
+    SUITE_ADD_TEST(suite, TestBencodeHash);
+    SUITE_ADD_TEST(suite, TestBencodeHashSelector);
+    SUITE_ADD_TEST(suite, TestBencodeEqual);
+    SUITE_ADD_TEST(suite, TestBencodeXxh64);
+    SUITE_ADD_TEST(suite, TestBencodeMemo);
+    SUITE_ADD_TEST(suite, TestBencodeMemoEvicts);
+    SUITE_ADD_TEST(suite, TestBencodeMemoReplaysIntoSink);
+    SUITE_ADD_TEST(suite, TestBencodeMemoKeyedOnCallbacks);
+    SUITE_ADD_TEST(suite, TestBencodeMemoKeyedOnSelector);
+    SUITE_ADD_TEST(suite, TestBencodeMemoKeyWithNul);
+    SUITE_ADD_TEST(suite, TestBencodeMemoRestoresParserState);
+    SUITE_ADD_TEST(suite, TestBencodeIntern);
+    SUITE_ADD_TEST(suite, TestBencodeInternShared);
+    SUITE_ADD_TEST(suite, TestBencodeInternDom);
+    SUITE_ADD_TEST(suite, TestBencodePipe);
+    SUITE_ADD_TEST(suite, TestBencodePipeErrors);
+    SUITE_ADD_TEST(suite, TestBencodePipeLongRawInt);
+    SUITE_ADD_TEST(suite, TestBencodePipeStringsComeOutOfTheRing);
+
+    CuSuiteRun(suite);
+    CuSuiteDetails(suite, output);
+    printf("%s\n", output->buffer);
+}
+
+int main()
+{
+    RunAllTests();
+    return 0;
+}
+
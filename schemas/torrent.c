@@ -0,0 +1,345 @@
+/* Generated from schemas/torrent.schema by bencode_schema.awk. Do not edit. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bencode.h"
+#include "torrent.h"
+
+static const char* __torrent_meta_paths[] = {
+    "announce",
+    "creation date",
+    "comment",
+};
+
+/**
+ * @return the field with this key; -1 if there isn't one */
+static int __torrent_meta_field(const char* key)
+{
+    if (!key)
+        return -1;
+
+    switch (strlen(key))
+    {
+    case 7:
+        if (0 == memcmp(key, "comment", 7))
+            return 2;
+        break;
+    case 8:
+        if (0 == memcmp(key, "announce", 8))
+            return 0;
+        break;
+    case 13:
+        if (0 == memcmp(key, "creation date", 13))
+            return 1;
+        break;
+    }
+    return -1;
+}
+
+static int __torrent_meta_int(bencode_t *s,
+        const char *dict_key,
+        const long long int val)
+{
+    torrent_meta_t* me = s->udata;
+    int i = __torrent_meta_field(dict_key);
+
+    switch (i)
+    {
+    case 1: me->creation_date = val; break;
+    /* not an integer field */
+    default: return 0;
+    }
+    me->seen |= 1u << i;
+    return 1;
+}
+
+static unsigned char* __torrent_meta_sink(bencode_t *s,
+        const char *dict_key,
+        unsigned int v_total_len)
+{
+    torrent_meta_t* me = s->udata;
+    char** str;
+
+    switch (__torrent_meta_field(dict_key))
+    {
+    case 0: str = &me->announce; break;
+    case 2: str = &me->comment; break;
+    default: return NULL;
+    }
+    free(*str);
+    *str = malloc(v_total_len + 1);
+    /* if NULL, __torrent_meta_str fails us */
+    return (unsigned char*)*str;
+}
+
+static int __torrent_meta_str(bencode_t *s,
+        const char *dict_key,
+        unsigned int v_total_len,
+        const unsigned char* val __attribute__((__unused__)),
+        unsigned int v_len __attribute__((__unused__)))
+{
+    torrent_meta_t* me = s->udata;
+    int i = __torrent_meta_field(dict_key);
+    char** str;
+    unsigned int* len;
+
+    switch (i)
+    {
+    case 0: str = &me->announce; len = &me->announce_len; break;
+    case 2: str = &me->comment; len = &me->comment_len; break;
+    /* not a string field */
+    default: return 0;
+    }
+
+    /* empty strings don't go through the sink */
+    if (0 == v_total_len)
+    {
+        free(*str);
+        *str = malloc(1);
+    }
+    /* out of memory */
+    if (!*str)
+        return 0;
+    (*str)[v_total_len] = '\0';
+    *len = v_total_len;
+    me->seen |= 1u << i;
+    return 1;
+}
+
+/**
+ * Fields are integers or strings, never lists or dicts */
+static int __torrent_meta_container(bencode_t *s __attribute__((__unused__)),
+        const char *dict_key __attribute__((__unused__)))
+{
+    return 0;
+}
+
+static bencode_callbacks_t __torrent_meta_cb = {
+    .hit_int = __torrent_meta_int,
+    .hit_str = __torrent_meta_str,
+    .dict_enter = __torrent_meta_container,
+    .list_enter = __torrent_meta_container,
+    .str_sink = __torrent_meta_sink,
+};
+
+bencode_t* torrent_meta_parser_new(torrent_meta_t* out)
+{
+    bencode_selector_t* sel;
+    bencode_t* s;
+
+    memset(out, 0, sizeof(torrent_meta_t));
+    if (!(sel = bencode_selector_new(__torrent_meta_paths, 3)))
+        return NULL;
+    if (!(s = bencode_new(33, &__torrent_meta_cb, out)))
+    {
+        bencode_selector_free(sel);
+        return NULL;
+    }
+    bencode_set_selector(s, sel);
+    return s;
+}
+
+int torrent_meta_finish(bencode_t* s)
+{
+    torrent_meta_t* out = s->udata;
+    bencode_selector_t* sel = s->selector;
+    int ok = BENCODE_ERR_NONE == bencode_error(s) &&
+        0 == s->d && BENCODE_TOK_NONE == s->stk[0].type &&
+        TORRENT_META_REQUIRED == (out->seen & TORRENT_META_REQUIRED);
+
+    bencode_free(s);
+    bencode_selector_free(sel);
+    return ok;
+}
+
+int torrent_meta_decode(const char* buf, unsigned int len, torrent_meta_t* out)
+{
+    bencode_t* s = torrent_meta_parser_new(out);
+
+    if (!s)
+        return 0;
+    bencode_dispatch_from_buffer(s, buf, len);
+    return torrent_meta_finish(s);
+}
+
+void torrent_meta_free(torrent_meta_t* me)
+{
+    free(me->announce);
+    free(me->comment);
+    memset(me, 0, sizeof(torrent_meta_t));
+}
+
+static const char* __torrent_info_paths[] = {
+    "info.name",
+    "info.piece length",
+    "info.pieces",
+    "info.length",
+    "info.private",
+};
+
+/**
+ * @return the field with this key; -1 if there isn't one */
+static int __torrent_info_field(const char* key)
+{
+    if (!key)
+        return -1;
+
+    switch (strlen(key))
+    {
+    case 4:
+        if (0 == memcmp(key, "name", 4))
+            return 0;
+        break;
+    case 6:
+        if (0 == memcmp(key, "pieces", 6))
+            return 2;
+        if (0 == memcmp(key, "length", 6))
+            return 3;
+        break;
+    case 7:
+        if (0 == memcmp(key, "private", 7))
+            return 4;
+        break;
+    case 12:
+        if (0 == memcmp(key, "piece length", 12))
+            return 1;
+        break;
+    }
+    return -1;
+}
+
+static int __torrent_info_int(bencode_t *s,
+        const char *dict_key,
+        const long long int val)
+{
+    torrent_info_t* me = s->udata;
+    int i = __torrent_info_field(dict_key);
+
+    switch (i)
+    {
+    case 1: me->piece_length = val; break;
+    case 3: me->length = val; break;
+    case 4: me->private = val; break;
+    /* not an integer field */
+    default: return 0;
+    }
+    me->seen |= 1u << i;
+    return 1;
+}
+
+static unsigned char* __torrent_info_sink(bencode_t *s,
+        const char *dict_key,
+        unsigned int v_total_len)
+{
+    torrent_info_t* me = s->udata;
+    char** str;
+
+    switch (__torrent_info_field(dict_key))
+    {
+    case 0: str = &me->name; break;
+    case 2: str = &me->pieces; break;
+    default: return NULL;
+    }
+    free(*str);
+    *str = malloc(v_total_len + 1);
+    /* if NULL, __torrent_info_str fails us */
+    return (unsigned char*)*str;
+}
+
+static int __torrent_info_str(bencode_t *s,
+        const char *dict_key,
+        unsigned int v_total_len,
+        const unsigned char* val __attribute__((__unused__)),
+        unsigned int v_len __attribute__((__unused__)))
+{
+    torrent_info_t* me = s->udata;
+    int i = __torrent_info_field(dict_key);
+    char** str;
+    unsigned int* len;
+
+    switch (i)
+    {
+    case 0: str = &me->name; len = &me->name_len; break;
+    case 2: str = &me->pieces; len = &me->pieces_len; break;
+    /* not a string field */
+    default: return 0;
+    }
+
+    /* empty strings don't go through the sink */
+    if (0 == v_total_len)
+    {
+        free(*str);
+        *str = malloc(1);
+    }
+    /* out of memory */
+    if (!*str)
+        return 0;
+    (*str)[v_total_len] = '\0';
+    *len = v_total_len;
+    me->seen |= 1u << i;
+    return 1;
+}
+
+/**
+ * Fields are integers or strings, never lists or dicts */
+static int __torrent_info_container(bencode_t *s __attribute__((__unused__)),
+        const char *dict_key __attribute__((__unused__)))
+{
+    return 0;
+}
+
+static bencode_callbacks_t __torrent_info_cb = {
+    .hit_int = __torrent_info_int,
+    .hit_str = __torrent_info_str,
+    .dict_enter = __torrent_info_container,
+    .list_enter = __torrent_info_container,
+    .str_sink = __torrent_info_sink,
+};
+
+bencode_t* torrent_info_parser_new(torrent_info_t* out)
+{
+    bencode_selector_t* sel;
+    bencode_t* s;
+
+    memset(out, 0, sizeof(torrent_info_t));
+    if (!(sel = bencode_selector_new(__torrent_info_paths, 5)))
+        return NULL;
+    if (!(s = bencode_new(34, &__torrent_info_cb, out)))
+    {
+        bencode_selector_free(sel);
+        return NULL;
+    }
+    bencode_set_selector(s, sel);
+    return s;
+}
+
+int torrent_info_finish(bencode_t* s)
+{
+    torrent_info_t* out = s->udata;
+    bencode_selector_t* sel = s->selector;
+    int ok = BENCODE_ERR_NONE == bencode_error(s) &&
+        0 == s->d && BENCODE_TOK_NONE == s->stk[0].type &&
+        TORRENT_INFO_REQUIRED == (out->seen & TORRENT_INFO_REQUIRED);
+
+    bencode_free(s);
+    bencode_selector_free(sel);
+    return ok;
+}
+
+int torrent_info_decode(const char* buf, unsigned int len, torrent_info_t* out)
+{
+    bencode_t* s = torrent_info_parser_new(out);
+
+    if (!s)
+        return 0;
+    bencode_dispatch_from_buffer(s, buf, len);
+    return torrent_info_finish(s);
+}
+
+void torrent_info_free(torrent_info_t* me)
+{
+    free(me->name);
+    free(me->pieces);
+    memset(me, 0, sizeof(torrent_info_t));
+}
@@ -0,0 +1,108 @@
+/* Generated from schemas/torrent.schema by bencode_schema.awk. Do not edit. */
+
+#ifndef TORRENT_SCHEMA_H
+#define TORRENT_SCHEMA_H
+
+#include "bencode.h"
+
+/* the dict at "" */
+typedef struct {
+    /* "announce", optional */
+    char* announce;
+    unsigned int announce_len;
+
+    /* "creation date", optional */
+    long long int creation_date;
+
+    /* "comment", optional */
+    char* comment;
+    unsigned int comment_len;
+
+    /* TORRENT_META_* bits of the fields we've read */
+    unsigned int seen;
+} torrent_meta_t;
+
+#define TORRENT_META_ANNOUNCE (1u << 0)
+#define TORRENT_META_CREATION_DATE (1u << 1)
+#define TORRENT_META_COMMENT (1u << 2)
+#define TORRENT_META_REQUIRED (0)
+
+/**
+ * @param out Where the fields are written; zeroed first
+ * @return parser that fills in out. Dispatch to it, then call
+ *         torrent_meta_finish(). NULL if we're out of memory
+ */
+bencode_t* torrent_meta_parser_new(torrent_meta_t* out);
+
+/**
+ * Free the parser
+ * @return 0 if the input was malformed, a field had the wrong type, or a
+ *         required field is missing; otherwise 1
+ */
+int torrent_meta_finish(bencode_t*);
+
+/**
+ * Decode a whole document
+ * @return 0 on error; otherwise 1
+ */
+int torrent_meta_decode(const char* buf, unsigned int len, torrent_meta_t* out);
+
+/**
+ * Free the strings we've read */
+void torrent_meta_free(torrent_meta_t*);
+
+/* the dict at "info" */
+typedef struct {
+    /* "name", required */
+    char* name;
+    unsigned int name_len;
+
+    /* "piece length", required */
+    long long int piece_length;
+
+    /* "pieces", required */
+    char* pieces;
+    unsigned int pieces_len;
+
+    /* "length", optional */
+    long long int length;
+
+    /* "private", optional */
+    long long int private;
+
+    /* TORRENT_INFO_* bits of the fields we've read */
+    unsigned int seen;
+} torrent_info_t;
+
+#define TORRENT_INFO_NAME (1u << 0)
+#define TORRENT_INFO_PIECE_LENGTH (1u << 1)
+#define TORRENT_INFO_PIECES (1u << 2)
+#define TORRENT_INFO_LENGTH (1u << 3)
+#define TORRENT_INFO_PRIVATE (1u << 4)
+#define TORRENT_INFO_REQUIRED (TORRENT_INFO_NAME | TORRENT_INFO_PIECE_LENGTH | TORRENT_INFO_PIECES)
+
+/**
+ * @param out Where the fields are written; zeroed first
+ * @return parser that fills in out. Dispatch to it, then call
+ *         torrent_info_finish(). NULL if we're out of memory
+ */
+bencode_t* torrent_info_parser_new(torrent_info_t* out);
+
+/**
+ * Free the parser
+ * @return 0 if the input was malformed, a field had the wrong type, or a
+ *         required field is missing; otherwise 1
+ */
+int torrent_info_finish(bencode_t*);
+
+/**
+ * Decode a whole document
+ * @return 0 on error; otherwise 1
+ */
+int torrent_info_decode(const char* buf, unsigned int len, torrent_info_t* out);
+
+/**
+ * Free the strings we've read */
+void torrent_info_free(torrent_info_t*);
+
+#endif /* TORRENT_SCHEMA_H */
@@ -15,6 +15,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 #include "CuTest.h"
 
 #include "bencode.h"
@@ -56,7 +57,7 @@ typedef struct node_s node_t;
 
 struct node_s {
     int type;
-    int intval;
+    long long int intval;
     char* strval;
     int sv_len;
     char* dictkey;
@@ -127,7 +128,7 @@ static node_t* __find_child_slot(node_t* n, int depth)
 
 int __int(bencode_t *s,
         const char *dict_key,
-        const long int val)
+        const long long int val)
 {
     node_t* n = __find_sibling_slot(s->udata, s->d);
     n->intval = val;
@@ -307,6 +308,134 @@ void TestBencodeIntValueLarge(
     CuAssertTrue(tc, dom->type == BENCODE_TYPE_INT);
 }
 
+void TestBencodeIntValue64(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    char *str = "i4294967296000e";
+    node_t* dom = calloc(1,sizeof(node_t));
+
+    s = bencode_new(2, &__cb, dom);
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str, strlen(str)));
+    CuAssertTrue(tc, 4294967296000LL == dom->intval);
+}
+
+void TestBencodeIntValueNegative(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    char *str = "i-42e";
+    node_t* dom = calloc(1,sizeof(node_t));
+
+    s = bencode_new(2, &__cb, dom);
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str, strlen(str)));
+    CuAssertTrue(tc, -42 == dom->intval);
+}
+
+void TestBencodeIntValueExtremes(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    char *max = "i9223372036854775807e";
+    char *min = "i-9223372036854775808e";
+    node_t* dom = calloc(1,sizeof(node_t));
+
+    s = bencode_new(2, &__cb, dom);
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, max, strlen(max)));
+    CuAssertTrue(tc, LLONG_MAX == dom->intval);
+
+    dom = calloc(1,sizeof(node_t));
+    s = bencode_new(2, &__cb, dom);
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, min, strlen(min)));
+    CuAssertTrue(tc, LLONG_MIN == dom->intval);
+}
+
+void TestBencodeIntValueSplitAcrossBuffers(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    char *str = "i-1234567890123e";
+    node_t* dom = calloc(1,sizeof(node_t));
+
+    s = bencode_new(2, &__cb, dom);
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str, 2));
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str + 2, 7));
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str + 9, strlen(str) - 9));
+    CuAssertTrue(tc, -1234567890123LL == dom->intval);
+}
+
+void TestBencodeIntOverflow(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    char *str = "i9223372036854775808e";
+    node_t* dom = calloc(1,sizeof(node_t));
+
+    s = bencode_new(2, &__cb, dom);
+    CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, str, strlen(str)));
+    CuAssertTrue(tc, BENCODE_ERR_INT_OVERFLOW == bencode_error(s));
+}
+
+void TestBencodeIntMalformed(
+    CuTest * tc
+)
+{
+    char *bad[] = { "ie", "i-e", "i--1e", "i1-e", "i1xe" };
+    unsigned int i;
+
+    for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+    {
+        node_t* dom = calloc(1,sizeof(node_t));
+        bencode_t* s = bencode_new(2, &__cb, dom);
+
+        CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, bad[i], strlen(bad[i])));
+        CuAssertTrue(tc, BENCODE_ERR_BAD_INT == bencode_error(s));
+    }
+}
+
+static int __raw_int(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)),
+        const char *digits,
+        unsigned int len)
+{
+    strncat(s->udata, digits, len);
+    strcat(s->udata, ";");
+    return 1;
+}
+
+static int __raw_int_hit(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)),
+        const long long int val __attribute__((__unused__)))
+{
+    strcat(s->udata, "int;");
+    return 1;
+}
+
+void TestBencodeIntRawDigits(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    bencode_callbacks_t cb = {
+        .hit_int = __raw_int_hit,
+        .hit_int_raw = __raw_int
+    };
+    char *str = "li-7ei123456789012345678901234567890ee";
+    char out[256] = "";
+
+    s = bencode_new(2, &cb, out);
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str, 10));
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str + 10, strlen(str) - 10));
+    /* the big one only comes through as digits */
+    CuAssertStrEquals(tc, "-7;int;123456789012345678901234567890;", out);
+    bencode_free(s);
+}
+
 void TestBencodeIsIntEmpty(
     CuTest * tc
 )
@@ -407,7 +536,7 @@ void TestBencodeIsList(
 static void print_dom(node_t* n, int d)
 {
     int i;
-    printf("t:%d v:(%.*s %d) k: %s\n",
+    printf("t:%d v:(%.*s %lld) k: %s\n",
             n->type, n->sv_len, n->strval, n->intval, n->dictkey);
 
     if (n->child)
@@ -777,3 +906,1028 @@ void TestBencodeDictLeaveGetsCalled(
     CuAssertTrue(tc, dom->dict_leave_called == 2);
 }
 
+
+static int __path_int(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)),
+        const long long int val __attribute__((__unused__)))
+{
+    char* paths = s->udata;
+    strcat(paths, bencode_path(s));
+    strcat(paths, ";");
+    return 1;
+}
+
+static int __path_str(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)),
+        unsigned int v_total_len __attribute__((__unused__)),
+        const unsigned char* val __attribute__((__unused__)),
+        unsigned int v_len __attribute__((__unused__)))
+{
+    char* paths = s->udata;
+    strcat(paths, bencode_path(s));
+    strcat(paths, ";");
+    return 1;
+}
+
+static bencode_callbacks_t __path_cb = {
+    .hit_int = __path_int,
+    .hit_str = __path_str,
+};
+
+void TestBencodePathIncludesKeysAndListIndices(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    char *str = "d4:infod5:filesld6:lengthi1eed6:lengthi2eee4:name1:xe6:lengthi3ee";
+    char paths[256] = "";
+
+    s = bencode_new(10, &__path_cb, paths);
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str, strlen(str)));
+    CuAssertStrEquals(tc,
+            "info.files[0].length;info.files[1].length;info.name;length;",
+            paths);
+    CuAssertStrEquals(tc, "", bencode_path(s));
+}
+
+void TestBencodePathOfTopLevelList(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    char *str = "li1el3:fooee";
+    char paths[256] = "";
+
+    s = bencode_new(10, &__path_cb, paths);
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str, strlen(str)));
+    CuAssertStrEquals(tc, "[0];[1][0];", paths);
+}
+
+static int __path_component_int(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)),
+        const long long int val __attribute__((__unused__)))
+{
+    CuTest* tc = s->udata;
+    const char* key;
+    unsigned int len;
+
+    CuAssertTrue(tc, 3 == bencode_path_depth(s));
+    key = bencode_path_key(s, 0, &len);
+    CuAssertTrue(tc, 3 == len);
+    CuAssertTrue(tc, 0 == strncmp("a.b", key, len));
+    CuAssertTrue(tc, -1 == bencode_path_index(s, 0));
+    CuAssertTrue(tc, NULL == bencode_path_key(s, 1, &len));
+    CuAssertTrue(tc, 1 == bencode_path_index(s, 1));
+    key = bencode_path_key(s, 2, &len);
+    CuAssertTrue(tc, 1 == len);
+    CuAssertTrue(tc, 0 == strncmp("c", key, len));
+    CuAssertTrue(tc, NULL == bencode_path_key(s, 3, &len));
+    return 1;
+}
+
+static int __path_component_str(bencode_t *s __attribute__((__unused__)),
+        const char *dict_key __attribute__((__unused__)),
+        unsigned int v_total_len __attribute__((__unused__)),
+        const unsigned char* val __attribute__((__unused__)),
+        unsigned int v_len __attribute__((__unused__)))
+{
+    return 1;
+}
+
+void TestBencodePathComponents(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    char *str = "d3:a.bl0:d1:ci1eeee";
+    bencode_callbacks_t cb = { .hit_int = __path_component_int,
+                               .hit_str = __path_component_str };
+
+    s = bencode_new(10, &cb, tc);
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str, strlen(str)));
+}
+
+void TestBencodeSelectorOnlyDeliversMatchingValues(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    bencode_selector_t* sel;
+    const char* paths[] = { "info.name", "info.files[*].length", "announce-list[*][*]" };
+    char *str = "d8:announce3:foo13:announce-listll1:ael1:b1:cee"
+        "4:infod5:filesld6:lengthi1e4:pathl1:xeed6:lengthi2eee"
+        "4:name4:test6:pieces3:xyzee";
+    char paths_hit[512] = "";
+
+    sel = bencode_selector_new(paths, 3);
+    CuAssertPtrNotNull(tc, sel);
+    s = bencode_new(10, &__path_cb, paths_hit);
+    bencode_set_selector(s, sel);
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str, strlen(str)));
+    CuAssertStrEquals(tc,
+            "announce-list[0][0];announce-list[1][0];announce-list[1][1];"
+            "info.files[0].length;info.files[1].length;info.name;",
+            paths_hit);
+}
+
+void TestBencodeSelectorDeliversWholeSubtree(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    bencode_selector_t* sel;
+    const char* paths[] = { "info.files[1]" };
+    char *str = "d4:infod5:filesld6:lengthi1eed6:lengthi2e4:pathl1:xeeeee";
+    char paths_hit[512] = "";
+
+    sel = bencode_selector_new(paths, 1);
+    s = bencode_new(10, &__path_cb, paths_hit);
+    bencode_set_selector(s, sel);
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str, strlen(str)));
+    CuAssertStrEquals(tc, "info.files[1].length;info.files[1].path[0];",
+            paths_hit);
+}
+
+void TestBencodeSelectorSkipsAcrossBufferBoundaries(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    bencode_selector_t* sel;
+    const char* paths[] = { "b" };
+    char *str = "d1:a11:0123456789x1:bi7ee";
+    char paths_hit[512] = "";
+    unsigned int i;
+
+    sel = bencode_selector_new(paths, 1);
+    s = bencode_new(10, &__path_cb, paths_hit);
+    bencode_set_selector(s, sel);
+    for (i = 0; i < strlen(str); i += 3)
+        CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str + i,
+                    strlen(str) - i < 3 ? strlen(str) - i : 3));
+    CuAssertStrEquals(tc, "b;", paths_hit);
+}
+
+void TestBencodeSelectorRejectsInvalidSelectors(
+    CuTest * tc
+)
+{
+    const char* bad1[] = { "info..name" };
+    const char* bad2[] = { "info[x]" };
+    const char* bad3[] = { "info." };
+    /* a byte over 0x7f isn't an index */
+    const char* bad4[] = { "info[\xb9]" };
+
+    CuAssertTrue(tc, NULL == bencode_selector_new(bad1, 1));
+    CuAssertTrue(tc, NULL == bencode_selector_new(bad2, 1));
+    CuAssertTrue(tc, NULL == bencode_selector_new(bad3, 1));
+    CuAssertTrue(tc, NULL == bencode_selector_new(bad4, 1));
+}
+
+typedef struct {
+    unsigned char dest[32];
+    const unsigned char* hit_val;
+    unsigned int hit_len;
+    int nhits;
+} sink_t;
+
+static unsigned char* __sink_str_sink(bencode_t *s,
+        const char *dict_key,
+        unsigned int v_total_len)
+{
+    sink_t* sink = s->udata;
+
+    if (!dict_key || 0 != strcmp(dict_key, "pieces") ||
+        sizeof(sink->dest) < v_total_len)
+        return NULL;
+    return sink->dest;
+}
+
+static int __sink_str(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)),
+        unsigned int v_total_len __attribute__((__unused__)),
+        const unsigned char* val,
+        unsigned int v_len)
+{
+    sink_t* sink = s->udata;
+
+    sink->hit_val = val;
+    sink->hit_len = v_len;
+    sink->nhits++;
+    return 1;
+}
+
+void TestBencodeStringSinkReceivesBytesDirectly(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    char *str = "d6:pieces20:aaaaabbbbbcccccddddde";
+    bencode_callbacks_t cb = { .hit_str = __sink_str,
+                               .str_sink = __sink_str_sink };
+    sink_t sink;
+    unsigned int i;
+
+    memset(&sink, 0, sizeof(sink));
+    s = bencode_new(10, &cb, &sink);
+    for (i = 0; i < strlen(str); i += 7)
+        CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str + i,
+                    strlen(str) - i < 7 ? strlen(str) - i : 7));
+    CuAssertTrue(tc, 1 == sink.nhits);
+    CuAssertTrue(tc, sink.dest == sink.hit_val);
+    CuAssertTrue(tc, 20 == sink.hit_len);
+    CuAssertTrue(tc, 0 == memcmp("aaaaabbbbbcccccddddd", sink.dest, 20));
+    bencode_free(s);
+}
+
+void TestBencodeStringSinkDeclined(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    char *str = "d4:name5:helloe";
+    bencode_callbacks_t cb = { .hit_str = __sink_str,
+                               .str_sink = __sink_str_sink };
+    sink_t sink;
+
+    memset(&sink, 0, sizeof(sink));
+    s = bencode_new(10, &cb, &sink);
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str, strlen(str)));
+    CuAssertTrue(tc, 1 == sink.nhits);
+    CuAssertTrue(tc, sink.dest != sink.hit_val);
+    CuAssertTrue(tc, 0 == memcmp("hello", sink.hit_val, 5));
+    bencode_free(s);
+}
+
+void TestBencodePooledParserHoldsNothingWhileIdle(
+    CuTest * tc
+)
+{
+    bencode_pool_t* pool = bencode_pool_new();
+    bencode_t* a, *b;
+    char paths_a[256] = "", paths_b[256] = "";
+    char *str = "d3:fooi1e3:barl1:xee";
+
+    a = bencode_new_pooled(10, &__path_cb, paths_a, pool);
+    b = bencode_new_pooled(10, &__path_cb, paths_b, pool);
+    CuAssertTrue(tc, NULL == a->stk);
+    CuAssertTrue(tc, NULL == b->stk);
+
+    /* a is mid-document so it keeps its stack */
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(a, str, 10));
+    CuAssertPtrNotNull(tc, a->stk);
+    CuAssertTrue(tc, 0 == bencode_pool_count(pool));
+
+    /* b finishes its document and gives its stack back */
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(b, str, strlen(str)));
+    CuAssertTrue(tc, NULL == b->stk);
+    CuAssertTrue(tc, 1 == bencode_pool_count(pool));
+
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(a, str + 10,
+                strlen(str) - 10));
+    CuAssertTrue(tc, NULL == a->stk);
+    CuAssertTrue(tc, 2 == bencode_pool_count(pool));
+
+    CuAssertStrEquals(tc, "foo;bar[0];", paths_a);
+    CuAssertStrEquals(tc, "foo;bar[0];", paths_b);
+
+    /* the next document borrows a warm stack */
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(b, "i5e", 3));
+    CuAssertTrue(tc, 2 == bencode_pool_count(pool));
+
+    bencode_free(a);
+    bencode_free(b);
+    bencode_pool_free(pool);
+}
+
+void TestBencodePooledParserLetsGoBetweenTokens(
+    CuTest * tc
+)
+{
+    bencode_pool_t* pool = bencode_pool_new();
+    bencode_t* s;
+    char paths[256] = "";
+    char *str = "d1:ai1e1:bl1:xd1:ci2eee1:ci3ee";
+    unsigned int i;
+
+    s = bencode_new_pooled(10, &__path_cb, paths, pool);
+    bencode_set_canonical(s, 1);
+
+    /* the stack goes back to the pool between any two tokens */
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str, 10));
+    CuAssertTrue(tc, NULL == s->stk);
+    CuAssertTrue(tc, 1 == bencode_pool_count(pool));
+    CuAssertTrue(tc, 1 == bencode_path_depth(s));
+
+    /* but not partway through one */
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str + 10, 2));
+    CuAssertPtrNotNull(tc, s->stk);
+    CuAssertTrue(tc, 0 == bencode_pool_count(pool));
+
+    /* a byte at a time, it carries on from where it was each time */
+    for (i = 12; i < strlen(str); i++)
+        CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str + i, 1));
+    CuAssertTrue(tc, NULL == s->stk);
+    CuAssertStrEquals(tc, "a;b[0];b[1].c;c;", paths);
+
+    /* dicts remember their previous key for the canonical check */
+    bencode_reset(s);
+    str = "d1:bi1e1:ai2ee";
+    for (i = 0; i < 7; i++)
+        CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str + i, 1));
+    CuAssertTrue(tc, NULL == s->stk);
+    for (; i < strlen(str); i++)
+        if (!bencode_dispatch_from_buffer(s, str + i, 1))
+            break;
+    CuAssertTrue(tc, BENCODE_ERR_KEY_ORDER == bencode_error(s));
+
+    bencode_free(s);
+    CuAssertTrue(tc, 1 == bencode_pool_count(pool));
+    bencode_pool_free(pool);
+}
+
+void TestBencodeParsesConsecutiveDocuments(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    char *str = "d1:ai1eed1:bi2ee";
+    char paths[256] = "";
+
+    s = bencode_new(10, &__path_cb, paths);
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str, strlen(str)));
+    CuAssertStrEquals(tc, "a;b;", paths);
+    bencode_free(s);
+}
+
+void TestBencodeLimitRejectsLongStringBeforeBuffering(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    bencode_limits_t limits = { .max_str_len = 1000 };
+    char *str = "d4:name999999999:";
+    char paths[256] = "";
+    unsigned long int mem;
+
+    s = bencode_new(10, &__path_cb, paths);
+    bencode_set_limits(s, &limits);
+    mem = s->mem;
+    CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, str, strlen(str)));
+    CuAssertTrue(tc, mem == s->mem);
+    bencode_free(s);
+}
+
+void TestBencodeStringLengthOverflowFails(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    char *str = "99999999999999999999:";
+    char paths[256] = "";
+
+    s = bencode_new(10, &__path_cb, paths);
+    CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, str, strlen(str)));
+    bencode_free(s);
+}
+
+void TestBencodeLimitKeyLength(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    bencode_limits_t limits = { .max_key_len = 4 };
+    char *ok = "d4:namei1ee";
+    char *bad = "d5:namesi1ee";
+    char paths[256] = "";
+
+    s = bencode_new(10, &__path_cb, paths);
+    bencode_set_limits(s, &limits);
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, ok, strlen(ok)));
+    CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, bad, strlen(bad)));
+    bencode_free(s);
+}
+
+void TestBencodeLimitItems(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    bencode_limits_t limits = { .max_items = 3 };
+    char *ok = "li1ei2ee";
+    char *bad = "li1ei2ei3ee";
+    char paths[256] = "";
+
+    s = bencode_new(10, &__path_cb, paths);
+    bencode_set_limits(s, &limits);
+    /* the limit applies to each document */
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, ok, strlen(ok)));
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, ok, strlen(ok)));
+    CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, bad, strlen(bad)));
+    bencode_free(s);
+}
+
+void TestBencodeLimitDocumentBytes(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    bencode_limits_t limits = { .max_bytes = 10 };
+    char *ok = "li1ei23ee";
+    char *bad = "l9:";
+    char paths[256] = "";
+
+    s = bencode_new(10, &__path_cb, paths);
+    bencode_set_limits(s, &limits);
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, ok, strlen(ok)));
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, bad, 1));
+    /* the string's length would take us past the limit */
+    CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, bad + 1, 1));
+    bencode_free(s);
+}
+
+void TestBencodeLimitMemory(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    bencode_limits_t limits;
+    char *str = "l30:012345678901234567890123456789e";
+    char paths[256] = "";
+
+    s = bencode_new(10, &__path_cb, paths);
+    memset(&limits, 0, sizeof(limits));
+    limits.max_mem = s->mem + 16;
+    bencode_set_limits(s, &limits);
+    CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, str, strlen(str)));
+    bencode_free(s);
+}
+
+void TestBencodeErrorBadInt(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    char *str = "d3:fooi4x2ee";
+    char paths[256] = "";
+
+    s = bencode_new(10, &__path_cb, paths);
+    CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, str, strlen(str)));
+    CuAssertTrue(tc, BENCODE_ERR_BAD_INT == bencode_error(s));
+    CuAssertTrue(tc, 8 == bencode_error_offset(s));
+    CuAssertTrue(tc, 1 == bencode_error_depth(s));
+
+    /* we stay failed, even on good input */
+    CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, "i1e", 3));
+    CuAssertTrue(tc, BENCODE_ERR_BAD_INT == bencode_error(s));
+    bencode_free(s);
+}
+
+void TestBencodeErrorBadValueAndKey(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    char paths[256] = "";
+
+    s = bencode_new(10, &__path_cb, paths);
+    CuAssertTrue(tc, BENCODE_ERR_NONE == bencode_error(s));
+    CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, "lx", 2));
+    CuAssertTrue(tc, BENCODE_ERR_BAD_VALUE == bencode_error(s));
+    CuAssertTrue(tc, 1 == bencode_error_offset(s));
+    bencode_free(s);
+
+    s = bencode_new(10, &__path_cb, paths);
+    CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, "di1ei2ee", 8));
+    CuAssertTrue(tc, BENCODE_ERR_BAD_KEY == bencode_error(s));
+    bencode_free(s);
+
+    /* a key with no length */
+    s = bencode_new(10, &__path_cb, paths);
+    CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, "d:i1ee", 6));
+    CuAssertTrue(tc, BENCODE_ERR_BAD_KEY == bencode_error(s));
+    CuAssertTrue(tc, 1 == bencode_error_offset(s));
+    bencode_free(s);
+
+    s = bencode_new(10, &__path_cb, paths);
+    CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, "d1:ai1e:i2ee", 12));
+    CuAssertTrue(tc, BENCODE_ERR_BAD_KEY == bencode_error(s));
+    CuAssertTrue(tc, 7 == bencode_error_offset(s));
+    bencode_free(s);
+
+    /* whereas an empty key has a length of 0 */
+    s = bencode_new(10, &__path_cb, paths);
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, "d0:i1ee", 7));
+    bencode_free(s);
+
+    s = bencode_new(10, &__path_cb, paths);
+    CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, "3x", 2));
+    CuAssertTrue(tc, BENCODE_ERR_BAD_STR_LEN == bencode_error(s));
+    bencode_free(s);
+}
+
+void TestBencodeBytesOutsideAscii(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    char paths[256] = "";
+
+    /* fine inside strings and keys */
+    s = bencode_new(10, &__path_cb, paths);
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s,
+                "d2:\xe9\xff" "4:\x80:ie" "e", 12));
+    CuAssertTrue(tc, BENCODE_ERR_NONE == bencode_error(s));
+    bencode_free(s);
+
+    s = bencode_new(10, &__path_cb, paths);
+    CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, "l\xff" "e", 3));
+    CuAssertTrue(tc, BENCODE_ERR_BAD_VALUE == bencode_error(s));
+    CuAssertTrue(tc, 1 == bencode_error_offset(s));
+    bencode_free(s);
+
+    s = bencode_new(10, &__path_cb, paths);
+    CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, "i1\xb9" "e", 4));
+    CuAssertTrue(tc, BENCODE_ERR_BAD_INT == bencode_error(s));
+    CuAssertTrue(tc, 2 == bencode_error_offset(s));
+    bencode_free(s);
+
+    s = bencode_new(10, &__path_cb, paths);
+    CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, "d\xb1:ai1ee", 8));
+    CuAssertTrue(tc, BENCODE_ERR_BAD_KEY == bencode_error(s));
+    bencode_free(s);
+
+    s = bencode_new(10, &__path_cb, paths);
+    CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, "1\xba" "a", 3));
+    CuAssertTrue(tc, BENCODE_ERR_BAD_STR_LEN == bencode_error(s));
+    bencode_free(s);
+}
+
+void TestBencodeErrorTooDeep(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    char str[64];
+    char paths[256] = "";
+
+    memset(str, 'l', sizeof(str));
+    s = bencode_new(0, &__path_cb, paths);
+    CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, str, sizeof(str)));
+    CuAssertTrue(tc, BENCODE_ERR_TOO_DEEP == bencode_error(s));
+    bencode_free(s);
+}
+
+void TestBencodeErrorLimits(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    bencode_limits_t limits = { .max_items = 2 };
+    char paths[256] = "";
+
+    s = bencode_new(10, &__path_cb, paths);
+    bencode_set_limits(s, &limits);
+    CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, "li1ei2ee", 8));
+    CuAssertTrue(tc, BENCODE_ERR_TOO_MANY_ITEMS == bencode_error(s));
+    CuAssertTrue(tc, 4 == bencode_error_offset(s));
+    bencode_free(s);
+}
+
+static int __failing_int(bencode_t *s __attribute__((__unused__)),
+        const char *dict_key __attribute__((__unused__)),
+        const long long int val)
+{
+    return 2 != val;
+}
+
+void TestBencodeErrorCallbackFailed(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    bencode_callbacks_t cb = { .hit_int = __failing_int };
+
+    s = bencode_new(10, &cb, NULL);
+    CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, "li1ei2ei3ee", 11));
+    CuAssertTrue(tc, BENCODE_ERR_CALLBACK == bencode_error(s));
+    CuAssertTrue(tc, 6 == bencode_error_offset(s));
+    CuAssertStrEquals(tc, "callback failed",
+            bencode_strerror(bencode_error(s)));
+    bencode_free(s);
+}
+
+void TestBencodeCanonicalAccepted(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    char *str = "d0:i0e1:ai-1e2:aal3:xyze1:bd1:xi10e1:yi0eee";
+    char paths[256] = "";
+
+    s = bencode_new(10, &__path_cb, paths);
+    bencode_set_canonical(s, 1);
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str, strlen(str)));
+    bencode_free(s);
+}
+
+void TestBencodeCanonicalKeyOrder(
+    CuTest * tc
+)
+{
+    char *bad[] = {
+        "d1:bi1e1:ai2ee",
+        /* repeated */
+        "d1:ai1e1:ai2ee",
+        /* a prefix of the previous key */
+        "d2:aai1e1:ai2ee",
+        "d1:a0:0:0:e",
+    };
+    unsigned int i;
+
+    for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+    {
+        char paths[256] = "";
+        bencode_t* s = bencode_new(10, &__path_cb, paths);
+
+        bencode_set_canonical(s, 1);
+        CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, bad[i], strlen(bad[i])));
+        CuAssertTrue(tc, BENCODE_ERR_KEY_ORDER == bencode_error(s));
+        bencode_free(s);
+    }
+}
+
+void TestBencodeCanonicalKeyOrderAcrossBuffers(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    char *str = "d3:abci1e3:abdi2e3:abci3ee";
+    char paths[256] = "";
+    unsigned int i;
+
+    s = bencode_new(10, &__path_cb, paths);
+    bencode_set_canonical(s, 1);
+    for (i = 0; i < 21; i++)
+        CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str + i, 1));
+    /* the last byte of "abc" decides it sorts before "abd" */
+    CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, str + 21, 1));
+    CuAssertTrue(tc, 21 == bencode_error_offset(s));
+    CuAssertTrue(tc, BENCODE_ERR_KEY_ORDER == bencode_error(s));
+    bencode_free(s);
+}
+
+void TestBencodeCanonicalNumbers(
+    CuTest * tc
+)
+{
+    char *bad[] = { "i01e", "i-0e", "i-01e", "03:abc", "d01:ai1ee", "i00e" };
+    unsigned int i;
+
+    for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+    {
+        char paths[256] = "";
+        bencode_t* s = bencode_new(10, &__path_cb, paths);
+
+        /* fine unless we're checking */
+        CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, bad[i], strlen(bad[i])));
+        bencode_free(s);
+
+        s = bencode_new(10, &__path_cb, paths);
+        bencode_set_canonical(s, 1);
+        CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, bad[i], strlen(bad[i])));
+        CuAssertTrue(tc, BENCODE_ERR_NOT_CANONICAL == bencode_error(s));
+        bencode_free(s);
+    }
+}
+
+void TestBencodeCanonicalLeadingZeroAcrossBuffers(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    char paths[256] = "";
+
+    s = bencode_new(10, &__path_cb, paths);
+    bencode_set_canonical(s, 1);
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, "i0", 2));
+    CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, "1e", 2));
+    CuAssertTrue(tc, BENCODE_ERR_NOT_CANONICAL == bencode_error(s));
+    bencode_free(s);
+}
+
+static int __slice(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)),
+        int type,
+        const char *val,
+        unsigned int len)
+{
+    strcat(s->udata, BENCODE_TOK_INT == type ? "i:" : "s:");
+    strncat(s->udata, val, len);
+    strcat(s->udata, ";");
+    return 1;
+}
+
+void TestBencodeLazySlices(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    bencode_callbacks_t cb = { .hit_slice = __slice };
+    char *str = "d3:fooli-12e0:3:baree";
+    char out[256] = "";
+
+    s = bencode_new(10, &cb, out);
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str, strlen(str)));
+    CuAssertStrEquals(tc, "i:-12;s:;s:bar;", out);
+    bencode_free(s);
+}
+
+void TestBencodeLazySlicesAcrossBuffers(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    bencode_callbacks_t cb = { .hit_slice = __slice };
+    char *str = "li1234e5:abcdee";
+    char out[256] = "";
+    unsigned int i;
+
+    s = bencode_new(10, &cb, out);
+    for (i = 0; i < strlen(str); i++)
+        CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str + i, 1));
+    CuAssertStrEquals(tc, "i:1234;s:abcde;", out);
+    bencode_free(s);
+}
+
+void TestBencodeLazyStillValidates(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    bencode_callbacks_t cb = { .hit_slice = __slice };
+    char out[256] = "";
+
+    s = bencode_new(10, &cb, out);
+    CuAssertTrue(tc, 0 == bencode_dispatch_from_buffer(s, "li1x2ee", 7));
+    CuAssertTrue(tc, BENCODE_ERR_BAD_INT == bencode_error(s));
+    CuAssertTrue(tc, 3 == bencode_error_offset(s));
+    bencode_free(s);
+}
+
+void TestBencodeSliceConversion(
+    CuTest * tc
+)
+{
+    long long int val;
+    char str[8];
+
+    CuAssertTrue(tc, 1 == bencode_slice_int("-9223372036854775808", 20, &val));
+    CuAssertTrue(tc, LLONG_MIN == val);
+    CuAssertTrue(tc, 1 == bencode_slice_int("42", 2, &val));
+    CuAssertTrue(tc, 42 == val);
+    CuAssertTrue(tc, 0 == bencode_slice_int("9223372036854775808", 19, &val));
+    CuAssertTrue(tc, 0 == bencode_slice_int("-", 1, &val));
+
+    CuAssertTrue(tc, 1 == bencode_slice_str("abcdefgh", 7, str, sizeof(str)));
+    CuAssertStrEquals(tc, "abcdefg", str);
+    CuAssertTrue(tc, 0 == bencode_slice_str("abcdefgh", 8, str, sizeof(str)));
+}
+
+static int __batch(bencode_t *s,
+        const char *dict_key,
+        const bencode_item_t* items,
+        unsigned int n)
+{
+    char* out = s->udata;
+    unsigned int i;
+
+    sprintf(out + strlen(out), "%s[", dict_key ? dict_key : "");
+    for (i = 0; i < n; i++)
+    {
+        if (BENCODE_TOK_INT == items[i].type)
+            sprintf(out + strlen(out), "%lld,", items[i].intval);
+        else
+            sprintf(out + strlen(out), "%s,", items[i].strval);
+    }
+    strcat(out, "]");
+    return 1;
+}
+
+static int __batch_next(bencode_t *s)
+{
+    strcat(s->udata, "next;");
+    return 1;
+}
+
+static int __batch_enter(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)))
+{
+    strcat(s->udata, "(");
+    return 1;
+}
+
+static int __batch_leave(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)))
+{
+    strcat(s->udata, ")");
+    return 1;
+}
+
+void TestBencodeBatchedList(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    bencode_callbacks_t cb = {
+        .list_next = __batch_next,
+        .list_enter = __batch_enter,
+        .list_leave = __batch_leave,
+        .hit_batch = __batch
+    };
+    char *str = "d5:peersli1ei2e1:ai3e0:i5eee";
+    char out[256] = "";
+
+    s = bencode_new(10, &cb, out);
+    bencode_set_batch(s, 2);
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str, strlen(str)));
+    CuAssertStrEquals(tc, "(peers[1,2,]peers[a,3,]peers[,5,])", out);
+    bencode_free(s);
+}
+
+void TestBencodeBatchedListFlushesBeforeContainers(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    bencode_callbacks_t cb = {
+        .list_next = __batch_next,
+        .list_enter = __batch_enter,
+        .list_leave = __batch_leave,
+        .hit_batch = __batch
+    };
+    char *str = "li1e3:abcli2ei3eei4ee";
+    char out[256] = "";
+    unsigned int i;
+
+    s = bencode_new(10, &cb, out);
+    bencode_set_batch(s, 64);
+    for (i = 0; i < strlen(str); i++)
+        CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str + i, 1));
+    /* the nested list isn't batched, so it still gets list_next */
+    CuAssertStrEquals(tc, "([1,abc,]([2,3,])next;[4,])", out);
+    bencode_free(s);
+}
+
+static unsigned char __batch_sink_buf[32];
+
+static unsigned char* __batch_sink(bencode_t *s __attribute__((__unused__)),
+        const char *dict_key __attribute__((__unused__)),
+        unsigned int v_total_len __attribute__((__unused__)))
+{
+    return __batch_sink_buf;
+}
+
+static int __batch_str(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)),
+        unsigned int v_total_len __attribute__((__unused__)),
+        const unsigned char* val,
+        unsigned int v_len)
+{
+    sprintf(s->udata + strlen(s->udata), "s%.*s;", (int)v_len, val);
+    return 1;
+}
+
+static int __batch_int(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)),
+        const long long int val)
+{
+    sprintf(s->udata + strlen(s->udata), "i%lld;", val);
+    return 1;
+}
+
+static int __batch_int_raw(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)),
+        const char *digits,
+        unsigned int len)
+{
+    sprintf(s->udata + strlen(s->udata), "r%.*s;", (int)len, digits);
+    return 1;
+}
+
+void TestBencodeBatchedListKeepsOrderWithUnbatchedElements(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    bencode_callbacks_t cb = {
+        .hit_str = __batch_str,
+        .list_next = __batch_next,
+        .list_enter = __batch_enter,
+        .list_leave = __batch_leave,
+        .str_sink = __batch_sink,
+        .hit_batch = __batch
+    };
+    bencode_callbacks_t cb2 = {
+        .hit_int = __batch_int,
+        .hit_int_raw = __batch_int_raw,
+        .list_next = __batch_next,
+        .list_enter = __batch_enter,
+        .list_leave = __batch_leave,
+        .hit_batch = __batch
+    };
+    char *str = "li1ei2e3:abci3ee";
+    char *str2 = "li1e3:abci2ee";
+    char out[256] = "";
+
+    /* a string given to str_sink */
+    s = bencode_new(10, &cb, out);
+    bencode_set_batch(s, 16);
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str, strlen(str)));
+    CuAssertStrEquals(tc, "([1,2,]sabc;next;[3,])", out);
+    bencode_free(s);
+
+    /* integers given to hit_int_raw */
+    out[0] = '\0';
+    s = bencode_new(10, &cb2, out);
+    bencode_set_batch(s, 16);
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str2, strlen(str2)));
+    CuAssertStrEquals(tc, "(r1;i1;next;[abc,]r2;i2;next;)", out);
+    bencode_free(s);
+}
+
+void TestBencodeBatchCountsTowardsMaxMem(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    bencode_callbacks_t cb = {
+        .list_next = __batch_next,
+        .list_enter = __batch_enter,
+        .list_leave = __batch_leave,
+        .hit_batch = __batch
+    };
+    bencode_limits_t limits = { .max_mem = 4096 };
+    char *str = "li1e2:abi3ee";
+    char out[256] = "";
+
+    s = bencode_new(10, &cb, out);
+    bencode_set_limits(s, &limits);
+    CuAssertTrue(tc, 0 == bencode_set_batch(s, 1000));
+    CuAssertTrue(tc, BENCODE_ERR_MEMORY == bencode_error(s));
+    bencode_reset(s);
+
+    CuAssertTrue(tc, 1 == bencode_set_batch(s, 2));
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str, strlen(str)));
+    CuAssertStrEquals(tc, "([1,ab,][3,])", out);
+    bencode_free(s);
+}
+
+static int __value_start(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)),
+        int type)
+{
+    char* out = s->udata;
+
+    sprintf(out + strlen(out), "%d@%lu,%lu;", type,
+            bencode_value_offset(s), bencode_key_offset(s));
+    return 1;
+}
+
+static int __ignore_int(bencode_t *s __attribute__((__unused__)),
+        const char *dict_key __attribute__((__unused__)),
+        const long long int val __attribute__((__unused__)))
+{
+    return 1;
+}
+
+static int __ignore_str(bencode_t *s __attribute__((__unused__)),
+        const char *dict_key __attribute__((__unused__)),
+        unsigned int v_total_len __attribute__((__unused__)),
+        const unsigned char* val __attribute__((__unused__)),
+        unsigned int v_len __attribute__((__unused__)))
+{
+    return 1;
+}
+
+void TestBencodeValueStart(
+    CuTest * tc
+)
+{
+    bencode_t* s;
+    bencode_callbacks_t cb = {
+        .hit_int = __ignore_int,
+        .hit_str = __ignore_str,
+        .value_start = __value_start
+    };
+    char *str = "d1:ai1e2:bbl2:xxee";
+    char out[256] = "";
+    char expected[256];
+
+    s = bencode_new(10, &cb, out);
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, str, strlen(str)));
+    sprintf(expected, "%d@0,0;%d@4,1;%d@11,7;%d@12,12;",
+            BENCODE_TOK_DICT, BENCODE_TOK_INT, BENCODE_TOK_LIST, BENCODE_TOK_STR);
+    CuAssertStrEquals(tc, expected, out);
+    bencode_free(s);
+}
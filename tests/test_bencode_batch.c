@@ -0,0 +1,218 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Test parsing documents across a pool of threads
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdbool.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "CuTest.h"
+
+#include "bencode.h"
+#include "bencode_batch.h"
+
+static char* __hex(const unsigned char* h, char* out)
+{
+    int i;
+
+    for (i = 0; i < 20; i++)
+        sprintf(out + i * 2, "%02x", h[i]);
+    return out;
+}
+
+static int __piece_length(bencode_t *s,
+        const char *dict_key,
+        const long long int val)
+{
+    bencode_batch_item_t* it = s->udata;
+
+    if (0 == strcmp(dict_key, "piece length"))
+        *(long long int*)it->udata = val;
+    return 1;
+}
+
+static int __str(bencode_t *s __attribute__((__unused__)),
+        const char *dict_key __attribute__((__unused__)),
+        unsigned int v_total_len __attribute__((__unused__)),
+        const unsigned char* val __attribute__((__unused__)),
+        unsigned int v_len __attribute__((__unused__)))
+{
+    return 1;
+}
+
+static bencode_callbacks_t __cb = {
+    .hit_int = __piece_length,
+    .hit_str = __str,
+};
+
+void TestBencodeSha1(
+    CuTest * tc
+)
+{
+    char a[100], hex[41];
+    unsigned char h[20];
+
+    bencode_sha1("", 0, h);
+    CuAssertStrEquals(tc, "da39a3ee5e6b4b0d3255bfef95601890afd80709", __hex(h, hex));
+    memset(a, 'a', sizeof(a));
+    bencode_sha1(a, sizeof(a), h);
+    CuAssertStrEquals(tc, "7f9000257a4918d7072655ea468540cdcbd42e0c", __hex(h, hex));
+}
+
+void TestBencodeBatch(
+    CuTest * tc
+)
+{
+    char *torrent = "d8:announce3:foo4:infod6:lengthi5e4:name3:foo"
+        "12:piece lengthi16384e6:pieces0:ee";
+    bencode_batch_item_t items[200];
+    long long int piece_length[200];
+    char hex[41];
+    unsigned int i;
+
+    memset(items, 0, sizeof(items));
+    for (i = 0; i < 200; i++)
+    {
+        piece_length[i] = 0;
+        items[i].udata = &piece_length[i];
+        items[i].buf = torrent;
+        items[i].len = strlen(torrent);
+    }
+    /* no info dict */
+    items[10].buf = "d1:ai1ee";
+    items[10].len = 8;
+    /* broken */
+    items[20].buf = "d1:ai1x";
+    items[20].len = 7;
+    /* cut short */
+    items[30].len = 10;
+
+    CuAssertTrue(tc, 198 == bencode_batch_run(items, 200, &__cb, 10, 4));
+    for (i = 0; i < 200; i++)
+    {
+        if (10 == i || 20 == i || 30 == i)
+            continue;
+        CuAssertTrue(tc, BENCODE_ERR_NONE == items[i].err);
+        CuAssertTrue(tc, 1 == items[i].has_info_hash);
+        CuAssertStrEquals(tc, "bc2199230a2c8cef4b1f8a9cb8260c061ea789ac",
+                __hex(items[i].info_hash, hex));
+        CuAssertTrue(tc, 16384 == piece_length[i]);
+    }
+    CuAssertTrue(tc, BENCODE_ERR_NONE == items[10].err);
+    CuAssertTrue(tc, 0 == items[10].has_info_hash);
+    CuAssertTrue(tc, BENCODE_ERR_BAD_INT == items[20].err);
+    CuAssertTrue(tc, BENCODE_ERR_BAD_STATE == items[30].err);
+}
+
+void TestBencodeBatchFiles(
+    CuTest * tc
+)
+{
+    char *torrent = "d4:infod6:lengthi5e4:name3:foo"
+        "12:piece lengthi16384e6:pieces0:ee";
+    char path[] = "/tmp/bencode_batch_XXXXXX";
+    bencode_batch_item_t items[3];
+    long long int piece_length = 0;
+    char hex[41];
+    int fd;
+
+    fd = mkstemp(path);
+    CuAssertTrue(tc, -1 != fd);
+    CuAssertTrue(tc, (ssize_t)strlen(torrent) == write(fd, torrent, strlen(torrent)));
+    close(fd);
+
+    memset(items, 0, sizeof(items));
+    items[0].path = path;
+    items[0].udata = &piece_length;
+    items[1].path = "/nonexistent/bencode_batch";
+    items[2].path = path;
+    items[2].udata = &piece_length;
+
+    /* more threads than items */
+    CuAssertTrue(tc, 2 == bencode_batch_run(items, 3, &__cb, 10, 8));
+    CuAssertTrue(tc, 0 == items[0].io_err);
+    CuAssertStrEquals(tc, "bc2199230a2c8cef4b1f8a9cb8260c061ea789ac",
+            __hex(items[0].info_hash, hex));
+    CuAssertTrue(tc, ENOENT == items[1].io_err);
+    CuAssertTrue(tc, 1 == items[2].has_info_hash);
+    CuAssertTrue(tc, 16384 == piece_length);
+    unlink(path);
+}
+
+void TestBencodeBatchIngest(
+    CuTest * tc
+)
+{
+    char *torrent = "d4:infod6:lengthi5e4:name3:foo"
+        "12:piece lengthi16384e6:pieces0:ee";
+    char big[] = "/tmp/bencode_batch_XXXXXX";
+    char small[] = "/tmp/bencode_batch_XXXXXX";
+    bencode_batch_item_t items[40];
+    long long int piece_length[40];
+    char hex[41];
+    unsigned int i;
+    int fd;
+
+    fd = mkstemp(big);
+    CuAssertTrue(tc, -1 != fd);
+    CuAssertTrue(tc, (ssize_t)strlen(torrent) == write(fd, torrent, strlen(torrent)));
+    close(fd);
+    fd = mkstemp(small);
+    CuAssertTrue(tc, -1 != fd);
+    CuAssertTrue(tc, 8 == write(fd, "d1:ai1ee", 8));
+    close(fd);
+
+    memset(items, 0, sizeof(items));
+    for (i = 0; i < 40; i++)
+    {
+        piece_length[i] = 0;
+        items[i].udata = &piece_length[i];
+        switch (i % 4)
+        {
+        case 0: items[i].path = big; break;
+        case 1: items[i].path = small; break;
+        case 2: items[i].path = "/nonexistent/bencode_batch"; break;
+        case 3:
+            items[i].buf = torrent;
+            items[i].len = strlen(torrent);
+            break;
+        }
+    }
+
+    /* the torrent doesn't fit in a read buffer, so takes a second read */
+    CuAssertTrue(tc, 30 == bencode_batch_ingest(items, 40, &__cb, 10, 2, 4, 32));
+    for (i = 0; i < 40; i++)
+    {
+        switch (i % 4)
+        {
+        case 0:
+        case 3:
+            CuAssertTrue(tc, 0 == items[i].io_err);
+            CuAssertTrue(tc, BENCODE_ERR_NONE == items[i].err);
+            CuAssertStrEquals(tc, "bc2199230a2c8cef4b1f8a9cb8260c061ea789ac",
+                    __hex(items[i].info_hash, hex));
+            CuAssertTrue(tc, 16384 == piece_length[i]);
+            break;
+        case 1:
+            CuAssertTrue(tc, 0 == items[i].io_err);
+            CuAssertTrue(tc, 0 == items[i].has_info_hash);
+            break;
+        case 2:
+            CuAssertTrue(tc, ENOENT == items[i].io_err);
+            break;
+        }
+    }
+    unlink(big);
+    unlink(small);
+}
@@ -0,0 +1,118 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Test canonical re-encoding
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdbool.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "CuTest.h"
+
+#include "bencode.h"
+#include "bencode_canon.h"
+
+static int __flush(void* udata, const char* buf, unsigned int len)
+{
+    strncat(udata, buf, len);
+    return 1;
+}
+
+static int __canon(
+        const char* str,
+        unsigned int max_mem,
+        char* res)
+{
+    bencode_canon_t* c;
+    char out[8];
+    int ok;
+
+    res[0] = '\0';
+    c = bencode_canon_new(10, out, sizeof(out), __flush, res, max_mem);
+    ok = bencode_canon_dispatch_from_buffer(c, str, strlen(str)) &&
+        bencode_canon_finish(c);
+    bencode_canon_free(c);
+    return ok;
+}
+
+void TestBencodeCanonSortsKeys(
+    CuTest * tc
+)
+{
+    char res[256];
+
+    CuAssertTrue(tc, 1 == __canon("d1:bi1e1:ai2e2:aai3e0:i4ee", 0, res));
+    CuAssertStrEquals(tc, "d0:i4e1:ai2e2:aai3e1:bi1ee", res);
+}
+
+void TestBencodeCanonSortsNestedDicts(
+    CuTest * tc
+)
+{
+    char res[256];
+
+    CuAssertTrue(tc, 1 == __canon(
+                "ld4:infod4:name1:x6:lengthi7ee8:announce1:ued1:zle1:yi0eee",
+                0, res));
+    CuAssertStrEquals(tc,
+            "ld8:announce1:u4:infod6:lengthi7e4:name1:xeed1:yi0e1:zleee",
+            res);
+}
+
+void TestBencodeCanonFixesNumbers(
+    CuTest * tc
+)
+{
+    char res[256];
+
+    CuAssertTrue(tc, 1 == __canon("li007ei-0ei-012e03:abce", 0, res));
+    CuAssertStrEquals(tc, "li7ei0ei-12e3:abce", res);
+}
+
+void TestBencodeCanonRepeatedKeyFails(
+    CuTest * tc
+)
+{
+    char res[256];
+
+    CuAssertTrue(tc, 0 == __canon("d1:ai1e1:ai2ee", 0, res));
+}
+
+void TestBencodeCanonMemoryLimit(
+    CuTest * tc
+)
+{
+    char res[256];
+
+    /* lists outside of a dict aren't held */
+    CuAssertTrue(tc, 1 == __canon("l20:01234567890123456789e", 16, res));
+    CuAssertTrue(tc, 0 == __canon("d1:a20:01234567890123456789e", 16, res));
+}
+
+void TestBencodeCanonOnlyMovesItemsOutOfPlace(
+    CuTest * tc
+)
+{
+    char res[256];
+    unsigned int m;
+
+    CuAssertTrue(tc, 1 == __canon("d1:xd1:ai1e1:ci3e1:bi2eee", 0, res));
+    CuAssertStrEquals(tc, "d1:xd1:ai1e1:bi2e1:ci3eee", res);
+
+    /* keys in order aren't sorted or copied, so they take less memory */
+    for (m = 1; !__canon("d1:xd1:ai1e1:bi2eee", m, res); m++)
+        ;
+    CuAssertStrEquals(tc, "d1:xd1:ai1e1:bi2eee", res);
+    CuAssertTrue(tc, 0 == __canon("d1:xd1:bi2e1:ai1eee", m, res));
+
+    /* a repeated key is caught as soon as it arrives */
+    CuAssertTrue(tc, 0 == __canon("d1:xd1:ai1e1:ai2eee", 0, res));
+}
@@ -0,0 +1,132 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Test unpacking compact peers and nodes
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdbool.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "CuTest.h"
+
+#include "bencode.h"
+#include "bencode_compact.h"
+
+/* peer i is 10.0.0.i:(6880 + i) */
+static void __make_peers(unsigned char* buf, unsigned int n)
+{
+    unsigned int i;
+
+    for (i = 0; i < n; i++, buf += 6)
+    {
+        buf[0] = 10;
+        buf[1] = 0;
+        buf[2] = 0;
+        buf[3] = i;
+        buf[4] = (6880 + i) >> 8;
+        buf[5] = (6880 + i) & 0xff;
+    }
+}
+
+void TestBencodeCompactPeers(
+    CuTest * tc
+)
+{
+    unsigned char buf[6 * 9];
+    bencode_peer_t peers[9];
+    bencode_compact_t c;
+    unsigned int i;
+
+    __make_peers(buf, 9);
+    bencode_compact_init(&c, BENCODE_COMPACT_PEERS);
+    CuAssertTrue(tc, 9 == bencode_compact_count(&c, sizeof(buf)));
+    CuAssertTrue(tc, 9 == bencode_compact_peers(&c, buf, sizeof(buf), peers));
+
+    for (i = 0; i < 9; i++)
+    {
+        const unsigned char* a = (const unsigned char*)&peers[i].addr;
+
+        CuAssertTrue(tc, 10 == a[0] && 0 == a[1] && 0 == a[2] && i == a[3]);
+        CuAssertTrue(tc, 6880 + i == peers[i].port);
+    }
+}
+
+void TestBencodeCompactPeersInPieces(
+    CuTest * tc
+)
+{
+    unsigned char buf[6 * 5];
+    bencode_peer_t peers[5];
+    bencode_compact_t c;
+    unsigned int n = 0, off = 0, step = 4;
+
+    __make_peers(buf, 5);
+    bencode_compact_init(&c, BENCODE_COMPACT_PEERS);
+    while (off < sizeof(buf))
+    {
+        unsigned int len = sizeof(buf) - off < step ? sizeof(buf) - off : step;
+
+        CuAssertTrue(tc, n + bencode_compact_count(&c, len) <= 5);
+        n += bencode_compact_peers(&c, buf + off, len, peers + n);
+        off += len;
+        step += 3;
+    }
+    CuAssertTrue(tc, 5 == n);
+    CuAssertTrue(tc, 0 == c.carry_len);
+    CuAssertTrue(tc, 6884 == peers[4].port);
+    CuAssertTrue(tc, 6881 == peers[1].port);
+}
+
+void TestBencodeCompactNodes(
+    CuTest * tc
+)
+{
+    unsigned char buf[26 * 2];
+    bencode_node_t nodes[2];
+    bencode_compact_t c;
+
+    memset(buf, 'a', 20);
+    memcpy(buf + 20, "\x7f\x00\x00\x01\x1a\xe1", 6);
+    memset(buf + 26, 'b', 20);
+    memcpy(buf + 46, "\xc0\xa8\x01\x02\x00\x50", 6);
+
+    bencode_compact_init(&c, BENCODE_COMPACT_NODES);
+    CuAssertTrue(tc, 1 == bencode_compact_nodes(&c, buf, 30, nodes));
+    CuAssertTrue(tc, 1 == bencode_compact_nodes(&c, buf + 30, 22, nodes + 1));
+    CuAssertTrue(tc, 'a' == nodes[0].id[19]);
+    CuAssertTrue(tc, 6881 == nodes[0].port);
+    CuAssertTrue(tc, 0 == memcmp(&nodes[1].addr, "\xc0\xa8\x01\x02", 4));
+    CuAssertTrue(tc, 80 == nodes[1].port);
+
+    /* the decoder has to be set up for the format */
+    bencode_compact_init(&c, BENCODE_COMPACT_PEERS6);
+    CuAssertTrue(tc, 0 == bencode_compact_nodes(&c, buf, 26, nodes));
+}
+
+void TestBencodeCompactPeers6(
+    CuTest * tc
+)
+{
+    unsigned char buf[18];
+    bencode_peer6_t peer;
+    bencode_compact_t c;
+
+    memset(buf, 0, 16);
+    buf[15] = 1;
+    buf[16] = 0x1a;
+    buf[17] = 0xe1;
+
+    bencode_compact_init(&c, BENCODE_COMPACT_PEERS6);
+    CuAssertTrue(tc, 0 == bencode_compact_peers6(&c, buf, 17, &peer));
+    CuAssertTrue(tc, 1 == bencode_compact_peers6(&c, buf + 17, 1, &peer));
+    CuAssertTrue(tc, 1 == peer.addr[15]);
+    CuAssertTrue(tc, 6881 == peer.port);
+}
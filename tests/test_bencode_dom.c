@@ -0,0 +1,163 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Test building a tree out of a document
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdbool.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "CuTest.h"
+
+#include "bencode.h"
+#include "bencode_dom.h"
+
+void TestBencodeDomInt(
+    CuTest * tc
+)
+{
+    char *str = "i-42e";
+    bencode_dom_t* d = bencode_dom_new(10);
+    const bencode_node_t* n;
+
+    CuAssertTrue(tc, 1 == bencode_dom_dispatch_from_buffer(d, str, strlen(str)));
+    n = bencode_dom_root(d);
+    CuAssertTrue(tc, NULL != n);
+    CuAssertTrue(tc, BENCODE_TOK_INT == n->type);
+    CuAssertTrue(tc, -42 == n->intval);
+    bencode_dom_free(d);
+}
+
+void TestBencodeDomListIsContiguous(
+    CuTest * tc
+)
+{
+    char *str = "l3:fooi1el0:ee";
+    bencode_dom_t* d = bencode_dom_new(10);
+    const bencode_node_t* n;
+
+    CuAssertTrue(tc, 1 == bencode_dom_dispatch_from_buffer(d, str, strlen(str)));
+    n = bencode_dom_root(d);
+    CuAssertTrue(tc, BENCODE_TOK_LIST == n->type);
+    CuAssertTrue(tc, 3 == n->len);
+    CuAssertTrue(tc, BENCODE_TOK_STR == n->child[0].type);
+    CuAssertStrEquals(tc, "foo", n->child[0].strval);
+    CuAssertTrue(tc, NULL == n->child[0].key);
+    CuAssertTrue(tc, 1 == n->child[1].intval);
+    CuAssertTrue(tc, BENCODE_TOK_LIST == n->child[2].type);
+    CuAssertTrue(tc, 1 == n->child[2].len);
+    CuAssertStrEquals(tc, "", n->child[2].child[0].strval);
+    bencode_dom_free(d);
+}
+
+void TestBencodeDomDictIsSorted(
+    CuTest * tc
+)
+{
+    char *str = "d1:ci3e1:ai1e2:bbd1:yi5e1:xi4eee";
+    bencode_dom_t* d = bencode_dom_new(10);
+    const bencode_node_t* n, *v;
+
+    CuAssertTrue(tc, 1 == bencode_dom_dispatch_from_buffer(d, str, strlen(str)));
+    n = bencode_dom_root(d);
+    CuAssertTrue(tc, BENCODE_TOK_DICT == n->type);
+    CuAssertTrue(tc, 3 == n->len);
+    CuAssertStrEquals(tc, "a", n->child[0].key);
+    CuAssertStrEquals(tc, "bb", n->child[1].key);
+    CuAssertTrue(tc, 2 == n->child[1].klen);
+    CuAssertStrEquals(tc, "c", n->child[2].key);
+    CuAssertStrEquals(tc, "x", n->child[1].child[0].key);
+
+    v = bencode_dom_get(n, "c", 1);
+    CuAssertTrue(tc, NULL != v);
+    CuAssertTrue(tc, 3 == v->intval);
+    v = bencode_dom_get(bencode_dom_get(n, "bb", 2), "y", 1);
+    CuAssertTrue(tc, NULL != v);
+    CuAssertTrue(tc, 5 == v->intval);
+    CuAssertTrue(tc, NULL == bencode_dom_get(n, "b", 1));
+    CuAssertTrue(tc, NULL == bencode_dom_get(n->child, "a", 1));
+    bencode_dom_free(d);
+}
+
+void TestBencodeDomInPieces(
+    CuTest * tc
+)
+{
+    char *str = "d4:infod4:name11:hello world6:lengthi123ee1:ll1:a1:bee";
+    bencode_dom_t* d = bencode_dom_new(10);
+    const bencode_node_t* n;
+    unsigned int i;
+
+    for (i = 0; i < strlen(str); i++)
+    {
+        CuAssertTrue(tc, NULL == bencode_dom_root(d));
+        CuAssertTrue(tc, 1 == bencode_dom_dispatch_from_buffer(d, str + i, 1));
+    }
+    n = bencode_dom_get(bencode_dom_root(d), "info", 4);
+    CuAssertTrue(tc, NULL != n);
+    CuAssertStrEquals(tc, "hello world",
+            bencode_dom_get(n, "name", 4)->strval);
+    CuAssertTrue(tc, 123 == bencode_dom_get(n, "length", 6)->intval);
+    n = bencode_dom_get(bencode_dom_root(d), "l", 1);
+    CuAssertTrue(tc, 2 == n->len);
+    CuAssertStrEquals(tc, "b", n->child[1].strval);
+    bencode_dom_free(d);
+}
+
+void TestBencodeDomBigDocument(
+    CuTest * tc
+)
+{
+    char str[64];
+    bencode_dom_t* d = bencode_dom_new(10);
+    const bencode_node_t* n;
+    int i;
+
+    /* enough to fill a few arena blocks and grow the scratch nodes */
+    bencode_dom_dispatch_from_buffer(d, "l", 1);
+    for (i = 0; i < 1000; i++)
+    {
+        sprintf(str, "d1:ii%de1:s5:abcdee", i);
+        bencode_dom_dispatch_from_buffer(d, str, strlen(str));
+    }
+    CuAssertTrue(tc, 1 == bencode_dom_dispatch_from_buffer(d, "e", 1));
+    n = bencode_dom_root(d);
+    CuAssertTrue(tc, 1000 == n->len);
+    CuAssertTrue(tc, 999 == bencode_dom_get(&n->child[999], "i", 1)->intval);
+    CuAssertStrEquals(tc, "abcde", bencode_dom_get(&n->child[500], "s", 1)->strval);
+    bencode_dom_free(d);
+}
+
+void TestBencodeDomOneDocumentOnly(
+    CuTest * tc
+)
+{
+    char *str = "i1ei2e";
+    bencode_dom_t* d = bencode_dom_new(10);
+
+    CuAssertTrue(tc, 0 == bencode_dom_dispatch_from_buffer(d, str, strlen(str)));
+    CuAssertTrue(tc, BENCODE_ERR_CALLBACK == bencode_dom_error(d));
+    CuAssertTrue(tc, 1 == bencode_dom_root(d)->intval);
+    bencode_dom_free(d);
+}
+
+void TestBencodeDomBadInput(
+    CuTest * tc
+)
+{
+    char *str = "d1:ai1e1:bxe";
+    bencode_dom_t* d = bencode_dom_new(10);
+
+    CuAssertTrue(tc, 0 == bencode_dom_dispatch_from_buffer(d, str, strlen(str)));
+    CuAssertTrue(tc, BENCODE_ERR_BAD_VALUE == bencode_dom_error(d));
+    CuAssertTrue(tc, NULL == bencode_dom_root(d));
+    bencode_dom_free(d);
+}
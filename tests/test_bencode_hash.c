@@ -0,0 +1,186 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Test hashing and comparing values by their structure
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdbool.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "CuTest.h"
+
+#include "bencode.h"
+#include "bencode_hash.h"
+
+typedef struct {
+    char path[32];
+    unsigned char hash[16];
+    int n;
+} __got_t;
+
+static int __got(void* udata, const char* path, const unsigned char hash[16])
+{
+    __got_t* g = udata;
+
+    strcpy(g->path, path);
+    memcpy(g->hash, hash, 16);
+    g->n++;
+    return 1;
+}
+
+/**
+ * Hash the whole document, handing it over chunk bytes at a time */
+static int __hash(const char* doc, int flags, unsigned int chunk,
+        unsigned char out[16])
+{
+    __got_t g;
+    bencode_hash_t* h;
+    unsigned int i, len = strlen(doc);
+    int ok = 1;
+
+    memset(&g, 0, sizeof(g));
+    h = bencode_hash_new(10, NULL, 0, flags, __got, &g);
+    for (i = 0; ok && i < len; i += chunk)
+        ok = bencode_hash_dispatch_from_buffer(h, doc + i,
+                len - i < chunk ? len - i : chunk);
+    bencode_hash_free(h);
+    memcpy(out, g.hash, 16);
+    return ok && 1 == g.n;
+}
+
+static int __same(const char* a, const char* b, int flags)
+{
+    unsigned char x[16], y[16];
+
+    if (!__hash(a, flags, 1000, x) || !__hash(b, flags, 1000, y))
+        return -1;
+    return 0 == memcmp(x, y, 16);
+}
+
+void TestBencodeHash(
+    CuTest * tc
+)
+{
+    char *doc = "d4:infod6:lengthi5e4:name3:foo5:filesl"
+        "d6:lengthi1e4:pathl1:aeeee0:le5:emptyd0:0:ee";
+    unsigned char x[16], y[16];
+    int r;
+
+    /* however it's split up */
+    r = __hash(doc, 0, 1000, x);
+    CuAssertTrue(tc, r);
+    r = __hash(doc, 0, 1, y);
+    CuAssertTrue(tc, r);
+    CuAssertTrue(tc, 0 == memcmp(x, y, 16));
+    r = __hash(doc, 0, 7, y);
+    CuAssertTrue(tc, r);
+    CuAssertTrue(tc, 0 == memcmp(x, y, 16));
+
+    CuAssertTrue(tc, 1 == __same("i7e", "i007e", 0));
+    CuAssertTrue(tc, 1 == __same("i0e", "i-0e", 0));
+    CuAssertTrue(tc, 1 == __same("i123456789012345678901234567890e",
+                "i0123456789012345678901234567890e", 0));
+    CuAssertTrue(tc, 0 == __same("i7e", "i-7e", 0));
+    CuAssertTrue(tc, 0 == __same("i7e", "1:7", 0));
+    CuAssertTrue(tc, 0 == __same("0:", "le", 0));
+    CuAssertTrue(tc, 0 == __same("le", "de", 0));
+    CuAssertTrue(tc, 0 == __same("l1:a1:be", "l1:b1:ae", 0));
+    CuAssertTrue(tc, 0 == __same("l2:ab1:ce", "l1:a2:bce", 0));
+    CuAssertTrue(tc, 0 == __same("l1:ae", "l1:a0:e", 0));
+    CuAssertTrue(tc, 0 == __same("d1:a1:be", "d1:b1:ae", 0));
+    CuAssertTrue(tc, 0 == __same("d1:a1:be", "l1:a1:be", 0));
+
+    /* order of dict keys */
+    CuAssertTrue(tc, 0 == __same("d1:ai1e1:bi2ee", "d1:bi2e1:ai1ee", 0));
+    CuAssertTrue(tc, 1 == __same("d1:ai1e1:bi2ee", "d1:bi2e1:ai1ee",
+                BENCODE_HASH_SORT_KEYS));
+    CuAssertTrue(tc, 0 == __same("d1:ai1e1:bi2ee", "d1:ai2e1:bi1ee",
+                BENCODE_HASH_SORT_KEYS));
+    CuAssertTrue(tc, 0 == __same("d1:ai1e1:bi2ee", "d1:ai1ee",
+                BENCODE_HASH_SORT_KEYS));
+    CuAssertTrue(tc, 0 == __same("l1:a1:be", "l1:b1:ae",
+                BENCODE_HASH_SORT_KEYS));
+}
+
+void TestBencodeHashSelector(
+    CuTest * tc
+)
+{
+    char *doc = "d8:announce3:foo4:infod6:lengthi5e4:name3:fooee";
+    const char *paths[] = { "info" };
+    unsigned char want[16];
+    bencode_hash_t* h;
+    __got_t g;
+    int r;
+
+    r = __hash("d6:lengthi5e4:name3:fooe", 0, 1000, want);
+    CuAssertTrue(tc, r);
+
+    memset(&g, 0, sizeof(g));
+    h = bencode_hash_new(10, paths, 1, 0, __got, &g);
+    r = bencode_hash_dispatch_from_buffer(h, doc, strlen(doc));
+    CuAssertTrue(tc, r);
+    CuAssertTrue(tc, 1 == g.n);
+    CuAssertStrEquals(tc, "info", g.path);
+    CuAssertTrue(tc, 0 == memcmp(want, g.hash, 16));
+    bencode_hash_free(h);
+
+    /* broken input */
+    memset(&g, 0, sizeof(g));
+    h = bencode_hash_new(10, NULL, 0, 0, __got, &g);
+    r = bencode_hash_dispatch_from_buffer(h, "d1:ai1x", 7);
+    CuAssertTrue(tc, 0 == r);
+    CuAssertTrue(tc, BENCODE_ERR_BAD_INT == bencode_hash_error(h));
+    CuAssertTrue(tc, 0 == g.n);
+    bencode_hash_free(h);
+}
+
+static int __equal(const char* a, const char* b, int flags)
+{
+    return bencode_equal(a, strlen(a), b, strlen(b), flags);
+}
+
+void TestBencodeEqual(
+    CuTest * tc
+)
+{
+    CuAssertTrue(tc, 1 == __equal("i7e", "i007e", 0));
+    CuAssertTrue(tc, 1 == __equal("i0e", "i-0e", 0));
+    CuAssertTrue(tc, 0 == __equal("i7e", "i-7e", 0));
+    CuAssertTrue(tc, 0 == __equal("i7e", "1:7", 0));
+    CuAssertTrue(tc, 1 == __equal("3:foo", "3:foo", 0));
+    CuAssertTrue(tc, 0 == __equal("3:foo", "3:fop", 0));
+    CuAssertTrue(tc, 1 == __equal("l1:ai1ee", "l1:ai1ee", 0));
+    CuAssertTrue(tc, 0 == __equal("l1:ai1ee", "li1e1:ae", 0));
+    CuAssertTrue(tc, 0 == __equal("l1:ae", "l1:a1:ae", 0));
+    CuAssertTrue(tc, 0 == __equal("le", "de", 0));
+    CuAssertTrue(tc, 1 == __equal("d1:ad1:bl0:eee", "d1:ad1:bl0:eee", 0));
+
+    /* order of dict keys */
+    CuAssertTrue(tc, 0 == __equal("d1:ai1e1:bi2ee", "d1:bi2e1:ai1ee", 0));
+    CuAssertTrue(tc, 1 == __equal("d1:ai1e1:bi2ee", "d1:bi2e1:ai1ee",
+                BENCODE_HASH_SORT_KEYS));
+    CuAssertTrue(tc, 1 == __equal("d1:xd1:ai1e1:bi2ee1:yi3ee",
+                "d1:yi3e1:xd1:bi2e1:ai1eee", BENCODE_HASH_SORT_KEYS));
+    CuAssertTrue(tc, 0 == __equal("d1:ai1ee", "d1:ai1e1:bi2ee",
+                BENCODE_HASH_SORT_KEYS));
+    CuAssertTrue(tc, 0 == __equal("d1:ai1e1:bi2ee", "d1:ai1ee",
+                BENCODE_HASH_SORT_KEYS));
+    CuAssertTrue(tc, 0 == __equal("d1:ai1e1:bi2ee", "d1:bi1e1:ai2ee",
+                BENCODE_HASH_SORT_KEYS));
+
+    /* malformed, or trailing bytes */
+    CuAssertTrue(tc, 0 == __equal("l1:a", "l1:a", 0));
+    CuAssertTrue(tc, 0 == __equal("i1xe", "i1xe", 0));
+    CuAssertTrue(tc, 0 == __equal("5:ab", "5:ab", 0));
+    CuAssertTrue(tc, 0 == __equal("i1ei2e", "i1ei2e", 0));
+    CuAssertTrue(tc, 0 == __equal("d1:ai1ee", "d1:ai1e", BENCODE_HASH_SORT_KEYS));
+}
@@ -0,0 +1,293 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Test document indexing
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdbool.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include "CuTest.h"
+
+#include "bencode.h"
+#include "bencode_index.h"
+
+void TestBencodeIndexEntries(
+    CuTest * tc
+)
+{
+    char *str = "d3:fool1:ai42ee3:bar0:e";
+    bencode_index_t* idx;
+    const bencode_index_entry_t* e;
+
+    idx = bencode_index_new(str, strlen(str), 10);
+    CuAssertPtrNotNull(tc, idx);
+    CuAssertTrue(tc, 7 == bencode_index_count(idx));
+    e = bencode_index_entries(idx);
+
+    CuAssertTrue(tc, BENCODE_TOK_DICT == e[0].type);
+    CuAssertTrue(tc, 0 == e[0].off);
+    CuAssertTrue(tc, strlen(str) == e[0].len);
+    CuAssertTrue(tc, 7 == e[0].skip);
+
+    CuAssertTrue(tc, BENCODE_TOK_DICT_KEY == e[1].type);
+    CuAssertTrue(tc, 0 == strncmp("3:foo", str + e[1].off, e[1].len));
+
+    CuAssertTrue(tc, BENCODE_TOK_LIST == e[2].type);
+    CuAssertTrue(tc, 0 == strncmp("l1:ai42ee", str + e[2].off, e[2].len));
+    CuAssertTrue(tc, 3 == e[2].skip);
+
+    CuAssertTrue(tc, BENCODE_TOK_STR == e[3].type);
+    CuAssertTrue(tc, 0 == strncmp("1:a", str + e[3].off, e[3].len));
+
+    CuAssertTrue(tc, BENCODE_TOK_INT == e[4].type);
+    CuAssertTrue(tc, 0 == strncmp("i42e", str + e[4].off, e[4].len));
+
+    CuAssertTrue(tc, BENCODE_TOK_STR == e[6].type);
+    CuAssertTrue(tc, 0 == strncmp("0:", str + e[6].off, e[6].len));
+    CuAssertTrue(tc, 2 == e[6].len);
+
+    CuAssertTrue(tc, 2 == bencode_index_dict_get(idx, str, 0, "foo", 3));
+    CuAssertTrue(tc, 6 == bencode_index_dict_get(idx, str, 0, "bar", 3));
+    CuAssertTrue(tc, -1 == bencode_index_dict_get(idx, str, 0, "baz", 3));
+    bencode_index_free(idx);
+}
+
+void TestBencodeIndexSaveAndLoad(
+    CuTest * tc
+)
+{
+    char *str = "d4:infod6:lengthi7e4:name1:xee";
+    char src_path[] = "/tmp/bencode_index_src_XXXXXX";
+    char idx_path[64];
+    bencode_index_t* idx;
+    FILE* fp;
+    int fd;
+
+    fd = mkstemp(src_path);
+    CuAssertTrue(tc, -1 != fd);
+    CuAssertTrue(tc, (ssize_t)strlen(str) == write(fd, str, strlen(str)));
+    close(fd);
+    sprintf(idx_path, "%s.idx", src_path);
+
+    idx = bencode_index_new(str, strlen(str), 10);
+    CuAssertTrue(tc, 1 == bencode_index_save(idx, idx_path, src_path));
+    bencode_index_free(idx);
+
+    idx = bencode_index_load(idx_path, src_path, str, strlen(str));
+    CuAssertPtrNotNull(tc, idx);
+    CuAssertTrue(tc, 7 == bencode_index_count(idx));
+    CuAssertTrue(tc, 4 == bencode_index_dict_get(idx, str,
+                bencode_index_dict_get(idx, str, 0, "info", 4), "length", 6));
+    bencode_index_free(idx);
+
+    /* a different source of the same size fails the hash check */
+    CuAssertTrue(tc, NULL == bencode_index_load(idx_path, src_path,
+                "d4:infod6:lengthi8e4:name1:xee", strlen(str)));
+
+    /* the source has changed underneath the index */
+    fp = fopen(src_path, "a");
+    fputs("x", fp);
+    fclose(fp);
+    CuAssertTrue(tc, NULL == bencode_index_load(idx_path, src_path, NULL, 0));
+
+    unlink(src_path);
+    unlink(idx_path);
+}
+
+void TestBencodeIndexTruncated(
+    CuTest * tc
+)
+{
+    char *str = "d4:infod6:lengthi7e4:name1:xee";
+
+    CuAssertTrue(tc, NULL == bencode_index_new(str, strlen(str) - 1, 10));
+    CuAssertTrue(tc, NULL == bencode_index_new(str, 5, 10));
+    CuAssertTrue(tc, NULL == bencode_index_new(str, 0, 10));
+}
+
+void TestBencodeIndexLoadRejectsBadEntries(
+    CuTest * tc
+)
+{
+    char *str = "d4:infod6:lengthi7e4:name1:xee";
+    char src_path[] = "/tmp/bencode_index_src_XXXXXX";
+    char idx_path[64];
+    bencode_index_t* idx;
+    struct stat st;
+    struct timespec ts[2];
+    uint64_t off = 1000;
+    uint32_t skip = 100;
+    FILE* fp;
+    int fd;
+
+    fd = mkstemp(src_path);
+    CuAssertTrue(tc, -1 != fd);
+    CuAssertTrue(tc, (ssize_t)strlen(str) == write(fd, str, strlen(str)));
+    close(fd);
+    sprintf(idx_path, "%s.idx", src_path);
+
+    idx = bencode_index_new(str, strlen(str), 10);
+    CuAssertTrue(tc, 1 == bencode_index_save(idx, idx_path, src_path));
+    bencode_index_free(idx);
+    idx = bencode_index_load(idx_path, src_path, NULL, 0);
+    CuAssertPtrNotNull(tc, idx);
+    bencode_index_free(idx);
+
+    /* an entry that points past the end of the source */
+    fp = fopen(idx_path, "r+b");
+    fseek(fp, sizeof(bencode_index_header_t) + sizeof(bencode_index_entry_t) +
+            offsetof(bencode_index_entry_t, off), SEEK_SET);
+    fwrite(&off, sizeof(off), 1, fp);
+    fclose(fp);
+    CuAssertTrue(tc, NULL == bencode_index_load(idx_path, src_path, NULL, 0));
+
+    /* an entry that spans past the end of the index */
+    idx = bencode_index_new(str, strlen(str), 10);
+    CuAssertTrue(tc, 1 == bencode_index_save(idx, idx_path, src_path));
+    bencode_index_free(idx);
+    fp = fopen(idx_path, "r+b");
+    fseek(fp, sizeof(bencode_index_header_t) + 2 * sizeof(bencode_index_entry_t) +
+            offsetof(bencode_index_entry_t, skip), SEEK_SET);
+    fwrite(&skip, sizeof(skip), 1, fp);
+    fclose(fp);
+    CuAssertTrue(tc, NULL == bencode_index_load(idx_path, src_path, NULL, 0));
+
+    /* the source was rewritten within the same second */
+    idx = bencode_index_new(str, strlen(str), 10);
+    CuAssertTrue(tc, 1 == bencode_index_save(idx, idx_path, src_path));
+    bencode_index_free(idx);
+    CuAssertTrue(tc, 0 == stat(src_path, &st));
+    ts[0] = st.st_atim;
+    ts[1] = st.st_mtim;
+    ts[1].tv_nsec = (ts[1].tv_nsec + 1) % 1000000000;
+    CuAssertTrue(tc, 0 == utimensat(AT_FDCWD, src_path, ts, 0));
+    CuAssertTrue(tc, NULL == bencode_index_load(idx_path, src_path, NULL, 0));
+
+    unlink(src_path);
+    unlink(idx_path);
+}
+
+void TestBencodeIndexKeys(
+    CuTest * tc
+)
+{
+    char *str = malloc(10000 * 16 + 2), *p = str;
+    bencode_index_t* idx;
+    bencode_index_keys_t* keys;
+    char key[16];
+    int i;
+
+    p += sprintf(p, "d");
+    for (i = 0; i < 10000; i++)
+        p += sprintf(p, "5:k%04dli%dee", i, i);
+    sprintf(p, "e");
+
+    idx = bencode_index_new(str, strlen(str), 10);
+    keys = bencode_index_keys_new(idx, str, 0);
+    CuAssertPtrNotNull(tc, keys);
+    for (i = 0; i < 10000; i += 7)
+    {
+        sprintf(key, "k%04d", i);
+        CuAssertTrue(tc, bencode_index_dict_get(idx, str, 0, key, 5) ==
+                bencode_index_keys_get(keys, str, key, 5));
+    }
+    CuAssertTrue(tc, 2 == bencode_index_keys_get(keys, str, "k0000", 5));
+    CuAssertTrue(tc, -1 == bencode_index_keys_get(keys, str, "k10000", 6));
+    CuAssertTrue(tc, -1 == bencode_index_keys_get(keys, str, "k000", 4));
+
+    /* not a dict */
+    CuAssertTrue(tc, NULL == bencode_index_keys_new(idx, str, 2));
+    bencode_index_keys_free(keys);
+    bencode_index_free(idx);
+    free(str);
+}
+
+void TestBencodeIndexKeysRebuild(
+    CuTest * tc
+)
+{
+    char *a = "d1:ai1e1:bi2ee";
+    char *b = "d1:ci3e1:bi4e1:ci5ee";
+    bencode_index_t* idx;
+    bencode_index_keys_t* keys;
+
+    idx = bencode_index_new(a, strlen(a), 10);
+    keys = bencode_index_keys_new(idx, a, 0);
+    CuAssertTrue(tc, 2 == bencode_index_keys_get(keys, a, "a", 1));
+    bencode_index_free(idx);
+
+    /* the dict's been re-read */
+    idx = bencode_index_new(b, strlen(b), 10);
+    CuAssertTrue(tc, 1 == bencode_index_keys_rebuild(keys, idx, b, 0));
+    CuAssertTrue(tc, -1 == bencode_index_keys_get(keys, b, "a", 1));
+    CuAssertTrue(tc, 4 == bencode_index_keys_get(keys, b, "b", 1));
+    /* the first of a repeated key */
+    CuAssertTrue(tc, 2 == bencode_index_keys_get(keys, b, "c", 1));
+    bencode_index_keys_free(keys);
+    bencode_index_free(idx);
+}
+
+void TestBencodeIndexKeysRebuildKeepsSlots(
+    CuTest * tc
+)
+{
+    char *a = malloc(3000 * 16 + 2), *b = malloc(3000 * 16 + 2), *p;
+    bencode_index_t* idx;
+    bencode_index_keys_t* keys;
+    char key[16];
+    int i;
+
+    p = a + sprintf(a, "d");
+    for (i = 0; i < 3000; i++)
+        p += sprintf(p, "5:k%04di%de", i, i);
+    sprintf(p, "e");
+
+    /* a third of the keys gone, others added, and the values moved */
+    p = b + sprintf(b, "d");
+    for (i = 0; i < 3000; i++)
+        if (i % 3)
+            p += sprintf(p, "5:k%04dli%dee", i, i);
+    for (i = 0; i < 1000; i++)
+        p += sprintf(p, "5:n%04di%de", i, i);
+    sprintf(p, "e");
+
+    idx = bencode_index_new(a, strlen(a), 10);
+    keys = bencode_index_keys_new(idx, a, 0);
+    bencode_index_free(idx);
+
+    idx = bencode_index_new(b, strlen(b), 10);
+    CuAssertTrue(tc, 1 == bencode_index_keys_rebuild(keys, idx, b, 0));
+    for (i = 0; i < 3000; i++)
+    {
+        sprintf(key, "k%04d", i);
+        CuAssertTrue(tc, bencode_index_dict_get(idx, b, 0, key, 5) ==
+                bencode_index_keys_get(keys, b, key, 5));
+        CuAssertTrue(tc, (0 == i % 3) ==
+                (-1 == bencode_index_keys_get(keys, b, key, 5)));
+    }
+    for (i = 0; i < 1000; i++)
+    {
+        sprintf(key, "n%04d", i);
+        CuAssertTrue(tc, -1 != bencode_index_keys_get(keys, b, key, 5));
+        CuAssertTrue(tc, bencode_index_dict_get(idx, b, 0, key, 5) ==
+                bencode_index_keys_get(keys, b, key, 5));
+    }
+
+    bencode_index_keys_free(keys);
+    bencode_index_free(idx);
+    free(a);
+    free(b);
+}
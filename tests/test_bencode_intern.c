@@ -0,0 +1,144 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Test keeping one copy of strings that repeat across documents
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdbool.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "CuTest.h"
+
+#include "bencode.h"
+#include "bencode_intern.h"
+#include "bencode_dom.h"
+
+void TestBencodeIntern(
+    CuTest * tc
+)
+{
+    bencode_intern_t* t = bencode_intern_new(16, 0);
+    const char *a, *b, *c;
+    unsigned int id, id2, len, i;
+    char s[16];
+
+    a = bencode_intern(t, "length", 6, &id);
+    CuAssertStrEquals(tc, "length", a);
+    CuAssertTrue(tc, 0 == id);
+
+    /* not terminated where it's given to us */
+    b = bencode_intern(t, "lengthy", 6, &id2);
+    CuAssertTrue(tc, a == b);
+    CuAssertTrue(tc, id == id2);
+
+    c = bencode_intern(t, "path", 4, &id2);
+    CuAssertTrue(tc, a != c);
+    CuAssertTrue(tc, 1 == id2);
+    CuAssertTrue(tc, c == bencode_intern_lookup(t, 1, &len));
+    CuAssertTrue(tc, 4 == len);
+    CuAssertTrue(tc, NULL == bencode_intern_lookup(t, 2, &len));
+
+    /* too long */
+    CuAssertTrue(tc, NULL == bencode_intern(t, "abcdefghijklmnopq", 17, &id));
+    CuAssertTrue(tc, 2 == bencode_intern_count(t));
+
+    /* strings stay put as the table grows */
+    for (i = 0; i < 10000; i++)
+    {
+        sprintf(s, "%u", i);
+        bencode_intern(t, s, strlen(s), NULL);
+    }
+    CuAssertTrue(tc, 10002 == bencode_intern_count(t));
+    CuAssertTrue(tc, a == bencode_intern(t, "length", 6, NULL));
+    CuAssertStrEquals(tc, "9999", bencode_intern_lookup(t, 10001, NULL));
+    CuAssertTrue(tc, 10000 < bencode_intern_mem(t));
+    bencode_intern_free(t);
+}
+
+static void* __interner(void* arg)
+{
+    bencode_intern_t* t = arg;
+    unsigned int i;
+    char s[16];
+
+    for (i = 0; i < 1000; i++)
+    {
+        sprintf(s, "%u", i);
+        if (bencode_intern(t, s, strlen(s), NULL) !=
+            bencode_intern(t, s, strlen(s), NULL))
+            return t;
+    }
+    return NULL;
+}
+
+void TestBencodeInternShared(
+    CuTest * tc
+)
+{
+    bencode_intern_t* t = bencode_intern_new(16, 1);
+    pthread_t threads[4];
+    void* r;
+    int i;
+
+    for (i = 0; i < 4; i++)
+        pthread_create(&threads[i], NULL, __interner, t);
+    for (i = 0; i < 4; i++)
+    {
+        pthread_join(threads[i], &r);
+        CuAssertTrue(tc, NULL == r);
+    }
+    CuAssertTrue(tc, 1000 == bencode_intern_count(t));
+    CuAssertStrEquals(tc, "500", bencode_intern(t, "500", 3, NULL));
+    bencode_intern_free(t);
+}
+
+void TestBencodeInternDom(
+    CuTest * tc
+)
+{
+    char *doc = "d8:encoding5:UTF-84:infod6:lengthi5e4:name19:a long name, "
+        "uniqueee";
+    bencode_intern_t* t = bencode_intern_new(8, 0);
+    const bencode_node_t *x, *y, *ix, *iy;
+    bencode_dom_t *a, *b;
+    int r;
+
+    a = bencode_dom_new(10);
+    b = bencode_dom_new(10);
+    bencode_dom_set_intern(a, t);
+    bencode_dom_set_intern(b, t);
+    r = bencode_dom_dispatch_from_buffer(a, doc, strlen(doc));
+    CuAssertTrue(tc, 1 == r);
+    r = bencode_dom_dispatch_from_buffer(b, doc, strlen(doc));
+    CuAssertTrue(tc, 1 == r);
+
+    x = bencode_dom_get(bencode_dom_root(a), "encoding", 8);
+    y = bencode_dom_get(bencode_dom_root(b), "encoding", 8);
+    CuAssertStrEquals(tc, "UTF-8", x->strval);
+    CuAssertTrue(tc, 5 == x->len);
+    CuAssertTrue(tc, x->strval == y->strval);
+    CuAssertTrue(tc, x->key == y->key);
+
+    ix = bencode_dom_get(bencode_dom_root(a), "info", 4);
+    iy = bencode_dom_get(bencode_dom_root(b), "info", 4);
+    x = bencode_dom_get(ix, "name", 4);
+    y = bencode_dom_get(iy, "name", 4);
+    CuAssertTrue(tc, x->key == y->key);
+
+    /* too long to intern */
+    CuAssertStrEquals(tc, "a long name, unique", x->strval);
+    CuAssertTrue(tc, x->strval != y->strval);
+
+    bencode_dom_free(a);
+    bencode_dom_free(b);
+    bencode_intern_free(t);
+}
@@ -0,0 +1,134 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Test bencode to JSON transcoding
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdbool.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "CuTest.h"
+
+#include "bencode.h"
+#include "bencode_json.h"
+
+static int __flush(void* udata, const char* buf, unsigned int len)
+{
+    strncat(udata, buf, len);
+    return 1;
+}
+
+static void __transcode(
+        const char* str,
+        unsigned int len,
+        int bin_mode,
+        char* json)
+{
+    bencode_json_t* j;
+    char out[16];
+
+    json[0] = '\0';
+    j = bencode_json_new(10, out, sizeof(out), __flush, json, bin_mode);
+    bencode_json_dispatch_from_buffer(j, str, len);
+    bencode_json_finish(j);
+    bencode_json_free(j);
+}
+
+void TestBencodeJsonNested(
+    CuTest * tc
+)
+{
+    char *str = "d8:announce3:foo4:infod6:lengthi12e5:filesli1ei2eee4:listlee";
+    char json[256];
+
+    __transcode(str, strlen(str), BENCODE_JSON_BIN_ESCAPE, json);
+    CuAssertStrEquals(tc,
+            "{\"announce\":\"foo\",\"info\":{\"length\":12,\"files\":[1,2]},\"list\":[]}",
+            json);
+}
+
+void TestBencodeJsonEmptyDict(
+    CuTest * tc
+)
+{
+    char *str = "d1:ade1:bdee";
+    char json[256];
+
+    __transcode(str, strlen(str), BENCODE_JSON_BIN_ESCAPE, json);
+    CuAssertStrEquals(tc, "{\"a\":{},\"b\":{}}", json);
+}
+
+void TestBencodeJsonEscapesText(
+    CuTest * tc
+)
+{
+    char *str = "l8:a\"b\\c\nd\x01" "5:\xc3\xa9t\xc3\xa9" "e";
+    char json[256];
+
+    __transcode(str, strlen(str), BENCODE_JSON_BIN_ESCAPE, json);
+    CuAssertStrEquals(tc, "[\"a\\\"b\\\\c\\nd\\u0001\",\"\xc3\xa9t\xc3\xa9\"]", json);
+}
+
+void TestBencodeJsonBinaryAsHex(
+    CuTest * tc
+)
+{
+    char *str = "6:\x7f\x00\x00\x01\x1a\xe1";
+    char json[256];
+
+    __transcode(str, 8, BENCODE_JSON_BIN_HEX, json);
+    CuAssertStrEquals(tc, "\"7f0000011ae1\"", json);
+}
+
+void TestBencodeJsonBinaryAsBase64(
+    CuTest * tc
+)
+{
+    char *str = "l4:\xff\xfe\xfd\xfc" "3:\xff\xfe\xfd" "e";
+    char json[256];
+
+    __transcode(str, strlen(str), BENCODE_JSON_BIN_BASE64, json);
+    CuAssertStrEquals(tc, "[\"//79/A==\",\"//79\"]", json);
+}
+
+void TestBencodeJsonBinaryEscaped(
+    CuTest * tc
+)
+{
+    char *str = "2:a\xff";
+    char json[256];
+
+    __transcode(str, strlen(str), BENCODE_JSON_BIN_ESCAPE, json);
+    CuAssertStrEquals(tc, "\"a\\u00ff\"", json);
+}
+
+void TestBencodeJsonHexWritesEveryString(
+    CuTest * tc
+)
+{
+    char *str = "d4:cafe2:\xca\xfe" "e";
+    char json[256];
+
+    /* text and binary can't be mistaken for each other */
+    __transcode(str, strlen(str), BENCODE_JSON_BIN_HEX, json);
+    CuAssertStrEquals(tc, "{\"63616665\":\"cafe\"}", json);
+}
+
+void TestBencodeJsonKeyWithNul(
+    CuTest * tc
+)
+{
+    char *str = "d3:a\0bi1ee";
+    char json[256];
+
+    __transcode(str, 10, BENCODE_JSON_BIN_ESCAPE, json);
+    CuAssertStrEquals(tc, "{\"a\\u0000b\":1}", json);
+}
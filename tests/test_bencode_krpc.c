@@ -0,0 +1,136 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Test KRPC decoding
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdbool.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "CuTest.h"
+
+#include "bencode.h"
+#include "bencode_krpc.h"
+
+void TestBencodeKrpcQuery(
+    CuTest * tc
+)
+{
+    char *str = "d1:ad2:id20:abcdefghij01234567899:info_hash20:mnopqrstuvwxyz123456e"
+        "1:q9:get_peers1:t2:aa1:y1:qe";
+    bencode_krpc_msg_t msg;
+
+    CuAssertTrue(tc, 1 == bencode_krpc_decode(str, strlen(str), &msg));
+    CuAssertTrue(tc, 'q' == *msg.y.val);
+    CuAssertTrue(tc, 0 == strncmp("aa", msg.t.val, msg.t.len));
+    CuAssertTrue(tc, 9 == msg.q.len);
+    CuAssertTrue(tc, 0 == strncmp("get_peers", msg.q.val, msg.q.len));
+    CuAssertTrue(tc, 20 == msg.id.len);
+    CuAssertTrue(tc, 0 == strncmp("abcdefghij0123456789", msg.id.val, 20));
+    CuAssertTrue(tc, 0 == strncmp("mnopqrstuvwxyz123456", msg.info_hash.val, 20));
+    CuAssertTrue(tc, NULL == msg.token.val);
+    CuAssertTrue(tc, -1 == msg.port);
+    CuAssertTrue(tc, 0 == msg.unknown);
+}
+
+void TestBencodeKrpcResponseWithValues(
+    CuTest * tc
+)
+{
+    char *str = "d1:rd2:id20:abcdefghij01234567895:token8:aoeusnth"
+        "6:valuesl6:axje.u6:idhtnmee1:t2:aa1:y1:re";
+    bencode_krpc_msg_t msg;
+
+    CuAssertTrue(tc, 1 == bencode_krpc_decode(str, strlen(str), &msg));
+    CuAssertTrue(tc, 'r' == *msg.y.val);
+    CuAssertTrue(tc, 0 == strncmp("aoeusnth", msg.token.val, 8));
+    CuAssertTrue(tc, 2 == msg.nvalues);
+    CuAssertTrue(tc, 0 == strncmp("idhtnm", msg.values[1].val, 6));
+    CuAssertTrue(tc, 0 == msg.values_truncated);
+}
+
+void TestBencodeKrpcError(
+    CuTest * tc
+)
+{
+    char *str = "d1:eli201e23:A Generic Error Ocurrede1:t2:aa1:y1:ee";
+    bencode_krpc_msg_t msg;
+
+    CuAssertTrue(tc, 1 == bencode_krpc_decode(str, strlen(str), &msg));
+    CuAssertTrue(tc, 201 == msg.err_code);
+    CuAssertTrue(tc, 23 == msg.err_msg.len);
+}
+
+void TestBencodeKrpcBytesOutsideAscii(
+    CuTest * tc
+)
+{
+    bencode_krpc_msg_t msg;
+
+    /* where a string's length should be */
+    CuAssertTrue(tc, 0 == bencode_krpc_decode("d1:t\xb2:aa1:y1:qe", 15, &msg));
+    CuAssertTrue(tc, 0 == bencode_krpc_decode("d1:q\xff" "e", 6, &msg));
+    CuAssertTrue(tc, 0 == bencode_krpc_decode("d\xb1:t2:aa1:y1:qe", 15, &msg));
+
+    /* and inside one, where they're fine */
+    CuAssertTrue(tc, 1 == bencode_krpc_decode("d1:t2:\xff\xfe" "1:y1:qe", 15, &msg));
+    CuAssertTrue(tc, 2 == msg.t.len);
+}
+
+void TestBencodeKrpcUnknownKeysAreSkipped(
+    CuTest * tc
+)
+{
+    char *str = "d1:ad2:id20:abcdefghij01234567893:fooli1ed1:xleee"
+        "4:porti6881ee1:q4:ping3:zzzd1:ai1ee1:t2:aa1:y1:qe";
+    bencode_krpc_msg_t msg;
+
+    CuAssertTrue(tc, 1 == bencode_krpc_decode(str, strlen(str), &msg));
+    CuAssertTrue(tc, 2 == msg.unknown);
+    CuAssertTrue(tc, 6881 == msg.port);
+    CuAssertTrue(tc, 0 == strncmp("ping", msg.q.val, 4));
+}
+
+void TestBencodeKrpcTruncatedPacketsFail(
+    CuTest * tc
+)
+{
+    char *str = "d1:ad2:id20:abcdefghij01234567893:fooli1ed1:xleee"
+        "4:porti6881ee1:q4:ping1:t2:aa1:y1:qe";
+    bencode_krpc_msg_t msg;
+    unsigned int i;
+
+    for (i = 0; i < strlen(str); i++)
+    {
+        /* copied so that reading past the end is caught */
+        char* p = malloc(i);
+
+        memcpy(p, str, i);
+        CuAssertTrue(tc, 0 == bencode_krpc_decode(p, i, &msg));
+        free(p);
+    }
+}
+
+void TestBencodeKrpcNotAMessage(
+    CuTest * tc
+)
+{
+    bencode_krpc_msg_t msg;
+
+    /* no transaction id */
+    CuAssertTrue(tc, 0 == bencode_krpc_decode("d1:y1:qe", 8, &msg));
+    /* not a dict */
+    CuAssertTrue(tc, 0 == bencode_krpc_decode("li1ee", 5, &msg));
+    /* trailing garbage */
+    CuAssertTrue(tc, 0 == bencode_krpc_decode("d1:t2:aa1:y1:qex", 16, &msg));
+    /* string length runs past the packet */
+    CuAssertTrue(tc, 0 == bencode_krpc_decode("d1:t99:aa1:y1:qe", 16, &msg));
+}
@@ -0,0 +1,457 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Test replaying the callbacks of messages we've parsed before
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdbool.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "CuTest.h"
+
+#include "bencode.h"
+#include "bencode_memo.h"
+#include "schemas/torrent.h"
+
+/* what the callbacks saw */
+typedef struct {
+    char log[256];
+    int fail;
+} __log_t;
+
+static void __log(bencode_t* s, const char* ev, const char* dict_key)
+{
+    __log_t* l = s->udata;
+    unsigned int n = strlen(l->log);
+
+    snprintf(l->log + n, sizeof(l->log) - n, "%s(%s)", ev,
+            dict_key ? dict_key : "");
+}
+
+static int __int(bencode_t *s,
+        const char *dict_key,
+        const long long int val)
+{
+    __log_t* l = s->udata;
+    char ev[32];
+
+    sprintf(ev, "i%lld", val);
+    __log(s, ev, dict_key);
+    return !l->fail;
+}
+
+static int __str(bencode_t *s,
+        const char *dict_key,
+        unsigned int v_total_len __attribute__((__unused__)),
+        const unsigned char* val,
+        unsigned int v_len)
+{
+    char ev[32];
+
+    sprintf(ev, "s%.*s", (int)v_len, (const char*)val);
+    __log(s, ev, dict_key);
+    return 1;
+}
+
+static int __dict_enter(bencode_t *s, const char *dict_key)
+{
+    __log(s, "d", dict_key);
+    return 1;
+}
+
+static int __dict_leave(bencode_t *s, const char *dict_key)
+{
+    __log(s, "/d", dict_key);
+    return 1;
+}
+
+static int __list_enter(bencode_t *s, const char *dict_key)
+{
+    __log(s, "l", dict_key);
+    return 1;
+}
+
+static int __list_leave(bencode_t *s, const char *dict_key)
+{
+    __log(s, "/l", dict_key);
+    return 1;
+}
+
+static bencode_callbacks_t __cb = {
+    .hit_int = __int,
+    .hit_str = __str,
+    .dict_enter = __dict_enter,
+    .dict_leave = __dict_leave,
+    .list_enter = __list_enter,
+    .list_leave = __list_leave,
+};
+
+void TestBencodeXxh64(
+    CuTest * tc
+)
+{
+    char *s = "Nobody inspects the spammish repetition";
+
+    CuAssertTrue(tc, 0xef46db3751d8e999ULL == bencode_xxh64("", 0, 0));
+    CuAssertTrue(tc, 0xd24ec4f1a98c6e5bULL == bencode_xxh64("a", 1, 0));
+    CuAssertTrue(tc, 0x44bc2cf5ad770999ULL == bencode_xxh64("abc", 3, 0));
+    CuAssertTrue(tc, 0xfbcea83c8a378bf1ULL == bencode_xxh64(s, strlen(s), 0));
+}
+
+void TestBencodeMemo(
+    CuTest * tc
+)
+{
+    char *msg = "d1:ad2:id3:abce1:q9:find_node1:t2:aa1:y1:q1:zli1ei2eee";
+    char *want = "d()d(a)sabc(id)/d(a)sfind_node(q)saa(t)sq(y)"
+        "l(z)i1()i2()/l(z)/d()";
+    bencode_memo_stats_t st;
+    bencode_memo_t* m;
+    bencode_t* s;
+    __log_t l;
+    int r;
+
+    memset(&l, 0, sizeof(l));
+    m = bencode_memo_new(1 << 20);
+    s = bencode_new(10, &__cb, &l);
+
+    r = bencode_memo_dispatch_from_buffer(m, s, msg, strlen(msg));
+    CuAssertTrue(tc, 1 == r);
+    CuAssertStrEquals(tc, want, l.log);
+
+    /* replayed */
+    l.log[0] = '\0';
+    r = bencode_memo_dispatch_from_buffer(m, s, msg, strlen(msg));
+    CuAssertTrue(tc, 1 == r);
+    CuAssertStrEquals(tc, want, l.log);
+
+    l.log[0] = '\0';
+    r = bencode_memo_dispatch_from_buffer(m, s, "li7ee", 5);
+    CuAssertTrue(tc, 1 == r);
+    CuAssertStrEquals(tc, "l()i7()/l()", l.log);
+
+    bencode_memo_stats(m, &st);
+    CuAssertTrue(tc, 1 == st.hits);
+    CuAssertTrue(tc, 2 == st.misses);
+    CuAssertTrue(tc, 2 == st.entries);
+    CuAssertTrue(tc, 0 == st.evictions);
+
+    /* a callback failing on replay */
+    l.fail = 1;
+    r = bencode_memo_dispatch_from_buffer(m, s, "li7ee", 5);
+    CuAssertTrue(tc, 0 == r);
+    CuAssertTrue(tc, BENCODE_ERR_CALLBACK == bencode_error(s));
+    l.fail = 0;
+
+    /* broken messages aren't remembered */
+    r = bencode_memo_dispatch_from_buffer(m, s, "d1:ai1x", 7);
+    CuAssertTrue(tc, 0 == r);
+    CuAssertTrue(tc, BENCODE_ERR_BAD_INT == bencode_error(s));
+    r = bencode_memo_dispatch_from_buffer(m, s, "d1:ai1x", 7);
+    CuAssertTrue(tc, 0 == r);
+    bencode_memo_stats(m, &st);
+    CuAssertTrue(tc, 4 == st.misses);
+    CuAssertTrue(tc, 2 == st.entries);
+
+    bencode_free(s);
+    bencode_memo_free(m);
+}
+
+void TestBencodeMemoEvicts(
+    CuTest * tc
+)
+{
+    bencode_memo_stats_t st;
+    bencode_memo_t* m;
+    bencode_t* s;
+    __log_t l;
+    unsigned long int one;
+    int r;
+
+    memset(&l, 0, sizeof(l));
+    s = bencode_new(10, &__cb, &l);
+
+    /* find out how much a message takes up */
+    m = bencode_memo_new(1 << 20);
+    r = bencode_memo_dispatch_from_buffer(m, s, "li1ee", 5);
+    CuAssertTrue(tc, 1 == r);
+    bencode_memo_stats(m, &st);
+    one = st.mem;
+    bencode_memo_free(m);
+
+    /* room for two */
+    m = bencode_memo_new(one * 2);
+    r = bencode_memo_dispatch_from_buffer(m, s, "li1ee", 5);
+    CuAssertTrue(tc, 1 == r);
+    r = bencode_memo_dispatch_from_buffer(m, s, "li2ee", 5);
+    CuAssertTrue(tc, 1 == r);
+    /* 1 is used more recently than 2 */
+    r = bencode_memo_dispatch_from_buffer(m, s, "li1ee", 5);
+    CuAssertTrue(tc, 1 == r);
+    r = bencode_memo_dispatch_from_buffer(m, s, "li3ee", 5);
+    CuAssertTrue(tc, 1 == r);
+
+    bencode_memo_stats(m, &st);
+    CuAssertTrue(tc, 1 == st.evictions);
+    CuAssertTrue(tc, 2 == st.entries);
+    CuAssertTrue(tc, one * 2 == st.mem);
+
+    r = bencode_memo_dispatch_from_buffer(m, s, "li1ee", 5);
+    CuAssertTrue(tc, 1 == r);
+    bencode_memo_stats(m, &st);
+    CuAssertTrue(tc, 2 == st.hits);
+    r = bencode_memo_dispatch_from_buffer(m, s, "li2ee", 5);
+    CuAssertTrue(tc, 1 == r);
+    bencode_memo_stats(m, &st);
+    CuAssertTrue(tc, 2 == st.hits);
+    CuAssertTrue(tc, 4 == st.misses);
+
+    bencode_free(s);
+    bencode_memo_free(m);
+}
+
+void TestBencodeMemoReplaysIntoSink(
+    CuTest * tc
+)
+{
+    char *msg = "d8:announce3:fooe";
+    bencode_memo_stats_t st;
+    bencode_memo_t* m;
+    torrent_meta_t meta, meta2;
+    bencode_t* s;
+    int r;
+
+    m = bencode_memo_new(1 << 20);
+    s = torrent_meta_parser_new(&meta);
+
+    r = bencode_memo_dispatch_from_buffer(m, s, msg, strlen(msg));
+    CuAssertTrue(tc, 1 == r);
+    CuAssertStrEquals(tc, "foo", meta.announce);
+    torrent_meta_free(&meta);
+
+    /* replayed; the string is written to the sink the parser would use */
+    r = bencode_memo_dispatch_from_buffer(m, s, msg, strlen(msg));
+    CuAssertTrue(tc, 1 == r);
+    CuAssertStrEquals(tc, "foo", meta.announce);
+    CuAssertTrue(tc, 3 == meta.announce_len);
+    bencode_memo_stats(m, &st);
+    CuAssertTrue(tc, 1 == st.hits);
+    CuAssertTrue(tc, 1 == torrent_meta_finish(s));
+    torrent_meta_free(&meta);
+
+    /* a second parser of the same schema shares the entry */
+    s = torrent_meta_parser_new(&meta2);
+    r = bencode_memo_dispatch_from_buffer(m, s, msg, strlen(msg));
+    CuAssertTrue(tc, 1 == r);
+    CuAssertStrEquals(tc, "foo", meta2.announce);
+    bencode_memo_stats(m, &st);
+    CuAssertTrue(tc, 2 == st.hits);
+    CuAssertTrue(tc, 1 == st.misses);
+    CuAssertTrue(tc, 1 == torrent_meta_finish(s));
+    torrent_meta_free(&meta2);
+
+    bencode_memo_free(m);
+}
+
+void TestBencodeMemoKeyedOnCallbacks(
+    CuTest * tc
+)
+{
+    char *msg = "d1:ali1eee";
+    bencode_callbacks_t cb = { .hit_int = __int, .hit_str = __str };
+    bencode_memo_stats_t st;
+    bencode_memo_t* m;
+    bencode_t *s, *s2;
+    __log_t l;
+    int r;
+
+    memset(&l, 0, sizeof(l));
+    m = bencode_memo_new(1 << 20);
+    s = bencode_new(10, &__cb, &l);
+    s2 = bencode_new(10, &cb, &l);
+
+    r = bencode_memo_dispatch_from_buffer(m, s, msg, strlen(msg));
+    CuAssertTrue(tc, 1 == r);
+    CuAssertStrEquals(tc, "d()l(a)i1()/l(a)/d()", l.log);
+
+    /* no container callbacks, so the other tape isn't replayed into it */
+    l.log[0] = '\0';
+    r = bencode_memo_dispatch_from_buffer(m, s2, msg, strlen(msg));
+    CuAssertTrue(tc, 1 == r);
+    CuAssertStrEquals(tc, "i1()", l.log);
+
+    l.log[0] = '\0';
+    r = bencode_memo_dispatch_from_buffer(m, s2, msg, strlen(msg));
+    CuAssertTrue(tc, 1 == r);
+    CuAssertStrEquals(tc, "i1()", l.log);
+
+    bencode_memo_stats(m, &st);
+    CuAssertTrue(tc, 1 == st.hits);
+    CuAssertTrue(tc, 2 == st.misses);
+    CuAssertTrue(tc, 2 == st.entries);
+
+    bencode_free(s);
+    bencode_free(s2);
+    bencode_memo_free(m);
+}
+
+void TestBencodeMemoKeyedOnSelector(
+    CuTest * tc
+)
+{
+    char *msg = "d1:ai1e1:bi2ee";
+    const char* paths[] = { "b" };
+    bencode_selector_t* sel;
+    bencode_memo_stats_t st;
+    bencode_memo_t* m;
+    bencode_t* s;
+    __log_t l;
+    int r;
+
+    memset(&l, 0, sizeof(l));
+    m = bencode_memo_new(1 << 20);
+    s = bencode_new(10, &__cb, &l);
+    sel = bencode_selector_new(paths, 1);
+
+    r = bencode_memo_dispatch_from_buffer(m, s, msg, strlen(msg));
+    CuAssertTrue(tc, 1 == r);
+    CuAssertStrEquals(tc, "d()i1(a)i2(b)/d()", l.log);
+
+    l.log[0] = '\0';
+    bencode_set_selector(s, sel);
+    r = bencode_memo_dispatch_from_buffer(m, s, msg, strlen(msg));
+    CuAssertTrue(tc, 1 == r);
+    CuAssertStrEquals(tc, "i2(b)", l.log);
+
+    l.log[0] = '\0';
+    bencode_set_selector(s, NULL);
+    r = bencode_memo_dispatch_from_buffer(m, s, msg, strlen(msg));
+    CuAssertTrue(tc, 1 == r);
+    CuAssertStrEquals(tc, "d()i1(a)i2(b)/d()", l.log);
+
+    bencode_memo_stats(m, &st);
+    CuAssertTrue(tc, 1 == st.hits);
+    CuAssertTrue(tc, 2 == st.misses);
+
+    bencode_free(s);
+    bencode_selector_free(sel);
+    bencode_memo_free(m);
+}
+
+static int __int_nul_key(bencode_t *s,
+        const char *dict_key,
+        const long long int val __attribute__((__unused__)))
+{
+    int* ok = s->udata;
+
+    *ok = 0 == memcmp(dict_key, "a\0b", 4);
+    return 1;
+}
+
+void TestBencodeMemoKeyWithNul(
+    CuTest * tc
+)
+{
+    char *msg = "d3:a\0bi1ee";
+    bencode_callbacks_t cb = { .hit_int = __int_nul_key };
+    bencode_memo_t* m;
+    bencode_t* s;
+    int ok = 0;
+
+    m = bencode_memo_new(1 << 20);
+    s = bencode_new(10, &cb, &ok);
+    CuAssertTrue(tc, 1 == bencode_memo_dispatch_from_buffer(m, s, msg, 10));
+    CuAssertTrue(tc, 1 == ok);
+
+    /* replayed, with the whole key */
+    ok = 0;
+    CuAssertTrue(tc, 1 == bencode_memo_dispatch_from_buffer(m, s, msg, 10));
+    CuAssertTrue(tc, 1 == ok);
+
+    bencode_free(s);
+    bencode_memo_free(m);
+}
+
+static void __log_state(bencode_t* s, const char* ev)
+{
+    char* out = s->udata;
+    unsigned int klen = 0;
+    const char* key = 0 < s->d ?
+        bencode_path_key(s, s->d - 1, &klen) : NULL;
+
+    sprintf(out + strlen(out), "%s d=%u path=%s key=%.*s off=%lu;", ev, s->d,
+            bencode_path(s), (int)klen, key ? key : "", bencode_offset(s));
+}
+
+static int __state_int(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)),
+        const long long int val __attribute__((__unused__)))
+{
+    __log_state(s, "i");
+    return 1;
+}
+
+static int __state_str(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)),
+        unsigned int v_total_len __attribute__((__unused__)),
+        const unsigned char* val __attribute__((__unused__)),
+        unsigned int v_len __attribute__((__unused__)))
+{
+    __log_state(s, "s");
+    return 1;
+}
+
+static int __state_leave(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)))
+{
+    __log_state(s, "/");
+    return 1;
+}
+
+void TestBencodeMemoRestoresParserState(
+    CuTest * tc
+)
+{
+    char *msg = "d1:ad1:bi5ee1:lli1e2:xyee";
+    bencode_callbacks_t cb = {
+        .hit_int = __state_int,
+        .hit_str = __state_str,
+        .dict_leave = __state_leave,
+        .list_leave = __state_leave,
+    };
+    char want[512] = "", got[512] = "";
+    bencode_memo_stats_t st;
+    bencode_memo_t* m;
+    bencode_t* s;
+
+    m = bencode_memo_new(1 << 20);
+    s = bencode_new(10, &cb, want);
+    CuAssertTrue(tc, 1 == bencode_memo_dispatch_from_buffer(m, s, msg,
+                strlen(msg)));
+    CuAssertTrue(tc, NULL != strstr(want, "i d=2 path=a.b key=b off=10;"));
+
+    /* replayed, with the parser as it was when each callback fired */
+    s->udata = got;
+    CuAssertTrue(tc, 1 == bencode_memo_dispatch_from_buffer(m, s, msg,
+                strlen(msg)));
+    bencode_memo_stats(m, &st);
+    CuAssertTrue(tc, 1 == st.hits);
+    CuAssertStrEquals(tc, want, got);
+
+    /* and left ready for the next document */
+    CuAssertTrue(tc, 0 == s->d);
+    CuAssertStrEquals(tc, "", bencode_path(s));
+    CuAssertTrue(tc, strlen(msg) == bencode_offset(s));
+    CuAssertTrue(tc, 1 == bencode_dispatch_from_buffer(s, "i1e", 3));
+
+    bencode_free(s);
+    bencode_memo_free(m);
+}
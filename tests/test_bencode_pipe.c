@@ -0,0 +1,302 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Test scanning on one thread and firing callbacks on another
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdbool.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "CuTest.h"
+
+#include "bencode.h"
+#include "bencode_pipe.h"
+
+/* what the callbacks saw */
+typedef struct {
+    char log[4096];
+    int fail_at;
+    int n;
+
+    /* the string hit_str is part way through */
+    char head[9];
+    unsigned int spos;
+    unsigned int pieces;
+} __log_t;
+
+static int __log(bencode_t* s, const char* ev, const char* dict_key)
+{
+    __log_t* l = s->udata;
+    unsigned int n = strlen(l->log);
+
+    snprintf(l->log + n, sizeof(l->log) - n, "%s(%s)", ev,
+            dict_key ? dict_key : "");
+    return ++l->n != l->fail_at;
+}
+
+static int __int(bencode_t *s,
+        const char *dict_key,
+        const long long int val)
+{
+    char ev[32];
+
+    sprintf(ev, "i%lld", val);
+    return __log(s, ev, dict_key);
+}
+
+static int __str(bencode_t *s,
+        const char *dict_key,
+        unsigned int v_total_len,
+        const unsigned char* val,
+        unsigned int v_len)
+{
+    __log_t* l = s->udata;
+    char ev[32];
+
+    /* strings can come in pieces */
+    if (0 < v_len && l->spos < sizeof(l->head) - 1)
+    {
+        unsigned int n = sizeof(l->head) - 1 - l->spos;
+
+        memcpy(l->head + l->spos, val, v_len < n ? v_len : n);
+    }
+    l->spos += v_len;
+    l->pieces++;
+    if (l->spos < v_total_len)
+        return 1;
+    if (l->spos != v_total_len)
+        return 0;
+
+    l->head[v_total_len < 8 ? v_total_len : 8] = '\0';
+    l->spos = 0;
+    sprintf(ev, "s%u:%s", v_total_len, l->head);
+    return __log(s, ev, dict_key);
+}
+
+static int __dict_enter(bencode_t *s, const char *dict_key)
+{
+    return __log(s, "d", dict_key);
+}
+
+static int __dict_leave(bencode_t *s, const char *dict_key)
+{
+    return __log(s, "/d", dict_key);
+}
+
+static int __list_enter(bencode_t *s, const char *dict_key)
+{
+    return __log(s, "l", dict_key);
+}
+
+static int __list_leave(bencode_t *s, const char *dict_key)
+{
+    return __log(s, "/l", dict_key);
+}
+
+static int __list_next(bencode_t *s)
+{
+    return __log(s, ",", NULL);
+}
+
+static int __dict_next(bencode_t *s)
+{
+    return __log(s, ";", NULL);
+}
+
+static int __value_start(bencode_t *s, const char *dict_key, int type)
+{
+    char ev[8];
+
+    sprintf(ev, "^%d", type);
+    return __log(s, ev, dict_key);
+}
+
+static bencode_callbacks_t __cb = {
+    .hit_int = __int,
+    .hit_str = __str,
+    .dict_enter = __dict_enter,
+    .dict_leave = __dict_leave,
+    .list_enter = __list_enter,
+    .list_leave = __list_leave,
+    .list_next = __list_next,
+    .dict_next = __dict_next,
+    .value_start = __value_start,
+};
+
+/**
+ * Run the document through the pipeline, chunk bytes at a time */
+static int __pipe(const char* doc, unsigned int len, unsigned int chunk,
+        unsigned int ring_size, __log_t* l, int* err)
+{
+    bencode_pipe_t* p = bencode_pipe_new(10, &__cb, l, ring_size);
+    unsigned int i;
+    int ok = 1;
+
+    for (i = 0; ok && i < len; i += chunk)
+        ok = bencode_pipe_dispatch_from_buffer(p, doc + i,
+                len - i < chunk ? len - i : chunk);
+    if (ok)
+        ok = bencode_pipe_finish(p);
+    *err = bencode_pipe_error(p);
+    bencode_pipe_free(p);
+    return ok;
+}
+
+void TestBencodePipe(
+    CuTest * tc
+)
+{
+    char doc[2048];
+    __log_t want, got;
+    bencode_t* s;
+    unsigned int n;
+    int r, err;
+
+    strcpy(doc, "d8:announce3:foo4:infod5:filesld6:lengthi5e4:pathl1:a1:bee"
+            "d6:lengthi-12e4:pathl0:eee4:name3:fooe3:zzzli1eli2eedeee"
+            "li7ee1000:");
+    n = strlen(doc);
+    memset(doc + n, 'x', 1000);
+    doc[n + 1000] = '\0';
+
+    /* what the parser makes of it */
+    memset(&want, 0, sizeof(want));
+    s = bencode_new(10, &__cb, &want);
+    r = bencode_dispatch_from_buffer(s, doc, strlen(doc));
+    CuAssertTrue(tc, 1 == r);
+    bencode_free(s);
+
+    memset(&got, 0, sizeof(got));
+    r = __pipe(doc, strlen(doc), 4096, 0, &got, &err);
+    CuAssertTrue(tc, 1 == r);
+    CuAssertStrEquals(tc, want.log, got.log);
+
+    /* a byte at a time, through a ring smaller than the long string */
+    memset(&got, 0, sizeof(got));
+    r = __pipe(doc, strlen(doc), 1, 64, &got, &err);
+    CuAssertTrue(tc, 1 == r);
+    CuAssertStrEquals(tc, want.log, got.log);
+}
+
+void TestBencodePipeErrors(
+    CuTest * tc
+)
+{
+    char doc[100000];
+    __log_t got;
+    int r, err;
+
+    /* what came before the error still gets through */
+    memset(&got, 0, sizeof(got));
+    r = __pipe("d1:ai1e1:bi1xe", 14, 3, 0, &got, &err);
+    CuAssertTrue(tc, 0 == r);
+    CuAssertTrue(tc, BENCODE_ERR_BAD_INT == err);
+    CuAssertStrEquals(tc, "^8()d()^5(a)i1(a);()", got.log);
+
+    memset(&got, 0, sizeof(got));
+    r = __pipe("di1ei2ee", 8, 100, 0, &got, &err);
+    CuAssertTrue(tc, 0 == r);
+    CuAssertTrue(tc, BENCODE_ERR_BAD_KEY == err);
+
+    memset(&got, 0, sizeof(got));
+    r = __pipe("d1:ae", 5, 100, 0, &got, &err);
+    CuAssertTrue(tc, 0 == r);
+    CuAssertTrue(tc, BENCODE_ERR_BAD_VALUE == err);
+
+    memset(&got, 0, sizeof(got));
+    r = __pipe("i99999999999999999999e", 22, 100, 0, &got, &err);
+    CuAssertTrue(tc, 0 == r);
+    CuAssertTrue(tc, BENCODE_ERR_INT_OVERFLOW == err);
+
+    /* an integer that never ends isn't gathered up forever */
+    memset(doc, '1', sizeof(doc));
+    doc[0] = 'i';
+    memset(&got, 0, sizeof(got));
+    r = __pipe(doc, sizeof(doc), 100, 0, &got, &err);
+    CuAssertTrue(tc, 0 == r);
+    CuAssertTrue(tc, BENCODE_ERR_INT_OVERFLOW == err);
+
+    memset(&got, 0, sizeof(got));
+    r = __pipe("lllllllllllllllllllllllllllllllllllllllllll", 43, 100, 0,
+            &got, &err);
+    CuAssertTrue(tc, 0 == r);
+    CuAssertTrue(tc, BENCODE_ERR_TOO_DEEP == err);
+
+    /* cut short */
+    memset(&got, 0, sizeof(got));
+    r = __pipe("li1e", 4, 100, 0, &got, &err);
+    CuAssertTrue(tc, 0 == r);
+    CuAssertTrue(tc, BENCODE_ERR_BAD_STATE == err);
+    CuAssertStrEquals(tc, "^1()l()^5()i1(),()", got.log);
+
+    /* a callback failing */
+    memset(&got, 0, sizeof(got));
+    got.fail_at = 3;
+    r = __pipe("li1ei2ei3ee", 11, 1, 64, &got, &err);
+    CuAssertTrue(tc, 0 == r);
+    CuAssertTrue(tc, BENCODE_ERR_CALLBACK == err);
+    CuAssertStrEquals(tc, "^1()l()^5()", got.log);
+}
+
+static int __int_raw(bencode_t *s,
+        const char *dict_key,
+        const char *digits,
+        unsigned int len)
+{
+    char ev[32];
+
+    sprintf(ev, "r%u:%.4s", len, digits);
+    return __log(s, ev, dict_key);
+}
+
+void TestBencodePipeLongRawInt(
+    CuTest * tc
+)
+{
+    bencode_callbacks_t cb = { .hit_int_raw = __int_raw };
+    bencode_pipe_t* p;
+    char doc[102];
+    __log_t got;
+    int r;
+
+    /* hit_int_raw takes integers of any length */
+    memset(doc, '1', sizeof(doc));
+    doc[0] = 'i';
+    doc[sizeof(doc) - 1] = 'e';
+    memset(&got, 0, sizeof(got));
+    p = bencode_pipe_new(10, &cb, &got, 0);
+    r = bencode_pipe_dispatch_from_buffer(p, doc, sizeof(doc));
+    CuAssertTrue(tc, 1 == r);
+    r = bencode_pipe_finish(p);
+    CuAssertTrue(tc, 1 == r);
+    CuAssertStrEquals(tc, "r100:1111()", got.log);
+    bencode_pipe_free(p);
+}
+
+void TestBencodePipeStringsComeOutOfTheRing(
+    CuTest * tc
+)
+{
+    char doc[1100];
+    __log_t got;
+    int r, err;
+
+    /* a string longer than the ring isn't gathered up first */
+    strcpy(doc, "l1000:");
+    memset(doc + 6, 'x', 1000);
+    strcpy(doc + 1006, "3:abce");
+    memset(&got, 0, sizeof(got));
+    r = __pipe(doc, strlen(doc), 4096, 64, &got, &err);
+    CuAssertTrue(tc, 1 == r);
+    CuAssertStrEquals(tc,
+            "^1()l()^7()s1000:xxxxxxxx(),()^7()s3:abc(),()/l()", got.log);
+    CuAssertTrue(tc, 1000 / 64 < got.pieces);
+}
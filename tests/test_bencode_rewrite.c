@@ -0,0 +1,201 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Test rewriting documents as they stream through
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdbool.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "CuTest.h"
+
+#include "bencode.h"
+#include "bencode_rewrite.h"
+
+typedef struct {
+    bencode_rewrite_t* rw;
+    char out[256];
+    unsigned int nwrites;
+    const char* last;
+} __rw_t;
+
+static int __write(void* udata, const char* buf, unsigned int len)
+{
+    __rw_t* r = udata;
+
+    strncat(r->out, buf, len);
+    r->nwrites++;
+    r->last = buf;
+    return 1;
+}
+
+static int __is(bencode_t *s, const char* path)
+{
+    return 0 == strcmp(bencode_path(s), path);
+}
+
+static int __start(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)),
+        int type __attribute__((__unused__)))
+{
+    __rw_t* r = s->udata;
+
+    if (__is(s, "announce"))
+        return bencode_rewrite_replace(r->rw, "8:udp://x/", 10);
+    if (__is(s, "junk"))
+        return bencode_rewrite_delete(r->rw);
+    if (__is(s, "name"))
+        return bencode_rewrite_insert(r->rw, "4:infod1:ai1ee", 14);
+    return 1;
+}
+
+static int __int(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)),
+        const long long int val)
+{
+    __rw_t* r = s->udata;
+    char buf[32];
+
+    if (__is(s, "uploaded"))
+    {
+        sprintf(buf, "i%llde", val + 1);
+        return bencode_rewrite_replace(r->rw, buf, strlen(buf));
+    }
+    if (__is(s, "l[1]"))
+        return bencode_rewrite_delete(r->rw);
+    return 1;
+}
+
+static int __list_leave(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)))
+{
+    __rw_t* r = s->udata;
+
+    if (__is(s, "l"))
+        return bencode_rewrite_insert(r->rw, "i9e", 3);
+    return 1;
+}
+
+static int __dict_leave(bencode_t *s,
+        const char *dict_key __attribute__((__unused__)))
+{
+    __rw_t* r = s->udata;
+
+    if (__is(s, ""))
+        return bencode_rewrite_insert(r->rw, "1:zi0e", 6);
+    return 1;
+}
+
+static bencode_callbacks_t __cb = {
+    .hit_int = __int,
+    .value_start = __start,
+    .list_leave = __list_leave,
+    .dict_leave = __dict_leave,
+};
+
+static char *__doc =
+    "d8:announce17:http://x/announce"
+    "4:junkd1:ali1ei2eee"
+    "1:lli1ei2ei3ee"
+    "4:name3:foo"
+    "8:uploadedi99e"
+    "e";
+
+static char *__expected =
+    "d8:announce8:udp://x/"
+    "1:lli1ei3ei9ee"
+    "4:infod1:ai1ee"
+    "4:name3:foo"
+    "8:uploadedi100e"
+    "1:zi0e"
+    "e";
+
+void TestBencodeRewrite(
+    CuTest * tc
+)
+{
+    __rw_t r;
+
+    memset(&r, 0, sizeof(r));
+    r.rw = bencode_rewrite_new(10, &__cb, &r, __write, &r);
+    CuAssertTrue(tc, 1 == bencode_rewrite_dispatch_from_buffer(r.rw,
+                __doc, strlen(__doc)));
+    CuAssertStrEquals(tc, __expected, r.out);
+    bencode_rewrite_free(r.rw);
+}
+
+void TestBencodeRewriteInPieces(
+    CuTest * tc
+)
+{
+    __rw_t r;
+    unsigned int i;
+
+    memset(&r, 0, sizeof(r));
+    r.rw = bencode_rewrite_new(10, &__cb, &r, __write, &r);
+    for (i = 0; i < strlen(__doc); i++)
+        CuAssertTrue(tc, 1 == bencode_rewrite_dispatch_from_buffer(r.rw,
+                    __doc + i, 1));
+    CuAssertStrEquals(tc, __expected, r.out);
+    bencode_rewrite_free(r.rw);
+}
+
+void TestBencodeRewriteUntouchedIsNotCopied(
+    CuTest * tc
+)
+{
+    char *str = "d3:food3:bari1eee";
+    bencode_callbacks_t cb;
+    __rw_t r;
+
+    memset(&r, 0, sizeof(r));
+    memset(&cb, 0, sizeof(cb));
+    r.rw = bencode_rewrite_new(10, &cb, &r, __write, &r);
+    CuAssertTrue(tc, 1 == bencode_rewrite_dispatch_from_buffer(r.rw,
+                str, strlen(str)));
+    CuAssertStrEquals(tc, str, r.out);
+    CuAssertTrue(tc, 1 == r.nwrites);
+    CuAssertTrue(tc, str == r.last);
+    bencode_rewrite_free(r.rw);
+}
+
+void TestBencodeRewriteBigInt(
+    CuTest * tc
+)
+{
+    char *str = "d8:uploadedi99e1:xi123456789012345678901234567890ee";
+    __rw_t r;
+    unsigned int i;
+
+    memset(&r, 0, sizeof(r));
+    r.rw = bencode_rewrite_new(10, &__cb, &r, __write, &r);
+    for (i = 0; i < strlen(str); i += 4)
+        CuAssertTrue(tc, 1 == bencode_rewrite_dispatch_from_buffer(r.rw,
+                    str + i, strlen(str + i) < 4 ? strlen(str + i) : 4));
+    CuAssertStrEquals(tc,
+            "d8:uploadedi100e1:xi123456789012345678901234567890e1:zi0ee",
+            r.out);
+    bencode_rewrite_free(r.rw);
+}
+
+void TestBencodeRewriteMarkOutsideCallback(
+    CuTest * tc
+)
+{
+    __rw_t r;
+
+    memset(&r, 0, sizeof(r));
+    r.rw = bencode_rewrite_new(10, &__cb, &r, __write, &r);
+    CuAssertTrue(tc, 0 == bencode_rewrite_delete(r.rw));
+    CuAssertTrue(tc, 0 == bencode_rewrite_replace(r.rw, "i1e", 3));
+    CuAssertTrue(tc, 0 == bencode_rewrite_insert(r.rw, "i1e", 3));
+    bencode_rewrite_free(r.rw);
+}
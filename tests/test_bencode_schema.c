@@ -0,0 +1,130 @@
+
+/**
+ * Copyright (c) 2014, Willem-Hendrik Thiart
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * @file
+ * @brief Test decoders generated from schemas
+ * @author  Willem Thiart himself@willemthiart.com
+ * @version 0.1
+ */
+
+#include <stdbool.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "CuTest.h"
+
+#include "bencode.h"
+#include "schemas/torrent.h"
+
+static char* __torrent =
+    "d8:announce17:http://x/announce"
+    "13:creation datei1400000000e"
+    "4:infod"
+    "5:filesld6:lengthi5e4:pathl1:aeee"
+    "4:name3:foo"
+    "12:piece lengthi16384e"
+    "6:pieces20:aaaaaaaaaaaaaaaaaaaa"
+    "ee";
+
+void TestBencodeSchemaDecodesInfo(
+    CuTest * tc
+)
+{
+    torrent_info_t info;
+
+    CuAssertTrue(tc, 1 == torrent_info_decode(__torrent, strlen(__torrent), &info));
+    CuAssertStrEquals(tc, "foo", info.name);
+    CuAssertTrue(tc, 3 == info.name_len);
+    CuAssertTrue(tc, 16384 == info.piece_length);
+    CuAssertTrue(tc, 20 == info.pieces_len);
+    /* optional, and not there */
+    CuAssertTrue(tc, 0 == (info.seen & TORRENT_INFO_LENGTH));
+    torrent_info_free(&info);
+}
+
+void TestBencodeSchemaDecodesRootInPieces(
+    CuTest * tc
+)
+{
+    torrent_meta_t meta;
+    bencode_t* s;
+    unsigned int i;
+
+    s = torrent_meta_parser_new(&meta);
+    for (i = 0; i < strlen(__torrent); i++)
+        bencode_dispatch_from_buffer(s, __torrent + i, 1);
+    CuAssertTrue(tc, 1 == torrent_meta_finish(s));
+    CuAssertStrEquals(tc, "http://x/announce", meta.announce);
+    CuAssertTrue(tc, 1400000000 == meta.creation_date);
+    CuAssertTrue(tc, NULL == meta.comment);
+    torrent_meta_free(&meta);
+}
+
+void TestBencodeSchemaRequiredField(
+    CuTest * tc
+)
+{
+    char *str = "d4:infod4:name3:foo6:pieces0:ee";
+    torrent_info_t info;
+
+    /* no "piece length" */
+    CuAssertTrue(tc, 0 == torrent_info_decode(str, strlen(str), &info));
+    CuAssertStrEquals(tc, "", info.pieces);
+    torrent_info_free(&info);
+}
+
+void TestBencodeSchemaWrongType(
+    CuTest * tc
+)
+{
+    char *str = "d4:infod4:namei1e12:piece lengthi1e6:pieces0:ee";
+    char *str2 = "d4:infod4:namele12:piece lengthi1e6:pieces0:ee";
+    torrent_info_t info;
+
+    CuAssertTrue(tc, 0 == torrent_info_decode(str, strlen(str), &info));
+    torrent_info_free(&info);
+    CuAssertTrue(tc, 0 == torrent_info_decode(str2, strlen(str2), &info));
+    torrent_info_free(&info);
+}
+
+/**
+ * @return the generator's exit status for a struct with this field line */
+static int __generate(const char* field)
+{
+    char path[] = "/tmp/bencode_schema_XXXXXX";
+    char cmd[256];
+    FILE* fp;
+    int fd, ret;
+
+    fd = mkstemp(path);
+    fp = fdopen(fd, "w");
+    fprintf(fp, "struct x \"\"\n%s\nend\n", field);
+    fclose(fp);
+
+    sprintf(cmd, "awk -f bencode_schema.awk -v out=%s %s 2>/dev/null",
+            path, path);
+    ret = system(cmd);
+
+    unlink(path);
+    sprintf(cmd, "%s.c", path);
+    unlink(cmd);
+    sprintf(cmd, "%s.h", path);
+    unlink(cmd);
+    return ret;
+}
+
+void TestBencodeSchemaRejectsSelectorSyntaxInKeys(
+    CuTest * tc
+)
+{
+    CuAssertTrue(tc, 0 == __generate("int a \"a b\" optional"));
+    CuAssertTrue(tc, 0 != __generate("int a \"a.b\" optional"));
+    CuAssertTrue(tc, 0 != __generate("int a \"*\" optional"));
+    CuAssertTrue(tc, 0 != __generate("int a \"a[0]\" optional"));
+    CuAssertTrue(tc, 0 != __generate("int a \"]\" optional"));
+}